@@ -0,0 +1,84 @@
+#include "AcquisitionScheduler.h"
+
+int AcquisitionScheduler::add(uint32_t periodMs, uint32_t now)
+{
+  if (m_count >= MAX_SENSORS)
+    return -1;
+  if (periodMs == 0)
+    periodMs = 1;
+  Timing &t = m_t[m_count];
+  t.periodMs = periodMs;
+  t.nextStart = now + (m_count * STAGGER_MS) % periodMs;
+  t.readyAt = t.startedAt = now;
+  t.lastAcqMs = 0;
+  t.samples = 0;
+  t.converting = false;
+  return m_count++;
+}
+
+AcquisitionScheduler::Action AcquisitionScheduler::next(uint32_t now, uint8_t &id) const
+{
+  int best = -1;
+  int32_t bestLate = -1;
+  for (uint8_t i = 0; i < m_count; i++)
+  {
+    const Timing &t = m_t[i];
+    if (t.converting && reached(now, t.readyAt) && (int32_t)(now - t.readyAt) > bestLate)
+    {
+      best = i;
+      bestLate = (int32_t)(now - t.readyAt);
+    }
+  }
+  if (best >= 0)
+  {
+    id = (uint8_t)best;
+    return COLLECT;
+  }
+  for (uint8_t i = 0; i < m_count; i++)
+  {
+    const Timing &t = m_t[i];
+    if (!t.converting && reached(now, t.nextStart) && (int32_t)(now - t.nextStart) > bestLate)
+    {
+      best = i;
+      bestLate = (int32_t)(now - t.nextStart);
+    }
+  }
+  if (best < 0)
+    return NONE;
+  id = (uint8_t)best;
+  return START;
+}
+
+void AcquisitionScheduler::started(uint8_t id, uint32_t now, uint32_t waitMs)
+{
+  Timing &t = m_t[id];
+  t.converting = true;
+  t.startedAt = now;
+  t.readyAt = now + waitMs;
+  // Keep the phase; if we fell a whole period behind, restart from now.
+  t.nextStart += t.periodMs;
+  if (reached(now, t.nextStart))
+    t.nextStart = now + t.periodMs;
+}
+
+void AcquisitionScheduler::collected(uint8_t id, uint32_t now)
+{
+  Timing &t = m_t[id];
+  t.converting = false;
+  t.lastAcqMs = now - t.startedAt;
+  t.samples++;
+}
+
+uint32_t AcquisitionScheduler::idleFor(uint32_t now) const
+{
+  uint32_t best = UINT32_MAX;
+  for (uint8_t i = 0; i < m_count; i++)
+  {
+    const Timing &t = m_t[i];
+    uint32_t due = t.converting ? t.readyAt : t.nextStart;
+    uint32_t wait = reached(now, due) ? 0 : due - now;
+    if (wait < best)
+      best = wait;
+  }
+  return best;
+}
@@ -0,0 +1,58 @@
+/*********************************************************************
+ * AcquisitionScheduler – non-blocking per-sensor sampling timetable
+ * -------------------------------------------------------
+ * • Each sensor has its own period (config "periodMs")
+ * • START kicks off a conversion and returns how long it takes;
+ *   COLLECT is only offered once that time has passed
+ * • next() hands out one action at a time so loop() never waits
+ * • All times are millis() values; comparisons are wrap-safe
+ *********************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+class AcquisitionScheduler
+{
+public:
+  static const uint8_t MAX_SENSORS = 32;
+  static const uint32_t STAGGER_MS = 50; // spreads first starts of equal periods
+
+  enum Action : uint8_t
+  {
+    NONE,
+    START,
+    COLLECT
+  };
+
+  struct Timing
+  {
+    uint32_t periodMs;
+    uint32_t nextStart;
+    uint32_t readyAt;
+    uint32_t startedAt;
+    uint32_t lastAcqMs; // START -> COLLECT wall time of the last sample
+    uint32_t samples;
+    bool converting;
+  };
+
+  void clear() { m_count = 0; }
+  // Returns the new id (sequential from 0) or -1 when full.
+  int add(uint32_t periodMs, uint32_t now);
+
+  // The most urgent action due at `now` (collects before starts).
+  Action next(uint32_t now, uint8_t &id) const;
+  void started(uint8_t id, uint32_t now, uint32_t waitMs);
+  void collected(uint8_t id, uint32_t now);
+
+  // Milliseconds until next() will return something (0 = now).
+  uint32_t idleFor(uint32_t now) const;
+
+  uint8_t count() const { return m_count; }
+  const Timing &timing(uint8_t id) const { return m_t[id]; }
+
+private:
+  static bool reached(uint32_t now, uint32_t t) { return (int32_t)(now - t) >= 0; }
+
+  Timing m_t[MAX_SENSORS];
+  uint8_t m_count = 0;
+};
@@ -0,0 +1,80 @@
+#include "AdcBurst.h"
+
+#include <algorithm>
+
+uint16_t adcTrimmedMean(uint16_t *v, size_t n, uint8_t trimPercent)
+{
+  if (n == 0)
+    return 0;
+  size_t trim = trimPercent >= 50 ? (n - 1) / 2 : n * trimPercent / 100;
+  size_t lo = trim, hi = n - trim; // keep [lo, hi)
+  // Two selections instead of a sort: O(n), and the kept range is left
+  // unordered since only its sum is needed.
+  std::nth_element(v, v + lo, v + n);
+  if (hi - lo > 1)
+    std::nth_element(v + lo, v + hi - 1, v + n);
+  uint32_t sum = 0;
+  for (size_t i = lo; i < hi; i++)
+    sum += v[i];
+  uint32_t kept = (uint32_t)(hi - lo);
+  return (uint16_t)((sum + kept / 2) / kept);
+}
+
+int8_t AdcBurst::addChannel(uint8_t channel)
+{
+  if (channel >= 16)
+    return -1;
+  if (m_slotOf[channel] >= 0)
+    return m_slotOf[channel];
+  if (m_channels == ADC_BURST_MAX_CHANNELS)
+    return -1;
+  m_channel[m_channels] = channel;
+  m_slotOf[channel] = (int8_t)m_channels;
+  m_count[m_channels] = 0;
+  m_value[m_channels] = 0;
+  return (int8_t)m_channels++;
+}
+
+void AdcBurst::clear()
+{
+  for (uint8_t i = 0; i < m_channels; i++)
+    m_slotOf[m_channel[i]] = -1;
+  m_channels = 0;
+}
+
+void AdcBurst::reset()
+{
+  for (uint8_t i = 0; i < m_channels; i++)
+    m_count[i] = 0;
+}
+
+void AdcBurst::feedType1(const uint8_t *raw, size_t bytes)
+{
+  for (size_t i = 0; i + 1 < bytes; i += 2)
+  {
+    uint16_t word = (uint16_t)(raw[i] | raw[i + 1] << 8);
+    int8_t slot = m_slotOf[word >> 12];
+    if (slot >= 0)
+      add((uint8_t)slot, word & 0x0FFF);
+  }
+}
+
+void AdcBurst::add(uint8_t slot, uint16_t value)
+{
+  if (slot < m_channels && m_count[slot] < ADC_BURST_SAMPLES)
+    m_samples[slot][m_count[slot]++] = value;
+}
+
+void AdcBurst::reduce(uint8_t trimPercent)
+{
+  for (uint8_t i = 0; i < m_channels; i++)
+    m_value[i] = adcTrimmedMean(m_samples[i], m_count[i], trimPercent);
+}
+
+uint32_t AdcBurst::channelMask() const
+{
+  uint32_t mask = 0;
+  for (uint8_t i = 0; i < m_channels; i++)
+    mask |= 1u << m_channel[i];
+  return mask;
+}
@@ -0,0 +1,59 @@
+/*********************************************************************
+ * AdcBurst – one multi-channel ADC burst reduced to one value per pin
+ * -------------------------------------------------------
+ * • All moisture pins are sampled together: the ESP32 ADC DMA
+ *   (continuous) driver interleaves conversions of every channel in one
+ *   buffer; feedType1() splits that buffer by channel
+ * • Each channel's samples are reduced with a trimmed mean: the lowest
+ *   and highest trimPercent are dropped (50 = median), which rejects
+ *   the ESP32 ADC's spikes without the bias of a plain mean
+ * • Fixed buffers (ADC_BURST_MAX_CHANNELS x ADC_BURST_SAMPLES), no heap
+ * • Hardware-free: the firmware feeds it DMA bytes (or analogRead()
+ *   values for pins the DMA path cannot use)
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ADC_BURST_MAX_CHANNELS 8 // ADC1 on the ESP32
+#define ADC_BURST_SAMPLES 64     // per channel and burst
+
+// Trimmed mean of v[0..n); reorders v. 0 for n == 0.
+uint16_t adcTrimmedMean(uint16_t *v, size_t n, uint8_t trimPercent);
+
+class AdcBurst
+{
+public:
+  // Adds a channel (once); returns its slot, or -1 when full.
+  int8_t addChannel(uint8_t channel);
+  void clear();
+
+  // Starts a new burst: drops the samples of the previous one.
+  void reset();
+
+  // ESP32 TYPE1 DMA output: 16-bit little-endian words, data:12 | channel:4.
+  // Samples of unknown channels and beyond ADC_BURST_SAMPLES are ignored.
+  void feedType1(const uint8_t *raw, size_t bytes);
+  void add(uint8_t slot, uint16_t value);
+
+  // Reduces every slot's samples; value(slot) is valid afterwards.
+  void reduce(uint8_t trimPercent);
+
+  uint8_t channels() const { return m_channels; }
+  uint8_t channel(uint8_t slot) const { return m_channel[slot]; }
+  uint16_t count(uint8_t slot) const { return m_count[slot]; }
+  uint16_t value(uint8_t slot) const { return m_value[slot]; }
+  // Channel bit mask, for the DMA driver's configuration.
+  uint32_t channelMask() const;
+  // Conversions needed for a full burst (all channels).
+  uint32_t conversions() const { return (uint32_t)m_channels * ADC_BURST_SAMPLES; }
+
+private:
+  uint8_t m_channels = 0;
+  uint8_t m_channel[ADC_BURST_MAX_CHANNELS] = {};
+  int8_t m_slotOf[16] = {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+  uint16_t m_count[ADC_BURST_MAX_CHANNELS] = {};
+  uint16_t m_value[ADC_BURST_MAX_CHANNELS] = {};
+  uint16_t m_samples[ADC_BURST_MAX_CHANNELS][ADC_BURST_SAMPLES];
+};
@@ -0,0 +1,294 @@
+/*********************************************************************
+ * ConfigImage – parsed config.json as a flat, CRC-checked struct
+ * -------------------------------------------------------
+ * • Filled once from JSON on cold boot; kept in RTC memory so a deep
+ *   sleep wake applies it directly (no LittleFS mount, no JSON parse)
+ * • Plain aggregate (fixed char arrays, no heap, no constructor) so it
+ *   can live in RTC_DATA_ATTR and be checked with a CRC
+ * • Cached Wi-Fi association (BSSID / channel / IP lease) for fast
+ *   reconnects uses the same pattern
+ * • Alert limits and window settings for on-device aggregation
+ *   (TelemetryWindow) are stored in telemetryScale() units / integers
+ * • Watering zones refer to their moisture sensor by index (resolved
+ *   from its name at parse time)
+ * • configImageDiff() tells a live reload what it has to redo;
+ *   configImageCheck() is the value half of the /save_config schema
+ *********************************************************************/
+#pragma once
+
+#include <Crc32.h>
+#include <SensorKind.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CONFIG_IMAGE_MAGIC 0x43464734 // "CFG4"; bump when the layout changes
+#define CONFIG_IMAGE_MAX_SENSORS 16
+#define CONFIG_IMAGE_MAX_ZONES 8
+#define CONFIG_IMAGE_NO_PIN 0xFF
+#define WIFI_CACHE_MAGIC 0x57464331   // "WFC1"
+
+// Copies src into a fixed field; false (and empty field) if it does not fit.
+inline bool configImageSetString(char *dst, size_t cap, const char *src)
+{
+  size_t n = src ? strlen(src) : 0;
+  if (!src || n >= cap)
+  {
+    dst[0] = '\0';
+    return !src;
+  }
+  memcpy(dst, src, n + 1);
+  return true;
+}
+
+struct SensorConfig
+{
+  char name[24];
+  SensorKind kind;
+  uint8_t pin;
+  uint8_t address; // BME280 / BMP280 I2C address
+  uint8_t index;   // DS18B20 index on its bus
+  uint16_t airValue, waterValue;
+  uint32_t periodMs;
+  uint8_t alertMask; // FieldLimits::BELOW / ABOVE bits, 2 per field
+  int16_t alertBelow[FIELD_COUNT], alertAbove[FIELD_COUNT]; // telemetryScale() units
+};
+
+// Watering zone ("zones" in config.json).
+struct ZoneConfig
+{
+  char name[16];
+  uint8_t sensor;   // index into sensors, CONFIG_IMAGE_NO_PIN = timer zone
+  uint8_t valvePin;
+  bool activeLow;
+  int16_t startBelow, stopAbove; // telemetryScale() moisture units
+  uint32_t maxRunSec, minOffSec;
+  uint16_t fromMin, toMin; // allowed window, minutes of the local day; equal = all day
+};
+
+struct ConfigImage
+{
+  uint32_t magic;
+  bool node;
+  bool meshBinary;
+  uint16_t batchWakes;
+  char ssid[33];
+  char password[65];
+  char iothubHost[128];
+  char deviceId[64];
+  char sasToken[320];
+  char protocol[8];
+  char firmwareUrl[192];
+  char nodeFirmwareUrl[192]; // gateway: image it stages and serves to the nodes over the mesh
+  uint32_t sleepSeconds;
+  int16_t batchDelta[FIELD_COUNT];
+  uint16_t queueRamSlots;
+  uint32_t queueMaxMessages, queueMaxBytes, queueMaxAgeSec;
+  uint32_t windowSec;  // gateway: summary period, 0 = a raw message every report
+  uint8_t ewmaPercent; // EWMA weight of a new sample (1-100)
+  int16_t alertHysteresis[FIELD_COUNT]; // telemetryScale() units
+  char timezone[48];     // POSIX TZ for schedules ("CET-1CEST,M3.5.0,M10.5.0/3")
+  uint8_t pumpPin;       // on while any valve is open; CONFIG_IMAGE_NO_PIN = none
+  bool pumpActiveLow;
+  uint8_t maxConcurrent; // valves open at once
+  uint8_t zoneCount;
+  ZoneConfig zones[CONFIG_IMAGE_MAX_ZONES];
+  uint8_t sensorCount;
+  SensorConfig sensors[CONFIG_IMAGE_MAX_SENSORS];
+  uint32_t crc;
+
+  bool valid() const { return magic == CONFIG_IMAGE_MAGIC && crc == checksum(); }
+  void clear() { memset(this, 0, sizeof(*this)); }
+  void seal()
+  {
+    magic = CONFIG_IMAGE_MAGIC;
+    crc = checksum();
+  }
+  uint32_t checksum() const { return crc32(this, offsetof(ConfigImage, crc)); }
+};
+
+// What differs between two images; a live reload redoes only these parts.
+enum ConfigChange : uint8_t
+{
+  CONFIG_CHANGE_NONE = 0,
+  CONFIG_CHANGE_RESTART = 1 << 0,  // mode, Wi-Fi credentials, device id (mesh name)
+  CONFIG_CHANGE_UPLINK = 1 << 1,   // protocol, hub, device id, token
+  CONFIG_CHANGE_SENSORS = 1 << 2,
+  CONFIG_CHANGE_QUEUE = 1 << 3,    // queue limits (sized at boot)
+  CONFIG_CHANGE_SETTINGS = 1 << 4, // sleep, batching, mesh encoding, firmware URLs, window
+  CONFIG_CHANGE_WATERING = 1 << 5, // zones, pump, time zone
+};
+
+inline bool sensorConfigSameAlerts(const SensorConfig &a, const SensorConfig &b)
+{
+  return a.alertMask == b.alertMask && !memcmp(a.alertBelow, b.alertBelow, sizeof(a.alertBelow)) &&
+         !memcmp(a.alertAbove, b.alertAbove, sizeof(a.alertAbove));
+}
+
+// Same driver object can be kept (name and period may still differ).
+inline bool sensorConfigSameDriver(const SensorConfig &a, const SensorConfig &b)
+{
+  return a.kind == b.kind && a.pin == b.pin && a.address == b.address && a.index == b.index &&
+         a.airValue == b.airValue && a.waterValue == b.waterValue;
+}
+
+// Driver reuse across a reload: from[i] is the sensor of `prev` whose
+// driver sensor i of `next` takes over, or -1 when it needs a new one.
+// Each old driver goes to at most one new sensor.
+inline void sensorDriverPlan(const ConfigImage &prev, const ConfigImage &next,
+                             int8_t from[CONFIG_IMAGE_MAX_SENSORS])
+{
+  bool taken[CONFIG_IMAGE_MAX_SENSORS] = {false};
+  for (uint8_t i = 0; i < next.sensorCount; i++)
+  {
+    from[i] = -1;
+    for (uint8_t j = 0; j < prev.sensorCount && from[i] < 0; j++)
+      if (!taken[j] && sensorConfigSameDriver(prev.sensors[j], next.sensors[i]))
+      {
+        taken[j] = true;
+        from[i] = (int8_t)j;
+      }
+  }
+}
+
+inline uint8_t configImageDiff(const ConfigImage &a, const ConfigImage &b)
+{
+  uint8_t changed = CONFIG_CHANGE_NONE;
+  if (a.node != b.node || strcmp(a.ssid, b.ssid) || strcmp(a.password, b.password) ||
+      strcmp(a.deviceId, b.deviceId)) // the mesh name, on gateways and nodes alike
+    changed |= CONFIG_CHANGE_RESTART;
+  if (strcmp(a.protocol, b.protocol) || strcmp(a.iothubHost, b.iothubHost) ||
+      strcmp(a.deviceId, b.deviceId) || strcmp(a.sasToken, b.sasToken))
+    changed |= CONFIG_CHANGE_UPLINK;
+  if (a.sensorCount != b.sensorCount)
+    changed |= CONFIG_CHANGE_SENSORS;
+  for (uint8_t i = 0; i < b.sensorCount && !(changed & CONFIG_CHANGE_SENSORS); i++)
+  {
+    const SensorConfig &x = a.sensors[i], &y = b.sensors[i];
+    if (!sensorConfigSameDriver(x, y) || strcmp(x.name, y.name) || x.periodMs != y.periodMs ||
+        !sensorConfigSameAlerts(x, y))
+      changed |= CONFIG_CHANGE_SENSORS;
+  }
+  if (a.queueRamSlots != b.queueRamSlots || a.queueMaxMessages != b.queueMaxMessages ||
+      a.queueMaxBytes != b.queueMaxBytes || a.queueMaxAgeSec != b.queueMaxAgeSec)
+    changed |= CONFIG_CHANGE_QUEUE;
+  if (a.zoneCount != b.zoneCount || a.pumpPin != b.pumpPin || a.pumpActiveLow != b.pumpActiveLow ||
+      a.maxConcurrent != b.maxConcurrent || strcmp(a.timezone, b.timezone) ||
+      memcmp(a.zones, b.zones, b.zoneCount * sizeof(ZoneConfig)))
+    changed |= CONFIG_CHANGE_WATERING;
+  if (a.sleepSeconds != b.sleepSeconds || a.batchWakes != b.batchWakes || a.meshBinary != b.meshBinary ||
+      memcmp(a.batchDelta, b.batchDelta, sizeof(a.batchDelta)) || strcmp(a.firmwareUrl, b.firmwareUrl) ||
+      strcmp(a.nodeFirmwareUrl, b.nodeFirmwareUrl) ||
+      a.windowSec != b.windowSec || a.ewmaPercent != b.ewmaPercent ||
+      memcmp(a.alertHysteresis, b.alertHysteresis, sizeof(a.alertHysteresis)))
+    changed |= CONFIG_CHANGE_SETTINGS;
+  return changed;
+}
+
+// True if a sensor is wired to `pin`. BME280 / BMP280 sit on the I2C bus
+// and ignore their pin.
+inline bool configImageSensorOnPin(const ConfigImage &img, uint8_t pin)
+{
+  for (uint8_t i = 0; i < img.sensorCount; i++)
+  {
+    const SensorConfig &s = img.sensors[i];
+    if (s.pin == pin && s.kind != SensorKind::BME280 && s.kind != SensorKind::BMP280)
+      return true;
+  }
+  return false;
+}
+
+// Value rules for an uploaded config; nullptr when it is acceptable.
+inline const char *configImageCheck(const ConfigImage &img)
+{
+  if (!img.ssid[0])
+    return "SSID is required";
+  if (!img.deviceId[0])
+    return "DEVICE_ID is required";
+  if (strcmp(img.protocol, "http") && strcmp(img.protocol, "mqtt") && strcmp(img.protocol, "sdk"))
+    return "PROTOCOL must be http, mqtt or sdk";
+  if (img.sleepSeconds == 0)
+    return "sleepSeconds must be at least 1";
+  if (img.batchWakes == 0)
+    return "batchWakes must be at least 1";
+  if (img.windowSec > 86400)
+    return "aggregate windowSec must be at most 86400";
+  if (img.windowSec && (img.ewmaPercent < 1 || img.ewmaPercent > 100))
+    return "aggregate ewmaAlpha must be between 0.01 and 1";
+  for (uint8_t i = 0; i < img.sensorCount; i++)
+  {
+    const SensorConfig &s = img.sensors[i];
+    if (!s.name[0])
+      return "every sensor needs a name";
+    if (s.periodMs < 100)
+      return "sensor periodMs must be at least 100";
+    if (s.kind == SensorKind::CAP_SOIL_MOISTURE && s.airValue == s.waterValue)
+      return "air_value and water_value must differ";
+    for (uint8_t f = 0; f < FIELD_COUNT; f++)
+      if ((s.alertMask >> (2 * f) & 3) == 3 && s.alertBelow[f] >= s.alertAbove[f])
+        return "alertBelow must be lower than alertAbove";
+    for (uint8_t j = 0; j < i; j++)
+      if (!strcmp(img.sensors[j].name, s.name))
+        return "sensor names must be unique";
+  }
+  if (img.zoneCount && img.maxConcurrent == 0)
+    return "watering maxConcurrent must be at least 1";
+  if (img.pumpPin != CONFIG_IMAGE_NO_PIN && configImageSensorOnPin(img, img.pumpPin))
+    return "watering pumpPin is used by a sensor";
+  for (uint8_t i = 0; i < img.zoneCount; i++)
+  {
+    const ZoneConfig &z = img.zones[i];
+    if (!z.name[0])
+      return "every zone needs a name";
+    if (z.valvePin == CONFIG_IMAGE_NO_PIN || z.valvePin == img.pumpPin)
+      return "every zone needs its own valvePin";
+    if (configImageSensorOnPin(img, z.valvePin))
+      return "zone valvePin is used by a sensor";
+    if (z.maxRunSec == 0)
+      return "zone maxRunSec must be at least 1";
+    if (z.sensor != CONFIG_IMAGE_NO_PIN)
+    {
+      if (z.sensor >= img.sensorCount || img.sensors[z.sensor].kind != SensorKind::CAP_SOIL_MOISTURE)
+        return "zone sensor must name a cap_soil_moisture sensor";
+      if (z.startBelow >= z.stopAbove)
+        return "zone startBelow must be lower than stopAbove";
+    }
+    else if (z.fromMin == z.toMin && z.minOffSec == 0)
+      return "a zone without sensor needs a schedule or minOffSec";
+    if (z.fromMin >= 1440 || z.toMin >= 1440)
+      return "zone schedule times must be HH:MM";
+    for (uint8_t j = 0; j < i; j++)
+    {
+      if (!strcmp(img.zones[j].name, z.name))
+        return "zone names must be unique";
+      if (img.zones[j].valvePin == z.valvePin)
+        return "every zone needs its own valvePin";
+    }
+  }
+  return nullptr;
+}
+
+struct WifiCache
+{
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip, gateway, subnet, dns; // network byte order, as IPAddress stores it
+  uint32_t savedBoot;                // boot count when the lease was taken
+  uint32_t crc;
+
+  bool valid() const { return magic == WIFI_CACHE_MAGIC && crc == checksum(); }
+  void clear() { memset(this, 0, sizeof(*this)); }
+  void seal()
+  {
+    magic = WIFI_CACHE_MAGIC;
+    crc = checksum();
+  }
+  uint32_t checksum() const { return crc32(this, offsetof(WifiCache, crc)); }
+  // Same association and lease (savedBoot ignored): no NVS write needed.
+  bool sameLink(const WifiCache &o) const
+  {
+    return memcmp(bssid, o.bssid, sizeof(bssid)) == 0 && channel == o.channel && ip == o.ip &&
+           gateway == o.gateway && subnet == o.subnet && dns == o.dns;
+  }
+};
@@ -0,0 +1,15 @@
+/*********************************************************************
+ * Crc32 – IEEE 802.3 CRC-32 (same polynomial as zlib / esp_rom_crc32_le)
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental: pass the previous result as `crc` to continue a running CRC.
+uint32_t crc32Update(uint32_t crc, const void *data, size_t len);
+
+inline uint32_t crc32(const void *data, size_t len)
+{
+  return crc32Update(0, data, len);
+}
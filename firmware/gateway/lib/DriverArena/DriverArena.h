@@ -0,0 +1,154 @@
+/*********************************************************************
+ * DriverArena – fixed slots for sensor driver objects (no heap churn)
+ * -------------------------------------------------------
+ * • Statically sized: Slots × SlotBytes, objects built with placement new
+ * • Callers hold a DriverHandle (slot + generation), never a pointer;
+ *   a handle to a destroyed object resolves to nullptr, so a stale or
+ *   repeated release is a counted no-op instead of a double free
+ * • Reference counted: a shared bus (OneWire) is retained per sensor and
+ *   destroyed with its last user
+ * • get<T>() checks the stored type, so a handle cannot be read as the
+ *   wrong driver
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <utility>
+
+struct DriverHandle
+{
+  uint8_t slot = 0xFF;
+  uint8_t gen = 0;
+  bool valid() const { return slot != 0xFF; }
+};
+
+template <size_t SlotBytes, uint8_t Slots>
+class DriverArena
+{
+public:
+  static_assert(Slots < 0xFF, "slot 0xFF marks an empty handle");
+
+  struct Stats
+  {
+    uint32_t created;
+    uint32_t destroyed;
+    uint32_t full;  // create() with every slot in use
+    uint32_t stale; // retain()/release() with an outdated handle
+  };
+
+  DriverArena() : m_stats() {}
+  ~DriverArena() { clear(); }
+  DriverArena(const DriverArena &) = delete;
+  DriverArena &operator=(const DriverArena &) = delete;
+
+  // Builds a T in a free slot; an invalid handle when the arena is full.
+  template <class T, class... Args>
+  DriverHandle create(Args &&...args)
+  {
+    static_assert(sizeof(T) <= SlotBytes, "driver does not fit a slot");
+    static_assert(alignof(T) <= alignof(Slot), "driver alignment exceeds the slot");
+    DriverHandle h;
+    for (uint8_t i = 0; i < Slots; i++)
+    {
+      if (m_type[i])
+        continue;
+      new (m_slots[i].bytes) T(std::forward<Args>(args)...);
+      m_type[i] = tag<T>();
+      m_dtor[i] = &destroyAs<T>;
+      m_refs[i] = 1;
+      h.slot = i;
+      h.gen = m_gen[i];
+      m_stats.created++;
+      return h;
+    }
+    m_stats.full++;
+    return h;
+  }
+
+  // nullptr for an empty/stale handle or one that holds another type.
+  template <class T>
+  T *get(DriverHandle h) const
+  {
+    if (!live(h) || m_type[h.slot] != tag<T>())
+      return nullptr;
+    return reinterpret_cast<T *>(const_cast<unsigned char *>(m_slots[h.slot].bytes));
+  }
+
+  bool retain(DriverHandle h)
+  {
+    if (!live(h))
+    {
+      m_stats.stale++;
+      return false;
+    }
+    m_refs[h.slot]++;
+    return true;
+  }
+
+  // Drops one reference (and the object with the last one); empties `h`.
+  void release(DriverHandle &h)
+  {
+    if (!h.valid())
+      return;
+    if (!live(h))
+      m_stats.stale++;
+    else if (--m_refs[h.slot] == 0)
+      destroySlot(h.slot);
+    h = DriverHandle();
+  }
+
+  void clear()
+  {
+    for (uint8_t i = 0; i < Slots; i++)
+      if (m_type[i])
+        destroySlot(i);
+  }
+
+  uint8_t used() const
+  {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < Slots; i++)
+      n += m_type[i] != nullptr;
+    return n;
+  }
+  uint8_t capacity() const { return Slots; }
+  static size_t slotBytes() { return SlotBytes; }
+  const Stats &stats() const { return m_stats; }
+
+private:
+  struct Slot
+  {
+    alignas(8) unsigned char bytes[SlotBytes];
+  };
+
+  // One address per type; compared, never dereferenced (no RTTI needed).
+  template <class T>
+  static const void *tag()
+  {
+    static const char id = 0;
+    return &id;
+  }
+
+  template <class T>
+  static void destroyAs(void *p) { static_cast<T *>(p)->~T(); }
+
+  bool live(DriverHandle h) const { return h.slot < Slots && m_type[h.slot] && m_gen[h.slot] == h.gen; }
+
+  void destroySlot(uint8_t i)
+  {
+    m_dtor[i](m_slots[i].bytes);
+    m_type[i] = nullptr;
+    m_refs[i] = 0;
+    m_gen[i]++; // outstanding handles to this slot go stale
+    m_stats.destroyed++;
+  }
+
+  Slot m_slots[Slots];
+  const void *m_type[Slots] = {};
+  void (*m_dtor[Slots])(void *) = {};
+  uint8_t m_refs[Slots] = {};
+  uint8_t m_gen[Slots] = {};
+  Stats m_stats;
+};
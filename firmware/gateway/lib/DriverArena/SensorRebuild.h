@@ -0,0 +1,53 @@
+/*********************************************************************
+ * SensorRebuild – the sensor list on a config reload
+ * -------------------------------------------------------
+ * • sensorDriverPlan() picks the old drivers the new sensors take over
+ * • Drivers nobody takes over are released before any new one is set
+ *   up, so the arena never holds the old and the new set at once
+ * • One copy for buildSensors() and the reload soak test
+ *********************************************************************/
+#pragma once
+
+#include <ConfigImage.h>
+#include <DriverArena.h>
+#include <string.h>
+#include <vector>
+
+// Builds `out` for `next`. out[i] is a copy of the `cur` sensor whose driver
+// it takes over, or a default-constructed sensor passed to
+// setup(out[i], next.sensors[i]). `prev` is the image `cur` was built from
+// (nullptr: nothing is kept). `out` should have room for next.sensorCount
+// sensors. Returns how many kept their driver.
+template <class Sensor, class Arena, class Setup>
+uint8_t sensorRebuild(Arena &arena, const ConfigImage *prev, const ConfigImage &next,
+                      std::vector<Sensor> &cur, std::vector<Sensor> &out, Setup setup)
+{
+  int8_t from[CONFIG_IMAGE_MAX_SENSORS];
+  memset(from, -1, sizeof(from));
+  if (prev && prev->sensorCount == cur.size())
+    sensorDriverPlan(*prev, next, from);
+  bool takenOver[CONFIG_IMAGE_MAX_SENSORS] = {false};
+  for (uint8_t i = 0; i < next.sensorCount; i++)
+    if (from[i] >= 0)
+      takenOver[from[i]] = true;
+  for (uint8_t j = 0; j < cur.size(); j++)
+    if (!takenOver[j])
+      arena.release(cur[j].driver);
+
+  out.clear();
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < next.sensorCount; i++)
+  {
+    if (from[i] >= 0)
+    {
+      out.push_back(cur[from[i]]);
+      kept++;
+    }
+    else
+    {
+      out.emplace_back();
+      setup(out.back(), next.sensors[i]);
+    }
+  }
+  return kept;
+}
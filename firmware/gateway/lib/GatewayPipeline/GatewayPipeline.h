@@ -0,0 +1,17 @@
+/*********************************************************************
+ * GatewayPipeline – sizes of the gateway's mesh -> uplink path
+ * -------------------------------------------------------
+ * • One set of figures for main.cpp and the mesh simulator
+ *   (test/test_mesh_sim), so the benchmark runs the firmware's sizes
+ * • MESH_SCHEMA_MAX_NODES may be overridden with -D (native_sim env)
+ *********************************************************************/
+#pragma once
+
+#define UPLINK_DRAIN_BUDGET 8         // queued messages sent per loop() pass
+#define HTTP_BATCH_MAX_MESSAGES 32
+#define HTTP_BATCH_MAX_BYTES 8192
+#define UPLINK_RING_SLOTS 12          // loop() -> uplink task hand-off
+#define UPLINK_RING_SLOT_BYTES 1024
+#ifndef MESH_SCHEMA_MAX_NODES
+#define MESH_SCHEMA_MAX_NODES 64      // gateway: cached node schemas
+#endif
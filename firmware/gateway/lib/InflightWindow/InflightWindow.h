@@ -0,0 +1,170 @@
+/*********************************************************************
+ * InflightWindow – bounded set of sent-but-unconfirmed messages
+ * -------------------------------------------------------
+ * • Each send gets a fresh correlation id; the transport's confirmation
+ *   callback resolves it (ok / failed). Ids never repeat within a run,
+ *   so a late confirmation for a slot already given up is ignored.
+ * • full() is the backpressure signal: nothing new goes out until a
+ *   confirmation frees a slot
+ * • take() hands back finished slots (confirmed, failed, or unanswered
+ *   for longer than the timeout) with their attempt count, so the caller
+ *   decides to retry (add() again) or requeue
+ * • The message itself is an opaque handle owned by the caller. No heap.
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <uint8_t N>
+class InflightWindow
+{
+  static_assert(N > 0, "empty window");
+
+public:
+  enum Status : uint8_t
+  {
+    PENDING = 0,
+    CONFIRMED,
+    FAILED,   // transport reported an error
+    TIMED_OUT // no confirmation within timeoutMs
+  };
+
+  struct Done
+  {
+    void *msg;
+    uint32_t id;
+    uint8_t attempt;   // 1 for the first send
+    Status status;
+    uint32_t elapsedMs; // send to confirmation (or give-up)
+  };
+
+  struct Stats
+  {
+    uint32_t sent = 0; // add() calls, retries included
+    uint32_t confirmed = 0;
+    uint32_t failed = 0;
+    uint32_t timedOut = 0;
+    uint32_t stale = 0; // confirmations for ids no longer in the window
+    uint8_t highWater = 0;
+  };
+
+  explicit InflightWindow(uint32_t timeoutMs, uint32_t firstId = 1)
+      : m_timeoutMs(timeoutMs), m_nextId(firstId ? firstId : 1) {}
+
+  // Records a send; returns its correlation id (never 0), or 0 when full.
+  uint32_t add(void *msg, uint32_t nowMs, uint8_t attempt = 1)
+  {
+    for (Slot &s : m_slots)
+    {
+      if (s.id)
+        continue;
+      s.id = m_nextId++;
+      if (!m_nextId)
+        m_nextId = 1;
+      s.msg = msg;
+      s.sentMs = nowMs;
+      s.attempt = attempt;
+      s.status = PENDING;
+      m_count++;
+      m_stats.sent++;
+      if (m_count > m_stats.highWater)
+        m_stats.highWater = m_count;
+      return s.id;
+    }
+    return 0;
+  }
+
+  // Confirmation callback. False for an unknown (given up) id.
+  bool resolve(uint32_t id, bool ok, uint32_t nowMs)
+  {
+    for (Slot &s : m_slots)
+    {
+      if (s.id != id || !id || s.status != PENDING)
+        continue;
+      s.status = ok ? CONFIRMED : FAILED;
+      s.doneMs = nowMs;
+      return true;
+    }
+    m_stats.stale++;
+    return false;
+  }
+
+  // Removes one finished slot (oldest send first); false when none is.
+  bool take(uint32_t nowMs, Done &out)
+  {
+    Slot *pick = nullptr;
+    for (Slot &s : m_slots)
+    {
+      if (!s.id)
+        continue;
+      if (s.status == PENDING && nowMs - s.sentMs >= m_timeoutMs)
+      {
+        s.status = TIMED_OUT;
+        s.doneMs = nowMs;
+      }
+      if (s.status != PENDING && (!pick || (int32_t)(s.sentMs - pick->sentMs) < 0))
+        pick = &s;
+    }
+    if (!pick)
+      return false;
+    if (pick->status == CONFIRMED)
+      m_stats.confirmed++;
+    else if (pick->status == FAILED)
+      m_stats.failed++;
+    else
+      m_stats.timedOut++;
+    release(*pick, out);
+    return true;
+  }
+
+  // Removes any slot, finished or not (teardown / requeue everything).
+  bool takeAny(Done &out)
+  {
+    for (Slot &s : m_slots)
+    {
+      if (!s.id)
+        continue;
+      if (s.status == PENDING)
+        s.doneMs = s.sentMs;
+      release(s, out);
+      return true;
+    }
+    return false;
+  }
+
+  bool full() const { return m_count == N; }
+  bool empty() const { return m_count == 0; }
+  uint8_t size() const { return m_count; }
+  static uint8_t capacity() { return N; }
+  const Stats &stats() const { return m_stats; }
+
+private:
+  struct Slot
+  {
+    uint32_t id = 0; // 0 = free
+    void *msg = nullptr;
+    uint32_t sentMs = 0;
+    uint32_t doneMs = 0;
+    uint8_t attempt = 0;
+    Status status = PENDING;
+  };
+
+  void release(Slot &s, Done &out)
+  {
+    out.msg = s.msg;
+    out.id = s.id;
+    out.attempt = s.attempt;
+    out.status = s.status;
+    out.elapsedMs = s.doneMs - s.sentMs;
+    s.id = 0;
+    s.msg = nullptr;
+    m_count--;
+  }
+
+  Slot m_slots[N];
+  uint8_t m_count = 0;
+  uint32_t m_timeoutMs;
+  uint32_t m_nextId;
+  Stats m_stats;
+};
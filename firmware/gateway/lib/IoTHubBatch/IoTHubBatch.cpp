@@ -0,0 +1,116 @@
+#include "IoTHubBatch.h"
+
+#include <string.h>
+
+namespace
+{
+  const char kB64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const char kEntryHead[] = "{\"body\":\"";
+  const char kEntryTail[] = "\",\"base64Encoded\":true}";
+}
+
+size_t base64Encode(const uint8_t *in, size_t len, char *out, size_t cap)
+{
+  size_t need = base64Length(len);
+  if (need > cap)
+    return 0;
+  char *o = out;
+  size_t i = 0;
+  for (; i + 2 < len; i += 3)
+  {
+    uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+    *o++ = kB64[v >> 18];
+    *o++ = kB64[(v >> 12) & 63];
+    *o++ = kB64[(v >> 6) & 63];
+    *o++ = kB64[v & 63];
+  }
+  if (i < len)
+  {
+    uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0);
+    *o++ = kB64[v >> 18];
+    *o++ = kB64[(v >> 12) & 63];
+    *o++ = i + 1 < len ? kB64[(v >> 6) & 63] : '=';
+    *o++ = '=';
+  }
+  return need;
+}
+
+size_t base64Decode(const char *in, size_t len, uint8_t *out, size_t cap)
+{
+  if (len % 4)
+    return 0;
+  size_t pad = 0;
+  if (len && in[len - 1] == '=')
+    pad = in[len - 2] == '=' ? 2 : 1;
+  size_t need = len / 4 * 3 - pad;
+  if (need > cap)
+    return 0;
+  size_t o = 0;
+  for (size_t i = 0; i < len; i += 4)
+  {
+    uint32_t v = 0;
+    for (size_t k = 0; k < 4; k++)
+    {
+      char c = in[i + k];
+      int d;
+      if (c >= 'A' && c <= 'Z')
+        d = c - 'A';
+      else if (c >= 'a' && c <= 'z')
+        d = c - 'a' + 26;
+      else if (c >= '0' && c <= '9')
+        d = c - '0' + 52;
+      else if (c == '+')
+        d = 62;
+      else if (c == '/')
+        d = 63;
+      else if (c == '=' && i + k >= len - pad)
+        d = 0;
+      else
+        return 0;
+      v = v << 6 | (uint32_t)d;
+    }
+    for (size_t k = 0; k < 3 && o < need; k++)
+      out[o++] = (uint8_t)(v >> (16 - 8 * k));
+  }
+  return need;
+}
+
+IoTHubBatchWriter::IoTHubBatchWriter(char *buf, size_t cap) : m_buf(buf), m_cap(cap)
+{
+  reset();
+}
+
+void IoTHubBatchWriter::reset()
+{
+  m_len = 0;
+  m_count = 0;
+}
+
+size_t IoTHubBatchWriter::entrySize(size_t len)
+{
+  return 1 + (sizeof(kEntryHead) - 1) + base64Length(len) + (sizeof(kEntryTail) - 1);
+}
+
+bool IoTHubBatchWriter::add(const char *msg, size_t len)
+{
+  // Leave room for the closing bracket and terminator.
+  if (m_len + entrySize(len) + 2 > m_cap)
+    return false;
+  m_buf[m_len++] = m_count ? ',' : '[';
+  memcpy(m_buf + m_len, kEntryHead, sizeof(kEntryHead) - 1);
+  m_len += sizeof(kEntryHead) - 1;
+  m_len += base64Encode((const uint8_t *)msg, len, m_buf + m_len, m_cap - m_len);
+  memcpy(m_buf + m_len, kEntryTail, sizeof(kEntryTail) - 1);
+  m_len += sizeof(kEntryTail) - 1;
+  m_count++;
+  return true;
+}
+
+size_t IoTHubBatchWriter::finish()
+{
+  if (m_count == 0)
+    return 0;
+  m_buf[m_len] = ']';
+  m_buf[m_len + 1] = '\0';
+  return m_len + 1;
+}
@@ -0,0 +1,48 @@
+/*********************************************************************
+ * IoTHubBatch – body writer for IoT Hub HTTPS batch sends
+ * -------------------------------------------------------
+ * • POST /devices/{id}/messages/events with
+ *   Content-Type: application/vnd.microsoft.iothub.json
+ * • Body: [{"body":"<base64>","base64Encoded":true}, ...]
+ * • Writes into a caller-owned fixed buffer (no heap)
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IOTHUB_BATCH_CONTENT_TYPE "application/vnd.microsoft.iothub.json"
+
+// Encoded length of `len` bytes, without terminator.
+inline size_t base64Length(size_t len)
+{
+  return (len + 2) / 3 * 4;
+}
+
+// Writes base64 of `in` to `out`; returns bytes written or 0 if `cap` is too small.
+size_t base64Encode(const uint8_t *in, size_t len, char *out, size_t cap);
+// Decodes standard padded base64; returns bytes written, 0 on bad input or small `cap`.
+size_t base64Decode(const char *in, size_t len, uint8_t *out, size_t cap);
+
+class IoTHubBatchWriter
+{
+public:
+  IoTHubBatchWriter(char *buf, size_t cap);
+
+  void reset();
+  // Appends one message; false (and unchanged buffer) when it does not fit.
+  bool add(const char *msg, size_t len);
+  // Bytes a message of `len` bytes adds to the body.
+  static size_t entrySize(size_t len);
+  // Closes the array and NUL-terminates; returns body length (0 if empty).
+  size_t finish();
+
+  uint16_t count() const { return m_count; }
+  size_t length() const { return m_len; }
+
+private:
+  char *m_buf;
+  size_t m_cap;
+  size_t m_len = 0;
+  uint16_t m_count = 0;
+};
@@ -0,0 +1,33 @@
+/*********************************************************************
+ * AtomicWords – byte copies through relaxed 32-bit atomics
+ * -------------------------------------------------------
+ * Seqlock-style readers may race with the writer; going through atomics
+ * makes a torn read detectable (sequence check) instead of undefined.
+ * On the ESP32 these compile to plain aligned loads/stores.
+ *********************************************************************/
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+inline void atomicWordsStore(std::atomic<uint32_t> *words, const uint8_t *src, size_t len)
+{
+  for (size_t w = 0; w * 4 < len; w++)
+  {
+    uint32_t v = 0;
+    for (size_t b = 0; b < 4 && w * 4 + b < len; b++)
+      v |= (uint32_t)src[w * 4 + b] << (8 * b);
+    words[w].store(v, std::memory_order_relaxed);
+  }
+}
+
+inline void atomicWordsLoad(const std::atomic<uint32_t> *words, uint8_t *dst, size_t len)
+{
+  for (size_t w = 0; w * 4 < len; w++)
+  {
+    uint32_t v = words[w].load(std::memory_order_relaxed);
+    for (size_t b = 0; b < 4 && w * 4 + b < len; b++)
+      dst[w * 4 + b] = (uint8_t)(v >> (8 * b));
+  }
+}
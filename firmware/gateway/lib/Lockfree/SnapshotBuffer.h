@@ -0,0 +1,64 @@
+/*********************************************************************
+ * SnapshotBuffer – latest-value publication from one writer to many
+ * readers (seqlock). Readers copy out and retry if a publish overlapped.
+ *********************************************************************/
+#pragma once
+
+#include "AtomicWords.h"
+
+template <uint16_t Cap>
+class SnapshotBuffer
+{
+public:
+  static const uint16_t CAPACITY = Cap;
+
+  // Writer side (single task). Data longer than Cap is rejected.
+  bool publish(const char *data, size_t len, uint32_t timestamp)
+  {
+    if (len > Cap)
+      return false;
+    uint32_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed); // odd: writing
+    std::atomic_thread_fence(std::memory_order_release);
+    m_len.store((uint32_t)len, std::memory_order_relaxed);
+    m_ts.store(timestamp, std::memory_order_relaxed);
+    atomicWordsStore(m_words, (const uint8_t *)data, len);
+    m_seq.store(seq + 2, std::memory_order_release);
+    return true;
+  }
+
+  // Reader side (any task). Returns the snapshot length, 0 if nothing has
+  // been published yet or the writer kept overlapping the copy.
+  size_t read(char *buf, size_t cap, uint32_t &version, uint32_t &timestamp) const
+  {
+    for (uint8_t attempt = 0; attempt < 8; attempt++)
+    {
+      uint32_t seq1 = m_seq.load(std::memory_order_acquire);
+      if (seq1 == 0)
+        return 0;
+      if (seq1 & 1)
+        continue;
+      size_t len = m_len.load(std::memory_order_relaxed);
+      timestamp = m_ts.load(std::memory_order_relaxed);
+      if (len > cap)
+        len = cap;
+      atomicWordsLoad(m_words, (uint8_t *)buf, len);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (m_seq.load(std::memory_order_relaxed) == seq1)
+      {
+        version = seq1 / 2;
+        return len;
+      }
+    }
+    return 0;
+  }
+
+  // Number of publishes so far (0 = none); cheap change check for ETags.
+  uint32_t version() const { return m_seq.load(std::memory_order_acquire) / 2; }
+
+private:
+  std::atomic<uint32_t> m_seq{0};
+  std::atomic<uint32_t> m_len{0};
+  std::atomic<uint32_t> m_ts{0};
+  std::atomic<uint32_t> m_words[(Cap + 3) / 4];
+};
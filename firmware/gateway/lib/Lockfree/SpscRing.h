@@ -0,0 +1,137 @@
+/*********************************************************************
+ * SpscRing – lock-free single-producer / single-consumer message ring
+ * -------------------------------------------------------
+ * • Fixed slots, no heap, never blocks the producer
+ * • Overflow policy: drop-oldest (the producer overwrites; the consumer
+ *   detects overrun / torn slots through per-slot sequence numbers)
+ * • Counters are plain atomics, safe to read from any task
+ *********************************************************************/
+#pragma once
+
+#include "AtomicWords.h"
+
+template <uint16_t Slots, uint16_t SlotBytes>
+class SpscRing
+{
+public:
+  struct Stats
+  {
+    uint32_t pushed;
+    uint32_t popped;
+    uint32_t dropped;  // overwritten before the consumer got to them
+    uint32_t oversize; // rejected by push(): larger than SlotBytes
+    uint32_t highWater;
+  };
+
+  static const uint16_t SLOT_BYTES = SlotBytes;
+
+  SpscRing()
+  {
+    for (uint16_t i = 0; i < Slots; i++)
+      m_slots[i].seq.store(0, std::memory_order_relaxed);
+  }
+
+  // Producer side. Always succeeds for len <= SlotBytes; when the ring is
+  // full the oldest unread message is overwritten.
+  bool push(const void *data, size_t len)
+  {
+    if (len > SlotBytes)
+    {
+      m_oversize.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    uint32_t h = m_head.load(std::memory_order_relaxed);
+    Slot &s = m_slots[h % Slots];
+    s.seq.store(h * 2 + 1, std::memory_order_relaxed); // odd: being written
+    std::atomic_thread_fence(std::memory_order_release);
+    s.len.store((uint16_t)len, std::memory_order_relaxed);
+    atomicWordsStore(s.words, (const uint8_t *)data, len);
+    s.seq.store(h * 2 + 2, std::memory_order_release);
+    m_head.store(h + 1, std::memory_order_release);
+    m_pushed.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t depth = h + 1 - m_tail.load(std::memory_order_relaxed);
+    if (depth > Slots)
+      depth = Slots;
+    if (depth > m_highWater.load(std::memory_order_relaxed))
+      m_highWater.store(depth, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Consumer side. Copies the oldest intact message into buf (cap >= SlotBytes)
+  // and returns its length, or 0 when empty.
+  size_t pop(void *buf, size_t cap)
+  {
+    uint32_t t = m_tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      uint32_t h = m_head.load(std::memory_order_acquire);
+      if (t == h)
+        break;
+      if (h - t > Slots)
+      {
+        drop(h - Slots - t);
+        t = h - Slots;
+      }
+      Slot &s = m_slots[t % Slots];
+      uint32_t seq1 = s.seq.load(std::memory_order_acquire);
+      if (seq1 != t * 2 + 2)
+      {
+        // Producer lapped us on this slot (or is writing it right now).
+        drop(1);
+        t++;
+        continue;
+      }
+      size_t len = s.len.load(std::memory_order_relaxed);
+      if (len > cap)
+        len = cap;
+      atomicWordsLoad(s.words, (uint8_t *)buf, len);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s.seq.load(std::memory_order_relaxed) != seq1)
+      {
+        drop(1);
+        t++;
+        continue;
+      }
+      m_tail.store(t + 1, std::memory_order_relaxed);
+      m_popped.fetch_add(1, std::memory_order_relaxed);
+      return len;
+    }
+    m_tail.store(t, std::memory_order_relaxed);
+    return 0;
+  }
+
+  bool empty() const
+  {
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+  }
+
+  Stats stats() const
+  {
+    Stats st;
+    st.pushed = m_pushed.load(std::memory_order_relaxed);
+    st.popped = m_popped.load(std::memory_order_relaxed);
+    st.dropped = m_dropped.load(std::memory_order_relaxed);
+    st.oversize = m_oversize.load(std::memory_order_relaxed);
+    st.highWater = m_highWater.load(std::memory_order_relaxed);
+    return st;
+  }
+
+private:
+  static const uint16_t WORDS = (SlotBytes + 3) / 4;
+
+  // Payload words are relaxed atomics so a torn read is detectable, not UB.
+  struct Slot
+  {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint16_t> len;
+    std::atomic<uint32_t> words[WORDS];
+  };
+
+  void drop(uint32_t n) { m_dropped.fetch_add(n, std::memory_order_relaxed); }
+
+  Slot m_slots[Slots];
+  std::atomic<uint32_t> m_head{0}; // written by the producer only
+  std::atomic<uint32_t> m_tail{0}; // written by the consumer only
+  std::atomic<uint32_t> m_pushed{0}, m_popped{0}, m_dropped{0}, m_oversize{0}, m_highWater{0};
+};
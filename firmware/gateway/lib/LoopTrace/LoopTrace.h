@@ -0,0 +1,136 @@
+/*********************************************************************
+ * LoopTrace – scoped trace events in a lock-free ring, Chrome export
+ * -------------------------------------------------------
+ * • record() claims a slot with one atomic add, so any task may trace;
+ *   the oldest events are overwritten
+ * • Each slot is a small seqlock: a dump running next to writers skips
+ *   a slot being rewritten instead of reporting a torn event
+ * • Start in µs (a clock shared by both cores), duration in CPU cycles
+ *   (the core's cycle counter, exact for short scopes)
+ * • writeChromeJson() emits trace-event JSON ("ph":"X" complete events)
+ *   for chrome://tracing / Perfetto; names must be plain string literals
+ * • Two writers only share a slot if N events are recorded while one
+ *   of them is inside record()
+ *********************************************************************/
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef void (*TraceSink)(const char *data, size_t len, void *ctx);
+
+struct TraceEvent
+{
+  const char *name;
+  uint32_t startUs;
+  uint32_t cycles;
+  uint8_t tid;
+};
+
+template <uint16_t N>
+class TraceRing
+{
+public:
+  void record(const char *name, uint8_t tid, uint32_t startUs, uint32_t cycles)
+  {
+    uint32_t seq = m_next.fetch_add(1, std::memory_order_relaxed);
+    Slot &s = m_slots[seq % N];
+    s.seq.store(0, std::memory_order_relaxed); // being written
+    std::atomic_thread_fence(std::memory_order_release);
+    s.name.store(name, std::memory_order_relaxed);
+    s.startUs.store(startUs, std::memory_order_relaxed);
+    s.cycles.store(cycles, std::memory_order_relaxed);
+    s.tid.store(tid, std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_release);
+  }
+
+  // Events recorded so far (including overwritten ones).
+  uint32_t written() const { return m_next.load(std::memory_order_relaxed); }
+
+  // Event number `seq`; false if overwritten or mid-write.
+  bool read(uint32_t seq, TraceEvent &out) const
+  {
+    const Slot &s = m_slots[seq % N];
+    if (s.seq.load(std::memory_order_acquire) != seq + 1)
+      return false;
+    out.name = s.name.load(std::memory_order_relaxed);
+    out.startUs = s.startUs.load(std::memory_order_relaxed);
+    out.cycles = s.cycles.load(std::memory_order_relaxed);
+    out.tid = s.tid.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s.seq.load(std::memory_order_relaxed) == seq + 1;
+  }
+
+  // Trace-event JSON of the retained events; `threads` names tid 0..n-1.
+  // Timestamps are relative to the oldest exported event. Returns events written.
+  uint32_t writeChromeJson(TraceSink sink, void *ctx, uint32_t cyclesPerUs, const char *const *threads,
+                           uint8_t threadCount) const
+  {
+    uint32_t end = written();
+    uint32_t begin = end > N ? end - N : 0;
+    TraceEvent e;
+    uint32_t base = 0;
+    bool haveBase = false;
+    // Scopes are recorded when they end, so an outer scope follows the
+    // inner ones in the ring: the base is the earliest start, not the first.
+    for (uint32_t i = begin; i < end; i++)
+      if (read(i, e) && (!haveBase || (int32_t)(e.startUs - base) < 0))
+      {
+        base = e.startUs;
+        haveBase = true;
+      }
+
+    char line[LINE_BYTES];
+    emit(sink, ctx, line, snprintf(line, sizeof(line), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    bool first = true;
+    for (uint8_t t = 0; t < threadCount; t++)
+    {
+      emit(sink, ctx, line,
+           snprintf(line, sizeof(line),
+                    "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",", t, threads[t]));
+      first = false;
+    }
+    uint32_t count = 0;
+    for (uint32_t i = begin; i < end; i++)
+    {
+      // A slot rewritten since the first pass holds a newer event; only one
+      // that would land before `base` is left out.
+      if (!read(i, e) || (int32_t)(e.startUs - base) < 0)
+        continue;
+      emit(sink, ctx, line,
+           snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%u,\"dur\":%.3f}",
+                    first ? "" : ",", e.name, e.tid, (unsigned)(e.startUs - base),
+                    cyclesPerUs ? (double)e.cycles / cyclesPerUs : 0.0));
+      first = false;
+      count++;
+    }
+    emit(sink, ctx, line, snprintf(line, sizeof(line), "]}\n"));
+    return count;
+  }
+
+  static uint16_t capacity() { return N; }
+
+private:
+  static const size_t LINE_BYTES = 160;
+
+  static void emit(TraceSink sink, void *ctx, const char *line, int n)
+  {
+    if (n > 0 && (size_t)n < LINE_BYTES)
+      sink(line, n, ctx);
+  }
+
+  struct Slot
+  {
+    std::atomic<uint32_t> seq{0}; // event number + 1; 0 = empty or mid-write
+    std::atomic<const char *> name{nullptr};
+    std::atomic<uint32_t> startUs{0};
+    std::atomic<uint32_t> cycles{0};
+    std::atomic<uint8_t> tid{0};
+  };
+
+  Slot m_slots[N];
+  std::atomic<uint32_t> m_next{0};
+};
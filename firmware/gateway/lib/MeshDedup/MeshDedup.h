@@ -0,0 +1,131 @@
+/*********************************************************************
+ * MeshDedup – (nodeId, seq) tagging and gateway-side duplicate filter
+ * -------------------------------------------------------
+ * • Nodes prefix every mesh message with "#<seq hex>:"; the node id is
+ *   painlessMesh's origin id (`from`), which relays keep
+ * • Messages without the prefix (older firmware) pass unfiltered
+ * • The gateway remembers recent (node, seq) pairs in a fixed table:
+ *   open addressing over a short probe window, entries expire after
+ *   `windowMs`, a full window evicts its oldest entry. No heap.
+ * • Sequence numbers are seeded randomly at cold boot so a restarted
+ *   node does not repeat pairs still in the table
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define MESH_SEQ_PREFIX '#'
+#define MESH_SEQ_PREFIX_BYTES 10 // '#' + 8 hex digits + ':'
+
+// Writes the prefix for `seq`; returns its length (0 if `cap` is short).
+inline size_t meshSeqPrefix(uint32_t seq, char *out, size_t cap)
+{
+  if (cap <= MESH_SEQ_PREFIX_BYTES)
+    return 0;
+  snprintf(out, cap, "%c%08x:", MESH_SEQ_PREFIX, (unsigned)seq);
+  return MESH_SEQ_PREFIX_BYTES;
+}
+
+// Parses a prefix at the start of `msg`; returns the payload offset, or 0
+// if there is none.
+inline size_t meshSeqParse(const char *msg, size_t len, uint32_t &seq)
+{
+  if (len < MESH_SEQ_PREFIX_BYTES || msg[0] != MESH_SEQ_PREFIX || msg[MESH_SEQ_PREFIX_BYTES - 1] != ':')
+    return 0;
+  uint32_t v = 0;
+  for (size_t i = 1; i < MESH_SEQ_PREFIX_BYTES - 1; i++)
+  {
+    char c = msg[i];
+    uint8_t d;
+    if (c >= '0' && c <= '9')
+      d = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      d = c - 'a' + 10;
+    else
+      return 0;
+    v = v << 4 | d;
+  }
+  seq = v;
+  return MESH_SEQ_PREFIX_BYTES;
+}
+
+template <uint16_t Slots, uint8_t Probe = 8>
+class MeshDedup
+{
+  static_assert(Slots && !(Slots & (Slots - 1)), "Slots must be a power of two");
+  static_assert(Probe && Probe <= Slots, "probe window larger than the table");
+
+public:
+  struct Stats
+  {
+    uint32_t accepted = 0;
+    uint32_t duplicates = 0;
+    uint32_t evicted = 0; // live entries pushed out by a full probe window
+  };
+
+  explicit MeshDedup(uint32_t windowMs) : m_windowMs(windowMs) {}
+
+  // True the first time (node, seq) is seen within the window.
+  bool firstSeen(uint32_t node, uint32_t seq, uint32_t nowMs)
+  {
+    uint32_t h = hash(node, seq);
+    Entry *victim = nullptr;
+    bool victimLive = true;
+    for (uint8_t i = 0; i < Probe; i++)
+    {
+      Entry &e = m_entries[(h + i) & (Slots - 1)];
+      bool live = e.used && nowMs - e.seenMs < m_windowMs;
+      if (live && e.node == node && e.seq == seq)
+      {
+        m_stats.duplicates++;
+        return false;
+      }
+      if (!live)
+      {
+        if (victimLive)
+          victim = &e; // first free / expired slot
+        victimLive = false;
+      }
+      else if (victimLive && (!victim || (int32_t)(e.seenMs - victim->seenMs) < 0))
+        victim = &e; // oldest live entry so far
+    }
+    if (victimLive)
+      m_stats.evicted++;
+    victim->node = node;
+    victim->seq = seq;
+    victim->seenMs = nowMs;
+    victim->used = true;
+    m_stats.accepted++;
+    return true;
+  }
+
+  void clear()
+  {
+    for (auto &e : m_entries)
+      e.used = false;
+  }
+
+  const Stats &stats() const { return m_stats; }
+  static uint16_t capacity() { return Slots; }
+
+private:
+  struct Entry
+  {
+    uint32_t node = 0;
+    uint32_t seq = 0;
+    uint32_t seenMs = 0;
+    bool used = false;
+  };
+
+  static uint32_t hash(uint32_t node, uint32_t seq)
+  {
+    uint32_t h = node * 0x9E3779B1u ^ seq * 0x85EBCA77u;
+    return h ^ h >> 15;
+  }
+
+  Entry m_entries[Slots];
+  uint32_t m_windowMs;
+  Stats m_stats;
+};
@@ -0,0 +1,76 @@
+#include "MeshIngest.h"
+
+#include <TelemetryFrame.h>
+#include <TelemetryJson.h>
+#include <stdio.h>
+
+void MeshIngest::setSchema(uint32_t from, uint16_t id, const char *firmware, const char *const *names,
+                           const SensorKind *kinds, uint8_t count)
+{
+  if (!m_schemas.count(from) && m_schemas.size() >= m_maxNodes && !m_schemas.empty())
+    m_schemas.erase(m_schemas.begin());
+  Schema &s = m_schemas[from];
+  s.id = id;
+  s.firmware = firmware ? firmware : "";
+  s.names.assign(names, names + count);
+  s.kinds.assign(kinds, kinds + count);
+}
+
+int MeshIngest::onFrameText(uint32_t from, const char *text, size_t len, int rssi, Sink sink, void *ctx)
+{
+  size_t frameLen = telemetryFrameFromText(text, len, m_frame, sizeof(m_frame));
+  TelemetryFrameReader r;
+  if (!frameLen || !r.open(m_frame, frameLen))
+  {
+    m_stats.invalid++;
+    return -1;
+  }
+  m_stats.frames++;
+  const TelemetryFrameHeader &h = r.header();
+  auto it = m_schemas.find(from);
+  const Schema *ns = (it != m_schemas.end() && it->second.id == h.schema) ? &it->second : nullptr;
+  if (!ns)
+    m_stats.unknownSchema++;
+
+  int emitted = 0;
+  uint16_t age;
+  while (r.nextRecord(age))
+  {
+    JsonWriter out(m_json, sizeof(m_json));
+    out.string("deviceId", r.deviceId());
+    if (ns)
+      out.string("firmwareVersion", ns->firmware.c_str());
+    out.number("battery", h.batteryMv / 1000.0, 5);
+    out.integer("rssi", rssi);
+    out.integer("meshHopCount", h.hops);
+    out.integer("sleepSeconds", h.sleepSec);
+    if (age)
+      out.integer("sampleAgeSec", age);
+
+    uint8_t sensor;
+    SensorField field;
+    float value;
+    char key[48];
+    while (r.nextReading(sensor, field, value))
+    {
+      // Unknown schema (gateway rebooted, announcement lost): index keys.
+      if (!ns || sensor >= ns->names.size())
+        snprintf(key, sizeof(key), "s%u_%s", sensor, sensorFieldName(field));
+      else if (sensorKindIsScalar(ns->kinds[sensor]))
+        snprintf(key, sizeof(key), "%s", ns->names[sensor].c_str());
+      else
+        snprintf(key, sizeof(key), "%s_%s", ns->names[sensor].c_str(), sensorFieldName(field));
+      out.number(key, value);
+    }
+    size_t n = out.finish();
+    if (!n)
+    {
+      m_stats.oversize++;
+      continue;
+    }
+    m_stats.messages++;
+    emitted++;
+    sink(from, m_json, n, ctx);
+  }
+  return emitted;
+}
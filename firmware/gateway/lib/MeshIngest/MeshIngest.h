@@ -0,0 +1,66 @@
+/*********************************************************************
+ * MeshIngest – gateway side of binary mesh telemetry
+ * -------------------------------------------------------
+ * • Keeps the schema (sensor names + kinds) each node announced and
+ *   turns its TelemetryFrames into the gateway's JSON telemetry, one
+ *   message per record
+ * • JSON is written straight into a fixed buffer (JsonWriter, no heap
+ *   per message); the sink sees each message before the next is built
+ * • No Arduino dependencies: the firmware's meshReceivedCallback() and
+ *   the host mesh simulator (test_mesh_sim) run the same code
+ *********************************************************************/
+#pragma once
+
+#include <SensorKind.h>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define MESH_INGEST_FRAME_BYTES 512 // decoded binary frame
+#define MESH_INGEST_JSON_BYTES 1024 // one outgoing telemetry message
+
+class MeshIngest
+{
+public:
+  struct Stats
+  {
+    uint32_t frames = 0;   // decoded frames
+    uint32_t invalid = 0;  // undecodable frame texts
+    uint32_t messages = 0; // JSON messages handed to the sink
+    uint32_t oversize = 0; // records that did not fit MESH_INGEST_JSON_BYTES
+    uint32_t unknownSchema = 0;
+  };
+
+  typedef void (*Sink)(uint32_t from, const char *json, size_t len, void *ctx);
+
+  // Up to `maxNodes` schemas are kept; a new node evicts the lowest id.
+  explicit MeshIngest(size_t maxNodes) : m_maxNodes(maxNodes) {}
+
+  void setSchema(uint32_t from, uint16_t id, const char *firmware, const char *const *names,
+                 const SensorKind *kinds, uint8_t count);
+  size_t nodes() const { return m_schemas.size(); }
+
+  // Decodes a frame in mesh text form ('~' + base64). `rssi` is the
+  // gateway's own link, reported with every message. Returns the number
+  // of messages emitted, -1 if the text is not a valid frame.
+  int onFrameText(uint32_t from, const char *text, size_t len, int rssi, Sink sink, void *ctx);
+
+  const Stats &stats() const { return m_stats; }
+
+private:
+  struct Schema
+  {
+    uint16_t id = 0;
+    std::string firmware;
+    std::vector<std::string> names;
+    std::vector<SensorKind> kinds;
+  };
+
+  size_t m_maxNodes;
+  std::map<uint32_t, Schema> m_schemas;
+  uint8_t m_frame[MESH_INGEST_FRAME_BYTES];
+  char m_json[MESH_INGEST_JSON_BYTES];
+  Stats m_stats;
+};
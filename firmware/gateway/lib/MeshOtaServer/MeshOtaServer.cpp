@@ -0,0 +1,110 @@
+#include "MeshOtaServer.h"
+
+void MeshOtaServer::begin(uint32_t parts, const Config &cfg, uint32_t nowMs)
+{
+  m_cfg = cfg;
+  m_parts = parts;
+  m_tokensMilli = cfg.burst * 1000u;
+  m_refillAt = nowMs;
+  m_head = m_count = 0;
+  m_nodeCount = 0;
+  m_stats = Stats();
+}
+
+MeshOtaServer::Node *MeshOtaServer::track(uint32_t node, uint32_t nowMs)
+{
+  for (uint8_t i = 0; i < m_nodeCount; i++)
+    if (m_nodes[i].id == node)
+      return &m_nodes[i];
+  if (m_nodeCount == MESH_OTA_MAX_NODES)
+  {
+    // Reuse the slot of a finished node that has been quiet longest.
+    int8_t oldest = -1;
+    for (uint8_t i = 0; i < m_nodeCount; i++)
+      if (m_nodes[i].done && (oldest < 0 || (int32_t)(m_nodes[i].lastAt - m_nodes[oldest].lastAt) < 0))
+        oldest = (int8_t)i;
+    if (oldest < 0)
+      return nullptr;
+    m_nodes[oldest] = Node();
+    m_nodes[oldest].id = node;
+    m_nodes[oldest].lastAt = nowMs;
+    return &m_nodes[oldest];
+  }
+  Node &n = m_nodes[m_nodeCount++];
+  n = Node();
+  n.id = node;
+  n.lastAt = nowMs;
+  return &n;
+}
+
+bool MeshOtaServer::request(uint32_t node, uint32_t part, uint32_t nowMs)
+{
+  if (part >= m_parts)
+    return false;
+  m_stats.requests++;
+  Node *n = track(node, nowMs);
+  if (n)
+    n->lastAt = nowMs;
+  for (uint8_t i = 0; i < m_count; i++)
+  {
+    const Request &q = m_queue[(m_head + i) % MESH_OTA_QUEUE];
+    if (q.node == node && q.part == part)
+    {
+      m_stats.duplicates++;
+      return false;
+    }
+  }
+  if (m_count == MESH_OTA_QUEUE)
+  {
+    m_stats.dropped++;
+    return false;
+  }
+  m_queue[(m_head + m_count++) % MESH_OTA_QUEUE] = {node, part, false};
+  return true;
+}
+
+bool MeshOtaServer::next(uint32_t nowMs, bool hold, Request &out)
+{
+  uint32_t cap = m_cfg.burst * 1000u;
+  uint32_t elapsed = nowMs - m_refillAt;
+  if (elapsed > 60000)
+    elapsed = 60000; // long idle: the bucket is full anyway, do not overflow
+  m_tokensMilli += elapsed * m_cfg.partsPerSec;
+  if (m_tokensMilli > cap)
+    m_tokensMilli = cap;
+  m_refillAt = nowMs;
+  if (!m_count)
+    return false;
+  if (hold)
+  {
+    m_stats.held++;
+    return false;
+  }
+  if (m_tokensMilli < 1000)
+    return false;
+  m_tokensMilli -= 1000;
+  out = m_queue[m_head];
+  m_head = (m_head + 1) % MESH_OTA_QUEUE;
+  m_count--;
+  m_stats.served++;
+  for (uint8_t i = 0; i < m_nodeCount; i++)
+  {
+    Node &n = m_nodes[i];
+    if (n.id != out.node)
+      continue;
+    n.served++;
+    if (out.part < n.next)
+    {
+      n.repeats++;
+    }
+    else
+    {
+      n.next = out.part + 1;
+      out.fresh = true;
+    }
+    if (n.next == m_parts)
+      n.done = true;
+    break;
+  }
+  return true;
+}
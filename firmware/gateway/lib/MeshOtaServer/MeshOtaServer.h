@@ -0,0 +1,111 @@
+/*********************************************************************
+ * MeshOtaServer – gateway side of firmware distribution over the mesh
+ * -------------------------------------------------------
+ * • Nodes pull the image part by part (painlessMesh OTA: one DataRequest
+ *   per part, asked again after a timeout when the reply is lost); the
+ *   server queues the requests instead of answering in the callback
+ * • next() hands out queued requests at a paced rate (token bucket) and
+ *   not at all while `hold` is set, so node telemetry keeps its airtime
+ * • A request already queued is not queued twice; a full queue drops the
+ *   request (the node asks again)
+ * • Per-node progress: parts served, highest part, repeats (parts asked
+ *   for again: lost replies), done once the last part went out
+ * • MeshOtaImage records the image staged for the nodes (version, MD5 the
+ *   nodes compare with their own, size), plain aggregate with a magic +
+ *   CRC so the firmware can keep it in NVS
+ * • No Arduino dependencies: host tests run a simulated site against it
+ *********************************************************************/
+#pragma once
+
+#include <Crc32.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MESH_OTA_MAX_NODES 32 // nodes with tracked progress; more are served, not tracked
+#define MESH_OTA_QUEUE 16     // pending part requests
+#define MESH_OTA_IMAGE_MAGIC 0x4D4F5431 // "MOT1"
+
+struct MeshOtaImage
+{
+  uint32_t magic;
+  char version[24];
+  char md5[33];      // hex, as painlessMesh announces it
+  char hardware[8];  // "ESP32" / "ESP8266"
+  char partition[17]; // label of the flash area holding it
+  uint32_t size;
+  uint32_t crc;
+
+  bool valid() const { return magic == MESH_OTA_IMAGE_MAGIC && crc == checksum(); }
+  void clear() { memset(this, 0, sizeof(*this)); }
+  void seal()
+  {
+    magic = MESH_OTA_IMAGE_MAGIC;
+    crc = checksum();
+  }
+  uint32_t checksum() const { return crc32(this, offsetof(MeshOtaImage, crc)); }
+  uint32_t parts(uint32_t partBytes) const { return (size + partBytes - 1) / partBytes; }
+};
+
+class MeshOtaServer
+{
+public:
+  struct Config
+  {
+    uint16_t partsPerSec = 8; // sustained rate over all nodes
+    uint8_t burst = 4;        // parts that may go out back to back
+  };
+
+  struct Request
+  {
+    uint32_t node;
+    uint32_t part;
+    bool fresh; // set by next(): first time this tracked node gets `part`
+  };
+
+  struct Node
+  {
+    uint32_t id;
+    uint32_t served;  // replies sent
+    uint32_t repeats; // parts served more than once
+    uint32_t next;    // highest part served + 1
+    uint32_t lastAt;  // ms of the last request
+    bool done;
+  };
+
+  struct Stats
+  {
+    uint32_t requests, served, duplicates, dropped, held;
+  };
+
+  // Starts serving an image of `parts` parts; forgets all progress.
+  void begin(uint32_t parts, const Config &cfg, uint32_t nowMs);
+  void stop() { m_parts = 0; }
+  bool active() const { return m_parts != 0; }
+  uint32_t parts() const { return m_parts; }
+
+  // A node asked for `part`. False when not queued (duplicate, full queue,
+  // part out of range); the node asks again after its timeout.
+  bool request(uint32_t node, uint32_t part, uint32_t nowMs);
+  // The request to answer now, if pacing allows and `hold` is false.
+  bool next(uint32_t nowMs, bool hold, Request &out);
+
+  uint8_t nodes() const { return m_nodeCount; }
+  const Node &node(uint8_t i) const { return m_nodes[i]; }
+  // Share of the image a node has received, 0-100.
+  uint8_t percent(const Node &n) const { return m_parts ? (uint8_t)((uint64_t)n.next * 100 / m_parts) : 0; }
+  const Stats &stats() const { return m_stats; }
+
+private:
+  Node *track(uint32_t node, uint32_t nowMs);
+
+  Config m_cfg;
+  uint32_t m_parts = 0;
+  uint32_t m_tokensMilli = 0; // tokens * 1000
+  uint32_t m_refillAt = 0;
+  Request m_queue[MESH_OTA_QUEUE];
+  uint8_t m_head = 0, m_count = 0;
+  Node m_nodes[MESH_OTA_MAX_NODES];
+  uint8_t m_nodeCount = 0;
+  Stats m_stats = {};
+};
@@ -0,0 +1,86 @@
+#include "Metrics.h"
+
+#include <stdio.h>
+
+LatencyHistogram::LatencyHistogram(const uint32_t *boundsUs, uint8_t bounds)
+    : m_boundsUs(boundsUs), m_bounds(bounds > METRICS_MAX_BUCKETS ? METRICS_MAX_BUCKETS : bounds)
+{
+  for (auto &b : m_buckets)
+    b.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(uint32_t us)
+{
+  uint8_t i = 0;
+  while (i < m_bounds && us > m_boundsUs[i])
+    i++;
+  m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+
+  m_remUs += us % 1000;
+  uint32_t ms = us / 1000 + m_remUs / 1000;
+  m_remUs %= 1000;
+  if (ms)
+    m_sumMs.fetch_add(ms, std::memory_order_relaxed);
+}
+
+void PromWriter::write(const char *data, size_t len)
+{
+  m_sink(data, len, m_ctx);
+  m_bytes += len;
+}
+
+void PromWriter::family(const char *name, const char *type, const char *help)
+{
+  char line[192];
+  int n = snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  if (n > 0)
+    write(line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+}
+
+void PromWriter::sampleText(const char *name, const char *suffix, const char *labels, const char *extra,
+                            const char *value)
+{
+  bool hasLabels = labels && *labels;
+  bool hasExtra = extra && *extra;
+  char line[192];
+  int n = snprintf(line, sizeof(line), "%s%s%s%s%s%s%s %s\n", name, suffix,
+                   hasLabels || hasExtra ? "{" : "", hasLabels ? labels : "",
+                   hasLabels && hasExtra ? "," : "", hasExtra ? extra : "",
+                   hasLabels || hasExtra ? "}" : "", value);
+  if (n > 0 && (size_t)n < sizeof(line))
+    write(line, n);
+}
+
+void PromWriter::sample(const char *name, const char *labels, uint32_t value)
+{
+  char v[12];
+  snprintf(v, sizeof(v), "%u", (unsigned)value);
+  sampleText(name, "", labels, nullptr, v);
+}
+
+void PromWriter::sample(const char *name, const char *labels, double value)
+{
+  char v[24];
+  snprintf(v, sizeof(v), "%.6g", value);
+  sampleText(name, "", labels, nullptr, v);
+}
+
+void PromWriter::histogram(const char *name, const char *labels, const LatencyHistogram &h)
+{
+  char le[24], v[24];
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i <= h.bounds(); i++)
+  {
+    cumulative += h.bucket(i);
+    if (i < h.bounds())
+      snprintf(le, sizeof(le), "le=\"%g\"", h.bound(i) / 1e6);
+    else
+      snprintf(le, sizeof(le), "le=\"+Inf\"");
+    snprintf(v, sizeof(v), "%u", (unsigned)cumulative);
+    sampleText(name, "_bucket", labels, le, v);
+  }
+  snprintf(v, sizeof(v), "%.3f", h.sumMs() / 1000.0);
+  sampleText(name, "_sum", labels, nullptr, v);
+  snprintf(v, sizeof(v), "%u", (unsigned)cumulative);
+  sampleText(name, "_count", labels, nullptr, v);
+}
@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Metrics – lock-free counters/histograms + Prometheus text output
+ * -------------------------------------------------------
+ * • Every value is a relaxed std::atomic<uint32_t>: recording is one
+ *   atomic add (no lock, no heap), scraping may run on any task
+ * • Histogram buckets are counted individually; the exported count is
+ *   their sum, so +Inf always equals _count even mid-update
+ * • Histogram sums are kept in whole milliseconds (32-bit lasts 49 days
+ *   of accumulated time); the sub-ms remainder is per-histogram writer
+ *   state, so each histogram needs a single writer task
+ * • PromWriter renders the text exposition format into a sink
+ *   (AsyncResponseStream on the device, std::string in host tests)
+ *********************************************************************/
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_MAX_BUCKETS 12
+
+class MetricCounter
+{
+public:
+  void add(uint32_t n = 1) { m_v.fetch_add(n, std::memory_order_relaxed); }
+  uint32_t value() const { return m_v.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint32_t> m_v{0};
+};
+
+class MetricGauge
+{
+public:
+  void set(uint32_t v) { m_v.store(v, std::memory_order_relaxed); }
+  uint32_t value() const { return m_v.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint32_t> m_v{0};
+};
+
+// Durations in microseconds against fixed upper bounds (ascending, µs).
+class LatencyHistogram
+{
+public:
+  LatencyHistogram(const uint32_t *boundsUs, uint8_t bounds);
+
+  void record(uint32_t us);
+
+  uint8_t bounds() const { return m_bounds; }
+  uint32_t bound(uint8_t i) const { return m_boundsUs[i]; }
+  // Non-cumulative count of bucket i; i == bounds() is the +Inf overflow.
+  uint32_t bucket(uint8_t i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+  uint32_t sumMs() const { return m_sumMs.load(std::memory_order_relaxed); }
+
+private:
+  const uint32_t *m_boundsUs;
+  uint8_t m_bounds;
+  std::atomic<uint32_t> m_buckets[METRICS_MAX_BUCKETS + 1];
+  std::atomic<uint32_t> m_sumMs{0};
+  uint32_t m_remUs = 0; // writer only
+};
+
+typedef void (*PromSink)(const char *data, size_t len, void *ctx);
+
+// Writes one metric family at a time:
+//   w.family("x_total", "counter", "help"); w.sample("x_total", "a=\"b\"", 3);
+class PromWriter
+{
+public:
+  PromWriter(PromSink sink, void *ctx) : m_sink(sink), m_ctx(ctx) {}
+
+  void family(const char *name, const char *type, const char *help);
+  // `labels` is the inside of {...} without braces, or nullptr.
+  void sample(const char *name, const char *labels, uint32_t value);
+  void sample(const char *name, const char *labels, double value);
+  // _bucket / _sum / _count series, values in seconds.
+  void histogram(const char *name, const char *labels, const LatencyHistogram &h);
+
+  size_t bytes() const { return m_bytes; }
+
+private:
+  void write(const char *data, size_t len);
+  void sampleText(const char *name, const char *suffix, const char *labels, const char *extra,
+                  const char *value);
+
+  PromSink m_sink;
+  void *m_ctx;
+  size_t m_bytes = 0;
+};
@@ -0,0 +1,110 @@
+#include "MqttSession.h"
+
+#include <string.h>
+
+void MqttSession::begin(const MqttTransport &t, const MqttSessionConfig &cfg, uint32_t seed, uint32_t nowMs)
+{
+  m_t = t;
+  m_cfg = cfg;
+  m_rng = seed ? seed : 1;
+  m_state = WAITING;
+  m_delayMs = 0;
+  m_nextAttemptMs = nowMs;
+  m_downSinceMs = nowMs;
+}
+
+void MqttSession::stop()
+{
+  m_state = STOPPED;
+}
+
+MqttSession::Event MqttSession::step(uint32_t nowMs)
+{
+  if (m_state == STOPPED)
+    return NONE;
+  if (m_state == CONNECTED)
+  {
+    m_t.poll(m_t.ctx);
+    if (m_t.connected(m_t.ctx))
+      return NONE;
+    m_stats.losses++;
+    m_state = WAITING;
+    m_downSinceMs = nowMs;
+    m_delayMs = 0;
+    m_nextAttemptMs = nowMs;
+    return LOST;
+  }
+  if ((int32_t)(nowMs - m_nextAttemptMs) < 0)
+    return NONE;
+
+  m_stats.attempts++;
+  if (m_t.connect(m_t.ctx))
+  {
+    m_stats.connects++;
+    m_state = CONNECTED;
+    m_delayMs = 0;
+    m_lastReconnectMs = nowMs - m_downSinceMs;
+    return UP;
+  }
+  m_nextAttemptMs = nowMs + nextDelay();
+  return FAILED;
+}
+
+void MqttSession::published(uint32_t messages)
+{
+  m_stats.publishes++;
+  m_stats.messages += messages;
+}
+
+void MqttSession::publishFailed()
+{
+  m_stats.publishFailures++;
+}
+
+uint32_t MqttSession::retryInMs(uint32_t nowMs) const
+{
+  if (m_state != WAITING || (int32_t)(m_nextAttemptMs - nowMs) < 0)
+    return 0;
+  return m_nextAttemptMs - nowMs;
+}
+
+uint32_t MqttSession::nextDelay()
+{
+  m_delayMs = m_delayMs ? m_delayMs * 2 : m_cfg.backoffMinMs;
+  if (m_delayMs > m_cfg.backoffMaxMs)
+    m_delayMs = m_cfg.backoffMaxMs;
+  // xorshift32
+  m_rng ^= m_rng << 13;
+  m_rng ^= m_rng >> 17;
+  m_rng ^= m_rng << 5;
+  uint32_t half = m_delayMs / 2;
+  return half + (half ? m_rng % (m_delayMs - half + 1) : 0);
+}
+
+MqttBatchWriter::MqttBatchWriter(char *buf, size_t cap) : m_buf(buf), m_cap(cap)
+{
+  if (cap)
+    m_buf[0] = '[';
+}
+
+bool MqttBatchWriter::add(const char *msg, size_t len)
+{
+  // separator + message + closing bracket + NUL
+  if (m_len + (m_count ? 1 : 0) + len + 2 > m_cap)
+    return false;
+  if (m_count)
+    m_buf[m_len++] = ',';
+  memcpy(m_buf + m_len, msg, len);
+  m_len += len;
+  m_count++;
+  return true;
+}
+
+size_t MqttBatchWriter::finish()
+{
+  if (!m_count)
+    return 0;
+  m_buf[m_len] = ']';
+  m_buf[m_len + 1] = '\0';
+  return m_len + 1;
+}
@@ -0,0 +1,113 @@
+/*********************************************************************
+ * MqttSession – MQTT connection state machine for the uplink task
+ * -------------------------------------------------------
+ * • step() is called on every uplink pass: it services keepalive
+ *   (client loop) while connected, notices a lost link and starts one
+ *   bounded connect attempt when the backoff has elapsed. Publishing
+ *   never connects inline.
+ * • Backoff doubles from minMs to maxMs; each delay is drawn from
+ *   [delay/2, delay] ("equal jitter") so gateways that lost the broker
+ *   together do not reconnect together
+ * • Reconnect latency: from the moment the link was found down (or the
+ *   session started) until a connect succeeds
+ * • MqttBatchWriter coalesces queued JSON messages into one publish as
+ *   a JSON array, in a caller-owned buffer
+ * • The client is reached through a small function table, so host
+ *   tests drive the same code with a fake broker
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct MqttTransport
+{
+  bool (*connect)(void *ctx);   // one blocking attempt (bounded by socket timeouts)
+  bool (*connected)(void *ctx); // link state as the client sees it
+  void (*poll)(void *ctx);      // keepalive / inbound packets (PubSubClient::loop)
+  void *ctx;
+};
+
+struct MqttSessionConfig
+{
+  uint32_t backoffMinMs = 1000;
+  uint32_t backoffMaxMs = 60000;
+};
+
+class MqttSession
+{
+public:
+  enum State : uint8_t
+  {
+    STOPPED = 0, // no transport (other protocol selected)
+    WAITING,     // down, next attempt at m_nextAttemptMs
+    CONNECTED
+  };
+
+  enum Event : uint8_t
+  {
+    NONE = 0,
+    UP,     // connect succeeded; lastReconnectMs() is valid
+    FAILED, // connect attempt failed; retry in retryInMs()
+    LOST    // link dropped while connected
+  };
+
+  struct Stats
+  {
+    uint32_t attempts = 0;
+    uint32_t connects = 0;
+    uint32_t losses = 0;
+    uint32_t publishes = 0; // successful publish calls
+    uint32_t messages = 0;  // queued messages carried by them
+    uint32_t publishFailures = 0;
+  };
+
+  void begin(const MqttTransport &t, const MqttSessionConfig &cfg, uint32_t seed, uint32_t nowMs);
+  void stop();
+
+  // Uplink task: keepalive, loss detection, reconnect when due.
+  Event step(uint32_t nowMs);
+
+  // Bookkeeping around a publish; a failed publish on a dead link moves
+  // the session to WAITING on the next step().
+  void published(uint32_t messages);
+  void publishFailed();
+
+  bool connected() const { return m_state == CONNECTED; }
+  State state() const { return m_state; }
+  uint32_t lastReconnectMs() const { return m_lastReconnectMs; }
+  uint32_t retryInMs(uint32_t nowMs) const;
+  const Stats &stats() const { return m_stats; }
+
+private:
+  uint32_t nextDelay();
+
+  MqttTransport m_t = {};
+  MqttSessionConfig m_cfg;
+  State m_state = STOPPED;
+  uint32_t m_rng = 1;
+  uint32_t m_delayMs = 0; // current backoff ceiling, 0 = next attempt is immediate
+  uint32_t m_nextAttemptMs = 0;
+  uint32_t m_downSinceMs = 0;
+  uint32_t m_lastReconnectMs = 0;
+  Stats m_stats;
+};
+
+// "[m1,m2,...]" into a fixed buffer.
+class MqttBatchWriter
+{
+public:
+  MqttBatchWriter(char *buf, size_t cap);
+
+  // Appends one JSON message; false (buffer unchanged) when it does not fit.
+  bool add(const char *msg, size_t len);
+  // Closes the array; returns its length (0 if empty).
+  size_t finish();
+  uint16_t count() const { return m_count; }
+
+private:
+  char *m_buf;
+  size_t m_cap;
+  size_t m_len = 1;
+  uint16_t m_count = 0;
+};
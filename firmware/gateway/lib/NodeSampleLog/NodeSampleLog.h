@@ -0,0 +1,122 @@
+/*********************************************************************
+ * NodeSampleLog – sample ring that survives deep sleep (RTC memory)
+ * -------------------------------------------------------
+ * • Plain aggregate with no constructor: declared RTC_DATA_ATTR it is
+ *   zeroed on cold boot and left alone on wake; a magic + CRC tells a
+ *   valid log from garbage (brown-out, firmware change)
+ * • Readings are stored in TelemetryFrame wire form (tag + int16), so a
+ *   batch goes out without re-scaling
+ * • Full ring drops the oldest sample
+ * • Also keeps the values last transmitted, for threshold-triggered sends
+ *********************************************************************/
+#pragma once
+
+#include <Crc32.h>
+#include <TelemetryFrame.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NODE_SAMPLE_LOG_MAGIC 0x4E534C31 // "NSL1"
+
+struct NodeSampleReading
+{
+  uint8_t tag; // sensor << 2 | field, as in TelemetryFrame
+  int16_t raw; // telemetryScale() units
+};
+
+template <uint8_t Slots, uint8_t MaxReadings>
+struct NodeSampleLog
+{
+  struct Entry
+  {
+    uint32_t t; // node clock (s) when sampled
+    uint8_t n;
+    NodeSampleReading r[MaxReadings];
+  };
+
+  uint32_t magic;
+  uint32_t clockSec; // seconds slept + awake since the log was created
+  uint8_t head, count;
+  uint16_t wakes; // samples taken since the last transmission
+  Entry entries[Slots];
+  uint8_t sentN;
+  NodeSampleReading sent[MaxReadings];
+  uint32_t crc;
+
+  bool valid() const { return magic == NODE_SAMPLE_LOG_MAGIC && crc == checksum(); }
+
+  void reset()
+  {
+    memset(this, 0, sizeof(*this));
+    magic = NODE_SAMPLE_LOG_MAGIC;
+    seal();
+  }
+
+  // Call after every change, before sleeping.
+  void seal() { crc = checksum(); }
+
+  bool full() const { return count == Slots; }
+
+  // Batch policy: transmit every `batchWakes` samples or when the ring is full.
+  bool due(uint16_t batchWakes) const { return full() || wakes >= batchWakes; }
+
+  // Oldest first.
+  const Entry &at(uint8_t i) const { return entries[(head + i) % Slots]; }
+
+  // Returns false when the oldest sample had to be overwritten.
+  bool append(uint32_t t, const NodeSampleReading *r, uint8_t n)
+  {
+    bool kept = !full();
+    if (!kept)
+    {
+      head = (head + 1) % Slots;
+      count--;
+    }
+    Entry &e = entries[(head + count) % Slots];
+    e.t = t;
+    e.n = n < MaxReadings ? n : MaxReadings;
+    memcpy(e.r, r, e.n * sizeof(NodeSampleReading));
+    count++;
+    wakes++;
+    return kept;
+  }
+
+  // True if any reading moved by at least delta[field] (raw units, 0 = off)
+  // from the value last transmitted, or was not transmitted at all.
+  bool crossed(const NodeSampleReading *r, uint8_t n, const int16_t delta[FIELD_COUNT]) const
+  {
+    for (uint8_t i = 0; i < n; i++)
+    {
+      int32_t d = delta[r[i].tag & 3];
+      if (d <= 0)
+        continue;
+      const NodeSampleReading *prev = nullptr;
+      for (uint8_t k = 0; k < sentN && !prev; k++)
+        if (sent[k].tag == r[i].tag)
+          prev = &sent[k];
+      if (!prev)
+        return true;
+      int32_t diff = (int32_t)r[i].raw - prev->raw;
+      if (diff >= d || -diff >= d)
+        return true;
+    }
+    return false;
+  }
+
+  // The batch is out: forget it and remember the newest values.
+  void markSent()
+  {
+    if (count)
+    {
+      const Entry &last = at(count - 1);
+      sentN = last.n;
+      memcpy(sent, last.r, last.n * sizeof(NodeSampleReading));
+    }
+    head = count = 0;
+    wakes = 0;
+  }
+
+private:
+  uint32_t checksum() const { return crc32(this, offsetof(NodeSampleLog, crc)); }
+};
@@ -0,0 +1,187 @@
+#include "OtaUpdate.h"
+
+int otaCompareVersions(const char *a, const char *b)
+{
+  while (*a || *b)
+  {
+    unsigned long x = 0, y = 0;
+    while (*a >= '0' && *a <= '9')
+      x = x * 10 + (unsigned long)(*a++ - '0');
+    while (*b >= '0' && *b <= '9')
+      y = y * 10 + (unsigned long)(*b++ - '0');
+    if (x != y)
+      return x < y ? -1 : 1;
+    if (*a != '.' && *b != '.')
+      break; // both at the end or a suffix ("-dev")
+    if (*a == '.')
+      a++;
+    if (*b == '.')
+      b++;
+  }
+  return 0;
+}
+
+static int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+bool otaParseHex(const char *hex, uint8_t *out, size_t n)
+{
+  if (!hex || strlen(hex) != 2 * n)
+    return false;
+  for (size_t i = 0; i < n; i++)
+  {
+    int hi = hexDigit(hex[2 * i]), lo = hexDigit(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0)
+      return false;
+    out[i] = (uint8_t)(hi << 4 | lo);
+  }
+  return true;
+}
+
+bool otaSameImage(const OtaManifest &a, const OtaManifest &b)
+{
+  if (a.hasSha && b.hasSha)
+    return !memcmp(a.sha256, b.sha256, OTA_SHA256_BYTES);
+  return !strcmp(a.url, b.url) && !strcmp(a.etag, b.etag) && !strcmp(a.version, b.version);
+}
+
+OtaDecision otaDecide(const OtaManifest &m, const char *runningVersion, const OtaCache &cache)
+{
+  if (!m.url[0])
+    return OTA_UP_TO_DATE;
+  if (m.version[0])
+  {
+    if (otaCompareVersions(m.version, runningVersion) <= 0)
+      return OTA_UP_TO_DATE;
+  }
+  else if (!m.etag[0] || (cache.valid() && !strcmp(cache.installedEtag, m.etag)))
+  {
+    return OTA_UP_TO_DATE; // without a version or ETag there is no telling; do not flash blindly
+  }
+  if (cache.valid() && cache.failures >= OTA_MAX_FAILURES && otaSameImage(cache.last, m))
+    return OTA_GIVE_UP;
+  return OTA_DOWNLOAD;
+}
+
+const char *otaResultName(OtaResult r)
+{
+  static const char *const kNames[] = {"ok", "http error", "network error", "size mismatch", "flash error",
+                                       "hash mismatch"};
+  return r < sizeof(kNames) / sizeof(kNames[0]) ? kNames[r] : "";
+}
+
+OtaResult OtaDownload::fail(const OtaIo &io, OtaResult r)
+{
+  if (m_begun)
+    io.end(io.ctx, false);
+  m_begun = false;
+  return r;
+}
+
+OtaResult OtaDownload::run(const OtaIo &io, const OtaManifest &m, uint8_t *buf, size_t cap,
+                           const OtaDownloadConfig &cfg)
+{
+  m_stats = Stats();
+  m_begun = false;
+  uint32_t size = m.size, offset = 0, backoff = cfg.backoffMs;
+  io.hashStart(io.ctx);
+  for (;;)
+  {
+    uint32_t total = 0;
+    int status = io.open(io.ctx, m.url, offset, total);
+    uint32_t skip = 0;
+    if (status == 200 && offset)
+    {
+      skip = offset; // Range ignored: the body starts at byte 0 again
+      m_stats.restarts++;
+    }
+    else if (status != (offset ? 206 : 200))
+    {
+      io.close(io.ctx);
+      if (status >= 0 && status < 500)
+        return fail(io, OTA_HTTP_ERROR);
+      total = 0; // no connection or a server error: retry like a drop
+      status = -1;
+    }
+
+    if (status > 0)
+    {
+      if (!m_begun)
+      {
+        if (!size)
+          size = total;
+        if (!size || (total && total != size))
+        {
+          io.close(io.ctx);
+          return fail(io, OTA_SIZE_MISMATCH);
+        }
+        if (!io.begin(io.ctx, size))
+        {
+          io.close(io.ctx);
+          return fail(io, OTA_FLASH_ERROR);
+        }
+        m_begun = true;
+      }
+      else if (total && total != size)
+      {
+        io.close(io.ctx);
+        return fail(io, OTA_SIZE_MISMATCH); // a new image was published mid-download
+      }
+
+      while (offset < size)
+      {
+        int n = io.read(io.ctx, buf, cap);
+        if (n <= 0)
+          break;
+        m_stats.fetched += (uint32_t)n;
+        const uint8_t *p = buf;
+        uint32_t use = (uint32_t)n;
+        if (skip)
+        {
+          uint32_t d = skip < use ? skip : use;
+          skip -= d;
+          p += d;
+          use -= d;
+        }
+        if (use > size - offset)
+          use = size - offset;
+        if (!use)
+          continue;
+        io.hashUpdate(io.ctx, p, use);
+        if (!io.write(io.ctx, p, use))
+        {
+          io.close(io.ctx);
+          return fail(io, OTA_FLASH_ERROR);
+        }
+        offset += use;
+        m_stats.written = offset;
+      }
+      io.close(io.ctx);
+      if (offset >= size)
+        break;
+    }
+
+    if (m_stats.resumes >= cfg.maxResumes)
+      return fail(io, m_begun ? OTA_NETWORK_ERROR : OTA_HTTP_ERROR);
+    m_stats.resumes++;
+    io.wait(io.ctx, backoff);
+    backoff *= 2;
+  }
+
+  uint8_t digest[OTA_SHA256_BYTES];
+  io.hashFinish(io.ctx, digest);
+  if (m.hasSha && memcmp(digest, m.sha256, OTA_SHA256_BYTES))
+    return fail(io, OTA_HASH_MISMATCH);
+  m_begun = false;
+  if (!io.end(io.ctx, true))
+    return OTA_FLASH_ERROR;
+  return OTA_OK;
+}
@@ -0,0 +1,139 @@
+/*********************************************************************
+ * OtaUpdate – conditional firmware check and resumable image download
+ * -------------------------------------------------------
+ * • A probe (manifest GET / image HEAD with If-None-Match) decides
+ *   whether to download at all; otaDecide() compares the offered version
+ *   (or, for a plain image URL, its ETag) with what is running
+ * • OtaCache keeps the last probe result (manifest, ETag, failures) as a
+ *   plain aggregate with a magic + CRC, stored in NVS by the firmware
+ * • An image that failed verification OTA_MAX_FAILURES times is not
+ *   fetched again until the manifest names a different one
+ * • OtaDownload streams the image to flash: a dropped connection resumes
+ *   with a Range request from the last byte written; a server that
+ *   ignores Range is read past what is already flashed
+ * • Every byte written is hashed; a SHA-256 mismatch aborts the update
+ * • HTTP, flash and hash are reached through a function table, so host
+ *   tests drive the same code with a fake server
+ *********************************************************************/
+#pragma once
+
+#include <Crc32.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define OTA_CACHE_MAGIC 0x4F544131 // "OTA1"
+#define OTA_SHA256_BYTES 32
+#define OTA_MAX_FAILURES 3 // verification / flash failures per image
+
+// What a probe offers. From a manifest:
+//   {"version": "1.3.5", "url": "https://…/fw.bin", "sha256": "<64 hex>", "size": 1234567}
+// From a plain image URL: url and the image's ETag / size, no version.
+struct OtaManifest
+{
+  char version[24]; // empty: unknown (plain image URL)
+  char url[192];    // the image
+  char etag[64];    // ETag of the probed resource (sent back as If-None-Match)
+  uint8_t sha256[OTA_SHA256_BYTES];
+  bool hasSha;
+  uint32_t size; // 0: taken from the download response
+};
+
+struct OtaCache
+{
+  uint32_t magic;
+  uint32_t source;        // crc32 of the firmwareUrl this was probed from
+  OtaManifest last;       // result of the last probe that returned a body
+  char installedEtag[64]; // plain image URL: ETag of the image we flashed
+  uint8_t failures;       // failed downloads of `last`
+  uint32_t crc;
+
+  bool valid() const { return magic == OTA_CACHE_MAGIC && crc == checksum(); }
+  void clear() { memset(this, 0, sizeof(*this)); }
+  void seal()
+  {
+    magic = OTA_CACHE_MAGIC;
+    crc = checksum();
+  }
+  uint32_t checksum() const { return crc32(this, offsetof(OtaCache, crc)); }
+};
+
+enum OtaDecision : uint8_t
+{
+  OTA_UP_TO_DATE = 0,
+  OTA_GIVE_UP, // this image failed OTA_MAX_FAILURES times
+  OTA_DOWNLOAD
+};
+
+// Dotted numeric versions ("1.3.10" > "1.3.9"); missing parts count as 0,
+// a non-numeric suffix is ignored. <0, 0, >0 like strcmp.
+int otaCompareVersions(const char *a, const char *b);
+// 2*n hex digits -> n bytes; false on a wrong length or a non-hex digit.
+bool otaParseHex(const char *hex, uint8_t *out, size_t n);
+// Same image: equal SHA-256 when both have one, otherwise same URL and ETag.
+bool otaSameImage(const OtaManifest &a, const OtaManifest &b);
+// Download only for a newer version (a plain image URL: an ETag we have not
+// flashed), and not again after OTA_MAX_FAILURES failures of the same image.
+OtaDecision otaDecide(const OtaManifest &m, const char *runningVersion, const OtaCache &cache);
+
+// Firmware side of a download. All callbacks get `ctx`.
+struct OtaIo
+{
+  // Requests the image from byte `offset` (a Range request when > 0).
+  // Returns the HTTP status, < 0 without a connection; `total` gets the
+  // full image size (Content-Length / Content-Range), 0 when unknown.
+  int (*open)(void *ctx, const char *url, uint32_t offset, uint32_t &total);
+  // Next body bytes (bounded wait): > 0 bytes read, <= 0 connection lost.
+  int (*read)(void *ctx, uint8_t *buf, size_t cap);
+  void (*close)(void *ctx);
+  bool (*begin)(void *ctx, uint32_t size);                   // open the OTA partition
+  bool (*write)(void *ctx, const uint8_t *data, size_t len); // in order, no gaps
+  bool (*end)(void *ctx, bool commit);                       // commit = false: abort
+  void (*hashStart)(void *ctx);
+  void (*hashUpdate)(void *ctx, const uint8_t *data, size_t len);
+  void (*hashFinish)(void *ctx, uint8_t out[OTA_SHA256_BYTES]);
+  void (*wait)(void *ctx, uint32_t ms); // backoff before a resume
+  void *ctx;
+};
+
+struct OtaDownloadConfig
+{
+  uint8_t maxResumes = 5;
+  uint32_t backoffMs = 2000; // doubles per resume
+};
+
+enum OtaResult : uint8_t
+{
+  OTA_OK = 0,
+  OTA_HTTP_ERROR,    // the server refused (4xx) or never answered
+  OTA_NETWORK_ERROR, // lost the connection more than maxResumes times
+  OTA_SIZE_MISMATCH, // no size, or the image changed during the download
+  OTA_FLASH_ERROR,
+  OTA_HASH_MISMATCH
+};
+
+const char *otaResultName(OtaResult r);
+
+class OtaDownload
+{
+public:
+  struct Stats
+  {
+    uint32_t fetched; // body bytes received, including re-sent ones
+    uint32_t written;
+    uint8_t resumes;  // reconnects after a lost connection
+    uint8_t restarts; // of those, answered from byte 0 (Range ignored)
+  };
+
+  // Downloads, verifies and (on OTA_OK) commits m.url; `buf` is the read
+  // buffer. Blocks until done.
+  OtaResult run(const OtaIo &io, const OtaManifest &m, uint8_t *buf, size_t cap,
+                const OtaDownloadConfig &cfg = OtaDownloadConfig());
+  const Stats &stats() const { return m_stats; }
+
+private:
+  OtaResult fail(const OtaIo &io, OtaResult r);
+
+  bool m_begun = false;
+  Stats m_stats = {};
+};
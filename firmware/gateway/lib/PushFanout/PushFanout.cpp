@@ -0,0 +1,158 @@
+#include "PushFanout.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+PushFanout::~PushFanout()
+{
+  end();
+}
+
+bool PushFanout::begin(const PushFanoutConfig &cfg)
+{
+  end();
+  m_cfg = cfg;
+  if (m_cfg.eventSlots == 0)
+    m_cfg.eventSlots = 1;
+  m_clients = (Client *)calloc(m_cfg.maxClients ? m_cfg.maxClients : 1, sizeof(Client));
+  m_latest = (char *)malloc(m_cfg.latestBytes);
+  m_events = (char *)malloc((size_t)m_cfg.eventSlots * m_cfg.eventBytes);
+  m_eventLen = (uint16_t *)calloc(m_cfg.eventSlots, sizeof(uint16_t));
+  if (!m_clients || !m_latest || !m_events || !m_eventLen)
+  {
+    end();
+    return false;
+  }
+  return true;
+}
+
+void PushFanout::end()
+{
+  free(m_clients);
+  free(m_latest);
+  free(m_events);
+  free(m_eventLen);
+  m_clients = nullptr;
+  m_latest = m_events = nullptr;
+  m_eventLen = nullptr;
+  m_clientCount = 0;
+  m_latestLen = 0;
+  m_latestVersion = 0;
+  m_eventHead = 0;
+}
+
+bool PushFanout::addClient(uint32_t id)
+{
+  if (!m_clients)
+    return false;
+  Client *slot = nullptr;
+  for (uint8_t i = 0; i < m_cfg.maxClients; i++)
+  {
+    if (m_clients[i].used && m_clients[i].id == id)
+      return true;
+    if (!m_clients[i].used && !slot)
+      slot = &m_clients[i];
+  }
+  if (!slot)
+  {
+    m_stats.rejected++;
+    return false;
+  }
+  slot->id = id;
+  slot->used = true;
+  slot->latestSent = 0;
+  slot->nextEvent = m_eventHead;
+  m_clientCount++;
+  return true;
+}
+
+void PushFanout::removeClient(uint32_t id)
+{
+  for (uint8_t i = 0; m_clients && i < m_cfg.maxClients; i++)
+  {
+    if (m_clients[i].used && m_clients[i].id == id)
+    {
+      m_clients[i].used = false;
+      m_clientCount--;
+      return;
+    }
+  }
+}
+
+bool PushFanout::publishLatest(const char *data, size_t len)
+{
+  if (!m_latest || len > m_cfg.latestBytes)
+  {
+    m_stats.oversize++;
+    return false;
+  }
+  // Anyone still holding the previous version never gets it: coalesced.
+  for (uint8_t i = 0; i < m_cfg.maxClients; i++)
+  {
+    if (m_clients[i].used && m_latestVersion && m_clients[i].latestSent != m_latestVersion)
+      m_stats.coalesced++;
+  }
+  memcpy(m_latest, data, len);
+  m_latestLen = len;
+  m_latestVersion++;
+  m_stats.frames++;
+  return true;
+}
+
+bool PushFanout::publishEvent(const char *data, size_t len)
+{
+  if (!m_events || len > m_cfg.eventBytes)
+  {
+    m_stats.oversize++;
+    return false;
+  }
+  memcpy(eventData(m_eventHead), data, len);
+  m_eventLen[m_eventHead % m_cfg.eventSlots] = (uint16_t)len;
+  m_eventHead++;
+  m_stats.frames++;
+  return true;
+}
+
+uint32_t PushFanout::pump(Ready ready, Send send, void *ctx)
+{
+  uint32_t sent = 0;
+  for (uint8_t i = 0; m_clients && i < m_cfg.maxClients; i++)
+  {
+    Client &c = m_clients[i];
+    if (!c.used)
+      continue;
+    bool pendingEvent = c.nextEvent != m_eventHead;
+    bool pendingLatest = m_latestVersion && c.latestSent != m_latestVersion;
+    if (!pendingEvent && !pendingLatest)
+      continue;
+    if (!ready(c.id, ctx))
+      continue;
+
+    uint32_t oldest = m_eventHead > m_cfg.eventSlots ? m_eventHead - m_cfg.eventSlots : 0;
+    if (c.nextEvent < oldest)
+    {
+      m_stats.skipped += oldest - c.nextEvent;
+      c.nextEvent = oldest;
+    }
+    bool ok = true;
+    while (ok && c.nextEvent != m_eventHead)
+    {
+      ok = send(c.id, eventData(c.nextEvent), m_eventLen[c.nextEvent % m_cfg.eventSlots], ctx);
+      if (ok)
+      {
+        c.nextEvent++;
+        sent++;
+      }
+    }
+    if (ok && pendingLatest)
+    {
+      if (send(c.id, m_latest, m_latestLen, ctx))
+      {
+        c.latestSent = m_latestVersion;
+        sent++;
+      }
+    }
+  }
+  m_stats.sent += sent;
+  return sent;
+}
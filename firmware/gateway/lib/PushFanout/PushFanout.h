@@ -0,0 +1,86 @@
+/*********************************************************************
+ * PushFanout – one-to-many live push with per-client coalescing
+ * -------------------------------------------------------
+ * • "Latest" channel (sensor samples): only the newest frame matters, so
+ *   a busy client simply gets the current one once it can take it
+ * • "Event" channel (forwarded mesh messages): a shared ring; each client
+ *   keeps a cursor and receives every event once, in order – unless it
+ *   falls a whole ring behind, then the missed ones are counted as skipped
+ * • Frames are stored once, not copied per client; no heap after begin()
+ * • Transport-agnostic and single-threaded: the caller supplies
+ *   ready/send callbacks and serialises calls
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct PushFanoutConfig
+{
+  uint8_t maxClients = 4;
+  uint8_t eventSlots = 8;      // mesh messages kept for clients that lag
+  uint16_t eventBytes = 1024;  // max size of one event frame
+  uint16_t latestBytes = 2304; // max size of the latest-sample frame
+};
+
+class PushFanout
+{
+public:
+  struct Stats
+  {
+    uint32_t frames = 0;    // published (latest + events)
+    uint32_t sent = 0;      // frames handed to a client
+    uint32_t coalesced = 0; // latest frames replaced before a busy client took them
+    uint32_t skipped = 0;   // events a client missed by lagging a whole ring
+    uint32_t oversize = 0;  // frames rejected by publish
+    uint32_t rejected = 0;  // clients refused by the limit
+  };
+
+  // ready(): may the client take frames now (e.g. its send queue is empty)?
+  // send(): false if the transport refused; the frame is retried next pump.
+  typedef bool (*Ready)(uint32_t client, void *ctx);
+  typedef bool (*Send)(uint32_t client, const char *data, size_t len, void *ctx);
+
+  ~PushFanout();
+
+  bool begin(const PushFanoutConfig &cfg);
+  void end();
+
+  // New clients start with the current latest frame and future events only.
+  bool addClient(uint32_t id);
+  void removeClient(uint32_t id);
+  uint8_t clientCount() const { return m_clientCount; }
+
+  bool publishLatest(const char *data, size_t len);
+  bool publishEvent(const char *data, size_t len);
+
+  // Sends whatever each ready client has not seen yet. Returns frames sent.
+  uint32_t pump(Ready ready, Send send, void *ctx);
+
+  const Stats &stats() const { return m_stats; }
+
+private:
+  struct Client
+  {
+    uint32_t id;
+    bool used;
+    uint32_t latestSent; // version of the last latest frame delivered
+    uint32_t nextEvent;  // sequence of the next event to deliver
+  };
+
+  char *eventData(uint32_t seq) { return m_events + (size_t)(seq % m_cfg.eventSlots) * m_cfg.eventBytes; }
+
+  PushFanoutConfig m_cfg;
+  Client *m_clients = nullptr;
+  uint8_t m_clientCount = 0;
+
+  char *m_latest = nullptr;
+  size_t m_latestLen = 0;
+  uint32_t m_latestVersion = 0; // 0 = nothing published yet
+
+  char *m_events = nullptr;
+  uint16_t *m_eventLen = nullptr;
+  uint32_t m_eventHead = 0; // sequence of the next event to publish
+
+  Stats m_stats;
+};
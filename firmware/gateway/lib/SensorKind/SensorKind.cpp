@@ -0,0 +1,61 @@
+#include "SensorKind.h"
+
+#include <string.h>
+
+namespace
+{
+  struct KindInfo
+  {
+    const char *name;
+    uint8_t fields;
+  };
+
+  // Indexed by SensorKind.
+  const KindInfo kKinds[(uint8_t)SensorKind::COUNT] = {
+      {"", 0},
+      {"cap_soil_moisture", FIELD_BIT(FIELD_MOISTURE)},
+      {"dht22", FIELD_BIT(FIELD_TEMP) | FIELD_BIT(FIELD_HUM)},
+      {"ds18b20", FIELD_BIT(FIELD_TEMP)},
+      {"bme280", FIELD_BIT(FIELD_TEMP) | FIELD_BIT(FIELD_HUM) | FIELD_BIT(FIELD_PRES)},
+      {"bmp280", FIELD_BIT(FIELD_TEMP) | FIELD_BIT(FIELD_PRES)},
+  };
+
+  const char *const kFieldNames[FIELD_COUNT] = {"moisture", "temp", "hum", "pres"};
+}
+
+SensorKind sensorKindFromString(const char *type)
+{
+  if (!type)
+    return SensorKind::UNKNOWN;
+  for (uint8_t k = 1; k < (uint8_t)SensorKind::COUNT; k++)
+  {
+    if (strcmp(type, kKinds[k].name) == 0)
+      return (SensorKind)k;
+  }
+  return SensorKind::UNKNOWN;
+}
+
+const char *sensorKindName(SensorKind kind)
+{
+  if ((uint8_t)kind >= (uint8_t)SensorKind::COUNT)
+    return "";
+  return kKinds[(uint8_t)kind].name;
+}
+
+uint8_t sensorKindFields(SensorKind kind)
+{
+  if ((uint8_t)kind >= (uint8_t)SensorKind::COUNT)
+    return 0;
+  return kKinds[(uint8_t)kind].fields;
+}
+
+const char *sensorFieldName(SensorField field)
+{
+  return field < FIELD_COUNT ? kFieldNames[field] : "";
+}
+
+bool sensorKindIsScalar(SensorKind kind)
+{
+  uint8_t f = sensorKindFields(kind);
+  return f != 0 && (f & (f - 1)) == 0;
+}
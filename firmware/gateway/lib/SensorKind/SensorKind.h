@@ -0,0 +1,58 @@
+/*********************************************************************
+ * SensorKind – typed sensor identity shared by firmware and host tests
+ * -------------------------------------------------------
+ * • The config "type" string is resolved once, at readConfig() time
+ * • Sampling dispatches on the enum, never on strings
+ * • SensorSample is a fixed-size value set (no heap)
+ *********************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+enum class SensorKind : uint8_t
+{
+  UNKNOWN = 0,
+  CAP_SOIL_MOISTURE,
+  DHT22,
+  DS18B20,
+  BME280,
+  BMP280,
+  COUNT
+};
+
+// Values a sensor can produce. Order matters: it is the key order used
+// in telemetry ("<name>_temp", "<name>_hum", ...).
+enum SensorField : uint8_t
+{
+  FIELD_MOISTURE = 0,
+  FIELD_TEMP,
+  FIELD_HUM,
+  FIELD_PRES,
+  FIELD_COUNT
+};
+
+#define FIELD_BIT(f) (uint8_t)(1u << (f))
+
+struct SensorSample
+{
+  float value[FIELD_COUNT];
+  uint8_t mask = 0;
+
+  void set(SensorField f, float v)
+  {
+    value[f] = v;
+    mask |= FIELD_BIT(f);
+  }
+  bool has(SensorField f) const { return mask & FIELD_BIT(f); }
+};
+
+// Config string -> kind. Unknown strings map to SensorKind::UNKNOWN.
+SensorKind sensorKindFromString(const char *type);
+// Kind -> config string ("cap_soil_moisture", ...); "" for UNKNOWN.
+const char *sensorKindName(SensorKind kind);
+// Bitmask of SensorField values the kind produces.
+uint8_t sensorKindFields(SensorKind kind);
+// Short field name used in telemetry keys ("moisture", "temp", "hum", "pres").
+const char *sensorFieldName(SensorField field);
+// True when the kind produces a single value, reported under the bare sensor name.
+bool sensorKindIsScalar(SensorKind kind);
@@ -0,0 +1,207 @@
+#include "TelemetryFrame.h"
+
+#include <Crc32.h>
+#include <IoTHubBatch.h>
+#include <math.h>
+#include <string.h>
+
+static_assert(FIELD_COUNT <= 4, "reading tag holds the field in 2 bits");
+
+namespace
+{
+  // Wire units per field: value = raw / scale.
+  const float kScale[FIELD_COUNT] = {100.0f, 100.0f, 100.0f, 10.0f};
+
+  uint16_t rd16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+}
+
+uint16_t telemetrySchemaId(const char *const *names, const SensorKind *kinds, uint8_t count)
+{
+  uint32_t c = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    c = crc32Update(c, names[i], strlen(names[i]) + 1);
+    c = crc32Update(c, &kinds[i], 1);
+  }
+  return (uint16_t)(c ^ c >> 16);
+}
+
+int16_t telemetryScale(SensorField field, float value)
+{
+  float v = roundf(value * kScale[field]);
+  if (!(v > -32768.0f)) // also catches NaN
+    return -32768;
+  if (v > 32767.0f)
+    return 32767;
+  return (int16_t)v;
+}
+
+float telemetryUnscale(SensorField field, int16_t raw)
+{
+  return raw / kScale[field];
+}
+
+TelemetryFrameWriter::TelemetryFrameWriter(uint8_t *buf, size_t cap) : m_buf(buf), m_cap(cap)
+{
+}
+
+bool TelemetryFrameWriter::put(const void *p, size_t n)
+{
+  if (!m_ok || m_len + n > m_cap)
+    return m_ok = false;
+  memcpy(m_buf + m_len, p, n);
+  m_len += n;
+  return true;
+}
+
+bool TelemetryFrameWriter::begin(const char *deviceId, const TelemetryFrameHeader &h)
+{
+  m_len = 0;
+  m_countAt = 0;
+  m_ok = true;
+  size_t idLen = strlen(deviceId);
+  if (idLen > TELEMETRY_FRAME_MAX_ID)
+    return m_ok = false;
+  uint8_t head[5] = {TELEMETRY_FRAME_MAGIC, TELEMETRY_FRAME_VERSION,
+                     (uint8_t)h.schema, (uint8_t)(h.schema >> 8), (uint8_t)idLen};
+  uint8_t tail[6] = {(uint8_t)h.rssi, (uint8_t)h.batteryMv, (uint8_t)(h.batteryMv >> 8),
+                     (uint8_t)h.sleepSec, (uint8_t)(h.sleepSec >> 8), h.hops};
+  uint8_t records = 0;
+  put(head, sizeof(head));
+  put(deviceId, idLen);
+  put(tail, sizeof(tail));
+  m_recordsAt = m_len;
+  return put(&records, 1);
+}
+
+bool TelemetryFrameWriter::beginRecord(uint16_t ageSec)
+{
+  if (!m_ok || m_buf[m_recordsAt] == 255)
+    return m_ok = false;
+  uint8_t rec[3] = {(uint8_t)ageSec, (uint8_t)(ageSec >> 8), 0};
+  if (!put(rec, sizeof(rec)))
+    return false;
+  m_buf[m_recordsAt]++;
+  m_countAt = m_len - 1;
+  return true;
+}
+
+bool TelemetryFrameWriter::add(uint8_t sensor, SensorField field, float value)
+{
+  if (sensor >= TELEMETRY_FRAME_MAX_SENSORS || field >= FIELD_COUNT)
+    return m_ok = false;
+  return addRaw((uint8_t)(sensor << 2 | field), telemetryScale(field, value));
+}
+
+bool TelemetryFrameWriter::addRaw(uint8_t tag, int16_t raw)
+{
+  if (!m_ok || !m_countAt || m_buf[m_countAt] == 255)
+    return m_ok = false;
+  uint8_t r[3] = {tag, (uint8_t)raw, (uint8_t)((uint16_t)raw >> 8)};
+  if (!put(r, sizeof(r)))
+    return false;
+  m_buf[m_countAt]++;
+  return true;
+}
+
+bool TelemetryFrameWriter::add(uint8_t sensor, const SensorSample &v)
+{
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+  {
+    if (v.has((SensorField)f) && !add(sensor, (SensorField)f, v.value[f]))
+      return false;
+  }
+  return m_ok;
+}
+
+size_t TelemetryFrameWriter::finish()
+{
+  return m_ok ? m_len : 0;
+}
+
+bool TelemetryFrameReader::open(const uint8_t *buf, size_t len)
+{
+  m_buf = nullptr;
+  if (len < 5 || buf[0] != TELEMETRY_FRAME_MAGIC || buf[1] != TELEMETRY_FRAME_VERSION)
+    return false;
+  size_t idLen = buf[4];
+  if (idLen > TELEMETRY_FRAME_MAX_ID || len < 5 + idLen + 7)
+    return false;
+  m_header.schema = rd16(buf + 2);
+  memcpy(m_id, buf + 5, idLen);
+  m_id[idLen] = '\0';
+  const uint8_t *p = buf + 5 + idLen;
+  m_header.rssi = (int8_t)p[0];
+  m_header.batteryMv = rd16(p + 1);
+  m_header.sleepSec = rd16(p + 3);
+  m_header.hops = p[5];
+  m_records = p[6];
+
+  // Walk the records once so the iterators never run past the end.
+  size_t pos = 5 + idLen + 7;
+  for (uint8_t r = 0; r < m_records; r++)
+  {
+    if (pos + 3 > len)
+      return false;
+    pos += 3 + (size_t)buf[pos + 2] * 3;
+    if (pos > len)
+      return false;
+  }
+  if (pos != len)
+    return false;
+
+  m_buf = buf;
+  m_len = len;
+  m_pos = 5 + idLen + 7;
+  m_recordsLeft = m_records;
+  m_readingsLeft = 0;
+  return true;
+}
+
+bool TelemetryFrameReader::nextRecord(uint16_t &ageSec)
+{
+  if (!m_buf)
+    return false;
+  m_pos += (size_t)m_readingsLeft * 3; // skip unread readings
+  m_readingsLeft = 0;
+  if (m_recordsLeft == 0)
+    return false;
+  m_recordsLeft--;
+  ageSec = rd16(m_buf + m_pos);
+  m_readingsLeft = m_buf[m_pos + 2];
+  m_pos += 3;
+  return true;
+}
+
+bool TelemetryFrameReader::nextReading(uint8_t &sensor, SensorField &field, float &value)
+{
+  while (m_readingsLeft)
+  {
+    const uint8_t *p = m_buf + m_pos;
+    m_pos += 3;
+    m_readingsLeft--;
+    if ((p[0] & 3) >= FIELD_COUNT)
+      continue;
+    sensor = p[0] >> 2;
+    field = (SensorField)(p[0] & 3);
+    value = telemetryUnscale(field, (int16_t)rd16(p + 1));
+    return true;
+  }
+  return false;
+}
+
+size_t telemetryFrameToText(const uint8_t *frame, size_t len, char *out, size_t cap)
+{
+  if (cap < 1)
+    return 0;
+  out[0] = TELEMETRY_FRAME_PREFIX;
+  size_t n = base64Encode(frame, len, out + 1, cap - 1);
+  return n ? n + 1 : 0;
+}
+
+size_t telemetryFrameFromText(const char *text, size_t len, uint8_t *out, size_t cap)
+{
+  if (len < 2 || text[0] != TELEMETRY_FRAME_PREFIX)
+    return 0;
+  return base64Decode(text + 1, len - 1, out, cap);
+}
@@ -0,0 +1,97 @@
+/*********************************************************************
+ * TelemetryFrame – compact binary node telemetry (mesh payload)
+ * -------------------------------------------------------
+ * • Sensors are referenced by their config index, values are int16
+ *   scaled per field (0.01 % / °C / %RH, 0.1 hPa)
+ * • Sensor names, kinds and firmware version travel separately in a
+ *   schema announcement; frames carry only its 16-bit id
+ * • One frame holds several records (samples) with their age in seconds
+ * • Versioned: readers reject frames with an unknown version byte
+ * • Mesh text form: TELEMETRY_FRAME_PREFIX + base64 (painlessMesh
+ *   payloads are strings); JSON messages start with '{' instead
+ *
+ * Layout v1 (little-endian):
+ *   u8 magic, u8 version, u16 schema, u8 idLen, id[idLen],
+ *   i8 rssi, u16 battery mV, u16 sleep s, u8 hops, u8 records,
+ *   records × { u16 age s, u8 n, n × { u8 sensor<<2 | field, i16 value } }
+ *********************************************************************/
+#pragma once
+
+#include <SensorKind.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_FRAME_MAGIC 0xD7
+#define TELEMETRY_FRAME_VERSION 1
+#define TELEMETRY_FRAME_PREFIX '~'
+#define TELEMETRY_FRAME_MAX_SENSORS 64 // 6-bit sensor index
+#define TELEMETRY_FRAME_MAX_ID 32
+
+struct TelemetryFrameHeader
+{
+  uint16_t schema = 0;
+  int8_t rssi = 0;
+  uint16_t batteryMv = 0;
+  uint16_t sleepSec = 0;
+  uint8_t hops = 0;
+};
+
+// Identifies a node's sensor table (names + kinds, in config order).
+uint16_t telemetrySchemaId(const char *const *names, const SensorKind *kinds, uint8_t count);
+
+// Wire value <-> float for a field (saturates at the int16 range).
+int16_t telemetryScale(SensorField field, float value);
+float telemetryUnscale(SensorField field, int16_t raw);
+
+class TelemetryFrameWriter
+{
+public:
+  TelemetryFrameWriter(uint8_t *buf, size_t cap);
+
+  bool begin(const char *deviceId, const TelemetryFrameHeader &h);
+  bool beginRecord(uint16_t ageSec);
+  bool add(uint8_t sensor, SensorField field, float value);
+  bool add(uint8_t sensor, const SensorSample &v);
+  // Already scaled reading (tag = sensor << 2 | field).
+  bool addRaw(uint8_t tag, int16_t raw);
+  // Frame length, 0 if anything did not fit.
+  size_t finish();
+  size_t length() const { return m_len; }
+
+private:
+  bool put(const void *p, size_t n);
+
+  uint8_t *m_buf;
+  size_t m_cap;
+  size_t m_len = 0;
+  size_t m_recordsAt = 0;
+  size_t m_countAt = 0; // reading count of the open record, 0 = none
+  bool m_ok = false;
+};
+
+class TelemetryFrameReader
+{
+public:
+  // Validates the whole frame up front; false on bad magic/version/length.
+  bool open(const uint8_t *buf, size_t len);
+
+  const TelemetryFrameHeader &header() const { return m_header; }
+  const char *deviceId() const { return m_id; }
+  uint8_t records() const { return m_records; }
+
+  bool nextRecord(uint16_t &ageSec);
+  // Readings of the current record.
+  bool nextReading(uint8_t &sensor, SensorField &field, float &value);
+
+private:
+  const uint8_t *m_buf = nullptr;
+  size_t m_len = 0, m_pos = 0;
+  TelemetryFrameHeader m_header;
+  char m_id[TELEMETRY_FRAME_MAX_ID + 1];
+  uint8_t m_records = 0, m_recordsLeft = 0, m_readingsLeft = 0;
+};
+
+// Mesh text form. encode returns chars written (with prefix, no NUL), 0 if cap is short.
+size_t telemetryFrameToText(const uint8_t *frame, size_t len, char *out, size_t cap);
+// Returns frame length, 0 if `text` is not a valid frame text.
+size_t telemetryFrameFromText(const char *text, size_t len, uint8_t *out, size_t cap);
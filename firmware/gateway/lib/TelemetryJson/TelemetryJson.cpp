@@ -0,0 +1,207 @@
+#include "TelemetryJson.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  // Writes `s` as a JSON string literal; returns its length, 0 if `cap` is short.
+  size_t quote(const char *s, char *out, size_t cap)
+  {
+    size_t n = 0;
+    char esc[8];
+    if (cap < 2)
+      return 0;
+    out[n++] = '"';
+    for (; *s; s++)
+    {
+      const char *part = esc;
+      size_t len;
+      if (*s == '"' || *s == '\\')
+      {
+        esc[0] = '\\';
+        esc[1] = *s;
+        len = 2;
+      }
+      else if ((uint8_t)*s < 0x20)
+        len = snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)(uint8_t)*s);
+      else
+      {
+        part = s;
+        len = 1;
+      }
+      if (n + len + 1 > cap)
+        return 0;
+      memcpy(out + n, part, len);
+      n += len;
+    }
+    if (n + 1 > cap)
+      return 0;
+    out[n++] = '"';
+    return n;
+  }
+}
+
+void sensorKeysBuild(SensorKeys &out, const char *name, SensorKind kind)
+{
+  uint8_t fields = sensorKindFields(kind);
+  bool scalar = sensorKindIsScalar(kind);
+  char key[TELEMETRY_KEY_BYTES];
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+  {
+    out.len[f] = 0;
+    if (!(fields & FIELD_BIT(f)))
+      continue;
+    if (scalar)
+      snprintf(key, sizeof(key), "%s", name);
+    else
+      snprintf(key, sizeof(key), "%s_%s", name, sensorFieldName((SensorField)f));
+    size_t n = quote(key, out.text[f], sizeof(out.text[f]) - 1);
+    if (!n)
+      continue;
+    out.text[f][n++] = ':';
+    out.len[f] = (uint8_t)n;
+  }
+}
+
+size_t sensorKeysMaxBytes(const SensorKeys &keys)
+{
+  size_t n = 0;
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+    if (keys.len[f])
+      n += 1 + keys.len[f] + TELEMETRY_NUMBER_BYTES;
+  return n;
+}
+
+size_t sensorKeysStatBytes(const SensorKeys &keys, size_t suffixLen)
+{
+  size_t n = 0;
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+    if (keys.len[f])
+      n += 1 + keys.len[f] + suffixLen + TELEMETRY_NUMBER_BYTES;
+  return n;
+}
+
+JsonWriter::JsonWriter(char *buf, size_t cap) : m_buf(buf), m_cap(cap), m_ok(cap > 0)
+{
+  put('{');
+}
+
+void JsonWriter::string(const char *key, const char *value)
+{
+  name(key);
+  if (!m_ok)
+    return;
+  size_t n = quote(value, m_buf + m_len, m_cap - m_len - 1);
+  if (n)
+    m_len += n;
+  else
+    m_ok = false;
+}
+
+void JsonWriter::number(const char *key, double v, uint8_t digits)
+{
+  name(key);
+  value(v, digits);
+}
+
+void JsonWriter::integer(const char *key, long v)
+{
+  name(key);
+  char text[24];
+  int n = snprintf(text, sizeof(text), "%ld", v);
+  raw(text, n);
+}
+
+void JsonWriter::boolean(const char *key, bool v)
+{
+  name(key);
+  raw(v ? "true" : "false", v ? 4 : 5);
+}
+
+void JsonWriter::sample(const SensorKeys &keys, const SensorSample &v)
+{
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+  {
+    if (!keys.len[f] || !v.has((SensorField)f))
+      continue;
+    if (!m_first)
+      put(',');
+    m_first = false;
+    raw(keys.text[f], keys.len[f]);
+    value(v.value[f], 7);
+  }
+}
+
+void JsonWriter::statistic(const SensorKeys &keys, SensorField f, const char *suffix, double v, uint8_t digits)
+{
+  if (!keys.len[f])
+    return;
+  if (!m_first)
+    put(',');
+  m_first = false;
+  raw(keys.text[f], keys.len[f] - 2); // without the closing "\":"
+  raw(suffix, strlen(suffix));
+  raw("\":", 2);
+  value(v, digits);
+}
+
+size_t JsonWriter::finish()
+{
+  put('}');
+  if (!m_ok)
+    return 0;
+  m_buf[m_len] = '\0';
+  return m_len;
+}
+
+void JsonWriter::restore(size_t mark)
+{
+  m_len = mark;
+  m_first = mark <= 1; // only the '{'
+  m_ok = m_cap > 0;
+}
+
+void JsonWriter::name(const char *key)
+{
+  if (!m_first)
+    put(',');
+  m_first = false;
+  if (!m_ok)
+    return;
+  size_t n = quote(key, m_buf + m_len, m_cap - m_len - 1);
+  if (n)
+    m_len += n;
+  else
+    m_ok = false;
+  put(':');
+}
+
+void JsonWriter::value(double v, uint8_t digits)
+{
+  if (isnan(v) || isinf(v))
+  {
+    raw("null", 4);
+    return;
+  }
+  char text[TELEMETRY_NUMBER_BYTES + 8];
+  int n = snprintf(text, sizeof(text), "%.*g", digits, v);
+  raw(text, n > 0 ? n : 0);
+}
+
+void JsonWriter::raw(const char *s, size_t len)
+{
+  if (m_ok && m_len + len < m_cap)
+  {
+    memcpy(m_buf + m_len, s, len);
+    m_len += len;
+  }
+  else
+    m_ok = false;
+}
+
+void JsonWriter::put(char c)
+{
+  raw(&c, 1);
+}
@@ -0,0 +1,73 @@
+/*********************************************************************
+ * TelemetryJson – flat telemetry JSON into a caller-owned buffer
+ * -------------------------------------------------------
+ * • No heap: no document tree, no temporary key strings, no growing
+ *   output string; overflow is reported, never truncated silently
+ * • Sensor keys ("Soil1", "Air_temp", ...) are built once per sensor at
+ *   config load (SensorKeys) and copied in as pre-quoted text
+ * • Numbers: floats with 7 significant digits (float precision), NaN /
+ *   Inf as null (ArduinoJson's default)
+ *********************************************************************/
+#pragma once
+
+#include <SensorKind.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_KEY_BYTES 64     // quoted key + ':' ("\"<name>_moisture\":")
+#define TELEMETRY_NUMBER_BYTES 16  // "-1.234567e+38"
+#define TELEMETRY_HEADER_BYTES 320 // deviceId, firmware, rssi, battery, ...
+
+// Pre-quoted keys for the fields a sensor produces, in SensorField order.
+struct SensorKeys
+{
+  char text[FIELD_COUNT][TELEMETRY_KEY_BYTES];
+  uint8_t len[FIELD_COUNT]; // 0 = field not produced by the kind
+};
+
+// Scalar kinds report under the bare name, others as "<name>_<field>".
+void sensorKeysBuild(SensorKeys &out, const char *name, SensorKind kind);
+// Most bytes JsonWriter::sample() adds for these keys (commas included).
+size_t sensorKeysMaxBytes(const SensorKeys &keys);
+// Most bytes JsonWriter::statistic() adds for every field of these keys,
+// with suffixes of up to `suffixLen` characters.
+size_t sensorKeysStatBytes(const SensorKeys &keys, size_t suffixLen);
+
+class JsonWriter
+{
+public:
+  // Opens the object; `cap` includes the terminating NUL.
+  JsonWriter(char *buf, size_t cap);
+
+  void string(const char *key, const char *value);
+  void number(const char *key, double value, uint8_t digits = 7);
+  void integer(const char *key, long value);
+  void boolean(const char *key, bool value);
+  // Every field of `v` the keys know about.
+  void sample(const SensorKeys &keys, const SensorSample &v);
+  // "<key><suffix>": v for field `f` ("Soil1_min", "Air_temp_max"); the
+  // suffix is plain ASCII, not escaped. Nothing if the keys lack `f`.
+  void statistic(const SensorKeys &keys, SensorField f, const char *suffix, double v, uint8_t digits = 7);
+
+  // Closes the object and NUL-terminates; returns its length, 0 if
+  // anything did not fit.
+  size_t finish();
+  bool ok() const { return m_ok; }
+  // Undo point: restore(mark()) drops what was written since, overflow
+  // included (fill a message with as many sensors as fit).
+  size_t mark() const { return m_len; }
+  void restore(size_t mark);
+
+private:
+  void name(const char *key);
+  void quoted(const char *s);
+  void value(double v, uint8_t digits);
+  void raw(const char *s, size_t len);
+  void put(char c);
+
+  char *m_buf;
+  size_t m_cap;
+  size_t m_len = 0;
+  bool m_first = true;
+  bool m_ok;
+};
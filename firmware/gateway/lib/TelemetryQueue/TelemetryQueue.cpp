@@ -0,0 +1,555 @@
+#include "TelemetryQueue.h"
+
+#include <Crc32.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+  const uint8_t REC_MAGIC = 0xA7;
+  const uint8_t REC_DATA = 1;
+  const uint8_t REC_ACK = 2; // cumulative: every DATA record with seq <= ack.seq is done
+
+  struct RecordHeader
+  {
+    uint8_t magic;
+    uint8_t type;
+    uint16_t len;
+    uint32_t seq;
+    uint32_t ts;
+    uint32_t crc; // over the fields above + payload
+  };
+
+  uint32_t recordCrc(const RecordHeader &h, const char *data)
+  {
+    uint32_t c = crc32Update(0, &h, offsetof(RecordHeader, crc));
+    return crc32Update(c, data, h.len);
+  }
+
+  // Reads one record at the current position; payload goes to buf (>= MAX_MESSAGE).
+  bool readRecord(FILE *f, RecordHeader &h, char *buf)
+  {
+    if (fread(&h, sizeof(h), 1, f) != 1)
+      return false;
+    if (h.magic != REC_MAGIC || (h.type != REC_DATA && h.type != REC_ACK) ||
+        h.len > TelemetryQueue::MAX_MESSAGE)
+      return false;
+    if (h.len && fread(buf, 1, h.len, f) != h.len)
+      return false;
+    return recordCrc(h, buf) == h.crc;
+  }
+
+  bool expiredAt(uint32_t ts, uint32_t now, uint32_t maxAge)
+  {
+    return maxAge && now >= ts && now - ts > maxAge;
+  }
+
+  // compact() writes the live records here, then renames it over the segment.
+  void compactPath(const char *segmentPath, char *out, size_t cap)
+  {
+    snprintf(out, cap, "%s.tmp", segmentPath);
+  }
+
+  struct PlainVisit
+  {
+    TelemetryQueue::Visitor visit;
+    void *ctx;
+  };
+
+  bool plainVisit(uint32_t, const char *data, size_t len, void *ctx)
+  {
+    PlainVisit *p = (PlainVisit *)ctx;
+    return p->visit(data, len, p->ctx);
+  }
+}
+
+TelemetryQueue::~TelemetryQueue()
+{
+  end();
+}
+
+bool TelemetryQueue::begin(const TelemetryQueueConfig &cfg)
+{
+  end();
+  m_cfg = cfg;
+  if (m_cfg.ramSlots == 0)
+    m_cfg.ramSlots = 1;
+  if (m_cfg.slotSize > MAX_MESSAGE)
+    m_cfg.slotSize = MAX_MESSAGE;
+  m_ram = (uint8_t *)malloc((size_t)m_cfg.ramSlots * slotStride());
+  m_frontBuf = (char *)malloc(MAX_MESSAGE);
+  if (!m_ram || !m_frontBuf)
+  {
+    end();
+    return false;
+  }
+  m_stats = Stats();
+  recover();
+  return true;
+}
+
+void TelemetryQueue::end()
+{
+  free(m_ram);
+  free(m_frontBuf);
+  m_ram = nullptr;
+  m_frontBuf = nullptr;
+  m_ramHead = m_ramCount = 0;
+  m_diskCount = m_cursor = m_fileSize = 0;
+  m_frontValid = false;
+}
+
+bool TelemetryQueue::push(const char *data, size_t len, uint32_t now)
+{
+  if (!m_ram || len == 0 || len > MAX_MESSAGE)
+    return false;
+  m_stats.pushed++;
+  while (size() >= m_cfg.maxMessages && size() > 0)
+    dropOldest(false);
+
+  uint32_t seq = m_nextSeq++;
+  if (len > m_cfg.slotSize)
+  {
+    // Keep ordering: everything older must be on disk before this one.
+    persist();
+    if (!appendData(seq, now, data, (uint16_t)len))
+    {
+      m_stats.dropped++;
+      return false;
+    }
+    m_stats.spilled++;
+    return true;
+  }
+
+  if (m_ramCount == m_cfg.ramSlots)
+    spillOldestRam();
+  uint16_t i = (m_ramHead + m_ramCount) % m_cfg.ramSlots;
+  Slot &s = slotAt(i);
+  s.seq = seq;
+  s.ts = now;
+  s.len = (uint16_t)len;
+  memcpy(slotData(i), data, len);
+  m_ramCount++;
+  return true;
+}
+
+size_t TelemetryQueue::peek(char *buf, size_t cap, uint32_t now)
+{
+  const char *src;
+  uint16_t len;
+  if (!front(cap, now, src, len))
+    return 0;
+  memcpy(buf, src, len);
+  return len;
+}
+
+// Drops expired messages and ones longer than `cap` at the front. True with
+// `src` pointing at the oldest one left (m_frontBuf or its RAM slot); copies
+// nothing, so peekMany() can use it on m_frontBuf.
+bool TelemetryQueue::front(size_t cap, uint32_t now, const char *&src, uint16_t &len)
+{
+  while (!empty())
+  {
+    uint32_t ts;
+    if (m_diskCount)
+    {
+      if (!readFront())
+        continue; // segment was unreadable and has been reset
+      src = m_frontBuf;
+      len = m_frontLen;
+      ts = m_frontTs;
+    }
+    else
+    {
+      const Slot &s = slotAt(m_ramHead);
+      src = slotData(m_ramHead);
+      len = s.len;
+      ts = s.ts;
+    }
+    if (expiredAt(ts, now, m_cfg.maxAgeSec))
+    {
+      dropOldest(true);
+      continue;
+    }
+    if (len > cap)
+    {
+      dropOldest(false);
+      continue;
+    }
+    return true;
+  }
+  return false;
+}
+
+void TelemetryQueue::pop()
+{
+  if (m_diskCount)
+  {
+    if (!readFront())
+      return;
+    uint32_t seq = m_frontSeq;
+    advanceDisk();
+    if (m_diskCount)
+      appendAck(seq);
+  }
+  else if (m_ramCount)
+  {
+    m_ramHead = (m_ramHead + 1) % m_cfg.ramSlots;
+    m_ramCount--;
+  }
+  else
+  {
+    return;
+  }
+  m_stats.delivered++;
+}
+
+uint32_t TelemetryQueue::peekMany(uint32_t max, uint32_t now, Visitor visit, void *ctx)
+{
+  PlainVisit p = {visit, ctx};
+  return peekMany(max, now, plainVisit, &p);
+}
+
+uint32_t TelemetryQueue::peekMany(uint32_t max, uint32_t now, SeqVisitor visit, void *ctx)
+{
+  // Drops expired messages at the front; later ones are younger.
+  const char *src;
+  uint16_t len;
+  if (max == 0 || !front(MAX_MESSAGE, now, src, len))
+    return 0;
+
+  uint32_t n = 0;
+  if (m_diskCount)
+  {
+    FILE *f = fopen(m_cfg.segmentPath, "rb");
+    bool more = f && fseek(f, m_cursor, SEEK_SET) == 0;
+    RecordHeader h;
+    uint32_t seen = 0;
+    while (more && seen < m_diskCount && n < max && readRecord(f, h, m_frontBuf))
+    {
+      if (h.type != REC_DATA)
+        continue;
+      seen++;
+      if (visit(h.seq, m_frontBuf, h.len, ctx))
+        n++;
+      else
+        more = false;
+    }
+    if (f)
+      fclose(f);
+    m_frontValid = false;
+    // Rejected, full, or unreadable: RAM entries are newer, so stop here.
+    if (!more || n == max || seen < m_diskCount)
+      return n;
+  }
+  for (uint16_t i = 0; i < m_ramCount && n < max; i++)
+  {
+    uint16_t slot = (m_ramHead + i) % m_cfg.ramSlots;
+    if (!visit(slotAt(slot).seq, slotData(slot), slotAt(slot).len, ctx))
+      break;
+    n++;
+  }
+  return n;
+}
+
+void TelemetryQueue::pop(uint32_t n)
+{
+  uint32_t fromDisk = n < m_diskCount ? n : m_diskCount;
+  if (fromDisk && !advanceDiskBy(fromDisk))
+    return;
+  m_stats.delivered += fromDisk;
+  for (n -= fromDisk; n && m_ramCount; n--)
+    pop();
+}
+
+void TelemetryQueue::persist()
+{
+  while (m_ramCount)
+    spillOldestRam();
+}
+
+// --- internals ---
+
+void TelemetryQueue::spillOldestRam()
+{
+  const Slot &s = slotAt(m_ramHead);
+  if (appendData(s.seq, s.ts, slotData(m_ramHead), s.len))
+    m_stats.spilled++;
+  else
+    m_stats.dropped++;
+  m_ramHead = (m_ramHead + 1) % m_cfg.ramSlots;
+  m_ramCount--;
+}
+
+void TelemetryQueue::dropOldest(bool expired)
+{
+  if (m_diskCount)
+  {
+    if (!readFront())
+      return;
+    uint32_t seq = m_frontSeq;
+    advanceDisk();
+    if (m_diskCount)
+      appendAck(seq);
+  }
+  else if (m_ramCount)
+  {
+    m_ramHead = (m_ramHead + 1) % m_cfg.ramSlots;
+    m_ramCount--;
+  }
+  else
+  {
+    return;
+  }
+  if (expired)
+    m_stats.expired++;
+  else
+    m_stats.dropped++;
+}
+
+// Moves the cursor past the cached front record; deletes the segment once drained.
+void TelemetryQueue::advanceDisk()
+{
+  m_cursor = m_frontNext;
+  m_frontValid = false;
+  if (--m_diskCount == 0)
+    resetSegment();
+}
+
+// Skips `n` DATA records with one file pass and a single cumulative ACK.
+bool TelemetryQueue::advanceDiskBy(uint32_t n)
+{
+  FILE *f = fopen(m_cfg.segmentPath, "rb");
+  bool ok = f && fseek(f, m_cursor, SEEK_SET) == 0;
+  RecordHeader h;
+  uint32_t off = m_cursor, seq = 0, skipped = 0;
+  while (ok && skipped < n)
+  {
+    ok = readRecord(f, h, m_frontBuf);
+    off += sizeof(h) + h.len;
+    if (ok && h.type == REC_DATA)
+    {
+      seq = h.seq;
+      skipped++;
+    }
+  }
+  if (f)
+    fclose(f);
+  m_frontValid = false;
+  if (!ok)
+  {
+    m_stats.dropped += m_diskCount;
+    m_diskCount = 0;
+    resetSegment();
+    return false;
+  }
+  m_cursor = off;
+  m_diskCount -= n;
+  if (m_diskCount == 0)
+    resetSegment();
+  else
+    appendAck(seq);
+  return true;
+}
+
+bool TelemetryQueue::appendData(uint32_t seq, uint32_t ts, const char *data, uint16_t len)
+{
+  bool wasEmpty = m_diskCount == 0;
+  if (!appendRecord(REC_DATA, seq, ts, data, len))
+    return false;
+  if (wasEmpty)
+    m_cursor = m_fileSize - (uint32_t)(sizeof(RecordHeader) + len);
+  m_diskCount++;
+  return true;
+}
+
+bool TelemetryQueue::appendAck(uint32_t seq)
+{
+  return appendRecord(REC_ACK, seq, 0, nullptr, 0);
+}
+
+bool TelemetryQueue::appendRecord(uint8_t type, uint32_t seq, uint32_t ts, const char *data, uint16_t len)
+{
+  uint32_t rec = sizeof(RecordHeader) + len;
+  if (rec > m_cfg.maxDiskBytes)
+    return false;
+  if (m_fileSize + rec > m_cfg.maxDiskBytes)
+  {
+    // Make room: evict the oldest pending records, then rewrite without garbage.
+    while (m_diskCount && (m_fileSize - m_cursor) + rec > m_cfg.maxDiskBytes)
+    {
+      if (!readFront())
+        break;
+      m_cursor = m_frontNext;
+      m_frontValid = false;
+      m_diskCount--;
+      m_stats.dropped++;
+    }
+    if (m_diskCount)
+      compact();
+    else
+      resetSegment();
+    if (m_fileSize + rec > m_cfg.maxDiskBytes)
+      return false;
+  }
+
+  RecordHeader h;
+  h.magic = REC_MAGIC;
+  h.type = type;
+  h.len = len;
+  h.seq = seq;
+  h.ts = ts;
+  h.crc = recordCrc(h, data);
+
+  FILE *f = fopen(m_cfg.segmentPath, "ab");
+  if (!f)
+    return false;
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && (len == 0 || fwrite(data, 1, len, f) == len);
+  ok = fclose(f) == 0 && ok;
+  if (!ok)
+  {
+    // A torn record would hide everything behind it; rebuild from what is readable.
+    recover();
+    return false;
+  }
+  m_fileSize += rec;
+  return true;
+}
+
+bool TelemetryQueue::readFront()
+{
+  if (m_frontValid)
+    return true;
+  FILE *f = fopen(m_cfg.segmentPath, "rb");
+  bool ok = f && fseek(f, m_cursor, SEEK_SET) == 0;
+  RecordHeader h;
+  uint32_t off = m_cursor;
+  while (ok)
+  {
+    ok = readRecord(f, h, m_frontBuf);
+    off += sizeof(h) + h.len;
+    if (ok && h.type == REC_DATA)
+      break;
+  }
+  if (f)
+    fclose(f);
+  if (!ok)
+  {
+    m_stats.dropped += m_diskCount;
+    m_diskCount = 0;
+    resetSegment();
+    return false;
+  }
+  m_frontSeq = h.seq;
+  m_frontTs = h.ts;
+  m_frontLen = h.len;
+  m_frontNext = off;
+  m_frontValid = true;
+  return true;
+}
+
+void TelemetryQueue::recover()
+{
+  m_diskCount = m_cursor = m_fileSize = 0;
+  m_frontValid = false;
+  // A compaction copy left by a reset: partial if the segment is still
+  // there, otherwise the only copy of the backlog.
+  char tmpPath[96];
+  compactPath(m_cfg.segmentPath, tmpPath, sizeof(tmpPath));
+  FILE *f = fopen(m_cfg.segmentPath, "rb");
+  if (f)
+    remove(tmpPath);
+  else if (rename(tmpPath, m_cfg.segmentPath) == 0)
+    f = fopen(m_cfg.segmentPath, "rb");
+  if (!f)
+    return;
+
+  RecordHeader h;
+  uint32_t maxAck = 0, maxSeq = 0, validEnd = 0;
+  while (readRecord(f, h, m_frontBuf))
+  {
+    if (h.type == REC_ACK && h.seq > maxAck)
+      maxAck = h.seq;
+    if (h.type == REC_DATA && h.seq > maxSeq)
+      maxSeq = h.seq;
+    validEnd += sizeof(h) + h.len;
+  }
+  fseek(f, 0, SEEK_END);
+  uint32_t actualEnd = (uint32_t)ftell(f);
+
+  rewind(f);
+  uint32_t off = 0;
+  while (off < validEnd && readRecord(f, h, m_frontBuf))
+  {
+    if (h.type == REC_DATA && h.seq > maxAck)
+    {
+      if (m_diskCount == 0)
+        m_cursor = off;
+      m_diskCount++;
+    }
+    off += sizeof(h) + h.len;
+  }
+  fclose(f);
+
+  if (maxSeq >= m_nextSeq)
+    m_nextSeq = maxSeq + 1;
+  m_fileSize = validEnd;
+  if (m_diskCount == 0)
+    resetSegment();
+  else if (validEnd != actualEnd)
+    compact(); // drop the torn tail
+}
+
+// Rewrites the pending DATA records into a fresh segment.
+void TelemetryQueue::compact()
+{
+  char tmpPath[96];
+  compactPath(m_cfg.segmentPath, tmpPath, sizeof(tmpPath));
+
+  FILE *in = fopen(m_cfg.segmentPath, "rb");
+  FILE *out = fopen(tmpPath, "wb");
+  bool ok = in && out && fseek(in, m_cursor, SEEK_SET) == 0;
+  uint32_t copied = 0, size = 0;
+  RecordHeader h;
+  while (ok && copied < m_diskCount && readRecord(in, h, m_frontBuf))
+  {
+    if (h.type != REC_DATA)
+      continue;
+    ok = fwrite(&h, sizeof(h), 1, out) == 1 && (h.len == 0 || fwrite(m_frontBuf, 1, h.len, out) == h.len);
+    size += sizeof(h) + h.len;
+    copied++;
+  }
+  if (in)
+    fclose(in);
+  if (out)
+    ok = fclose(out) == 0 && ok;
+
+  // rename() replaces the segment in one step (LittleFS, POSIX): a reset
+  // leaves either the old segment or the compacted one, never neither.
+  if (ok)
+    ok = rename(tmpPath, m_cfg.segmentPath) == 0;
+  if (!ok)
+  {
+    remove(tmpPath);
+    m_stats.dropped += m_diskCount;
+    m_diskCount = 0;
+    resetSegment();
+    return;
+  }
+  m_stats.dropped += m_diskCount - copied;
+  m_diskCount = copied;
+  m_cursor = 0;
+  m_fileSize = size;
+  m_frontValid = false;
+  m_stats.compactions++;
+  if (m_diskCount == 0)
+    resetSegment();
+}
+
+void TelemetryQueue::resetSegment()
+{
+  remove(m_cfg.segmentPath);
+  m_cursor = m_fileSize = 0;
+  m_frontValid = false;
+}
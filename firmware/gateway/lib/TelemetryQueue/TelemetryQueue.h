@@ -0,0 +1,122 @@
+/*********************************************************************
+ * TelemetryQueue – bounded store-and-forward queue for the uplink
+ * -------------------------------------------------------
+ * • RAM ring holds the newest messages (no flash writes while healthy)
+ * • When the ring fills, the oldest entries spill to an append-only
+ *   segment file, so disk always holds the oldest part of the queue
+ * • Delivery is acknowledged with cumulative ACK records; the segment
+ *   is deleted as soon as it drains and compacted when it grows
+ * • Caps: message count, segment bytes and message age (oldest dropped)
+ * • Plain stdio, so it runs on the ESP32 VFS (/littlefs/...) and on host
+ *********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct TelemetryQueueConfig
+{
+  const char *segmentPath = "/littlefs/txq.seg";
+  uint16_t ramSlots = 16;         // messages kept in RAM before spilling
+  uint16_t slotSize = 512;        // max bytes per RAM slot; larger messages go straight to disk
+  uint32_t maxMessages = 2000;    // total pending (RAM + disk)
+  uint32_t maxDiskBytes = 131072; // segment file cap
+  uint32_t maxAgeSec = 86400;     // 0 = keep forever
+};
+
+class TelemetryQueue
+{
+public:
+  static const uint16_t MAX_MESSAGE = 2048;
+
+  struct Stats
+  {
+    uint32_t pushed = 0;
+    uint32_t delivered = 0;
+    uint32_t dropped = 0; // evicted by count / disk caps
+    uint32_t expired = 0; // evicted by age
+    uint32_t spilled = 0; // written to the segment
+    uint32_t compactions = 0;
+  };
+
+  ~TelemetryQueue();
+
+  // Allocates the RAM ring and replays any pending messages left in the segment.
+  bool begin(const TelemetryQueueConfig &cfg);
+  void end();
+
+  // `now` is any monotonic seconds clock; it is only used for the age cap.
+  // Messages stamped in the future (clock reset after reboot) count as fresh.
+  bool push(const char *data, size_t len, uint32_t now);
+
+  // Copies the oldest pending message into buf and returns its length
+  // (0 when empty). Expired messages are dropped on the way.
+  size_t peek(char *buf, size_t cap, uint32_t now);
+
+  // Marks the message returned by the last peek() as delivered.
+  void pop();
+
+  // Visits up to `max` pending messages oldest-first without removing them
+  // and stops at the first one the visitor rejects. Returns how many were
+  // accepted; hand that count to pop(n) once they are delivered.
+  typedef bool (*Visitor)(const char *data, size_t len, void *ctx);
+  uint32_t peekMany(uint32_t max, uint32_t now, Visitor visit, void *ctx);
+  void pop(uint32_t n);
+
+  // Same, with each message's sequence number. It grows in push order and
+  // stays with the message until it is popped or dropped, across restarts.
+  typedef bool (*SeqVisitor)(uint32_t seq, const char *data, size_t len, void *ctx);
+  uint32_t peekMany(uint32_t max, uint32_t now, SeqVisitor visit, void *ctx);
+
+  // Spills the RAM ring to the segment (before restart / deep sleep).
+  void persist();
+
+  uint32_t size() const { return m_diskCount + m_ramCount; }
+  bool empty() const { return size() == 0; }
+  uint32_t diskCount() const { return m_diskCount; }
+  uint32_t diskBytes() const { return m_fileSize; }
+  const Stats &stats() const { return m_stats; }
+
+private:
+  struct Slot
+  {
+    uint32_t seq;
+    uint32_t ts;
+    uint16_t len;
+  };
+
+  Slot &slotAt(uint16_t i) { return *(Slot *)(m_ram + (size_t)i * slotStride()); }
+  char *slotData(uint16_t i) { return (char *)(&slotAt(i) + 1); }
+  size_t slotStride() const { return sizeof(Slot) + m_cfg.slotSize; }
+
+  bool appendData(uint32_t seq, uint32_t ts, const char *data, uint16_t len);
+  bool appendAck(uint32_t seq);
+  bool appendRecord(uint8_t type, uint32_t seq, uint32_t ts, const char *data, uint16_t len);
+  bool front(size_t cap, uint32_t now, const char *&src, uint16_t &len);
+  void spillOldestRam();
+  void dropOldest(bool expired);
+  void advanceDisk();
+  bool advanceDiskBy(uint32_t n);
+  void recover();
+  void compact();
+  void resetSegment();
+  bool readFront();
+
+  TelemetryQueueConfig m_cfg;
+  uint8_t *m_ram = nullptr;
+  uint16_t m_ramHead = 0, m_ramCount = 0;
+
+  // Segment state: m_cursor is the file offset of the oldest pending DATA record.
+  uint32_t m_diskCount = 0;
+  uint32_t m_cursor = 0;
+  uint32_t m_fileSize = 0;
+
+  // Front record cached by readFront() so peek() -> pop() does not re-read.
+  bool m_frontValid = false;
+  uint32_t m_frontSeq = 0, m_frontTs = 0, m_frontNext = 0;
+  uint16_t m_frontLen = 0;
+  char *m_frontBuf = nullptr;
+
+  uint32_t m_nextSeq = 1;
+  Stats m_stats;
+};
@@ -0,0 +1,155 @@
+/*********************************************************************
+ * TelemetryWindow – per-field statistics over tumbling windows
+ * -------------------------------------------------------
+ * • Every sample is folded into running count / min / max / mean and an
+ *   EWMA: O(1) memory per field, no sample buffer
+ * • One summary per window instead of one message per report period;
+ *   min / max / mean / count restart with each window, the EWMA carries
+ *   over (it is a smoothed level, not a window statistic)
+ * • Alert limits per field: a sample that moves a field past a below /
+ *   above limit, or back, is reported at once, raw; leaving needs a
+ *   hysteresis margin so noise at the limit does not flap
+ * • Non-finite samples (failed reads) are skipped
+ *********************************************************************/
+#pragma once
+
+#include <SensorKind.h>
+#include <math.h>
+#include <stdint.h>
+
+struct FieldStats
+{
+  uint16_t count;
+  float min, max, mean;
+  float ewma;
+  bool ewmaSet;
+
+  void add(float v, float alpha)
+  {
+    if (count < UINT16_MAX)
+      count++;
+    if (count == 1)
+      min = max = mean = v;
+    else
+    {
+      min = v < min ? v : min;
+      max = v > max ? v : max;
+      mean += (v - mean) / count; // running mean, no float sum to lose precision
+    }
+    ewma = ewmaSet ? ewma + alpha * (v - ewma) : v;
+    ewmaSet = true;
+  }
+};
+
+// Alert limits of one field; a limit applies when its bit is set.
+struct FieldLimits
+{
+  enum : uint8_t
+  {
+    BELOW = 1 << 0,
+    ABOVE = 1 << 1
+  };
+  uint8_t has;
+  float below, above;
+  float hysteresis; // how far back inside a limit a value must come to clear it
+
+  // 0 = within limits, BELOW / ABOVE = past that limit; `prev` is the
+  // state after the previous sample.
+  uint8_t state(float v, uint8_t prev) const
+  {
+    if ((has & BELOW) && v < (prev == BELOW ? below + hysteresis : below))
+      return BELOW;
+    if ((has & ABOVE) && v > (prev == ABOVE ? above - hysteresis : above))
+      return ABOVE;
+    return 0;
+  }
+};
+
+template <uint8_t Sensors>
+class TelemetryWindow
+{
+public:
+  struct Stats
+  {
+    uint32_t samples, windows, alerts;
+  };
+
+  // windowMs == 0 turns aggregation off (due() never fires). Keeps limits.
+  void begin(uint32_t windowMs, float alpha, uint32_t nowMs)
+  {
+    m_windowMs = windowMs;
+    m_alpha = alpha;
+    m_startMs = nowMs;
+    for (uint8_t s = 0; s < Sensors; s++)
+    {
+      m_alert[s] = 0;
+      for (uint8_t f = 0; f < FIELD_COUNT; f++)
+        m_field[s][f] = FieldStats();
+    }
+  }
+
+  bool enabled() const { return m_windowMs != 0; }
+
+  void setLimits(uint8_t sensor, const FieldLimits limits[FIELD_COUNT])
+  {
+    if (sensor >= Sensors)
+      return;
+    for (uint8_t f = 0; f < FIELD_COUNT; f++)
+      m_limits[sensor][f] = limits[f];
+    m_alert[sensor] = 0;
+  }
+
+  // Folds a sample in; true when a field crossed one of its limits (the
+  // caller sends the raw values now).
+  bool add(uint8_t sensor, const SensorSample &v)
+  {
+    if (sensor >= Sensors)
+      return false;
+    bool crossed = false;
+    for (uint8_t f = 0; f < FIELD_COUNT; f++)
+    {
+      if (!v.has((SensorField)f) || !isfinite(v.value[f]))
+        continue;
+      m_field[sensor][f].add(v.value[f], m_alpha);
+      uint8_t shift = 2 * f;
+      uint8_t prev = (m_alert[sensor] >> shift) & 3;
+      uint8_t state = m_limits[sensor][f].state(v.value[f], prev);
+      if (state != prev)
+      {
+        m_alert[sensor] = (uint8_t)((m_alert[sensor] & ~(3u << shift)) | state << shift);
+        crossed = true;
+      }
+    }
+    m_stats.samples++;
+    if (crossed)
+      m_stats.alerts++;
+    return crossed;
+  }
+
+  bool due(uint32_t nowMs) const { return m_windowMs && nowMs - m_startMs >= m_windowMs; }
+
+  // Starts the next window. Windows stay on a fixed grid; after a long
+  // stall (nothing to summarise) the grid restarts at nowMs.
+  void close(uint32_t nowMs)
+  {
+    m_startMs = nowMs - m_startMs >= 2 * m_windowMs ? nowMs : m_startMs + m_windowMs;
+    for (uint8_t s = 0; s < Sensors; s++)
+      for (uint8_t f = 0; f < FIELD_COUNT; f++)
+        m_field[s][f].count = 0;
+    m_stats.windows++;
+  }
+
+  const FieldStats &field(uint8_t sensor, SensorField f) const { return m_field[sensor][f]; }
+  // Current alert state of a field (0, FieldLimits::BELOW or ABOVE).
+  uint8_t alert(uint8_t sensor, SensorField f) const { return (m_alert[sensor] >> (2 * f)) & 3; }
+  uint32_t windowMs() const { return m_windowMs; }
+  const Stats &stats() const { return m_stats; }
+
+private:
+  uint32_t m_windowMs = 0, m_startMs = 0;
+  float m_alpha = 0;
+  FieldStats m_field[Sensors][FIELD_COUNT] = {};
+  FieldLimits m_limits[Sensors][FIELD_COUNT] = {};
+  uint8_t m_alert[Sensors] = {}; // 2 bits per field
+  Stats m_stats = {};
+};
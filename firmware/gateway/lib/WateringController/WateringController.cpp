@@ -0,0 +1,172 @@
+#include "WateringController.h"
+
+#include <math.h>
+#include <string.h>
+
+const char *wateringReasonName(uint8_t reason)
+{
+  static const char *const kNames[] = {"dry", "timer", "wet", "maxRun", "noReading", "schedule", "stopped"};
+  return reason < sizeof(kNames) / sizeof(kNames[0]) ? kNames[reason] : "";
+}
+
+void WateringController::reset(uint8_t zoneCount, uint8_t concurrent)
+{
+  memset(this, 0, sizeof(*this));
+  magic = WATERING_MAGIC;
+  zones = zoneCount < WATERING_MAX_ZONES ? zoneCount : WATERING_MAX_ZONES;
+  maxConcurrent = concurrent;
+  for (uint8_t z = 0; z < zones; z++)
+  {
+    zone[z].rested = true;
+    zone[z].moisture = NAN;
+  }
+  seal();
+}
+
+void WateringController::configure(uint8_t z, const WateringZone &cfg)
+{
+  if (z < zones)
+    zone[z].cfg = cfg;
+}
+
+void WateringController::reading(uint8_t z, float pct, uint32_t nowMs)
+{
+  if (z >= zones)
+    return;
+  zone[z].moisture = pct;
+  zone[z].readAt = nowMs;
+  zone[z].hasReading = isfinite(pct);
+}
+
+bool WateringController::fresh(const Zone &z, uint32_t nowMs) const
+{
+  return z.hasReading && nowMs - z.readAt <= z.cfg.staleMs;
+}
+
+bool WateringController::inWindow(const WateringZone &cfg, int16_t minuteOfDay)
+{
+  if (cfg.fromMin == cfg.toMin)
+    return true;
+  if (minuteOfDay < 0)
+    return cfg.hasSensor; // no clock: moisture still decides
+  if (cfg.fromMin < cfg.toMin)
+    return minuteOfDay >= cfg.fromMin && minuteOfDay < cfg.toMin;
+  return minuteOfDay >= cfg.fromMin || minuteOfDay < cfg.toMin; // over midnight
+}
+
+void WateringController::close(uint8_t z, uint8_t reason, uint32_t nowMs, WateringAction *out, uint8_t cap,
+                               uint8_t &n)
+{
+  Zone &zn = zone[z];
+  uint32_t ran = nowMs - zn.startAt;
+  zn.state = IDLE;
+  zn.stopAt = nowMs;
+  zn.rested = false;
+  stats.runMs += ran;
+  if (n < cap)
+    out[n++] = {z, false, reason, ran, zn.hasReading ? zn.moisture : NAN};
+}
+
+uint8_t WateringController::step(uint32_t nowMs, int16_t minuteOfDay, WateringAction *out, uint8_t cap)
+{
+  uint8_t n = 0;
+  for (uint8_t z = 0; z < zones; z++)
+  {
+    Zone &zn = zone[z];
+    if (zn.state != RUNNING)
+      continue;
+    bool known = fresh(zn, nowMs);
+    if (zn.cfg.hasSensor && !known)
+      close(z, WATER_NO_READING, nowMs, out, cap, n);
+    else if (zn.cfg.hasSensor && zn.moisture >= zn.cfg.stopAbove)
+      close(z, WATER_WET, nowMs, out, cap, n);
+    else if (nowMs - zn.startAt >= zn.cfg.maxRunMs)
+      close(z, WATER_MAX_RUN, nowMs, out, cap, n);
+    else if (!inWindow(zn.cfg, minuteOfDay))
+      close(z, WATER_SCHEDULE, nowMs, out, cap, n);
+  }
+
+  for (uint8_t z = 0; z < zones; z++)
+  {
+    Zone &zn = zone[z];
+    if (zn.state == RUNNING)
+      continue;
+    bool windowed = zn.cfg.fromMin != zn.cfg.toMin;
+    bool wants;
+    if (!inWindow(zn.cfg, minuteOfDay))
+    {
+      if (windowed && minuteOfDay >= 0)
+        zn.ranThisWindow = false; // the next window gets its own run
+      wants = false;
+    }
+    else if (!zn.rested && nowMs - zn.stopAt < zn.cfg.minOffMs)
+      wants = false;
+    else if (zn.cfg.hasSensor)
+      wants = fresh(zn, nowMs) && zn.moisture < zn.cfg.startBelow;
+    else
+      wants = !(windowed && zn.ranThisWindow);
+    if (!wants)
+      zn.state = IDLE;
+    else if (zn.state == IDLE)
+    {
+      zn.state = WAITING;
+      zn.waitSince = nowMs;
+      zn.startReason = zn.cfg.hasSensor ? WATER_DRY : WATER_TIMER;
+    }
+  }
+
+  // Free slots go to the zones that have waited longest.
+  uint8_t open = running();
+  while (open < maxConcurrent)
+  {
+    int8_t next = -1;
+    for (uint8_t z = 0; z < zones; z++)
+      if (zone[z].state == WAITING &&
+          (next < 0 || (int32_t)(zone[z].waitSince - zone[next].waitSince) < 0))
+        next = (int8_t)z;
+    if (next < 0)
+      break;
+    Zone &zn = zone[next];
+    zn.state = RUNNING;
+    zn.startAt = nowMs;
+    zn.ranThisWindow = true;
+    stats.runs++;
+    if (n < cap)
+      out[n++] = {(uint8_t)next, true, zn.startReason, 0, zn.hasReading ? zn.moisture : NAN};
+    open++;
+  }
+  if (open > stats.highWater)
+    stats.highWater = open;
+  seal();
+  return n;
+}
+
+uint8_t WateringController::stopAll(uint32_t nowMs, WateringAction *out, uint8_t cap)
+{
+  uint8_t n = 0;
+  for (uint8_t z = 0; z < zones; z++)
+  {
+    if (zone[z].state == RUNNING)
+      close(z, WATER_STOPPED, nowMs, out, cap, n);
+    else
+      zone[z].state = IDLE;
+  }
+  seal();
+  return n;
+}
+
+uint8_t WateringController::running() const
+{
+  uint8_t n = 0;
+  for (uint8_t z = 0; z < zones; z++)
+    n += zone[z].state == RUNNING;
+  return n;
+}
+
+uint8_t WateringController::waiting() const
+{
+  uint8_t n = 0;
+  for (uint8_t z = 0; z < zones; z++)
+    n += zone[z].state == WAITING;
+  return n;
+}
@@ -0,0 +1,117 @@
+/*********************************************************************
+ * WateringController – local closed-loop valve control per zone
+ * -------------------------------------------------------
+ * • A zone opens its valve when its soil moisture falls below startBelow
+ *   and closes it at stopAbove (hysteresis), after maxRun, when its
+ *   reading goes missing or stale, or when its schedule window ends
+ * • Zones without a sensor are timers: one run per schedule window, or
+ *   one every minOff when they have no window
+ * • minOff: rest time after a run (soak-in, no chattering)
+ * • At most maxConcurrent valves open at once (pump capacity); zones
+ *   waiting for a slot are started oldest first
+ * • Hardware-free: the firmware feeds readings, calls step() and drives
+ *   the GPIOs from the returned actions, which it also reports
+ * • Plain aggregate with a magic + CRC: lives in RTC memory on nodes, so
+ *   rest times and timer runs survive deep sleep
+ *********************************************************************/
+#pragma once
+
+#include <Crc32.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WATERING_MAX_ZONES 8
+#define WATERING_MAGIC 0x57544331 // "WTC1"
+
+// Zone settings (config.json "zones"). Times are ms of the caller's clock.
+struct WateringZone
+{
+  bool hasSensor;
+  float startBelow, stopAbove; // moisture %
+  uint32_t maxRunMs, minOffMs;
+  uint32_t staleMs;        // an older reading counts as none
+  uint16_t fromMin, toMin; // allowed window, minutes of the local day; equal = all day
+};
+
+enum WateringReason : uint8_t
+{
+  WATER_DRY = 0,    // opened: moisture below startBelow
+  WATER_TIMER,      // opened: timer zone
+  WATER_WET,        // closed: moisture reached stopAbove
+  WATER_MAX_RUN,    // closed: maxRun reached
+  WATER_NO_READING, // closed: reading missing or stale
+  WATER_SCHEDULE,   // closed: schedule window ended
+  WATER_STOPPED,    // closed: stopAll() (config change, restart)
+};
+
+struct WateringAction
+{
+  uint8_t zone;
+  bool open;
+  uint8_t reason;   // WateringReason
+  uint32_t runMs;   // close: how long the valve was open
+  float moisture;   // latest reading, NAN for none
+};
+
+// "dry", "timer", "wet", "maxRun", "noReading", "schedule", "stopped"
+const char *wateringReasonName(uint8_t reason);
+
+struct WateringController
+{
+  enum : uint8_t
+  {
+    IDLE = 0,
+    WAITING, // wants water, no free slot
+    RUNNING
+  };
+
+  struct Zone
+  {
+    WateringZone cfg;
+    uint8_t state;
+    uint8_t startReason;
+    bool hasReading, ranThisWindow, rested; // rested: no run to rest from
+    float moisture;
+    uint32_t readAt, startAt, stopAt, waitSince;
+  };
+
+  struct Stats
+  {
+    uint32_t runs, runMs;
+    uint8_t highWater; // most valves open at once
+  };
+
+  uint32_t magic;
+  uint8_t zones, maxConcurrent;
+  Zone zone[WATERING_MAX_ZONES];
+  Stats stats;
+  uint32_t crc;
+
+  bool valid() const { return magic == WATERING_MAGIC && crc == checksum(); }
+  // Forgets everything: all zones idle and rested.
+  void reset(uint8_t zoneCount, uint8_t concurrent);
+  // Call after every change that must survive deep sleep.
+  void seal() { crc = checksum(); }
+
+  // Settings of one zone; keeps its state.
+  void configure(uint8_t z, const WateringZone &cfg);
+  // Moisture of a zone's sensor; NAN for a failed read.
+  void reading(uint8_t z, float pct, uint32_t nowMs);
+
+  // Runs the zone state machines. minuteOfDay < 0: wall clock unknown,
+  // sensor zones then ignore their window and timer zones with a window
+  // wait. Returns the number of actions written to `out`.
+  uint8_t step(uint32_t nowMs, int16_t minuteOfDay, WateringAction *out, uint8_t cap);
+  // Closes every open valve (WATER_STOPPED).
+  uint8_t stopAll(uint32_t nowMs, WateringAction *out, uint8_t cap);
+
+  bool isOpen(uint8_t z) const { return zone[z].state == RUNNING; }
+  uint8_t running() const;
+  uint8_t waiting() const;
+
+private:
+  bool fresh(const Zone &z, uint32_t nowMs) const;
+  static bool inWindow(const WateringZone &cfg, int16_t minuteOfDay);
+  void close(uint8_t z, uint8_t reason, uint32_t nowMs, WateringAction *out, uint8_t cap, uint8_t &n);
+  uint32_t checksum() const { return crc32(this, offsetof(WateringController, crc)); }
+};
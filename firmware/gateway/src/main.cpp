@@ -17,12 +17,36 @@
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BME280.h>
 #include <Adafruit_BMP280.h>
-#include <set>
-#include <map>
 #include <vector>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <LittleFS.h>
+#include <SensorKind.h>
+#include <TelemetryQueue.h>
+#include <IoTHubBatch.h>
+#include <SpscRing.h>
+#include <SnapshotBuffer.h>
+#include <PushFanout.h>
+#include <TelemetryFrame.h>
+#include <NodeSampleLog.h>
+#include <MeshIngest.h>
+#include <MeshDedup.h>
+#include <GatewayPipeline.h>
+#include <MqttSession.h>
+#include <InflightWindow.h>
+#include <TelemetryJson.h>
+#include <ConfigImage.h>
+#include <DriverArena.h>
+#include <SensorRebuild.h>
+#include <Metrics.h>
+#include <LoopTrace.h>
+#include <AcquisitionScheduler.h>
+#include <AdcBurst.h>
+#include <TelemetryWindow.h>
+#include <WateringController.h>
+#include <OtaUpdate.h>
+#include <MeshOtaServer.h>
+#include <atomic>
 
 #if defined(ESP32)
 #include <WiFi.h>
@@ -30,9 +54,18 @@
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <HTTPClient.h>
-#include <HTTPUpdate.h>
+#include <Update.h>
+#include <mbedtls/sha256.h>
+#include <MD5Builder.h>
+#include <esp_ota_ops.h>
 #include "AzureIotHub.h"
 #include "Esp32MQTTClient.h"
+#include <Preferences.h>
+#include <esp_timer.h>
+#if CONFIG_IDF_TARGET_ESP32
+#include <driver/adc.h>
+#define SOIL_BURST_DMA // ADC1 DMA output in TYPE1 format (data:12, channel:4)
+#endif
 #define RTC_ATTR RTC_DATA_ATTR
 #define HTTP_CLIENT HTTPClient
 #define WebRequest AsyncWebServerRequest
@@ -59,6 +92,7 @@
 DNSServer dnsServer;
 
 // --- CONSTANTS ---
+// Uplink batch / hand-off ring / schema cache sizes: GatewayPipeline.h.
 #define FIRMWARE_VERSION "1.3.4"
 #define AP_SSID "ESP_Config"
 #define AP_PASSWORD "admin123"
@@ -66,6 +100,64 @@ DNSServer dnsServer;
 #define MESH_PREFIX "MESH_"
 #define MESH_PASSWORD "meshpass"
 #define MESH_PORT 5555
+#define MESH_CHANNEL 1                // until the router's channel is known
+#define UPLINK_BACKOFF_MIN_MS 1000
+#define UPLINK_BACKOFF_MAX_MS 60000
+#define MQTT_BATCH_MAX_MESSAGES 16    // queued messages coalesced into one publish
+#define MQTT_BATCH_MAX_BYTES 4096     // JSON array body; sizes the client buffer
+#define MQTT_KEEPALIVE_S 120
+#define MQTT_SOCKET_TIMEOUT_S 5       // bounds one connect attempt / publish
+#define MQTT_BACKOFF_MIN_MS 1000
+#define MQTT_BACKOFF_MAX_MS 60000
+#define SDK_INFLIGHT_MAX 8            // sent, unconfirmed SDK messages
+#define SDK_CONFIRM_TIMEOUT_MS 30000  // give up waiting for a confirmation
+#define SDK_MAX_ATTEMPTS 3            // sends per message before backing off
+#define SDK_DOWORK_MS 10              // uplink task cadence while messages are in flight
+#define UPLINK_TASK_STACK 8192
+#define UPLINK_TASK_CORE 0            // loop() runs on core 1
+#define UPLINK_TASK_IDLE_MS 100       // wake-up cadence without new messages
+#define TELEMETRY_INTERVAL_MS 10000   // gateway: own-sensor message cadence
+#define WINDOW_SUFFIX_BYTES 5         // longest summary key suffix ("_ewma")
+#define LIVE_SNAPSHOT_BYTES 2048      // rendered /live_data sensors object
+#define LIVE_PUSH_MAX_CLIENTS 4       // /ws connections beyond this are refused
+#define LIVE_PUSH_EVENT_SLOTS 8       // mesh frames kept for lagging clients
+#define LIVE_PUSH_EVENT_BYTES 1024
+#define SENSOR_DEFAULT_PERIOD_MS 10000
+#define SOIL_BURST_FREQ_HZ 20000      // ADC DMA conversions/s, all moisture pins together
+#define SOIL_BURST_TRIM_PERCENT 25    // dropped at each end: interquartile mean
+#define SOIL_BURST_REUSE_MS 1000      // moisture sensors started within this share a burst
+#define SOIL_READ_SAMPLES 8           // per pin without DMA: each analogRead() blocks loop()
+#define SOIL_DMA_FRAME_BYTES 256      // DMA bytes per interrupt / read
+#define MESH_FRAME_BYTES 512          // binary node telemetry frame
+#define MESH_SCHEMA_EVERY 16          // node: re-announce every N wakes (gateway reboots)
+#define MESH_DEDUP_SLOTS 256          // gateway: recent (node, seq) pairs (~4 KB)
+#define MESH_DEDUP_WINDOW_MS 10000    // ...remembered this long
+#define NODE_LOG_SLOTS 32             // node: samples kept in RTC memory between sends
+#define NODE_LOG_READINGS 16          // node: values per sample (sensor fields)
+#define STA_POLL_MS 20
+#define STA_TIMEOUT_MS 20000          // full connect (scan + DHCP)
+#define STA_FAST_TIMEOUT_MS 3000      // cached BSSID/channel before falling back
+#define WIFI_LEASE_BOOTS 200          // wakes before the cached IP lease is renewed
+#define WATERING_STEP_MS 1000         // zone state machines run at least this often
+#define WATERING_NODE_POLL_MS 2000    // node: zone sensors re-read while a valve is open
+#define WATERING_STALE_PERIODS 3      // older zone readings count as none
+#define WATERING_REPORT_SLOTS 16      // valve events waiting for the link (node: the mesh)
+#define NTP_SERVER "pool.ntp.org"
+#define CLOCK_VALID_AFTER 1600000000  // time() below this: SNTP has not answered yet
+#define OTA_READ_TIMEOUT_MS 10000     // no image bytes this long: connection counts as lost
+#define OTA_BUFFER_BYTES 4096         // image bytes per read / flash write
+#define MESH_OTA_ROLE "node"          // painlessMesh OTA role the nodes accept
+#define MESH_OTA_PART_BYTES 1024      // image bytes per mesh reply (base64: 1368 chars)
+#define MESH_OTA_PARTS_PER_SEC 8      // gateway: replies per second over all nodes
+#define MESH_OTA_BURST 4              // ...of which back to back
+#define MESH_OTA_HOLD_MS 200          // gateway: no reply this long after a node message
+#define MESH_OTA_ANNOUNCE_MS 10000    // gateway: staged image re-announced this often
+#define MESH_OTA_NUDGE_MS 1000        // ...and after a node message, at most this often
+#define MESH_OTA_NODE_IDLE_MS 60000   // node: stays awake this long after the last part
+#define CONFIG_PATH "/littlefs/config.json"
+#define CONFIG_TMP_PATH "/littlefs/config.json.tmp" // /save_config upload, renamed when valid
+#define CONFIG_MAX_BYTES 8192
+#define UPLINK_RELOAD_WAIT_MS 10000   // uplink task swap; a restart applies it otherwise
 
 // --- MODE ---
 enum class DeviceMode
@@ -76,17 +168,42 @@ enum class DeviceMode
 DeviceMode g_mode = DeviceMode::GATEWAY;
 
 // --- CONFIG ---
-String g_ssid, g_password, g_iothubHost, g_deviceId, g_sasToken;
+String g_ssid, g_password, g_deviceId;
+// Connection settings of the uplink; owned by the uplink task once it runs
+// (applyUplinkConfig()), so loop() never reads them while they change.
+String g_iothubHost, g_uplinkDeviceId, g_sasToken;
 String g_protocol = "http";
 String g_firmwareUrl = "";
+String g_nodeFirmwareUrl = ""; // gateway: node image, staged and served over the mesh
 uint32_t g_sleepSeconds = 60;
+bool g_meshBinary = false; // node: send TelemetryFrame instead of JSON
+uint16_t g_batchWakes = 10; // node: bring the radio up every N wakes...
+int16_t g_batchDelta[FIELD_COUNT] = {0}; // ...or when a value moves this much (frame units)
+bool g_nodeTransmit = false; // node: this wake sends the batch
+unsigned long g_radioStartMs = 0;
 
 // --- RTC VARIABLES ---
 RTC_ATTR uint32_t g_bootCount = 0;
 RTC_ATTR bool g_configValid = false;
+RTC_ATTR uint16_t g_announcedSchema = 0; // node: last schema sent to the gateway
+RTC_ATTR uint32_t g_meshSeq = 0;         // node: seq of the next mesh message
+RTC_ATTR uint32_t g_meshRoot = 0;        // node: root (gateway) id, 0 = unknown
+// Node: samples taken with the radio off, sent as one batch (see nodeTakeSample()).
+RTC_ATTR NodeSampleLog<NODE_LOG_SLOTS, NODE_LOG_READINGS> g_nodeLog;
+RTC_ATTR uint32_t g_radioOnMs = 0;     // node: radio-on time and samples sent,
+RTC_ATTR uint32_t g_radioSamples = 0;  // for the per-sample figure in the log
+RTC_ATTR ConfigImage g_cfgImage;       // parsed config.json (see readConfig())
+RTC_ATTR WifiCache g_wifiCache;        // last association (see connectSTA())
+RTC_ATTR WateringController g_watering; // zone states, rest times (see setupWatering())
+
+// --- BOOT TIMING ---
+// millis() at the end of each boot phase, reported with the first transmit.
+bool g_warmBoot = false;
+unsigned long g_bootConfigMs = 0, g_bootWifiMs = 0;
 
 // --- MESH ---
 painlessMesh mesh;
+MeshDedup<MESH_DEDUP_SLOTS> g_meshDedup(MESH_DEDUP_WINDOW_MS); // gateway
 
 // --- WEB ---
 AsyncWebServer server(80);
@@ -99,431 +216,3525 @@ unsigned long g_buttonPressTime = 0;
 WiFiClientSecure espClient;
 PubSubClient mqttClient(espClient);
 IOTHUB_CLIENT_LL_HANDLE g_iotHubClient = nullptr;
+// Messages handed to the SDK and not yet confirmed; owned by the uplink task.
+InflightWindow<SDK_INFLIGHT_MAX> g_sdkWindow(SDK_CONFIRM_TIMEOUT_MS);
+// The front of g_txQueue as far as the SDK has seen it, in queue order. A
+// message stays queued until it and everything before it are confirmed.
+struct SdkEntry
+{
+  uint32_t seq;              // TelemetryQueue sequence number
+  IOTHUB_MESSAGE_HANDLE msg; // in g_sdkWindow; nullptr once settled
+  bool confirmed;            // false with msg == nullptr: to be sent again
+};
+SdkEntry g_sdkSent[SDK_INFLIGHT_MAX];
+uint8_t g_sdkSentCount = 0;
 #else
 WiFiClient espClient;
 PubSubClient mqttClient(espClient);
 #endif
-unsigned long lastReconnectAttempt = 0;
+// Owned by the uplink task: connects, keepalive and backoff (serviceMqtt()).
+MqttSession g_mqtt;
+String g_mqttTopic;
+String g_mqttUser;
+
+// --- HTTP UPLINK SESSION ---
+// One HTTPClient reused across POSTs. With setReuse(true), end() keeps the
+// TLS connection on espClient open, so the handshake is paid once per
+// connection instead of once per message.
+HTTP_CLIENT g_http;
+String g_httpEventsUrl;
+uint32_t g_httpHandshakes = 0;
+uint32_t g_httpMessages = 0;
+
+// --- STORE-AND-FORWARD ---
+// Gateway telemetry goes through this queue; loop() drains it oldest-first.
+TelemetryQueueConfig g_queueCfg;
+TelemetryQueue g_txQueue;
+static_assert(UPLINK_RING_SLOT_BYTES <= TelemetryQueue::MAX_MESSAGE, "queue RAM slots hold a whole ring slot");
+unsigned long g_uplinkFailTime = 0;
+uint32_t g_uplinkBackoffMs = 0;
+
+// --- UPLINK TASK ---
+// loop() (sensors + mesh callback) is the only producer, the uplink task the
+// only consumer. The task owns g_txQueue and every network client, so a slow
+// POST or MQTT reconnect never stalls mesh.update(), DNS or the BOOT button.
+SpscRing<UPLINK_RING_SLOTS, UPLINK_RING_SLOT_BYTES> g_uplinkRing;
+TaskHandle_t g_uplinkTask = nullptr;
+std::atomic<bool> g_persistRequested{false};
+
+// --- LIVE DATA ---
+// Rendered by the sampling path after each collected sample; /live_data
+// only copies it out, so web requests never touch a sensor bus.
+SnapshotBuffer<LIVE_SNAPSHOT_BYTES> g_liveSnapshot;
+
+// --- LIVE PUSH ---
+// /ws pushes each new sample and each forwarded mesh message. g_push is only
+// touched from loop(); the async_tcp task reports (dis)connects through
+// g_wsNotices so the fan-out needs no lock.
+struct WsNotice
+{
+  uint32_t client;
+  bool connected;
+};
+AsyncWebSocket g_ws("/ws");
+PushFanout g_push;
+SpscRing<8, sizeof(WsNotice)> g_wsNotices;
+
+// --- METRICS ---
+// Scraped at /metrics (Prometheus text). Recording is a relaxed atomic add;
+// each histogram has a single writer: loop() for loop and sensor timings,
+// the uplink task (or loop() without it) for uplink timings.
+enum UplinkProtocol : uint8_t
+{
+  UPLINK_HTTP,
+  UPLINK_MQTT,
+  UPLINK_SDK,
+  UPLINK_PROTOCOLS
+};
+static const char *const kUplinkProtocolNames[UPLINK_PROTOCOLS] = {"http", "mqtt", "sdk"};
+
+// One implementation per protocol (kUplinkDrivers), chosen by setupIoTHub().
+// URLs, topics and clients are prepared in begin(), so sends do no string
+// building or protocol compares.
+struct UplinkDriver
+{
+  void (*begin)();                // precompute URL / topic, configure the client
+  void (*end)();                  // drop connections (config reload)
+  void (*service)();              // every uplink pass: keepalive, reconnect, DoWork
+  bool (*ready)();                // false: leave the queue alone this pass
+  uint32_t (*send)(uint32_t now); // deliver from the queue front; messages sent
+};
+extern const UplinkDriver kUplinkDrivers[UPLINK_PROTOCOLS];
+const UplinkDriver *g_uplink = &kUplinkDrivers[UPLINK_HTTP]; // owned by the uplink task
+uint8_t g_uplinkProto = UPLINK_HTTP;
+static const uint32_t kLoopBoundsUs[] = {100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000};
+static const uint32_t kUplinkBoundsUs[] = {50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+static const uint32_t kSensorBoundsUs[] = {100, 500, 1000, 5000, 10000, 50000, 100000};
+static const uint32_t kReconnectBoundsUs[] = {500000, 1000000, 2500000, 5000000, 10000000, 30000000, 60000000, 120000000};
+#define BOUNDS(a) a, (uint8_t)(sizeof(a) / sizeof(a[0]))
+
+struct UplinkMetrics
+{
+  MetricCounter sent, failed; // messages
+  LatencyHistogram latency{BOUNDS(kUplinkBoundsUs)};
+};
+struct MqttMetrics
+{
+  MetricCounter publishes, messages, connects;
+  MetricGauge connected;
+  LatencyHistogram reconnect{BOUNDS(kReconnectBoundsUs)};
+};
+struct SensorReadMetrics
+{
+  LatencyHistogram duration{BOUNDS(kSensorBoundsUs)};
+};
+struct MeshOtaNodeMetrics
+{
+  MetricGauge id, percent, repeats;
+};
+struct GatewayMetrics
+{
+  LatencyHistogram loop{BOUNDS(kLoopBoundsUs)};
+  UplinkMetrics uplink[UPLINK_PROTOCOLS];
+  MqttMetrics mqtt;
+  MetricGauge sdkInflight;
+  MetricCounter sdkRetries, sdkRequeued;
+  MetricGauge queueDepth, queueOnDisk, queueDropped, queueExpired;
+  MetricCounter meshJson, meshFrames, meshSchemas, meshInvalid, meshDuplicates;
+  MetricCounter ownRaw, ownSummaries, ownAlerts;
+  MetricGauge valvesOpen;
+  MetricCounter wateringRuns;
+  MetricCounter meshOtaParts, meshOtaNodes, meshOtaHeld;
+  MetricGauge meshOtaTracked; // g_meshOta node table, set by updateMeshOtaMetrics()
+  MeshOtaNodeMetrics meshOtaNode[MESH_OTA_MAX_NODES];
+  SensorReadMetrics sensorRead[(uint8_t)SensorKind::COUNT];
+};
+GatewayMetrics g_metrics;
+
+// --- TRACE ---
+// Build with -D LOOP_TRACE (env:esp32gateway_trace) for scoped trace points
+// in loop() and the uplink task; without it TRACE_SCOPE compiles to nothing.
+// Dump with GET /trace or 't' on the serial console: Chrome trace-event
+// JSON for chrome://tracing or ui.perfetto.dev.
+#ifdef LOOP_TRACE
+#ifndef LOOP_TRACE_EVENTS
+#define LOOP_TRACE_EVENTS 256
+#endif
+TraceRing<LOOP_TRACE_EVENTS> g_trace;
+
+struct TraceScope
+{
+  const char *name;
+  uint32_t startUs, startCycles;
+  explicit TraceScope(const char *n) : name(n), startUs(traceClockUs()), startCycles(ESP.getCycleCount()) {}
+  ~TraceScope() { g_trace.record(name, traceCore(), startUs, ESP.getCycleCount() - startCycles); }
+
+  // µs clock shared by both cores; the cycle counter is per core (tasks are pinned).
+  static uint32_t traceClockUs()
+  {
+#ifdef ESP32
+    return (uint32_t)esp_timer_get_time();
+#else
+    return micros();
+#endif
+  }
+  static uint8_t traceCore()
+  {
+#ifdef ESP32
+    return xPortGetCoreID();
+#else
+    return 0;
+#endif
+  }
+};
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) \
+  do                      \
+  {                       \
+  } while (0)
+#endif
+
+// --- CONFIG UPLOAD ---
+// /save_config streams into CONFIG_TMP_PATH on the async_tcp task; a valid
+// upload is parsed into g_pendingCfg and loop() applies it (reloadConfig()).
+// A second upload started meanwhile takes over; the first one gets a 409.
+struct ConfigUpload
+{
+  AsyncWebServerRequest *owner = nullptr;
+  File file;
+  uint32_t crc = 0;
+  int status = 0; // HTTP status once the body is complete
+  const char *error = nullptr;
+  bool restart = false;
+};
+ConfigUpload g_upload;
+ConfigImage g_pendingCfg;
+std::atomic<bool> g_cfgPending{false};
+std::atomic<bool> g_uplinkReloadRequested{false}; // uplink task: apply g_pendingCfg
 
 // Add this global
 bool g_meshInitialized = false;
 
+// --- MESH TELEMETRY SCHEMAS ---
+// Binary frames only carry sensor indexes; the names come from the schema
+// each node announces (JSON, "type":"schema") next to its frames.
+MeshIngest g_meshIngest(MESH_SCHEMA_MAX_NODES);
+
+// --- MESH OTA ---
+// Gateway: the node image is downloaded once into the idle app slot and
+// served part by part to the nodes that ask (see stageNodeImage()).
+MeshOtaImage g_meshOtaImage;          // staged image, kept in NVS
+MeshOtaServer g_meshOta;
+unsigned long g_meshHeardAt = 0;      // gateway: last node message (OTA holds off)
+unsigned long g_meshAnnouncedAt = 0;
+unsigned long g_meshOtaPartAt = 0;    // node: last OTA part received
+
 // --- SENSORS ---
+// DS18B20 conversions are per bus (pin); every sensor on the bus shares one.
+struct DallasConversion
+{
+  unsigned long readyAt = 0;
+  bool pending = false;
+};
+
+struct DallasBus
+{
+  OneWire wire;
+  DallasTemperature dt;
+  DallasConversion conv;
+  uint8_t pin;
+  explicit DallasBus(uint8_t p) : wire(p), dt(&wire), pin(p) {}
+};
+
 struct Sensor
 {
-  String name, type;
+  String name;
+  SensorKind kind = SensorKind::UNKNOWN;
   int pin = 0;
   int air_value = 4095, water_value = 0, index = 0;
   uint8_t address = 0;
-  DHT *dht = nullptr;
-  OneWire *oneWire = nullptr;
-  DallasTemperature *sensors = nullptr;
-  Adafruit_BME280 *bme = nullptr;
-  Adafruit_BMP280 *bmp = nullptr;
-  ~Sensor()
-  {
-    delete dht;
-    delete bme;
-    delete bmp;
-  }
+  int8_t adcSlot = -1; // cap soil: slot in g_soil.adc
+  DriverHandle driver; // DHT / BME280 / BMP280 or the shared DallasBus, in g_drivers
+  SensorKeys keys;     // telemetry keys, built at config load
+  // Latest completed acquisition (gateway scheduler).
+  SensorSample last;
+  unsigned long lastSampleAt = 0;
+  uint32_t busyUs = 0; // CPU time spent in start + collect for `last`
+};
+
+template <class T>
+constexpr size_t maxSizeOf() { return sizeof(T); }
+template <class T, class U, class... R>
+constexpr size_t maxSizeOf() { return sizeof(T) > maxSizeOf<U, R...>() ? sizeof(T) : maxSizeOf<U, R...>(); }
+
+// Driver objects live in one fixed arena, so config reloads reuse the same
+// slots instead of new/delete on a long-running heap. At most one slot per
+// sensor: sensors on one DS18B20 bus share it.
+DriverArena<maxSizeOf<DHT, Adafruit_BME280, Adafruit_BMP280, DallasBus>(), CONFIG_IMAGE_MAX_SENSORS> g_drivers;
+DriverHandle g_dallasBuses[CONFIG_IMAGE_MAX_SENSORS]; // found by pin; stale once freed
+// Moisture pins sampled together, one burst per round (see startCapSoil()).
+struct SoilBurst
+{
+  AdcBurst adc;
+  uint8_t pin[ADC_BURST_MAX_CHANNELS];
+  uint32_t dmaMask = 0; // ADC1 channels the DMA driver samples
+  uint8_t readPins = 0; // pins sampled with analogRead() instead
+  bool pending = false, dma = false, done = false;
+  unsigned long readyAt = 0, doneAt = 0;
 };
+SoilBurst g_soil;
 std::vector<Sensor> g_sensors;
-std::map<int, OneWire *> g_onewire_map;
-std::map<int, DallasTemperature *> g_dallas_map;
+AcquisitionScheduler g_acq;
+// Gateway: own samples folded into one summary per window ("aggregate" in
+// config.json); a limit crossing sends the raw values at once.
+TelemetryWindow<CONFIG_IMAGE_MAX_SENSORS> g_window;
+bool g_alertPending = false;
+// Valve events not sent yet; nodes hold them until the mesh is up.
+WateringAction g_wateringReports[WATERING_REPORT_SLOTS];
+uint8_t g_wateringReportCount = 0;
+bool g_wateringDue = false; // new zone reading: step before the next tick
+// Telemetry JSON (gateway own sensors / node fallback), sized for the
+// current sensor set by buildSensors(); reused for every message.
+std::vector<char> g_telemetryBuf;
 
 // --- FORWARD DECLARATIONS ---
 void forwardToIoTHub(const String &payload);
+void forwardToIoTHub(const char *payload, size_t len);
+void meshSendToRoot(const char *payload, size_t len);
+bool httpPost(const char *body, size_t len, const char *contentType, uint32_t messages);
+void beginTelemetryQueue();
+void drainTelemetryQueue();
+void serviceMqtt();
+void serviceSdk();
+void sdkResetWindow();
+void persistTelemetryQueue();
+void updateQueueMetrics();
+void startUplinkTask();
 void meshReceivedCallback(uint32_t from, String &msg);
-void clearSensors();
 void readConfig();
+bool reloadConfig(const ConfigImage &next);
+void setUplinkSettings(const ConfigImage &img);
+void applyUplinkConfig(const ConfigImage &img);
+void noteFirstTransmit();
+void requestDallasConversions();
+bool pollSensors();
+void publishLiveSnapshot();
+void sendNodeTelemetry();
+bool nodeTakeSample();
+void nodeSleep();
+void pumpLivePush();
+void reportAcquisitionTimes();
+void beginWindow(const ConfigImage &img);
+void sendOwnTelemetry(bool alert);
+void sendWindowSummary(unsigned long now);
+void sampleSensor(const Sensor &s, SensorSample &out);
+void setupWatering(const ConfigImage &img, bool keep);
+void configureZones(const ConfigImage &img);
+void wateringReading(uint8_t sensor, const SensorSample &v);
+void serviceWatering();
+void stopWatering();
+void flushWateringReports();
+void startClock();
+void addSampleNested(JsonObject obj, const SensorSample &v);
 bool connectSTA();
 void startAPMode();
 void setupMesh();
-#ifdef ESP32
 void setupIoTHub();
+#ifdef ESP32
+void setupMqtt();
+void setupSdk();
 void checkOTA();
 #endif
+void beginMeshOta();
+void serviceMeshOta();
 
 void setupWebServer();
 
 // --- MESH CALLBACK ---
+// Nodes send JSON ('{') or a TelemetryFrame in text form ('~'); both leave
+// the gateway as the same JSON telemetry.
+void pushMeshEvent(uint32_t from, const char *json)
+{
+  if (!g_push.clientCount())
+    return;
+  static char frame[LIVE_PUSH_EVENT_BYTES];
+  int n = snprintf(frame, sizeof(frame), "{\"type\":\"mesh\",\"from\":%u,\"data\":%s}",
+                   (unsigned)from, json);
+  if (n > 0 && (size_t)n < sizeof(frame))
+    g_push.publishEvent(frame, n);
+}
+
+void storeNodeSchema(uint32_t from, JsonDocument &doc)
+{
+  const char *names[TELEMETRY_FRAME_MAX_SENSORS];
+  SensorKind kinds[TELEMETRY_FRAME_MAX_SENSORS];
+  uint8_t count = 0;
+  for (JsonObject s : doc["sensors"].as<JsonArray>())
+  {
+    if (count == TELEMETRY_FRAME_MAX_SENSORS)
+      break;
+    names[count] = s["name"] | "";
+    kinds[count++] = sensorKindFromString(s["type"] | "");
+  }
+  g_meshIngest.setSchema(from, doc["schema"] | 0, doc["firmwareVersion"] | "", names, kinds, count);
+}
+
+static void forwardMeshMessage(uint32_t from, const char *json, size_t len, void *)
+{
+  forwardToIoTHub(json, len);
+  pushMeshEvent(from, json);
+}
+
 void meshReceivedCallback(uint32_t from, String &msg)
 {
   if (g_mode != DeviceMode::GATEWAY)
     return;
+  g_meshHeardAt = millis();
+  // Retransmissions and copies that took another path carry the same seq.
+  uint32_t seq;
+  size_t at = meshSeqParse(msg.c_str(), msg.length(), seq);
+  if (at && !g_meshDedup.firstSeen(from, seq, millis()))
+  {
+    g_metrics.meshDuplicates.add();
+    return;
+  }
+  const char *body = msg.c_str() + at;
+  size_t len = msg.length() - at;
+  if (len && body[0] == TELEMETRY_FRAME_PREFIX)
+  {
+    if (g_meshIngest.onFrameText(from, body, len, WiFi.RSSI(), forwardMeshMessage, nullptr) < 0)
+    {
+      g_metrics.meshInvalid.add();
+      Serial.printf("[MESH] Dropped undecodable frame from %u\n", from);
+      return;
+    }
+    g_metrics.meshFrames.add();
+    return;
+  }
   JsonDocument doc;
-  if (deserializeJson(doc, msg) != DeserializationError::Ok)
+  if (deserializeJson(doc, body, len) != DeserializationError::Ok)
+  {
+    g_metrics.meshInvalid.add();
+    return;
+  }
+  if (doc["type"] == "schema")
+  {
+    g_metrics.meshSchemas.add();
+    storeNodeSchema(from, doc);
     return;
+  }
+  g_metrics.meshJson.add();
   doc["rssi"] = WiFi.RSSI();
   String out;
   serializeJson(doc, out);
   forwardToIoTHub(out);
+  pushMeshEvent(from, out.c_str());
 }
 
-// --- CONFIG FUNCTIONS ---
-void clearSensors()
+// --- SENSOR DRIVERS ---
+// One entry per SensorKind. readConfig() resolves the "type" string once;
+// every sampling site goes through sampleSensor() (no string compares, no heap).
+// `start` begins a conversion and returns the ms until `sample` may read it
+// (nullptr: readable right away).
+struct SensorDriver
+{
+  void (*setup)(Sensor &s, const SensorConfig &cfg);
+  uint32_t (*start)(Sensor &s, unsigned long now);
+  void (*sample)(const Sensor &s, SensorSample &out);
+};
+
+// Calibration only; buildSensors() joins every cap_soil sensor to the burst.
+static void setupCapSoil(Sensor &s, const SensorConfig &cfg)
+{
+  s.air_value = cfg.airValue;
+  s.water_value = cfg.waterValue;
+}
+
+// Joins the moisture burst: ADC1 pins go to the DMA driver, any other pin
+// is read with analogRead() under a pseudo channel (8..15).
+static void joinSoilBurst(Sensor &s)
+{
+  for (uint8_t i = 0; i < g_soil.adc.channels(); i++)
+  {
+    if (g_soil.pin[i] == s.pin)
+    {
+      s.adcSlot = i;
+      return;
+    }
+  }
+  int ch = -1;
+#ifdef SOIL_BURST_DMA
+  ch = digitalPinToAnalogChannel(s.pin);
+#endif
+  bool dma = ch >= 0 && ch < 8;
+  s.adcSlot = g_soil.adc.addChannel(dma ? ch : 8 + g_soil.readPins);
+  if (s.adcSlot < 0)
+  {
+    Serial.printf("[SENSORS] %s: no ADC burst slot left, not sampled\n", s.name.c_str());
+    return;
+  }
+  g_soil.pin[s.adcSlot] = s.pin;
+  if (dma)
+    g_soil.dmaMask |= 1u << ch;
+  else
+    g_soil.readPins++;
+}
+
+#ifdef SOIL_BURST_DMA
+// Starts the DMA driver on every ADC1 moisture channel; the whole burst
+// fits its buffer, so nothing is lost before collectSoilDma().
+static bool startSoilDma()
+{
+  adc_digi_pattern_config_t pattern[ADC_BURST_MAX_CHANNELS] = {};
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < g_soil.adc.channels(); i++)
+  {
+    if (g_soil.adc.channel(i) >= 8)
+      continue;
+    pattern[n].atten = ADC_ATTEN_DB_11;
+    pattern[n].channel = g_soil.adc.channel(i);
+    pattern[n].unit = 0; // ADC1
+    pattern[n].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    n++;
+  }
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = n * ADC_BURST_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES + SOIL_DMA_FRAME_BYTES;
+  init.conv_num_each_intr = SOIL_DMA_FRAME_BYTES;
+  init.adc1_chan_mask = g_soil.dmaMask;
+  if (adc_digi_initialize(&init) != ESP_OK)
+    return false;
+  adc_digi_configuration_t cfg = {};
+  cfg.conv_limit_en = true;
+  cfg.conv_limit_num = 250;
+  cfg.pattern_num = n;
+  cfg.adc_pattern = pattern;
+  cfg.sample_freq_hz = SOIL_BURST_FREQ_HZ;
+  cfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  cfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&cfg) != ESP_OK || adc_digi_start() != ESP_OK)
+  {
+    adc_digi_deinitialize();
+    return false;
+  }
+  return true;
+}
+
+static bool soilDmaFull()
+{
+  for (uint8_t i = 0; i < g_soil.adc.channels(); i++)
+    if (g_soil.adc.channel(i) < 8 && g_soil.adc.count(i) < ADC_BURST_SAMPLES)
+      return false;
+  return true;
+}
+
+// Drains the burst from the DMA buffer (blocks only if called early) and
+// releases the driver, so analogRead() works on ADC1 again.
+static void collectSoilDma()
+{
+  static uint8_t buf[SOIL_DMA_FRAME_BYTES];
+  uint32_t got = 0;
+  uint32_t timeoutMs = g_soil.adc.conversions() * 1000 / SOIL_BURST_FREQ_HZ + 20;
+  while (!soilDmaFull() && adc_digi_read_bytes(buf, sizeof(buf), &got, timeoutMs) == ESP_OK)
+    g_soil.adc.feedType1(buf, got);
+  adc_digi_stop();
+  adc_digi_deinitialize();
+}
+#endif
+
+// Kicks a burst; returns the ms until it can be collected.
+static uint32_t startSoilBurst(unsigned long now)
+{
+  g_soil.adc.reset();
+  g_soil.done = false;
+  g_soil.pending = true;
+  g_soil.dma = false;
+  uint32_t waitMs = 0;
+#ifdef SOIL_BURST_DMA
+  if (g_soil.dmaMask && startSoilDma())
+  {
+    g_soil.dma = true;
+    uint8_t dmaChannels = __builtin_popcount(g_soil.dmaMask);
+    waitMs = (dmaChannels * ADC_BURST_SAMPLES * 1000 + SOIL_BURST_FREQ_HZ - 1) / SOIL_BURST_FREQ_HZ + 1;
+  }
+#endif
+  g_soil.readyAt = now + waitMs;
+  return waitMs;
+}
+
+// Collects the running burst: DMA channels from the buffer, the rest (or
+// all of them, if DMA is unavailable) with a few analogRead()s, then reduces.
+static void finishSoilBurst()
+{
+  if (!g_soil.pending)
+    return;
+#ifdef SOIL_BURST_DMA
+  if (g_soil.dma)
+    collectSoilDma();
+#endif
+  for (uint8_t i = 0; i < g_soil.adc.channels(); i++)
+    while (g_soil.adc.count(i) < SOIL_READ_SAMPLES)
+      g_soil.adc.add(i, analogRead(g_soil.pin[i]));
+  g_soil.adc.reduce(SOIL_BURST_TRIM_PERCENT);
+  g_soil.pending = false;
+  g_soil.done = true;
+  g_soil.doneAt = millis();
+}
+
+// First moisture sensor of a round starts the burst; the others wait for it
+// or reuse its result.
+static uint32_t startCapSoil(Sensor &, unsigned long now)
+{
+  if (g_soil.pending)
+  {
+    long wait = (long)(g_soil.readyAt - now);
+    return wait > 0 ? (uint32_t)wait : 0;
+  }
+  if (g_soil.done && now - g_soil.doneAt < SOIL_BURST_REUSE_MS)
+    return 0;
+  return startSoilBurst(now);
+}
+
+static void sampleCapSoil(const Sensor &s, SensorSample &out)
+{
+  if (!g_soil.pending && !(g_soil.done && millis() - g_soil.doneAt < SOIL_BURST_REUSE_MS))
+    startSoilBurst(millis()); // one-shot sampling (node wake): burst right here
+  finishSoilBurst();
+  if (s.adcSlot < 0)
+    return;
+  int raw = g_soil.adc.value(s.adcSlot);
+  float pct = 100.0 * (s.air_value - raw) / (float)(s.air_value - s.water_value);
+  out.set(FIELD_MOISTURE, constrain(pct, 0, 100));
+}
+
+// Config load / reload: drops every pin (buildSensors() adds them back).
+static void clearSoilBurst()
+{
+#ifdef SOIL_BURST_DMA
+  if (g_soil.pending && g_soil.dma)
+  {
+    adc_digi_stop();
+    adc_digi_deinitialize();
+  }
+#endif
+  g_soil.adc.clear();
+  g_soil.dmaMask = 0;
+  g_soil.readPins = 0;
+  g_soil.pending = g_soil.dma = g_soil.done = false;
+}
+
+static void setupDht22(Sensor &s, const SensorConfig &cfg)
+{
+  s.driver = g_drivers.create<DHT>(s.pin, DHT22);
+  if (DHT *dht = g_drivers.get<DHT>(s.driver))
+    dht->begin();
+}
+
+static void sampleDht22(const Sensor &s, SensorSample &out)
+{
+  DHT *dht = g_drivers.get<DHT>(s.driver);
+  if (!dht)
+    return;
+  out.set(FIELD_TEMP, dht->readTemperature());
+  out.set(FIELD_HUM, dht->readHumidity());
+}
+
+// Joins the bus on s.pin (one more reference) or creates it.
+static void setupDs18b20(Sensor &s, const SensorConfig &cfg)
+{
+  s.index = cfg.index;
+  DriverHandle *slot = nullptr;
+  for (DriverHandle &h : g_dallasBuses)
+  {
+    DallasBus *bus = g_drivers.get<DallasBus>(h);
+    if (bus && bus->pin == s.pin)
+    {
+      g_drivers.retain(h);
+      s.driver = h;
+      return;
+    }
+    if (!bus && !slot)
+      slot = &h;
+  }
+  s.driver = g_drivers.create<DallasBus>((uint8_t)s.pin);
+  DallasBus *bus = g_drivers.get<DallasBus>(s.driver);
+  if (!bus)
+    return;
+  bus->dt.begin();
+  bus->dt.setWaitForConversion(false); // requestTemperatures() returns at once
+  *slot = s.driver; // g_dallasBuses has one entry per arena slot
+}
+
+// Starts a bus conversion unless one is still running for another sensor.
+static uint32_t startDs18b20(Sensor &s, unsigned long now)
+{
+  DallasBus *bus = g_drivers.get<DallasBus>(s.driver);
+  if (!bus)
+    return 0;
+  DallasConversion &conv = bus->conv;
+  if (!conv.pending || (long)(now - conv.readyAt) >= 0)
+  {
+    bus->dt.requestTemperatures();
+    conv.readyAt = now + bus->dt.millisToWaitForConversion(bus->dt.getResolution());
+    conv.pending = true;
+  }
+  long wait = (long)(conv.readyAt - now);
+  return wait > 0 ? (uint32_t)wait : 0;
+}
+
+// Reads the last conversion; start it first (startDs18b20 / requestDallasConversions).
+static void sampleDs18b20(const Sensor &s, SensorSample &out)
+{
+  if (DallasBus *bus = g_drivers.get<DallasBus>(s.driver))
+    out.set(FIELD_TEMP, bus->dt.getTempCByIndex(s.index));
+}
+
+static void setupBme280(Sensor &s, const SensorConfig &cfg)
+{
+  s.address = cfg.address;
+  s.driver = g_drivers.create<Adafruit_BME280>();
+  if (Adafruit_BME280 *bme = g_drivers.get<Adafruit_BME280>(s.driver))
+    bme->begin(s.address);
+}
+
+static void sampleBme280(const Sensor &s, SensorSample &out)
+{
+  Adafruit_BME280 *bme = g_drivers.get<Adafruit_BME280>(s.driver);
+  if (!bme)
+    return;
+  out.set(FIELD_TEMP, bme->readTemperature());
+  out.set(FIELD_HUM, bme->readHumidity());
+  out.set(FIELD_PRES, bme->readPressure() / 100.0F);
+}
+
+static void setupBmp280(Sensor &s, const SensorConfig &cfg)
+{
+  s.address = cfg.address;
+  s.driver = g_drivers.create<Adafruit_BMP280>();
+  if (Adafruit_BMP280 *bmp = g_drivers.get<Adafruit_BMP280>(s.driver))
+    bmp->begin(s.address);
+}
+
+static void sampleBmp280(const Sensor &s, SensorSample &out)
+{
+  Adafruit_BMP280 *bmp = g_drivers.get<Adafruit_BMP280>(s.driver);
+  if (!bmp)
+    return;
+  out.set(FIELD_TEMP, bmp->readTemperature());
+  out.set(FIELD_PRES, bmp->readPressure() / 100.0F);
+}
+
+// Indexed by SensorKind.
+static const SensorDriver kSensorDrivers[(uint8_t)SensorKind::COUNT] = {
+    {nullptr, nullptr, nullptr}, // UNKNOWN
+    {setupCapSoil, startCapSoil, sampleCapSoil},
+    {setupDht22, nullptr, sampleDht22},
+    {setupDs18b20, startDs18b20, sampleDs18b20},
+    {setupBme280, nullptr, sampleBme280},
+    {setupBmp280, nullptr, sampleBmp280},
+};
+
+// Blocking: convert on every DS18B20 bus (one request per pin) and wait.
+// Only for one-shot sampling (node wake); the gateway uses pollSensors().
+void requestDallasConversions()
+{
+  uint32_t waitMs = 0;
+  for (DriverHandle h : g_dallasBuses)
+  {
+    DallasBus *bus = g_drivers.get<DallasBus>(h);
+    if (!bus)
+      continue;
+    bus->dt.requestTemperatures();
+    waitMs = std::max<uint32_t>(waitMs, bus->dt.millisToWaitForConversion(bus->dt.getResolution()));
+  }
+  if (waitMs)
+    delay(waitMs);
+}
+
+void sampleSensor(const Sensor &s, SensorSample &out)
+{
+  out.mask = 0;
+  const SensorDriver &d = kSensorDrivers[(uint8_t)s.kind];
+  if (d.sample)
+    d.sample(s, out);
+}
+
+// --- SENSOR ACQUISITION ---
+// One scheduler step per loop() pass: start a conversion or collect one that
+// is ready. Results land in Sensor::last; nothing here waits on a bus.
+// Returns true when a new sample was collected.
+bool pollSensors()
+{
+  uint8_t id;
+  unsigned long now = millis();
+  AcquisitionScheduler::Action a = g_acq.next(now, id);
+  if (a == AcquisitionScheduler::NONE)
+    return false;
+
+  Sensor &s = g_sensors[id];
+  const SensorDriver &d = kSensorDrivers[(uint8_t)s.kind];
+  uint32_t t0 = micros();
+  if (a == AcquisitionScheduler::START)
+  {
+    uint32_t wait = d.start ? d.start(s, now) : 0;
+    g_acq.started(id, now, wait);
+    s.busyUs = micros() - t0;
+    if (wait > 0)
+      return false;
+    t0 = micros(); // nothing to wait for: collect in the same pass
+  }
+  SensorSample v;
+  sampleSensor(s, v);
+  s.last = v;
+  s.lastSampleAt = millis();
+  s.busyUs += micros() - t0;
+  g_acq.collected(id, s.lastSampleAt);
+  if (g_window.enabled() && g_window.add(id, v))
+    g_alertPending = true;
+  wateringReading(id, v);
+  g_metrics.sensorRead[(uint8_t)s.kind].duration.record(s.busyUs);
+  return true;
+}
+
+// /live_data body: { "<name>": { "<field>": .. }, .. } from Sensor::last.
+void publishLiveSnapshot()
+{
+  static char buf[LIVE_SNAPSHOT_BYTES];
+  JsonDocument doc;
+  JsonObject root = doc.to<JsonObject>();
+  for (const auto &s : g_sensors)
+    addSampleNested(root.createNestedObject(s.name), s.last);
+
+  if (measureJson(doc) >= sizeof(buf))
+  {
+    Serial.println("[SENSORS] Live snapshot too large, not published");
+    return;
+  }
+  size_t n = serializeJson(doc, buf, sizeof(buf));
+  unsigned long now = millis();
+  g_liveSnapshot.publish(buf, n, now);
+
+  if (g_push.clientCount())
+  {
+    static char frame[LIVE_SNAPSHOT_BYTES + 64];
+    int len = snprintf(frame, sizeof(frame), "{\"type\":\"sample\",\"ts\":%lu,\"sensors\":%.*s}",
+                       now, (int)n, buf);
+    if (len > 0 && (size_t)len < sizeof(frame))
+      g_push.publishLatest(frame, len);
+  }
+}
+
+// --- LIVE PUSH ---
+// async_tcp task: enforce the client limit and pass (dis)connects to loop().
+void onWsEvent(AsyncWebSocket *ws, AsyncWebSocketClient *client, AwsEventType type,
+               void *arg, uint8_t *data, size_t len)
+{
+  WsNotice n;
+  n.client = client->id();
+  if (type == WS_EVT_CONNECT)
+  {
+    if (ws->count() > LIVE_PUSH_MAX_CLIENTS)
+    {
+      client->close(1013, "Too many live clients");
+      return;
+    }
+    n.connected = true;
+    g_wsNotices.push(&n, sizeof(n));
+  }
+  else if (type == WS_EVT_DISCONNECT)
+  {
+    n.connected = false;
+    g_wsNotices.push(&n, sizeof(n));
+  }
+}
+
+// A client is fed only while its send queue is empty; a slow one is
+// skipped and later gets the newest sample instead of a backlog.
+static bool wsClientReady(uint32_t id, void *)
+{
+  AsyncWebSocketClient *c = g_ws.client(id);
+  return c && c->status() == WS_CONNECTED && c->queueLen() == 0;
+}
+
+static bool wsClientSend(uint32_t id, const char *data, size_t len, void *)
+{
+  AsyncWebSocketClient *c = g_ws.client(id);
+  if (!c || !c->canSend())
+    return false;
+  c->text(data, len);
+  return true;
+}
+
+void pumpLivePush()
+{
+  WsNotice n;
+  while (g_wsNotices.pop(&n, sizeof(n)) == sizeof(n))
+  {
+    if (!n.connected)
+      g_push.removeClient(n.client);
+    else if (!g_push.addClient(n.client))
+    {
+      AsyncWebSocketClient *c = g_ws.client(n.client);
+      if (c)
+        c->close(1013, "Too many live clients");
+    }
+  }
+  if (g_push.clientCount())
+    g_push.pump(wsClientReady, wsClientSend, nullptr);
+
+  static unsigned long lastCleanup = 0;
+  if (millis() - lastCleanup > 1000)
+  {
+    lastCleanup = millis();
+    g_ws.cleanupClients(LIVE_PUSH_MAX_CLIENTS);
+  }
+}
+
+void reportAcquisitionTimes()
+{
+  for (uint8_t i = 0; i < g_acq.count(); i++)
+  {
+    const AcquisitionScheduler::Timing &t = g_acq.timing(i);
+    Serial.printf("[SENSORS] %s: acquisition %u ms, busy %u us, every %u ms (%u samples)\n",
+                  g_sensors[i].name.c_str(), t.lastAcqMs, g_sensors[i].busyUs, t.periodMs, t.samples);
+  }
+}
+
+// Telemetry keys: "<name>" for single-value sensors, "<name>_<field>" otherwise.
+// /live_data layout: { "moisture": .. } / { "temp": .., "hum": .., "pres": .. }
+void addSampleNested(JsonObject obj, const SensorSample &v)
+{
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+  {
+    if (v.has((SensorField)f))
+      obj[sensorFieldName((SensorField)f)] = v.value[f];
+  }
+}
+
+// --- OWN TELEMETRY ---
+static void writeTelemetryHeader(JsonWriter &w)
+{
+  w.string("deviceId", g_deviceId.c_str());
+  w.string("firmwareVersion", FIRMWARE_VERSION);
+  w.integer("rssi", WiFi.RSSI());
+  w.boolean("gateway", true);
+}
+
+// Latest completed samples only; pollSensors() does the bus I/O.
+void sendOwnTelemetry(bool alert)
+{
+  JsonWriter w(g_telemetryBuf.data(), g_telemetryBuf.size());
+  writeTelemetryHeader(w);
+  if (alert)
+    w.boolean("alert", true);
+  for (const auto &s : g_sensors)
+    w.sample(s.keys, s.last);
+  if (!alert)
+    reportAcquisitionTimes();
+
+  size_t n = w.finish();
+  if (!n)
+  {
+    Serial.printf("[GATEWAY] Telemetry did not fit %u bytes\n", (unsigned)g_telemetryBuf.size());
+    return;
+  }
+  Serial.print(alert ? "[GATEWAY] Alert, sending own sensors: " : "[GATEWAY] Sending own sensors: ");
+  Serial.write((const uint8_t *)g_telemetryBuf.data(), n);
+  Serial.println();
+  forwardToIoTHub(g_telemetryBuf.data(), n);
+  (alert ? g_metrics.ownAlerts : g_metrics.ownRaw).add();
+}
+
+// Per field: the window mean under the usual key (readers of raw messages
+// keep working), plus "_min", "_max", "_ewma" and the sample count "_n".
+static void writeSensorSummary(JsonWriter &w, uint8_t i)
+{
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+  {
+    const FieldStats &st = g_window.field(i, (SensorField)f);
+    if (!st.count)
+      continue;
+    w.statistic(g_sensors[i].keys, (SensorField)f, "", st.mean);
+    w.statistic(g_sensors[i].keys, (SensorField)f, "_min", st.min);
+    w.statistic(g_sensors[i].keys, (SensorField)f, "_max", st.max);
+    w.statistic(g_sensors[i].keys, (SensorField)f, "_ewma", st.ewma);
+    w.statistic(g_sensors[i].keys, (SensorField)f, "_n", st.count);
+  }
+}
+
+// Closes the window. Sensors go into as few messages as fit a hand-off
+// slot; messages after the first carry "part": 1, 2, ...
+void sendWindowSummary(unsigned long now)
+{
+  // A part that fits a queue RAM slot never goes to flash on a healthy link.
+  size_t cap = std::min<size_t>(g_telemetryBuf.size(), g_queueCfg.slotSize);
+  uint8_t i = 0, part = 0;
+  while (i < g_sensors.size())
+  {
+    JsonWriter w(g_telemetryBuf.data(), cap);
+    writeTelemetryHeader(w);
+    w.integer("windowSec", g_window.windowMs() / 1000);
+    if (part)
+      w.integer("part", part);
+    uint8_t first = i;
+    for (; i < g_sensors.size(); i++)
+    {
+      size_t mark = w.mark();
+      writeSensorSummary(w, i);
+      if (!w.ok() || w.mark() + 2 > cap) // '}' and NUL must still fit
+      {
+        w.restore(mark);
+        break;
+      }
+    }
+    if (i == first)
+    {
+      Serial.printf("[GATEWAY] Summary of %s does not fit a message, skipped\n", g_sensors[i].name.c_str());
+      i++;
+      continue;
+    }
+    size_t n = w.finish();
+    Serial.print("[GATEWAY] Sending window summary: ");
+    Serial.write((const uint8_t *)g_telemetryBuf.data(), n);
+    Serial.println();
+    forwardToIoTHub(g_telemetryBuf.data(), n);
+    g_metrics.ownSummaries.add();
+    part++;
+  }
+  reportAcquisitionTimes();
+  g_window.close(now);
+}
+
+// Restarts aggregation for the sensor set and window settings of `img`
+// (a partial window is dropped) and sizes g_telemetryBuf for summaries.
+void beginWindow(const ConfigImage &img)
+{
+  g_window.begin(img.windowSec * 1000UL, img.ewmaPercent / 100.0f, millis());
+  g_alertPending = false;
+  size_t bytes = TELEMETRY_HEADER_BYTES;
+  for (uint8_t i = 0; i < img.sensorCount && i < g_sensors.size(); i++)
+  {
+    const SensorConfig &sc = img.sensors[i];
+    FieldLimits limits[FIELD_COUNT] = {};
+    for (uint8_t f = 0; f < FIELD_COUNT; f++)
+    {
+      limits[f].has = (sc.alertMask >> (2 * f)) & 3;
+      limits[f].below = telemetryUnscale((SensorField)f, sc.alertBelow[f]);
+      limits[f].above = telemetryUnscale((SensorField)f, sc.alertAbove[f]);
+      limits[f].hysteresis = telemetryUnscale((SensorField)f, img.alertHysteresis[f]);
+    }
+    g_window.setLimits(i, limits);
+    bytes += 5 * sensorKeysStatBytes(g_sensors[i].keys, WINDOW_SUFFIX_BYTES);
+  }
+  if (img.windowSec && g_telemetryBuf.size() < bytes)
+    g_telemetryBuf.resize(bytes);
+  if (img.windowSec)
+    Serial.printf("[GATEWAY] Aggregating own sensors over %u s windows\n", (unsigned)img.windowSec);
+}
+
+// --- WATERING ---
+// Valves are decided here from the zone's own moisture sensor (or a timer),
+// not by a round trip through the cloud; every open / close is reported.
+static void writeOutput(uint8_t pin, bool activeLow, bool on)
+{
+  digitalWrite(pin, on != activeLow ? HIGH : LOW);
+}
+
+// Controller clock. Nodes add the slept time, so rest periods and stale
+// readings span deep sleep.
+static uint32_t wateringNow()
+{
+  if (g_mode == DeviceMode::NODE)
+    return g_nodeLog.clockSec * 1000 + millis();
+  return millis();
+}
+
+// Local minute of the day, -1 until SNTP has set the clock.
+static int16_t minuteOfDay()
+{
+  time_t now = time(nullptr);
+  if (now < CLOCK_VALID_AFTER)
+    return -1;
+  struct tm t;
+  localtime_r(&now, &t);
+  return (int16_t)(t.tm_hour * 60 + t.tm_min);
+}
+
+// After the STA link is up: schedules need the local time.
+void startClock()
+{
+  if (!g_cfgImage.zoneCount)
+    return;
+#ifdef ESP32
+  configTzTime(g_cfgImage.timezone, NTP_SERVER);
+#else
+  configTime(g_cfgImage.timezone, NTP_SERVER);
+#endif
+}
+
+// Drives the valves and the pump and queues the events for the uplink.
+static void applyWateringActions(const WateringAction *a, uint8_t n)
+{
+  for (uint8_t i = 0; i < n; i++)
+  {
+    const ZoneConfig &z = g_cfgImage.zones[a[i].zone];
+    writeOutput(z.valvePin, z.activeLow, a[i].open);
+    Serial.printf("[WATER] %s %s (%s, %.1f %%)\n", z.name, a[i].open ? "open" : "closed",
+                  wateringReasonName(a[i].reason), a[i].moisture);
+    if (a[i].open)
+      g_metrics.wateringRuns.add();
+    if (g_wateringReportCount < WATERING_REPORT_SLOTS)
+      g_wateringReports[g_wateringReportCount++] = a[i];
+    else
+      Serial.println("[WATER] Report buffer full, event not sent");
+  }
+  uint8_t open = g_watering.running();
+  if (g_cfgImage.pumpPin != CONFIG_IMAGE_NO_PIN)
+    writeOutput(g_cfgImage.pumpPin, g_cfgImage.pumpActiveLow, open > 0);
+  g_metrics.valvesOpen.set(open);
+}
+
+// One message per event: {"event":"watering","zone":..,"valve":"open"|"closed",
+// "reason":..,"moisture":..,"runSec":..}.
+void flushWateringReports()
+{
+  char buf[TELEMETRY_HEADER_BYTES];
+  for (uint8_t i = 0; i < g_wateringReportCount; i++)
+  {
+    const WateringAction &a = g_wateringReports[i];
+    JsonWriter w(buf, sizeof(buf));
+    w.string("deviceId", g_deviceId.c_str());
+    w.string("firmwareVersion", FIRMWARE_VERSION);
+    w.string("event", "watering");
+    w.string("zone", g_cfgImage.zones[a.zone].name);
+    w.string("valve", a.open ? "open" : "closed");
+    w.string("reason", wateringReasonName(a.reason));
+    w.number("moisture", a.moisture, 4);
+    if (!a.open)
+      w.integer("runSec", a.runMs / 1000);
+    size_t n = w.finish();
+    if (n)
+      forwardToIoTHub(buf, n);
+  }
+  g_wateringReportCount = 0;
+}
+
+// Boot or zone change. Pins start closed. `keep`: a deep-sleep wake
+// continues the zone states (rest times, timer runs); otherwise they start
+// over. A valve found open was cut by a reset and is reported closed.
+void setupWatering(const ConfigImage &img, bool keep)
+{
+  for (uint8_t z = 0; z < img.zoneCount; z++)
+  {
+    pinMode(img.zones[z].valvePin, OUTPUT);
+    writeOutput(img.zones[z].valvePin, img.zones[z].activeLow, false);
+  }
+  if (img.pumpPin != CONFIG_IMAGE_NO_PIN)
+  {
+    pinMode(img.pumpPin, OUTPUT);
+    writeOutput(img.pumpPin, img.pumpActiveLow, false);
+  }
+  if (!img.zoneCount)
+  {
+    g_watering.reset(0, 0);
+    return;
+  }
+  setenv("TZ", img.timezone, 1); // RTC time survives deep sleep, the TZ variable does not
+  tzset();
+
+  bool valid = g_watering.valid() && g_watering.zones == img.zoneCount;
+  if (valid && g_watering.running())
+  {
+    WateringAction a[WATERING_MAX_ZONES];
+    uint8_t n = g_watering.stopAll(wateringNow(), a, WATERING_MAX_ZONES);
+    applyWateringActions(a, n);
+  }
+  if (!keep || !valid)
+    g_watering.reset(img.zoneCount, img.maxConcurrent);
+  configureZones(img);
+  Serial.printf("[WATER] %u zones, %u valves at once%s\n", img.zoneCount, img.maxConcurrent,
+                keep && valid ? " (state kept)" : "");
+}
+
+// Zone settings only; open valves stay open (sensor reload: new periods
+// move the stale limits).
+void configureZones(const ConfigImage &img)
+{
+  for (uint8_t z = 0; z < img.zoneCount; z++)
+  {
+    const ZoneConfig &zc = img.zones[z];
+    WateringZone cfg = {};
+    cfg.hasSensor = zc.sensor != CONFIG_IMAGE_NO_PIN;
+    cfg.startBelow = telemetryUnscale(FIELD_MOISTURE, zc.startBelow);
+    cfg.stopAbove = telemetryUnscale(FIELD_MOISTURE, zc.stopAbove);
+    cfg.maxRunMs = zc.maxRunSec * 1000;
+    cfg.minOffMs = zc.minOffSec * 1000;
+    uint32_t periodMs = cfg.hasSensor ? img.sensors[zc.sensor].periodMs : 0;
+    cfg.staleMs = WATERING_STALE_PERIODS * std::max<uint32_t>(periodMs, WATERING_NODE_POLL_MS);
+    cfg.fromMin = zc.fromMin;
+    cfg.toMin = zc.toMin;
+    g_watering.configure(z, cfg);
+  }
+  g_watering.seal();
+  g_wateringDue = true;
+}
+
+// Config change: every valve closes before the zones are set up again.
+void stopWatering()
+{
+  WateringAction a[WATERING_MAX_ZONES];
+  uint8_t n = g_watering.stopAll(wateringNow(), a, WATERING_MAX_ZONES);
+  applyWateringActions(a, n);
+}
+
+// A new sample of sensor `sensor` for the zones watching it.
+void wateringReading(uint8_t sensor, const SensorSample &v)
+{
+  uint32_t now = wateringNow();
+  for (uint8_t z = 0; z < g_watering.zones; z++)
+  {
+    if (g_cfgImage.zones[z].sensor != sensor)
+      continue;
+    g_watering.reading(z, v.has(FIELD_MOISTURE) ? v.value[FIELD_MOISTURE] : NAN, now);
+    g_wateringDue = true;
+  }
+}
+
+// loop(): steps the zones on a new reading or every WATERING_STEP_MS. A
+// node has no scheduler running, so while a valve is open it re-reads the
+// zone sensors itself.
+void serviceWatering()
+{
+  if (!g_watering.zones)
+    return;
+  static unsigned long lastStep = 0, lastPoll = 0;
+  unsigned long now = millis();
+  if (g_mode == DeviceMode::NODE && g_watering.running() && now - lastPoll >= WATERING_NODE_POLL_MS)
+  {
+    lastPoll = now;
+    for (uint8_t z = 0; z < g_watering.zones; z++)
+    {
+      uint8_t i = g_cfgImage.zones[z].sensor;
+      if (i >= g_sensors.size())
+        continue;
+      sampleSensor(g_sensors[i], g_sensors[i].last);
+      wateringReading(i, g_sensors[i].last);
+    }
+  }
+  if (!g_wateringDue && now - lastStep < WATERING_STEP_MS)
+    return;
+  TRACE_SCOPE("watering");
+  g_wateringDue = false;
+  lastStep = now;
+  WateringAction a[2 * WATERING_MAX_ZONES];
+  uint8_t n = g_watering.step(wateringNow(), minuteOfDay(), a, 2 * WATERING_MAX_ZONES);
+  applyWateringActions(a, n);
+  if (g_mode == DeviceMode::GATEWAY)
+    flushWateringReports();
+}
+
+// --- CONFIG FUNCTIONS ---
+// "alertBelow" / "alertAbove": a number for single-value kinds, otherwise
+// an object keyed by field ({"temp": 35}). Fields the kind lacks are ignored.
+static void parseAlertLimits(JsonObject obj, SensorConfig &sc)
+{
+  static const char *const kKeys[] = {"alertBelow", "alertAbove"};
+  static const uint8_t kBits[] = {FieldLimits::BELOW, FieldLimits::ABOVE};
+  uint8_t fields = sensorKindFields(sc.kind);
+  for (uint8_t side = 0; side < 2; side++)
+  {
+    JsonVariant limits = obj[kKeys[side]];
+    int16_t *limit = side ? sc.alertAbove : sc.alertBelow;
+    for (uint8_t f = 0; f < FIELD_COUNT; f++)
+    {
+      if (!(fields & FIELD_BIT(f)))
+        continue;
+      JsonVariant v = limits.is<JsonObject>() ? limits[sensorFieldName((SensorField)f)]
+                                             : sensorKindIsScalar(sc.kind) ? limits : JsonVariant();
+      if (!v.is<float>())
+        continue;
+      limit[f] = telemetryScale((SensorField)f, v.as<float>());
+      sc.alertMask |= kBits[side] << (2 * f);
+    }
+  }
+}
+
+// "HH:MM" -> minute of the day; -1 if malformed.
+static int16_t parseTimeOfDay(const char *text)
+{
+  unsigned h, m;
+  char end;
+  if (sscanf(text, "%2u:%2u%c", &h, &m, &end) != 2 || h > 23 || m > 59)
+    return -1;
+  return (int16_t)(h * 60 + m);
+}
+
+// "watering" settings and the "zones" array; sensors must be parsed already
+// (a zone names its moisture sensor). Zones with a bad sensor or time are
+// an error for uploads and skipped at boot, like unknown sensor types.
+static const char *parseZones(JsonDocument &doc, ConfigImage &img, bool strict)
+{
+  static char error[96];
+  JsonObject watering = doc["watering"];
+  img.maxConcurrent = watering["maxConcurrent"] | 1;
+  img.pumpPin = watering["pumpPin"] | CONFIG_IMAGE_NO_PIN;
+  img.pumpActiveLow = watering["pumpActiveLow"] | false;
+  if (!configImageSetString(img.timezone, sizeof(img.timezone), watering["timezone"] | "UTC0"))
+    return "watering timezone too long";
+
+  for (JsonVariant v : doc["zones"].as<JsonArray>())
+  {
+    JsonObject obj = v.as<JsonObject>();
+    if (strict && (obj.isNull() || !obj["valvePin"].is<uint8_t>()))
+      return "each zone must be an object with an integer valvePin (0-255)";
+    if (img.zoneCount == CONFIG_IMAGE_MAX_ZONES)
+    {
+      snprintf(error, sizeof(error), "more than %d zones", CONFIG_IMAGE_MAX_ZONES);
+      if (strict)
+        return error;
+      Serial.printf("[CONFIG] %s – rest skipped\n", error);
+      break;
+    }
+    ZoneConfig &z = img.zones[img.zoneCount];
+    if (!configImageSetString(z.name, sizeof(z.name), obj["name"] | ""))
+    {
+      snprintf(error, sizeof(error), "zone name too long (max %u)", (unsigned)sizeof(z.name) - 1);
+      return error;
+    }
+    z.valvePin = obj["valvePin"] | CONFIG_IMAGE_NO_PIN;
+    z.activeLow = obj["activeLow"] | false;
+    z.startBelow = telemetryScale(FIELD_MOISTURE, obj["startBelow"] | 30.0f);
+    z.stopAbove = telemetryScale(FIELD_MOISTURE, obj["stopAbove"] | 45.0f);
+    z.maxRunSec = obj["maxRunSec"] | 300;
+    z.minOffSec = obj["minOffSec"] | 600;
+    z.sensor = CONFIG_IMAGE_NO_PIN;
+    const char *sensor = obj["sensor"] | "";
+    for (uint8_t i = 0; i < img.sensorCount && sensor[0]; i++)
+      if (!strcmp(img.sensors[i].name, sensor))
+        z.sensor = i;
+    int16_t from = parseTimeOfDay(obj["from"] | "00:00");
+    int16_t to = parseTimeOfDay(obj["to"] | "00:00");
+    const char *bad = z.valvePin == CONFIG_IMAGE_NO_PIN            ? "no valvePin"
+                      : sensor[0] && z.sensor == CONFIG_IMAGE_NO_PIN ? "unknown sensor"
+                      : from < 0 || to < 0                           ? "from / to must be HH:MM"
+                                                                     : nullptr;
+    if (bad)
+    {
+      snprintf(error, sizeof(error), "zone %s: %s", z.name, bad);
+      if (strict)
+        return error;
+      Serial.printf("[CONFIG] %s – skipped\n", error);
+      continue;
+    }
+    z.fromMin = (uint16_t)from;
+    z.toMin = (uint16_t)to;
+    img.zoneCount++;
+  }
+  return nullptr;
+}
+
+// Parses a config file into `img`; returns nullptr or what is wrong with it.
+// Strings that do not fit their field make the whole config invalid rather
+// than silently truncated. `strict` (uploads) also enforces the schema:
+// key types, enum values, sensor types and configImageCheck(). At boot an
+// unknown sensor type is only skipped, so an older file still loads.
+const char *parseConfigFile(const char *path, ConfigImage &img, bool strict)
+{
+  static char error[96];
+  File f = LittleFS.open(path, "r");
+  if (!f)
+    return "no config file";
+
+  JsonDocument doc;
+  DeserializationError jsonError = deserializeJson(doc, f);
+  f.close();
+  if (jsonError)
+  {
+    snprintf(error, sizeof(error), "invalid JSON: %s", jsonError.c_str());
+    return error;
+  }
+  if (!doc.is<JsonObject>())
+    return "config must be a JSON object";
+
+  String payload;
+  serializeJson(doc, payload);
+  Serial.println("[CONFIG] " + String(path) + ": " + payload);
+
+  if (strict)
+  {
+    static const char *const kStrings[] = {"mode", "SSID", "PASSWORD", "IOTHUB_HOST", "DEVICE_ID",
+                                           "SAS_TOKEN", "PROTOCOL", "firmwareUrl", "nodeFirmwareUrl",
+                                           "meshEncoding"};
+    for (const char *key : kStrings)
+      if (!doc[key].isNull() && !doc[key].is<const char *>())
+      {
+        snprintf(error, sizeof(error), "\"%s\" must be a string", key);
+        return error;
+      }
+    static const char *const kNumbers[] = {"sleepSeconds", "batchWakes"};
+    for (const char *key : kNumbers)
+      if (!doc[key].isNull() && !doc[key].is<uint32_t>())
+      {
+        snprintf(error, sizeof(error), "\"%s\" must be a positive integer", key);
+        return error;
+      }
+    const char *mode = doc["mode"] | "gateway";
+    if (strcmp(mode, "gateway") && strcmp(mode, "node"))
+      return "mode must be gateway or node";
+    const char *encoding = doc["meshEncoding"] | "json";
+    if (strcmp(encoding, "json") && strcmp(encoding, "binary"))
+      return "meshEncoding must be json or binary";
+    if (!doc["sensors"].isNull() && !doc["sensors"].is<JsonArray>())
+      return "\"sensors\" must be an array";
+    if (!doc["aggregate"].isNull() && !doc["aggregate"].is<JsonObject>())
+      return "\"aggregate\" must be an object";
+    if (!doc["aggregate"]["windowSec"].isNull() && !doc["aggregate"]["windowSec"].is<uint32_t>())
+      return "aggregate windowSec must be a positive integer";
+    if (!doc["zones"].isNull() && !doc["zones"].is<JsonArray>())
+      return "\"zones\" must be an array";
+    if (!doc["watering"].isNull() && !doc["watering"].is<JsonObject>())
+      return "\"watering\" must be an object";
+  }
+
+  img.clear();
+  String mode = doc["mode"] | "gateway";
+  img.node = mode == "node";
+  bool fits = configImageSetString(img.ssid, sizeof(img.ssid), doc["SSID"] | "") &&
+              configImageSetString(img.password, sizeof(img.password), doc["PASSWORD"] | "") &&
+              configImageSetString(img.iothubHost, sizeof(img.iothubHost), doc["IOTHUB_HOST"] | "") &&
+              configImageSetString(img.deviceId, sizeof(img.deviceId), doc["DEVICE_ID"] | "") &&
+              configImageSetString(img.sasToken, sizeof(img.sasToken), doc["SAS_TOKEN"] | "") &&
+              configImageSetString(img.protocol, sizeof(img.protocol), doc["PROTOCOL"] | "http") &&
+              configImageSetString(img.firmwareUrl, sizeof(img.firmwareUrl), doc["firmwareUrl"] | "") &&
+              configImageSetString(img.nodeFirmwareUrl, sizeof(img.nodeFirmwareUrl), doc["nodeFirmwareUrl"] | "");
+  if (!fits)
+    return "a config string is too long";
+  img.sleepSeconds = doc["sleepSeconds"] | 60;
+  img.meshBinary = doc["meshEncoding"] == "binary";
+  img.batchWakes = doc["batchWakes"] | 10;
+  JsonObject delta = doc["batchDelta"];
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+    img.batchDelta[f] = telemetryScale((SensorField)f, delta[sensorFieldName((SensorField)f)] | 0.0f);
+
+  JsonObject aggregate = doc["aggregate"];
+  img.windowSec = aggregate["windowSec"] | 0;
+  float alpha = aggregate["ewmaAlpha"] | 0.2f;
+  img.ewmaPercent = alpha > 0 && alpha <= 1 ? (uint8_t)std::max<long>(1, lroundf(alpha * 100)) : 0;
+  static const float kHysteresis[FIELD_COUNT] = {2, 0.5f, 2, 1}; // %, °C, %RH, hPa
+  JsonObject hysteresis = aggregate["hysteresis"];
+  for (uint8_t f = 0; f < FIELD_COUNT; f++)
+    img.alertHysteresis[f] =
+        telemetryScale((SensorField)f, hysteresis[sensorFieldName((SensorField)f)] | kHysteresis[f]);
+
+  JsonObject queue = doc["queue"];
+  img.queueRamSlots = queue["ramSlots"] | 16;
+  img.queueMaxMessages = queue["maxMessages"] | 2000;
+  img.queueMaxBytes = queue["maxBytes"] | 131072;
+  img.queueMaxAgeSec = queue["maxAgeSec"] | 86400;
+
+  for (JsonVariant v : doc["sensors"].as<JsonArray>())
+  {
+    JsonObject obj = v.as<JsonObject>();
+    if (strict && (obj.isNull() || (!obj["pin"].isNull() && !obj["pin"].is<uint8_t>())))
+      return "each sensor must be an object with an integer pin (0-255)";
+    const char *type = obj["type"] | "";
+    SensorKind kind = sensorKindFromString(type);
+    if (kind == SensorKind::UNKNOWN)
+    {
+      snprintf(error, sizeof(error), "unknown sensor type '%s'", type);
+      if (strict)
+        return error;
+      Serial.printf("[CONFIG] %s – skipped\n", error);
+      continue;
+    }
+    if (img.sensorCount == CONFIG_IMAGE_MAX_SENSORS)
+    {
+      snprintf(error, sizeof(error), "more than %d sensors", CONFIG_IMAGE_MAX_SENSORS);
+      if (strict)
+        return error;
+      Serial.printf("[CONFIG] %s – rest skipped\n", error);
+      break;
+    }
+    SensorConfig &sc = img.sensors[img.sensorCount];
+    if (!configImageSetString(sc.name, sizeof(sc.name), obj["name"] | ""))
+    {
+      snprintf(error, sizeof(error), "sensor name too long (max %u)", (unsigned)sizeof(sc.name) - 1);
+      return error;
+    }
+    sc.kind = kind;
+    sc.pin = obj["pin"] | 0;
+    sc.airValue = obj["air_value"] | 4095;
+    sc.waterValue = obj["water_value"] | 0;
+    sc.index = obj["index"] | 0;
+    sc.address = obj["address"] | 0x76;
+    sc.periodMs = obj["periodMs"] | SENSOR_DEFAULT_PERIOD_MS;
+    parseAlertLimits(obj, sc);
+    img.sensorCount++;
+  }
+  const char *zoneError = parseZones(doc, img, strict);
+  if (zoneError)
+    return zoneError;
+  if (strict)
+  {
+    const char *invalid = configImageCheck(img);
+    if (invalid)
+      return invalid;
+  }
+  img.seal();
+  return nullptr;
+}
+
+// Settings that take effect without rebuilding anything.
+void applySettings(const ConfigImage &img)
+{
+  g_firmwareUrl = img.firmwareUrl;
+  g_nodeFirmwareUrl = img.nodeFirmwareUrl;
+  g_sleepSeconds = img.sleepSeconds;
+  g_meshBinary = img.meshBinary;
+  g_batchWakes = img.batchWakes;
+  memcpy(g_batchDelta, img.batchDelta, sizeof(g_batchDelta));
+}
+
+uint32_t largestFreeBlock()
+{
+#ifdef ESP32
+  return ESP.getMaxAllocHeap();
+#else
+  return ESP.getMaxFreeBlockSize();
+#endif
+}
+
+// Builds g_sensors from `img`. With `prev` (the image the current sensors
+// were built from), sensors whose driver settings are unchanged keep their
+// driver and last sample; only new or changed ones are set up. Drivers
+// nobody takes over are released first, so the arena never has to hold the
+// old and the new set at once.
+void buildSensors(const ConfigImage &img, const ConfigImage *prev)
+{
+  std::vector<Sensor> next;
+  next.reserve(img.sensorCount);
+  uint32_t full = g_drivers.stats().full;
+  clearSoilBurst(); // rejoined below from the new set, so removed pins stop being sampled
+  uint8_t kept = sensorRebuild(g_drivers, prev, img, g_sensors, next, [](Sensor &s, const SensorConfig &sc)
+                               {
+                                 s.kind = sc.kind;
+                                 s.pin = sc.pin;
+                                 kSensorDrivers[(uint8_t)sc.kind].setup(s, sc);
+                               });
+  unsigned long now = millis();
+  size_t payloadBytes = TELEMETRY_HEADER_BYTES;
+  g_acq.clear();
+  for (uint8_t i = 0; i < img.sensorCount; i++)
+  {
+    const SensorConfig &sc = img.sensors[i];
+    next[i].name = sc.name;
+    if (sc.kind == SensorKind::CAP_SOIL_MOISTURE)
+      joinSoilBurst(next[i]);
+    sensorKeysBuild(next[i].keys, sc.name, sc.kind);
+    payloadBytes += sensorKeysMaxBytes(next[i].keys);
+    g_acq.add(sc.periodMs, now);
+  }
+  g_sensors.swap(next);
+  if (g_telemetryBuf.size() < payloadBytes)
+    g_telemetryBuf.resize(payloadBytes);
+  if (g_drivers.stats().full != full)
+    Serial.printf("[SENSOR] Driver arena full (%u slots), some sensors have no driver\n", g_drivers.capacity());
+  if (prev)
+    Serial.printf("[CONFIG] Sensors: %u kept, %u set up; %u/%u driver slots, largest free block %u\n", kept,
+                  img.sensorCount - kept, g_drivers.used(), g_drivers.capacity(), largestFreeBlock());
+}
+
+// Sets the config globals and builds the sensor drivers from a parsed image.
+void applyConfig(const ConfigImage &img)
+{
+  g_mode = img.node ? DeviceMode::NODE : DeviceMode::GATEWAY;
+  g_ssid = img.ssid;
+  g_password = img.password;
+  g_deviceId = img.deviceId;
+  setUplinkSettings(img);
+  applySettings(img);
+
+  g_queueCfg.ramSlots = img.queueRamSlots;
+  g_queueCfg.slotSize = UPLINK_RING_SLOT_BYTES; // any message the ring hands over stays in RAM
+  g_queueCfg.maxMessages = img.queueMaxMessages;
+  g_queueCfg.maxDiskBytes = img.queueMaxBytes;
+  g_queueCfg.maxAgeSec = img.queueMaxAgeSec;
+
+  buildSensors(img, nullptr);
+  beginWindow(img);
+  setupWatering(img, g_warmBoot);
+  g_configValid = !g_ssid.isEmpty() && !g_password.isEmpty() && !g_deviceId.isEmpty();
+}
+
+// Cold boot: parse config.json and keep the image in RTC memory, so the
+// following deep-sleep wakes skip LittleFS and JSON (see setup()).
+void readConfig()
+{
+  LittleFS.remove(CONFIG_TMP_PATH); // upload interrupted by a reset
+  const char *error = parseConfigFile(CONFIG_PATH, g_cfgImage, false);
+  if (error)
+  {
+    Serial.printf("[CONFIG] %s\n", error);
+    g_cfgImage.clear();
+    return;
+  }
+  applyConfig(g_cfgImage);
+}
+
+// True when `next` can only take effect through a restart.
+bool configNeedsRestart(const ConfigImage &next)
+{
+  return g_apMode || !g_configValid || (configImageDiff(g_cfgImage, next) & CONFIG_CHANGE_RESTART);
+}
+
+// loop(): applies an uploaded config (already saved as config.json) without
+// a reboot where possible. Settings are plain assignments, sensors are
+// rebuilt selectively and the uplink is swapped by the task that owns it.
+// Called every pass until it returns true: while the task swaps the uplink
+// the rest waits, and loop() keeps polling sensors and valves meanwhile.
+bool reloadConfig(const ConfigImage &next)
+{
+  static bool uplinkHandedOff = false;
+  static unsigned long handedOffAt = 0;
+  uint8_t changed = configImageDiff(g_cfgImage, next);
+  bool restart = configNeedsRestart(next);
+  if (!restart && (changed & CONFIG_CHANGE_UPLINK))
+  {
+    if (g_uplinkTask)
+    {
+      if (!uplinkHandedOff)
+      {
+        uplinkHandedOff = true;
+        handedOffAt = millis();
+        g_uplinkReloadRequested = true;
+        xTaskNotifyGive(g_uplinkTask);
+      }
+      if (g_uplinkReloadRequested && millis() - handedOffAt < UPLINK_RELOAD_WAIT_MS)
+        return false;
+      uplinkHandedOff = false;
+      restart = g_uplinkReloadRequested; // task stuck in a send: let the reboot apply it
+    }
+    else
+    {
+      applyUplinkConfig(next);
+    }
+  }
+  if (restart)
+  {
+    Serial.println("[CONFIG] Saved – restarting...");
+    persistTelemetryQueue();
+    delay(1000); // let the HTTP response go out
+    ESP.restart();
+    return true;
+  }
+
+  if (g_deviceId != next.deviceId)
+    g_deviceId = next.deviceId; // loop()'s copy; the uplink task has its own
+  applySettings(next);
+  if (changed & CONFIG_CHANGE_SENSORS)
+    buildSensors(next, &g_cfgImage);
+  if ((changed & CONFIG_CHANGE_SENSORS) || next.windowSec != g_cfgImage.windowSec ||
+      next.ewmaPercent != g_cfgImage.ewmaPercent ||
+      memcmp(next.alertHysteresis, g_cfgImage.alertHysteresis, sizeof(next.alertHysteresis)))
+    beginWindow(next);
+  if (changed & CONFIG_CHANGE_QUEUE)
+    Serial.println("[CONFIG] Queue limits apply after the next restart");
+  if (changed & CONFIG_CHANGE_WATERING)
+    stopWatering(); // with the old pins, before they change
+  bool timezone = strcmp(next.timezone, g_cfgImage.timezone) || !g_cfgImage.zoneCount;
+  g_cfgImage = next; // RTC copy: node wakes use it too
+  if (changed & CONFIG_CHANGE_WATERING)
+    setupWatering(next, false);
+  else if (changed & CONFIG_CHANGE_SENSORS)
+    configureZones(next);
+  if ((changed & CONFIG_CHANGE_WATERING) && timezone)
+    startClock();
+  Serial.printf("[CONFIG] Applied live (changes 0x%02x, no restart)\n", changed);
+  return true;
+}
+
+// --- WIFI ---
+// The last association (BSSID, channel, DHCP lease) is cached in RTC memory
+// and NVS. With it, a wake joins without a scan and without DHCP; if the
+// cached AP does not answer within STA_FAST_TIMEOUT_MS it falls back to a
+// normal connect.
+bool waitForSTA(uint32_t timeoutMs)
+{
+  unsigned long t0 = millis();
+  while (WiFi.status() != WL_CONNECTED && millis() - t0 < timeoutMs)
+    delay(STA_POLL_MS);
+  return WiFi.status() == WL_CONNECTED;
+}
+
+bool loadWifiCache()
+{
+  if (g_wifiCache.valid())
+    return true;
+#ifdef ESP32
+  Preferences prefs;
+  if (prefs.begin("wifi", true))
+  {
+    prefs.getBytes("cache", &g_wifiCache, sizeof(g_wifiCache));
+    prefs.end();
+  }
+#endif
+  return g_wifiCache.valid();
+}
+
+void saveWifiCache(bool dhcp)
+{
+  WifiCache c;
+  c.clear();
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = WiFi.channel();
+  c.ip = (uint32_t)WiFi.localIP();
+  c.gateway = (uint32_t)WiFi.gatewayIP();
+  c.subnet = (uint32_t)WiFi.subnetMask();
+  c.dns = (uint32_t)WiFi.dnsIP();
+  c.savedBoot = dhcp ? g_bootCount : g_wifiCache.savedBoot;
+  c.seal();
+  bool changed = !g_wifiCache.valid() || !c.sameLink(g_wifiCache);
+  g_wifiCache = c;
+#ifdef ESP32
+  if (changed) // NVS only when the association moved, not every wake
+  {
+    Preferences prefs;
+    if (prefs.begin("wifi", false))
+    {
+      prefs.putBytes("cache", &c, sizeof(c));
+      prefs.end();
+    }
+  }
+#endif
+}
+
+bool connectSTA()
+{
+  WiFi.mode(WIFI_STA);
+  bool sameCycle = g_wifiCache.valid(); // RTC copy: no power loss since it was taken
+  if (loadWifiCache())
+  {
+    // Reuse the lease only within this power cycle and for a bounded
+    // number of wakes; otherwise ask DHCP but still skip the scan.
+    bool reuseLease = sameCycle && g_bootCount - g_wifiCache.savedBoot < WIFI_LEASE_BOOTS && g_wifiCache.ip;
+    if (reuseLease)
+      WiFi.config(IPAddress(g_wifiCache.ip), IPAddress(g_wifiCache.gateway),
+                  IPAddress(g_wifiCache.subnet), IPAddress(g_wifiCache.dns));
+    WiFi.begin(g_ssid.c_str(), g_password.c_str(), g_wifiCache.channel, g_wifiCache.bssid);
+    if (waitForSTA(STA_FAST_TIMEOUT_MS))
+    {
+      saveWifiCache(!reuseLease);
+      Serial.printf("[STA] Fast reconnect (ch %u%s) — IP: %s\n", g_wifiCache.channel,
+                    reuseLease ? ", cached lease" : "", WiFi.localIP().toString().c_str());
+      return true;
+    }
+    Serial.println("[STA] Cached AP not reachable, scanning");
+    g_wifiCache.clear();
+    WiFi.disconnect();
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // back to DHCP
+  }
+
+  WiFi.begin(g_ssid.c_str(), g_password.c_str());
+  if (!waitForSTA(STA_TIMEOUT_MS))
+  {
+    Serial.println("[STA] Failed to connect!");
+    return false;
+  }
+  saveWifiCache(true);
+  Serial.printf("[STA] Connected — IP: %s\n", WiFi.localIP().toString().c_str());
+  return true;
+}
+
+void startAPMode()
+{
+  Serial.println("[AP] Starting AP mode...");
+  WiFi.mode(WIFI_AP);
+  WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
+  WiFi.softAP(AP_SSID, AP_PASSWORD);
+
+  dnsServer.start(53, "*", WiFi.softAPIP());
+
+  // if (!FS_BEGIN()) {
+  //   Serial.println("[AP] LittleFS failed! Formatting...");
+  //   LittleFS.format();  // Works on both ESP32 & ESP8266
+  //   if (FS_BEGIN()) {
+  //     Serial.println("[AP] LittleFS formatted & mounted");
+  //   } else {
+  //     Serial.println("[AP] LittleFS still failed!");
+  //   }
+  // }
+
+  setupWebServer();
+
+  g_apMode = true;
+  g_apStartTime = millis();
+  Serial.printf("[AP] Open: http://%s\n", WiFi.softAPIP().toString().c_str());
+}
+
+// --- MESH ---
+// The mesh runs on the router's channel: the gateway's station and mesh AP
+// share one radio, and nodes join on the channel they last saw the router on.
+static uint8_t meshChannel()
+{
+  if (WiFi.status() == WL_CONNECTED)
+    return WiFi.channel();
+  return g_wifiCache.valid() ? g_wifiCache.channel : MESH_CHANNEL;
+}
+
+void setupMesh()
+{
+  uint8_t channel = meshChannel();
+  mesh.setDebugMsgTypes(ERROR | STARTUP | CONNECTION);
+  mesh.init(String(MESH_PREFIX) + g_deviceId, MESH_PASSWORD, MESH_PORT, WIFI_AP_STA, channel);
+  mesh.onReceive(&meshReceivedCallback);
+  mesh.setContainsRoot(true);
+  if (g_mode == DeviceMode::GATEWAY)
+  {
+    // Root and bridge: painlessMesh keeps the station on the router
+    // (stationManual) instead of scanning for mesh nodes with it, so the
+    // uplink and the mesh do not fight over the station interface.
+    mesh.stationManual(g_ssid, g_password);
+    mesh.setRoot(true);
+    g_meshInitialized = true;
+    Serial.printf("[MESH] Root on channel %u, bridged to %s\n", channel, g_ssid.c_str());
+    return;
+  }
+
+  // Firmware from the gateway (see serviceMeshOta()). The node stays awake
+  // while an image other than its own is on offer or parts are arriving;
+  // painlessMesh flashes it and restarts after the last part.
+  mesh.initOTAReceive(MESH_OTA_ROLE, [](int part, int parts)
+                      {
+                        g_meshOtaPartAt = millis();
+                        if (part * 10 / parts != (part + 1) * 10 / parts)
+                          Serial.printf("[MESHOTA] %d%%\n", (part + 1) * 100 / parts);
+                      });
+  mesh.onPackage(painlessmesh::protocol::OTA_ANNOUNCE, [](painlessmesh::protocol::Variant variant)
+                 {
+                   painlessmesh::plugin::ota::Announce a = variant.to<painlessmesh::plugin::ota::Announce>();
+                   if (a.role == MESH_OTA_ROLE && a.md5 != ESP.getSketchMD5())
+                     g_meshOtaPartAt = millis();
+                   return false;
+                 });
+  g_meshInitialized = true; // Mark as ready
+  Serial.printf("[MESH] Mesh initialized (NODE mode, channel %u)\n", channel);
+}
+
+// --- IOT HUB ---
+#ifdef ESP32
+static bool mqttConnect(void *)
+{
+  return mqttClient.connect(g_uplinkDeviceId.c_str(), g_mqttUser.c_str(), g_sasToken.c_str());
+}
+
+static bool mqttConnected(void *) { return mqttClient.connected(); }
+static void mqttPoll(void *) { mqttClient.loop(); }
+
+// Client buffer sized for the largest publish (a coalesced batch), topic
+// and user built once; the first connect happens on the uplink task's
+// next pass.
+void setupMqtt()
+{
+  g_mqttTopic = "devices/" + g_uplinkDeviceId + "/messages/events/";
+  g_mqttUser = g_iothubHost + "/" + g_uplinkDeviceId + "/?api-version=2018-06-30";
+  espClient.setInsecure();
+  mqttClient.setServer(g_iothubHost.c_str(), 8883);
+  mqttClient.setBufferSize(MQTT_BATCH_MAX_BYTES + g_mqttTopic.length() + 8);
+  mqttClient.setKeepAlive(MQTT_KEEPALIVE_S);
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  MqttSessionConfig cfg;
+  cfg.backoffMinMs = MQTT_BACKOFF_MIN_MS;
+  cfg.backoffMaxMs = MQTT_BACKOFF_MAX_MS;
+  g_mqtt.begin({mqttConnect, mqttConnected, mqttPoll, nullptr}, cfg, esp_random(), millis());
+}
+
+void setupSdk()
+{
+  if (platform_init() != 0)
+    return;
+  String conn = "HostName=" + g_iothubHost + ";DeviceId=" + g_uplinkDeviceId +
+                ";SharedAccessSignature=" + g_sasToken;
+  g_iotHubClient = IoTHubClient_LL_CreateFromConnectionString(conn.c_str(), MQTT_Protocol);
+  if (g_iotHubClient)
+  {
+    IoTHubClient_LL_SetRetryPolicy(g_iotHubClient, IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER, 0);
+  }
+}
+
+// --- OTA ---
+// firmwareUrl is a manifest ({"version", "url", "sha256", "size"}, ending in
+// .json) or the image itself. Every boot probes it with If-None-Match (a
+// 304 costs a few hundred bytes); the image is only fetched when
+// otaDecide() says so. The last probe result lives in NVS.
+// nodeFirmwareUrl is probed the same way, with a cache of its own.
+struct OtaSource
+{
+  const String &url;
+  const char *key; // NVS key of its OtaCache
+};
+
+static void loadOtaCache(const OtaSource &src, OtaCache &c)
+{
+  c.clear();
+  Preferences prefs;
+  if (prefs.begin("ota", true))
+  {
+    prefs.getBytes(src.key, &c, sizeof(c));
+    prefs.end();
+  }
+  if (!c.valid() || c.source != crc32(src.url.c_str(), src.url.length()))
+    c.clear(); // another URL: its ETags mean nothing here
+}
+
+static void saveOtaCache(const OtaSource &src, OtaCache &c)
+{
+  c.source = crc32(src.url.c_str(), src.url.length());
+  c.seal();
+  Preferences prefs;
+  if (prefs.begin("ota", false))
+  {
+    prefs.putBytes(src.key, &c, sizeof(c));
+    prefs.end();
+  }
+}
+
+// Manifest GET / image HEAD. True with `m` filled (from the cache on a
+// 304); false when the probe failed.
+static bool otaProbe(const OtaSource &src, OtaCache &cache, OtaManifest &m)
+{
+  bool manifest = src.url.endsWith(".json");
+  HTTPClient http;
+  if (!http.begin(espClient, src.url))
+    return false;
+  const char *headers[] = {"ETag"};
+  http.collectHeaders(headers, 1);
+  if (cache.valid() && cache.last.etag[0])
+    http.addHeader("If-None-Match", cache.last.etag);
+  int code = manifest ? http.GET() : http.sendRequest("HEAD");
+  if (code == HTTP_CODE_NOT_MODIFIED && cache.valid())
+  {
+    m = cache.last;
+    http.end();
+    return true;
+  }
+  if (code != HTTP_CODE_OK)
+  {
+    Serial.printf("[OTA] Probe failed: %d\n", code);
+    http.end();
+    return false;
+  }
+
+  memset(&m, 0, sizeof(m));
+  configImageSetString(m.etag, sizeof(m.etag), http.header("ETag").c_str());
+  bool ok = true;
+  if (manifest)
+  {
+    JsonDocument doc;
+    ok = !deserializeJson(doc, http.getStream());
+    ok = ok && configImageSetString(m.version, sizeof(m.version), doc["version"] | "") &&
+         configImageSetString(m.url, sizeof(m.url), doc["url"] | "") && m.version[0] && m.url[0];
+    m.hasSha = otaParseHex(doc["sha256"] | "", m.sha256, OTA_SHA256_BYTES);
+    m.size = doc["size"] | 0;
+  }
+  else
+  {
+    ok = configImageSetString(m.url, sizeof(m.url), src.url.c_str());
+    m.size = http.getSize() > 0 ? http.getSize() : 0;
+  }
+  http.end();
+  if (!ok)
+  {
+    Serial.println("[OTA] Manifest needs \"version\" and \"url\"");
+    return false;
+  }
+  if (!otaSameImage(cache.last, m))
+    cache.failures = 0;
+  cache.last = m;
+  saveOtaCache(src, cache);
+  return true;
+}
+
+struct OtaSession
+{
+  HTTPClient http;
+  mbedtls_sha256_context sha;
+  uint32_t size = 0, written = 0;
+  uint8_t shownTenth = 0;
+  const esp_partition_t *stage = nullptr; // node image: the idle app slot
+  MD5Builder md5;                         // node image: announced to the nodes
+};
+
+static int otaOpen(void *ctx, const char *url, uint32_t offset, uint32_t &total)
+{
+  OtaSession &o = *(OtaSession *)ctx;
+  if (!o.http.begin(espClient, url))
+    return -1;
+  const char *headers[] = {"Content-Range"};
+  o.http.collectHeaders(headers, 1);
+  if (offset)
+  {
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%u-", (unsigned)offset);
+    o.http.addHeader("Range", range);
+    Serial.printf("[OTA] Resuming at %u bytes\n", (unsigned)offset);
+  }
+  int code = o.http.GET();
+  int len = o.http.getSize();
+  if (code == HTTP_CODE_PARTIAL_CONTENT)
+  {
+    String cr = o.http.header("Content-Range"); // "bytes <from>-<to>/<total>"
+    const char *slash = strrchr(cr.c_str(), '/');
+    total = slash ? strtoul(slash + 1, nullptr, 10) : 0;
+  }
+  else
+  {
+    total = code == HTTP_CODE_OK && len > 0 ? len : 0;
+  }
+  return code;
+}
+
+static int otaRead(void *ctx, uint8_t *buf, size_t cap)
+{
+  OtaSession &o = *(OtaSession *)ctx;
+  WiFiClient *stream = o.http.getStreamPtr();
+  unsigned long t0 = millis();
+  while (stream && stream->connected() && !stream->available() && millis() - t0 < OTA_READ_TIMEOUT_MS)
+    delay(1);
+  if (!stream || !stream->available())
+    return -1;
+  return stream->readBytes(buf, std::min<size_t>(cap, stream->available()));
+}
+
+static void otaClose(void *ctx) { ((OtaSession *)ctx)->http.end(); }
+
+static bool otaBegin(void *ctx, uint32_t size)
+{
+  ((OtaSession *)ctx)->size = size;
+  if (Update.begin(size))
+    return true;
+  Serial.printf("[OTA] No room for %u bytes: %s\n", (unsigned)size, Update.errorString());
+  return false;
+}
+
+static void otaProgress(OtaSession &o, size_t len)
+{
+  o.written += len;
+  uint8_t tenth = (uint8_t)((uint64_t)o.written * 10 / o.size);
+  if (tenth != o.shownTenth)
+  {
+    o.shownTenth = tenth;
+    Serial.printf("[OTA] %u%%\n", tenth * 10);
+  }
+}
+
+static bool otaWrite(void *ctx, const uint8_t *data, size_t len)
+{
+  OtaSession &o = *(OtaSession *)ctx;
+  if (Update.write((uint8_t *)data, len) != len)
+    return false;
+  otaProgress(o, len);
+  return true;
+}
+
+static bool otaEnd(void *, bool commit)
+{
+  if (!commit)
+  {
+    Update.abort();
+    return true;
+  }
+  return Update.end(true);
+}
+
+static void otaHashStart(void *ctx)
+{
+  OtaSession &o = *(OtaSession *)ctx;
+  mbedtls_sha256_init(&o.sha);
+  mbedtls_sha256_starts(&o.sha, 0);
+}
+
+static void otaHashUpdate(void *ctx, const uint8_t *data, size_t len)
+{
+  mbedtls_sha256_update(&((OtaSession *)ctx)->sha, data, len);
+}
+
+static void otaHashFinish(void *ctx, uint8_t out[OTA_SHA256_BYTES])
+{
+  OtaSession &o = *(OtaSession *)ctx;
+  mbedtls_sha256_finish(&o.sha, out);
+  mbedtls_sha256_free(&o.sha);
+}
+
+static void otaWait(void *, uint32_t ms) { delay(ms); }
+
+// Node image sink: raw writes to the idle app slot, which stays unbootable
+// (otadata is not touched); the gateway only reads it back for the mesh.
+static bool stageBegin(void *ctx, uint32_t size)
+{
+  OtaSession &o = *(OtaSession *)ctx;
+  o.size = size;
+  if (!o.stage || size > o.stage->size)
+  {
+    Serial.printf("[MESHOTA] No room for %u bytes\n", (unsigned)size);
+    return false;
+  }
+  o.md5.begin();
+  uint32_t erase = (size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+  return esp_partition_erase_range(o.stage, 0, erase) == ESP_OK;
+}
+
+static bool stageWrite(void *ctx, const uint8_t *data, size_t len)
+{
+  OtaSession &o = *(OtaSession *)ctx;
+  if (esp_partition_write(o.stage, o.written, data, len) != ESP_OK)
+    return false;
+  o.md5.add((uint8_t *)data, len);
+  otaProgress(o, len);
+  return true;
+}
+
+static bool stageEnd(void *ctx, bool commit)
+{
+  if (commit)
+    ((OtaSession *)ctx)->md5.calculate();
+  return true;
+}
+
+static void saveMeshOtaImage()
+{
+  Preferences prefs;
+  if (prefs.begin("ota", false))
+  {
+    prefs.putBytes("meshimg", &g_meshOtaImage, sizeof(g_meshOtaImage));
+    prefs.end();
+  }
+}
+
+// The staged image is only usable while it sits in the idle slot: after the
+// gateway updated itself, that slot is the one running.
+static void loadMeshOtaImage()
+{
+  Preferences prefs;
+  if (prefs.begin("ota", true))
+  {
+    prefs.getBytes("meshimg", &g_meshOtaImage, sizeof(g_meshOtaImage));
+    prefs.end();
+  }
+  const esp_partition_t *idle = esp_ota_get_next_update_partition(nullptr);
+  if (!g_meshOtaImage.valid() || !idle || strcmp(g_meshOtaImage.partition, idle->label))
+    g_meshOtaImage.clear();
+}
+
+// nodeFirmwareUrl: same probe and download as the gateway's own image, but
+// into the idle slot, compared with the staged version rather than the
+// running one. One download serves every node.
+static void stageNodeImage()
+{
+  if (g_nodeFirmwareUrl.length() < 10)
+    return;
+  if (!g_meshInitialized)
+  {
+    Serial.println("[MESHOTA] Gateway mesh is off, node image not staged");
+    return;
+  }
+  loadMeshOtaImage();
+  unsigned long t0 = millis();
+  OtaSource src = {g_nodeFirmwareUrl, "node"};
+  static OtaCache cache;
+  loadOtaCache(src, cache);
+  if (!g_meshOtaImage.valid())
+    cache.installedEtag[0] = '\0'; // nothing staged: a plain image URL is fetched again
+  OtaManifest m;
+  if (!otaProbe(src, cache, m))
+    return;
+  OtaDecision decision = otaDecide(m, g_meshOtaImage.valid() ? g_meshOtaImage.version : "0", cache);
+  if (decision != OTA_DOWNLOAD)
+  {
+    Serial.printf("[MESHOTA] Node image %s (%s, %lu ms)\n", decision == OTA_GIVE_UP ? "failed before, skipped" : "up to date",
+                  m.version[0] ? m.version : m.etag, millis() - t0);
+    return;
+  }
+
+  Serial.printf("[MESHOTA] Staging node image %s %s\n", m.version, m.url);
+  g_meshOtaImage.clear();
+  saveMeshOtaImage(); // a half-written slot is never served
+  static uint8_t buf[OTA_BUFFER_BYTES];
+  OtaSession session;
+  session.stage = esp_ota_get_next_update_partition(nullptr);
+  OtaIo io = {otaOpen, otaRead, otaClose, stageBegin, stageWrite, stageEnd,
+              otaHashStart, otaHashUpdate, otaHashFinish, otaWait, &session};
+  OtaDownload download;
+  OtaResult result = download.run(io, m, buf, sizeof(buf));
+  const OtaDownload::Stats &st = download.stats();
+  Serial.printf("[MESHOTA] %s: %u bytes staged, %u fetched, %u resumes (%lu ms)\n", otaResultName(result),
+                (unsigned)st.written, (unsigned)st.fetched, st.resumes, millis() - t0);
+  if (result != OTA_OK)
+  {
+    if (result == OTA_HASH_MISMATCH || result == OTA_FLASH_ERROR || result == OTA_SIZE_MISMATCH)
+      cache.failures++;
+    saveOtaCache(src, cache);
+    return;
+  }
+  configImageSetString(cache.installedEtag, sizeof(cache.installedEtag), m.etag);
+  cache.failures = 0;
+  saveOtaCache(src, cache);
+  configImageSetString(g_meshOtaImage.version, sizeof(g_meshOtaImage.version), m.version[0] ? m.version : m.etag);
+  configImageSetString(g_meshOtaImage.md5, sizeof(g_meshOtaImage.md5), session.md5.toString().c_str());
+  configImageSetString(g_meshOtaImage.hardware, sizeof(g_meshOtaImage.hardware), "ESP32");
+  configImageSetString(g_meshOtaImage.partition, sizeof(g_meshOtaImage.partition), session.stage->label);
+  g_meshOtaImage.size = st.written;
+  g_meshOtaImage.seal();
+  saveMeshOtaImage();
+}
+
+// Own image first: a gateway update reboots into the slot a staged node
+// image was in, and the next boot stages it again.
+static void updateGateway()
+{
+  if (g_firmwareUrl.length() < 10)
+    return;
+  unsigned long t0 = millis();
+  OtaSource src = {g_firmwareUrl, "cache"};
+  static OtaCache cache;
+  loadOtaCache(src, cache);
+  OtaManifest m;
+  if (!otaProbe(src, cache, m))
+    return;
+  OtaDecision decision = otaDecide(m, FIRMWARE_VERSION, cache);
+  if (decision != OTA_DOWNLOAD)
+  {
+    Serial.printf("[OTA] %s (%s, %lu ms)\n", decision == OTA_GIVE_UP ? "Image failed before, skipped" : "Up to date",
+                  m.version[0] ? m.version : m.etag, millis() - t0);
+    return;
+  }
+
+  Serial.printf("[OTA] Downloading %s %s\n", m.version, m.url);
+  g_meshOtaImage.clear();
+  saveMeshOtaImage(); // its slot is about to be overwritten
+  static uint8_t buf[OTA_BUFFER_BYTES];
+  OtaSession session;
+  OtaIo io = {otaOpen, otaRead, otaClose, otaBegin, otaWrite, otaEnd,
+              otaHashStart, otaHashUpdate, otaHashFinish, otaWait, &session};
+  OtaDownload download;
+  OtaResult result = download.run(io, m, buf, sizeof(buf));
+  const OtaDownload::Stats &st = download.stats();
+  Serial.printf("[OTA] %s: %u bytes written, %u fetched, %u resumes (%lu ms)\n", otaResultName(result),
+                (unsigned)st.written, (unsigned)st.fetched, st.resumes, millis() - t0);
+  if (result != OTA_OK)
+  {
+    if (result == OTA_HASH_MISMATCH || result == OTA_FLASH_ERROR || result == OTA_SIZE_MISMATCH)
+      cache.failures++;
+    saveOtaCache(src, cache);
+    return;
+  }
+  configImageSetString(cache.installedEtag, sizeof(cache.installedEtag), m.etag);
+  cache.failures = 0;
+  saveOtaCache(src, cache);
+  Serial.println("[OTA] Update applied successfully. Rebooting...");
+  persistTelemetryQueue();
+  delay(500);
+  ESP.restart();
+}
+
+void checkOTA()
+{
+  espClient.setInsecure();
+  updateGateway();
+  stageNodeImage();
+}
+#endif
+
+// --- MESH OTA ---
+// painlessMesh OTA protocol: the gateway announces the staged image, each
+// node whose firmware differs asks for it one part at a time and asks again
+// after a timeout. Requests are queued here, not answered in the callback:
+// serviceMeshOta() replies at MESH_OTA_PARTS_PER_SEC and not at all right
+// after a node message, so telemetry keeps its airtime.
+#ifdef ESP32
+using painlessmesh::plugin::ota::Announce;
+using painlessmesh::plugin::ota::Data;
+using painlessmesh::plugin::ota::DataRequest;
+
+static const esp_partition_t *g_meshOtaStage = nullptr;
+
+static bool onMeshOtaRequest(painlessmesh::protocol::Variant variant)
+{
+  DataRequest req = variant.to<DataRequest>();
+  if (req.md5 == g_meshOtaImage.md5)
+    g_meshOta.request(req.from, req.partNo, millis());
+  return false;
+}
+
+static void announceMeshOta()
+{
+  Announce a;
+  a.md5 = g_meshOtaImage.md5;
+  a.hardware = g_meshOtaImage.hardware;
+  a.role = MESH_OTA_ROLE;
+  a.noPart = g_meshOta.parts();
+  a.from = mesh.getNodeId();
+  mesh.sendPackage(&a);
+  g_meshAnnouncedAt = millis();
+}
+
+static void reportMeshOtaDone(uint32_t node)
+{
+  char buf[TELEMETRY_HEADER_BYTES], id[12];
+  snprintf(id, sizeof(id), "%u", (unsigned)node);
+  JsonWriter w(buf, sizeof(buf));
+  w.string("deviceId", g_deviceId.c_str());
+  w.string("firmwareVersion", FIRMWARE_VERSION);
+  w.string("event", "meshOta");
+  w.string("node", id);
+  w.string("image", g_meshOtaImage.version);
+  size_t n = w.finish();
+  if (n)
+    forwardToIoTHub(buf, n);
+}
+
+static void sendMeshOtaPart(const MeshOtaServer::Request &r)
+{
+  static uint8_t part[MESH_OTA_PART_BYTES];
+  uint32_t at = r.part * MESH_OTA_PART_BYTES;
+  size_t len = std::min<uint32_t>(MESH_OTA_PART_BYTES, g_meshOtaImage.size - at);
+  if (esp_partition_read(g_meshOtaStage, at, part, len) != ESP_OK)
+    return; // the node asks again
+  DataRequest req;
+  req.md5 = g_meshOtaImage.md5;
+  req.hardware = g_meshOtaImage.hardware;
+  req.role = MESH_OTA_ROLE;
+  req.noPart = g_meshOta.parts();
+  req.partNo = r.part;
+  req.from = r.node;
+  req.dest = mesh.getNodeId();
+  Data reply = Data::replyTo(req, painlessmesh::base64::encode(part, len), r.part);
+  mesh.sendPackage(&reply);
+  g_metrics.meshOtaParts.add();
+  if (!r.fresh)
+    return;
+  uint32_t parts = g_meshOta.parts();
+  uint8_t before = (uint8_t)((uint64_t)r.part * 10 / parts);
+  uint8_t after = (uint8_t)((uint64_t)(r.part + 1) * 10 / parts);
+  if (after != before)
+    Serial.printf("[MESHOTA] Node %u: %u%%\n", (unsigned)r.node, after * 10);
+  if (r.part + 1 == parts)
+  {
+    g_metrics.meshOtaNodes.add();
+    reportMeshOtaDone(r.node);
+  }
+}
+
+// After checkOTA(): serves the staged image, if any, while the gateway runs
+// the mesh.
+void beginMeshOta()
+{
+  if (!g_meshOtaImage.valid())
+    return;
+  g_meshOtaStage = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY,
+                                            g_meshOtaImage.partition);
+  if (!g_meshInitialized || !g_meshOtaStage)
+  {
+    Serial.printf("[MESHOTA] Node image %s staged, not served: gateway mesh is off\n", g_meshOtaImage.version);
+    return;
+  }
+  MeshOtaServer::Config cfg;
+  cfg.partsPerSec = MESH_OTA_PARTS_PER_SEC;
+  cfg.burst = MESH_OTA_BURST;
+  g_meshOta.begin(g_meshOtaImage.parts(MESH_OTA_PART_BYTES), cfg, millis());
+  mesh.onPackage(painlessmesh::protocol::OTA_DATA_REQUEST, onMeshOtaRequest);
+  Serial.printf("[MESHOTA] Serving node image %s: %u parts, md5 %s\n", g_meshOtaImage.version,
+                (unsigned)g_meshOta.parts(), g_meshOtaImage.md5);
+}
+
+// Node table figures for /metrics: entries first, then the count, so a
+// scrape never reads a node that is not filled in yet.
+static void updateMeshOtaMetrics()
+{
+  static uint32_t held = 0;
+  g_metrics.meshOtaHeld.add(g_meshOta.stats().held - held); // the server's count only grows
+  held = g_meshOta.stats().held;
+  for (uint8_t i = 0; i < g_meshOta.nodes(); i++)
+  {
+    const MeshOtaServer::Node &n = g_meshOta.node(i);
+    g_metrics.meshOtaNode[i].id.set(n.id);
+    g_metrics.meshOtaNode[i].percent.set(g_meshOta.percent(n));
+    g_metrics.meshOtaNode[i].repeats.set(n.repeats);
+  }
+  g_metrics.meshOtaTracked.set(g_meshOta.nodes());
+}
+
+void serviceMeshOta()
+{
+  if (!g_meshInitialized || !g_meshOta.active())
+    return;
+  unsigned long now = millis();
+  // A node that just reported is awake only for a few seconds: tell it now.
+  bool heard = (long)(g_meshHeardAt - g_meshAnnouncedAt) > 0 && now - g_meshAnnouncedAt >= MESH_OTA_NUDGE_MS;
+  if (heard || now - g_meshAnnouncedAt >= MESH_OTA_ANNOUNCE_MS)
+    announceMeshOta();
+  MeshOtaServer::Request r;
+  while (g_meshOta.next(now, now - g_meshHeardAt < MESH_OTA_HOLD_MS, r))
+    sendMeshOtaPart(r);
+  updateMeshOtaMetrics();
+}
+#else
+void beginMeshOta() {}
+void serviceMeshOta() {}
+#endif
+
+// Boot, or the uplink task on a reload: its own copies only. loop() keeps
+// g_deviceId and sets it itself (reloadConfig()).
+void setUplinkSettings(const ConfigImage &img)
+{
+  g_iothubHost = img.iothubHost;
+  g_uplinkDeviceId = img.deviceId;
+  g_sasToken = img.sasToken;
+  g_protocol = img.protocol;
+}
+
+// Uplink task (or loop() without it): drops every connection made with the
+// old settings and sets up the new ones. Queued messages are kept.
+void applyUplinkConfig(const ConfigImage &img)
+{
+  g_uplink->end();
+  espClient.stop();
+  setUplinkSettings(img);
+  g_uplinkBackoffMs = 0;
+  setupIoTHub();
+  Serial.printf("[UPLINK] Reconfigured: %s to %s\n", g_protocol.c_str(), g_iothubHost.c_str());
+}
+
+// --- CONFIG UPLOAD ---
+static void failConfigUpload(int status, const char *error)
+{
+  g_upload.status = status;
+  g_upload.error = error;
+  if (g_upload.file)
+    g_upload.file.close();
+  LittleFS.remove(CONFIG_TMP_PATH);
+  Serial.printf("[WEB] Config rejected (%d): %s\n", status, error);
+}
+
+static uint32_t fileCrc(const char *path)
+{
+  File f = LittleFS.open(path, "r");
+  uint8_t buf[256];
+  uint32_t crc = 0;
+  size_t n;
+  while (f && (n = f.read(buf, sizeof(buf))) > 0)
+    crc = crc32Update(crc, buf, n);
+  f.close();
+  return crc;
+}
+
+// Body complete: check the CRC of what reached flash (and of what the page
+// sent, if it sent X-Config-CRC32), validate, then rename over config.json.
+// The rename replaces the file atomically, so a reset never leaves a torn one.
+static void finishConfigUpload(AsyncWebServerRequest *request)
+{
+  g_upload.file.close();
+  if (request->hasHeader("X-Config-CRC32") &&
+      strtoul(request->header("X-Config-CRC32").c_str(), nullptr, 16) != g_upload.crc)
+    return failConfigUpload(400, "CRC mismatch, upload corrupted");
+  if (fileCrc(CONFIG_TMP_PATH) != g_upload.crc)
+    return failConfigUpload(500, "flash write verify failed");
+  const char *error = parseConfigFile(CONFIG_TMP_PATH, g_pendingCfg, true);
+  if (error)
+    return failConfigUpload(400, error);
+  if (!LittleFS.rename(CONFIG_TMP_PATH, CONFIG_PATH))
+    return failConfigUpload(500, "rename failed");
+  g_upload.restart = configNeedsRestart(g_pendingCfg);
+  g_upload.status = 200;
+}
+
+static void onConfigChunk(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  if (index == 0)
+  {
+    if (g_upload.file)
+      g_upload.file.close();
+    g_upload.owner = request;
+    g_upload.crc = 0;
+    g_upload.status = 0;
+    g_upload.error = nullptr;
+    if (total > CONFIG_MAX_BYTES)
+      return failConfigUpload(413, "config too large");
+    if (g_cfgPending)
+      return failConfigUpload(503, "previous config still being applied");
+    g_upload.file = LittleFS.open(CONFIG_TMP_PATH, "w");
+    if (!g_upload.file)
+      return failConfigUpload(500, "cannot create temp file");
+  }
+  if (request != g_upload.owner || g_upload.status)
+    return; // superseded by a newer upload, or already failed
+  if (g_upload.file.write(data, len) != len)
+    return failConfigUpload(500, "write failed (filesystem full?)");
+  g_upload.crc = crc32Update(g_upload.crc, data, len);
+  if (index + len == total)
+    finishConfigUpload(request);
+}
+
+// Runs after the last body chunk.
+static void onConfigUploaded(AsyncWebServerRequest *request)
+{
+  if (request != g_upload.owner || g_upload.status == 0)
+  {
+    request->send(409, "application/json", "{\"error\":\"upload incomplete or superseded\"}");
+    return;
+  }
+  g_upload.owner = nullptr;
+  JsonDocument doc;
+  if (g_upload.status != 200)
+  {
+    doc["error"] = g_upload.error;
+  }
+  else
+  {
+    doc["status"] = "ok";
+    doc["restart"] = g_upload.restart;
+  }
+  String body;
+  serializeJson(doc, body);
+  request->send(g_upload.status, "application/json", body);
+  if (g_upload.status == 200)
+    g_cfgPending = true; // loop() applies it
+}
+
+// --- METRICS ENDPOINT ---
+static void metricsToStream(const char *data, size_t len, void *ctx)
+{
+  ((AsyncResponseStream *)ctx)->write((const uint8_t *)data, len);
+}
+
+double uptimeSeconds()
+{
+#ifdef ESP32
+  return esp_timer_get_time() / 1e6; // 64-bit, no millis() wrap
+#else
+  return millis() / 1000.0;
+#endif
+}
+
+// Reads only atomics and values that are safe from the async_tcp task.
+void renderMetrics(PromWriter &w)
+{
+  char labels[64];
+  snprintf(labels, sizeof(labels), "version=\"%s\",mode=\"%s\"", FIRMWARE_VERSION,
+           g_mode == DeviceMode::NODE ? "node" : "gateway");
+  w.family("mywatering_build_info", "gauge", "Firmware version and device mode.");
+  w.sample("mywatering_build_info", labels, (uint32_t)1);
+  w.family("mywatering_boot_count", "gauge", "Boots since power-on (deep-sleep wakes included).");
+  w.sample("mywatering_boot_count", nullptr, g_bootCount);
+  w.family("mywatering_uptime_seconds", "gauge", "Seconds since this boot.");
+  w.sample("mywatering_uptime_seconds", nullptr, uptimeSeconds());
+
+  w.family("mywatering_heap_free_bytes", "gauge", "Free heap.");
+  w.sample("mywatering_heap_free_bytes", nullptr, (uint32_t)ESP.getFreeHeap());
+  w.family("mywatering_heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block.");
+  w.sample("mywatering_heap_largest_free_block_bytes", nullptr, largestFreeBlock());
+#ifdef ESP32
+  w.family("mywatering_heap_min_free_bytes", "gauge", "Lowest free heap since boot.");
+  w.sample("mywatering_heap_min_free_bytes", nullptr, (uint32_t)ESP.getMinFreeHeap());
+#endif
+
+  w.family("mywatering_loop_duration_seconds", "histogram", "Time per loop() pass.");
+  w.histogram("mywatering_loop_duration_seconds", nullptr, g_metrics.loop);
+
+  w.family("mywatering_uplink_sent_total", "counter", "Messages accepted by the uplink.");
+  for (uint8_t p = 0; p < UPLINK_PROTOCOLS; p++)
+  {
+    snprintf(labels, sizeof(labels), "protocol=\"%s\"", kUplinkProtocolNames[p]);
+    w.sample("mywatering_uplink_sent_total", labels, g_metrics.uplink[p].sent.value());
+  }
+  w.family("mywatering_uplink_failed_total", "counter", "Uplink sends that failed (then backed off).");
+  for (uint8_t p = 0; p < UPLINK_PROTOCOLS; p++)
+  {
+    snprintf(labels, sizeof(labels), "protocol=\"%s\"", kUplinkProtocolNames[p]);
+    w.sample("mywatering_uplink_failed_total", labels, g_metrics.uplink[p].failed.value());
+  }
+  w.family("mywatering_uplink_duration_seconds", "histogram", "Time per uplink send (one message or batch; sdk: send to confirmation).");
+  for (uint8_t p = 0; p < UPLINK_PROTOCOLS; p++)
+  {
+    snprintf(labels, sizeof(labels), "protocol=\"%s\"", kUplinkProtocolNames[p]);
+    w.histogram("mywatering_uplink_duration_seconds", labels, g_metrics.uplink[p].latency);
+  }
+
+  w.family("mywatering_mqtt_connected", "gauge", "1 while the MQTT session is up.");
+  w.sample("mywatering_mqtt_connected", nullptr, g_metrics.mqtt.connected.value());
+  w.family("mywatering_mqtt_connects_total", "counter", "Successful MQTT connects.");
+  w.sample("mywatering_mqtt_connects_total", nullptr, g_metrics.mqtt.connects.value());
+  w.family("mywatering_mqtt_publishes_total", "counter", "MQTT publishes (one message or a coalesced batch).");
+  w.sample("mywatering_mqtt_publishes_total", nullptr, g_metrics.mqtt.publishes.value());
+  w.family("mywatering_mqtt_messages_total", "counter", "Queued messages carried by MQTT publishes.");
+  w.sample("mywatering_mqtt_messages_total", nullptr, g_metrics.mqtt.messages.value());
+  w.family("mywatering_mqtt_reconnect_seconds", "histogram", "Link found down (or boot) to connected.");
+  w.histogram("mywatering_mqtt_reconnect_seconds", nullptr, g_metrics.mqtt.reconnect);
+
+  w.family("mywatering_sdk_inflight", "gauge", "SDK messages sent and awaiting confirmation.");
+  w.sample("mywatering_sdk_inflight", nullptr, g_metrics.sdkInflight.value());
+  w.family("mywatering_sdk_retries_total", "counter", "SDK messages resent after a failed or missing confirmation.");
+  w.sample("mywatering_sdk_retries_total", nullptr, g_metrics.sdkRetries.value());
+  w.family("mywatering_sdk_requeued_total", "counter", "SDK messages left in the queue for a later resend after SDK_MAX_ATTEMPTS.");
+  w.sample("mywatering_sdk_requeued_total", nullptr, g_metrics.sdkRequeued.value());
+
+  w.family("mywatering_queue_messages", "gauge", "Telemetry waiting for the uplink.");
+  w.sample("mywatering_queue_messages", "where=\"total\"", g_metrics.queueDepth.value());
+  w.sample("mywatering_queue_messages", "where=\"disk\"", g_metrics.queueOnDisk.value());
+  w.family("mywatering_queue_dropped_total", "counter", "Queued telemetry discarded.");
+  w.sample("mywatering_queue_dropped_total", "reason=\"full\"", g_metrics.queueDropped.value());
+  w.sample("mywatering_queue_dropped_total", "reason=\"expired\"", g_metrics.queueExpired.value());
+  SpscRing<UPLINK_RING_SLOTS, UPLINK_RING_SLOT_BYTES>::Stats ring = g_uplinkRing.stats();
+  w.sample("mywatering_queue_dropped_total", "reason=\"handoff\"", ring.dropped + ring.oversize);
+
+  w.family("mywatering_own_telemetry_total", "counter", "Gateway own-sensor messages by kind.");
+  w.sample("mywatering_own_telemetry_total", "kind=\"raw\"", g_metrics.ownRaw.value());
+  w.sample("mywatering_own_telemetry_total", "kind=\"summary\"", g_metrics.ownSummaries.value());
+  w.sample("mywatering_own_telemetry_total", "kind=\"alert\"", g_metrics.ownAlerts.value());
+
+  w.family("mywatering_valves_open", "gauge", "Watering zones with the valve open.");
+  w.sample("mywatering_valves_open", nullptr, g_metrics.valvesOpen.value());
+  w.family("mywatering_watering_runs_total", "counter", "Valve openings since boot.");
+  w.sample("mywatering_watering_runs_total", nullptr, g_metrics.wateringRuns.value());
+
+  w.family("mywatering_mesh_ota_parts_total", "counter", "Node image parts sent over the mesh.");
+  w.sample("mywatering_mesh_ota_parts_total", nullptr, g_metrics.meshOtaParts.value());
+  w.family("mywatering_mesh_ota_held_total", "counter", "Paced passes with parts waiting, held for node telemetry.");
+  w.sample("mywatering_mesh_ota_held_total", nullptr, g_metrics.meshOtaHeld.value());
+  w.family("mywatering_mesh_ota_nodes_updated_total", "counter", "Nodes sent the whole staged image.");
+  w.sample("mywatering_mesh_ota_nodes_updated_total", nullptr, g_metrics.meshOtaNodes.value());
+  w.family("mywatering_mesh_ota_progress_percent", "gauge", "Share of the staged image each node has received.");
+  uint32_t otaNodes = g_metrics.meshOtaTracked.value();
+  for (uint8_t i = 0; i < otaNodes; i++)
+  {
+    snprintf(labels, sizeof(labels), "node=\"%u\"", g_metrics.meshOtaNode[i].id.value());
+    w.sample("mywatering_mesh_ota_progress_percent", labels, g_metrics.meshOtaNode[i].percent.value());
+  }
+  w.family("mywatering_mesh_ota_repeats", "gauge", "Parts a node asked for again in the current update (lost replies).");
+  for (uint8_t i = 0; i < otaNodes; i++)
+  {
+    snprintf(labels, sizeof(labels), "node=\"%u\"", g_metrics.meshOtaNode[i].id.value());
+    w.sample("mywatering_mesh_ota_repeats", labels, g_metrics.meshOtaNode[i].repeats.value());
+  }
+
+  w.family("mywatering_mesh_received_total", "counter", "Mesh messages received.");
+  w.sample("mywatering_mesh_received_total", "encoding=\"json\"", g_metrics.meshJson.value());
+  w.sample("mywatering_mesh_received_total", "encoding=\"frame\"", g_metrics.meshFrames.value());
+  w.sample("mywatering_mesh_received_total", "encoding=\"schema\"", g_metrics.meshSchemas.value());
+  w.family("mywatering_mesh_dropped_total", "counter", "Mesh messages that could not be decoded.");
+  w.sample("mywatering_mesh_dropped_total", nullptr, g_metrics.meshInvalid.value());
+  w.family("mywatering_mesh_duplicates_total", "counter", "Mesh messages already forwarded (same node and seq).");
+  w.sample("mywatering_mesh_duplicates_total", nullptr, g_metrics.meshDuplicates.value());
+
+  w.family("mywatering_sensor_read_duration_seconds", "histogram", "Bus time per sensor sample.");
+  for (uint8_t k = 1; k < (uint8_t)SensorKind::COUNT; k++)
+  {
+    snprintf(labels, sizeof(labels), "kind=\"%s\"", sensorKindName((SensorKind)k));
+    w.histogram("mywatering_sensor_read_duration_seconds", labels, g_metrics.sensorRead[k].duration);
+  }
+}
+
+#ifdef LOOP_TRACE
+static void traceToPrint(const char *data, size_t len, void *ctx)
+{
+  ((Print *)ctx)->write((const uint8_t *)data, len);
+}
+
+void dumpTrace(Print &out)
+{
+#ifdef ESP32
+  static const char *const threads[] = {"core0 (uplink)", "core1 (loop)"};
+#else
+  static const char *const threads[] = {"loop"};
+#endif
+  g_trace.writeChromeJson(traceToPrint, &out, ESP.getCpuFreqMHz(), threads, sizeof(threads) / sizeof(threads[0]));
+}
+#endif
+
+// --- WEB SERVER ---
+void setupWebServer()
+{
+  PushFanoutConfig pushCfg;
+  pushCfg.maxClients = LIVE_PUSH_MAX_CLIENTS;
+  pushCfg.eventSlots = LIVE_PUSH_EVENT_SLOTS;
+  pushCfg.eventBytes = LIVE_PUSH_EVENT_BYTES;
+  pushCfg.latestBytes = LIVE_SNAPSHOT_BYTES + 64;
+  if (!g_push.begin(pushCfg))
+    Serial.println("[WEB] Live push disabled (out of memory)");
+  g_ws.onEvent(onWsEvent);
+  server.addHandler(&g_ws);
+
+  // Serve static files (HTML, CSS, …)
+  server.serveStatic("/", LittleFS, "/littlefs/").setDefaultFile("index.html");
+  
+  // GET current config (for auto-fill on page load)
+  server.on("/get_config", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    if (LittleFS.exists(CONFIG_PATH)) {
+      request->send(LittleFS, CONFIG_PATH, "application/json");
+    } else {
+      request->send(404, "text/plain", "No config yet");
+    } });
+
+  // POST new config → streamed to a temp file, validated, renamed over
+  // config.json and applied live (or by a restart, see reloadConfig())
+  server.on("/save_config", HTTP_POST, onConfigUploaded, nullptr, onConfigChunk);
+
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    PromWriter w(metricsToStream, response);
+    renderMetrics(w);
+    request->send(response); });
+
+  server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+#ifdef LOOP_TRACE
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->addHeader("Content-Disposition", "attachment; filename=\"trace.json\"");
+    dumpTrace(*response);
+    request->send(response);
+#else
+    request->send(404, "text/plain", "Tracing is not compiled in (build with -D LOOP_TRACE)");
+#endif
+  });
+
+  // --- LIVE DATA ENDPOINT ---
+  // Copies the latest snapshot; "age" is ms since it was rendered. The ETag
+  // changes only when a new snapshot is published, so pollers get 304s.
+  server.on("/live_data", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+  uint32_t version = g_liveSnapshot.version();
+  if (version == 0) {
+    request->send(503, "application/json", "{\"error\":\"no sample yet\"}");
+    return;
+  }
+
+  char etag[32];
+  snprintf(etag, sizeof(etag), "W/\"%u-%u\"", (unsigned)g_bootCount, (unsigned)version);
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    request->send(response);
+    return;
+  }
+
+  // Handlers run on the single async_tcp task, so one buffer is enough.
+  static char sensors[LIVE_SNAPSHOT_BYTES];
+  uint32_t ts = 0;
+  size_t n = g_liveSnapshot.read(sensors, sizeof(sensors), version, ts);
+  if (n == 0) {
+    request->send(503, "application/json", "{\"error\":\"snapshot busy\"}");
+    return;
+  }
+  snprintf(etag, sizeof(etag), "W/\"%u-%u\"", (unsigned)g_bootCount, (unsigned)version);
+
+  String body;
+  body.reserve(n + 48);
+  body += "{\"ts\":";
+  body += ts;
+  body += ",\"age\":";
+  body += (uint32_t)(millis() - ts);
+  body += ",\"sensors\":";
+  body.concat(sensors, n);
+  body += '}';
+
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", body);
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response); });
+  server.begin();
+  Serial.println("[WEB] HTTP server started");
+}
+
+// --- NODE TELEMETRY ---
+// One message per wake with the Sensor::last values: JSON, or with
+// "meshEncoding":"binary" a schema announcement plus a TelemetryFrame.
+static uint32_t findMeshRoot(const painlessmesh::protocol::NodeTree &t)
+{
+  if (t.root)
+    return t.nodeId;
+  for (const auto &sub : t.subs)
+  {
+    uint32_t id = findMeshRoot(sub);
+    if (id)
+      return id;
+  }
+  return 0;
+}
+
+// Unicast to the root (gateway) instead of flooding the mesh; broadcast
+// only while no route to it is known. Every message carries the next seq.
+void meshSendToRoot(const char *payload, size_t len)
+{
+  uint32_t root = findMeshRoot(mesh.asNodeTree());
+  if (root)
+    g_meshRoot = root;
+  char prefix[MESH_SEQ_PREFIX_BYTES + 1];
+  meshSeqPrefix(g_meshSeq++, prefix, sizeof(prefix));
+  String msg;
+  msg.reserve(MESH_SEQ_PREFIX_BYTES + len);
+  msg += prefix;
+  msg.concat(payload, len);
+  if (g_meshRoot && mesh.sendSingle(g_meshRoot, msg))
+    return;
+  mesh.sendBroadcast(msg);
+}
+
+String nodeSchemaJson(uint16_t schema)
+{
+  JsonDocument doc;
+  doc["type"] = "schema";
+  doc["deviceId"] = g_deviceId;
+  doc["firmwareVersion"] = FIRMWARE_VERSION;
+  doc["schema"] = schema;
+  JsonArray sensors = doc["sensors"].to<JsonArray>();
+  for (const auto &s : g_sensors)
+  {
+    JsonObject o = sensors.add<JsonObject>();
+    o["name"] = s.name;
+    o["type"] = sensorKindName(s.kind);
+  }
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+uint16_t nodeSchemaId()
+{
+  const char *names[TELEMETRY_FRAME_MAX_SENSORS];
+  SensorKind kinds[TELEMETRY_FRAME_MAX_SENSORS];
+  uint8_t n = 0;
+  for (const auto &s : g_sensors)
+  {
+    if (n == TELEMETRY_FRAME_MAX_SENSORS)
+      break;
+    names[n] = s.name.c_str();
+    kinds[n++] = s.kind;
+  }
+  return telemetrySchemaId(names, kinds, n);
+}
+
+// Samples the sensors into the RTC log with the radio off and decides
+// whether this wake transmits: cold boot, batch due, or a threshold crossed.
+bool nodeTakeSample()
+{
+  if (!g_nodeLog.valid())
+  {
+    Serial.println("[NODE] Sample log reset");
+    g_nodeLog.reset();
+  }
+  requestDallasConversions();
+  NodeSampleReading r[NODE_LOG_READINGS];
+  uint8_t n = 0;
+  for (size_t i = 0; i < g_sensors.size() && i < TELEMETRY_FRAME_MAX_SENSORS; i++)
+  {
+    Sensor &s = g_sensors[i];
+    sampleSensor(s, s.last);
+    s.lastSampleAt = millis();
+    for (uint8_t f = 0; f < FIELD_COUNT && n < NODE_LOG_READINGS; f++)
+    {
+      if (!s.last.has((SensorField)f))
+        continue;
+      r[n].tag = (uint8_t)(i << 2 | f);
+      r[n++].raw = telemetryScale((SensorField)f, s.last.value[f]);
+    }
+  }
+  bool crossed = g_nodeLog.crossed(r, n, g_batchDelta);
+  if (!g_nodeLog.append(g_nodeLog.clockSec + millis() / 1000, r, n))
+    Serial.println("[NODE] Sample log full, oldest sample dropped");
+  g_nodeLog.seal();
+
+  bool transmit = g_bootCount == 1 || crossed || g_nodeLog.due(g_batchWakes);
+  Serial.printf("[NODE] Sample %u/%u logged%s\n", g_nodeLog.wakes, g_batchWakes,
+                transmit ? (crossed ? ", threshold crossed: sending" : ", sending") : "");
+  return transmit;
+}
+
+void nodeSleep()
+{
+  if (g_nodeTransmit)
+  {
+    g_radioOnMs += millis() - g_radioStartMs;
+    Serial.printf("[NODE] Radio on %lu ms avg per sample sent\n",
+                  g_radioSamples ? (unsigned long)(g_radioOnMs / g_radioSamples) : 0UL);
+  }
+  g_nodeLog.clockSec += millis() / 1000 + g_sleepSeconds;
+  g_nodeLog.seal();
+  ESP.deepSleep(g_sleepSeconds * 1000000ULL);
+}
+
+uint16_t nodeSampleAge(const NodeSampleLog<NODE_LOG_SLOTS, NODE_LOG_READINGS>::Entry &e)
+{
+  uint32_t now = g_nodeLog.clockSec + millis() / 1000;
+  return (uint16_t)std::min<uint32_t>(now - e.t, 65535);
+}
+
+void sendFrame(const uint8_t *frame, size_t len)
+{
+  static char text[2 + (MESH_FRAME_BYTES + 2) / 3 * 4];
+  size_t tlen = telemetryFrameToText(frame, len, text, sizeof(text) - 1);
+  text[tlen] = '\0';
+  meshSendToRoot(text, tlen);
+  Serial.printf("[NODE] Sent %u-byte frame (%u chars)\n", (unsigned)len, (unsigned)tlen);
+}
+
+// The whole log, oldest first; several frames if it does not fit in one.
+bool sendNodeFrames()
+{
+  TelemetryFrameHeader h;
+  h.schema = nodeSchemaId();
+  h.rssi = (int8_t)constrain(WiFi.RSSI(), -128, 0);
+  h.batteryMv = (uint16_t)(analogRead(BATTERY_PIN) * 3300UL / 4095);
+  h.sleepSec = (uint16_t)std::min<uint32_t>(g_sleepSeconds, 65535);
+
+  static uint8_t frame[MESH_FRAME_BYTES];
+  TelemetryFrameWriter w(frame, sizeof(frame));
+  if (!w.begin(g_deviceId.c_str(), h))
+    return false;
+  if (h.schema != g_announcedSchema || g_bootCount % MESH_SCHEMA_EVERY == 1)
+  {
+    String schema = nodeSchemaJson(h.schema);
+    meshSendToRoot(schema.c_str(), schema.length());
+    g_announcedSchema = h.schema;
+  }
+
+  uint8_t inFrame = 0;
+  for (uint8_t i = 0; i < g_nodeLog.count; i++)
+  {
+    const auto &e = g_nodeLog.at(i);
+    if (inFrame && w.length() + 3 + 3 * e.n > sizeof(frame))
+    {
+      sendFrame(frame, w.finish());
+      w.begin(g_deviceId.c_str(), h);
+      inFrame = 0;
+    }
+    w.beginRecord(nodeSampleAge(e));
+    for (uint8_t k = 0; k < e.n; k++)
+      w.addRaw(e.r[k].tag, e.r[k].raw);
+    inFrame++;
+  }
+  if (inFrame)
+    sendFrame(frame, w.finish());
+  return true;
+}
+
+// JSON fallback: one message per logged sample, same keys as before.
+void sendNodeJson()
+{
+  for (uint8_t i = 0; i < g_nodeLog.count; i++)
+  {
+    const auto &e = g_nodeLog.at(i);
+    JsonWriter w(g_telemetryBuf.data(), g_telemetryBuf.size());
+    w.string("deviceId", g_deviceId.c_str());
+    w.string("firmwareVersion", FIRMWARE_VERSION);
+    w.number("battery", analogRead(BATTERY_PIN) * 3.3 / 4095.0);
+    w.integer("rssi", WiFi.RSSI());
+    w.integer("meshHopCount", 0);
+    w.integer("sleepSeconds", g_sleepSeconds);
+    uint16_t age = nodeSampleAge(e);
+    if (age)
+      w.integer("sampleAgeSec", age);
+
+    SensorSample v;
+    uint8_t sensor = 0xFF;
+    for (uint8_t k = 0; k <= e.n; k++)
+    {
+      // Readings are grouped by sensor: flush when the index changes.
+      uint8_t idx = k < e.n ? e.r[k].tag >> 2 : 0xFF;
+      if (idx != sensor && sensor < g_sensors.size())
+        w.sample(g_sensors[sensor].keys, v);
+      if (idx != sensor)
+      {
+        v.mask = 0;
+        sensor = idx;
+      }
+      if (k < e.n)
+        v.set((SensorField)(e.r[k].tag & 3), telemetryUnscale((SensorField)(e.r[k].tag & 3), e.r[k].raw));
+    }
+
+    size_t n = w.finish();
+    if (!n)
+      continue;
+    Serial.print("[payload] ");
+    Serial.write((const uint8_t *)g_telemetryBuf.data(), n);
+    Serial.println();
+    forwardToIoTHub(g_telemetryBuf.data(), n);
+  }
+}
+
+void sendNodeTelemetry()
+{
+  noteFirstTransmit();
+  uint8_t samples = g_nodeLog.count;
+  if (!g_meshBinary || !sendNodeFrames())
+    sendNodeJson();
+  g_radioSamples += samples;
+  g_nodeLog.markSent();
+  g_nodeLog.seal();
+}
+
+// --- AZURE SEND ---
+// Node: send to the root over the mesh. Gateway: hand off to the uplink
+// task (never blocks; the ring drops the oldest message when full).
+void forwardToIoTHub(const String &payload)
+{
+  forwardToIoTHub(payload.c_str(), payload.length());
+}
+
+// Gateway hand-off without a String copy (mesh frames, own telemetry).
+void forwardToIoTHub(const char *payload, size_t len)
+{
+  if (g_mode == DeviceMode::NODE)
+  {
+    meshSendToRoot(payload, len);
+    return;
+  }
+  if (g_uplinkTask)
+  {
+    if (!g_uplinkRing.push(payload, len))
+      Serial.printf("[UPLINK] Message too large for hand-off (%u bytes)\n", (unsigned)len);
+    xTaskNotifyGive(g_uplinkTask);
+    return;
+  }
+  if (!g_txQueue.push(payload, len, millis() / 1000))
+    Serial.println("[QUEUE] Failed to enqueue message");
+}
+
+// One publish on the session's connection; never connects inline.
+static bool mqttPublish(const char *body, size_t len, uint32_t messages)
+{
+  TRACE_SCOPE("mqtt.publish");
+  if (!g_mqtt.connected())
+    return false;
+  if (!mqttClient.publish(g_mqttTopic.c_str(), (const uint8_t *)body, len))
+  {
+    g_mqtt.publishFailed();
+    Serial.printf("[MQTT] Publish of %u bytes failed (client state %d)\n", (unsigned)len, mqttClient.state());
+    return false;
+  }
+  g_mqtt.published(messages);
+  g_metrics.mqtt.publishes.add();
+  g_metrics.mqtt.messages.add(messages);
+  return true;
+}
+
+// Uplink task: keepalive while connected, reconnect with backoff otherwise.
+void serviceMqtt()
+{
+  uint32_t now = millis();
+  switch (g_mqtt.step(now))
+  {
+  case MqttSession::UP:
+  {
+    uint32_t ms = g_mqtt.lastReconnectMs();
+    g_metrics.mqtt.connects.add();
+    g_metrics.mqtt.reconnect.record(ms < 0xFFFFFFFFu / 1000 ? ms * 1000 : 0xFFFFFFFFu);
+    Serial.printf("[MQTT] Connected after %u ms (%u attempts so far)\n", ms, g_mqtt.stats().attempts);
+    break;
+  }
+  case MqttSession::FAILED:
+    Serial.printf("[MQTT] Connect failed (client state %d), retry in %u ms\n", mqttClient.state(),
+                  g_mqtt.retryInMs(now));
+    break;
+  case MqttSession::LOST:
+    Serial.printf("[MQTT] Connection lost (client state %d)\n", mqttClient.state());
+    break;
+  default:
+    break;
+  }
+  g_metrics.mqtt.connected.set(g_mqtt.connected());
+}
+
+// POSTs one body on the kept-alive session; true on 2xx.
+bool httpPost(const char *body, size_t len, const char *contentType, uint32_t messages)
+{
+  TRACE_SCOPE("http.post");
+  if (!espClient.connected())
+    g_httpHandshakes++;
+
+  g_http.begin(espClient, g_httpEventsUrl);
+  g_http.addHeader("Authorization", g_sasToken);
+  g_http.addHeader("Content-Type", contentType);
+  int code = g_http.POST((uint8_t *)body, len);
+  g_http.end(); // keeps the socket when the hub allows keep-alive
+  if (code < 200 || code >= 300)
+  {
+    Serial.printf("[HTTP] POST failed: %d\n", code);
+    return false;
+  }
+  uint32_t before = g_httpMessages;
+  g_httpMessages += messages;
+  if (g_httpMessages / 1000 != before / 1000)
+    Serial.printf("[HTTP] %u messages, %u TLS handshakes\n", g_httpMessages, g_httpHandshakes);
+  return true;
+}
+
+// --- STORE-AND-FORWARD ---
+void beginTelemetryQueue()
+{
+  if (!g_txQueue.begin(g_queueCfg))
+  {
+    Serial.println("[QUEUE] Failed to allocate telemetry queue");
+    return;
+  }
+  Serial.printf("[QUEUE] Ready, %u message(s) pending from previous boot\n", g_txQueue.size());
+}
+
+// Safe from any task: the uplink task owns the queue, so ask it to spill
+// its RAM ring and wait (bounded) for it to finish.
+void persistTelemetryQueue()
+{
+  if (!g_uplinkTask)
+  {
+    g_txQueue.persist();
+    return;
+  }
+  g_persistRequested = true;
+  xTaskNotifyGive(g_uplinkTask);
+  for (uint8_t i = 0; i < 40 && g_persistRequested; i++)
+    delay(50);
+}
+
+static void uplinkTask(void *)
+{
+  static char buf[UPLINK_RING_SLOT_BYTES];
+  uint32_t reportedDrops = 0;
+  for (;;)
+  {
+    size_t n;
+    while ((n = g_uplinkRing.pop(buf, sizeof(buf))) > 0)
+    {
+      TRACE_SCOPE("queue.push");
+      if (!g_txQueue.push(buf, n, millis() / 1000))
+        Serial.println("[QUEUE] Failed to enqueue message");
+    }
+    if (g_persistRequested)
+    {
+      TRACE_SCOPE("queue.persist");
+      g_txQueue.persist();
+      g_persistRequested = false;
+    }
+    if (g_uplinkReloadRequested)
+    {
+      applyUplinkConfig(g_pendingCfg);
+      g_uplinkReloadRequested = false;
+    }
+
+    if (g_uplink->service)
+      g_uplink->service();
+    drainTelemetryQueue();
+    updateQueueMetrics();
+
+    auto st = g_uplinkRing.stats();
+    if (st.dropped != reportedDrops)
+    {
+      reportedDrops = st.dropped;
+      Serial.printf("[UPLINK] Hand-off ring overflow: pushed %u, dropped %u, high water %u/%u\n",
+                    st.pushed, st.dropped, st.highWater, UPLINK_RING_SLOTS);
+    }
+#ifdef ESP32
+    uint32_t idleMs = g_sdkWindow.empty() ? UPLINK_TASK_IDLE_MS : SDK_DOWORK_MS;
+#else
+    uint32_t idleMs = UPLINK_TASK_IDLE_MS;
+#endif
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idleMs));
+  }
+}
+
+void startUplinkTask()
+{
+#ifdef ESP32
+  if (xTaskCreatePinnedToCore(uplinkTask, "uplink", UPLINK_TASK_STACK, nullptr, 1,
+                              &g_uplinkTask, UPLINK_TASK_CORE) != pdPASS)
+  {
+    g_uplinkTask = nullptr;
+    Serial.println("[UPLINK] Task start failed, sending from loop()");
+    return;
+  }
+  Serial.printf("[UPLINK] Task running on core %d\n", UPLINK_TASK_CORE);
+#endif
+}
+
+static bool addToBatch(const char *data, size_t len, void *ctx)
+{
+  return ((IoTHubBatchWriter *)ctx)->add(data, len);
+}
+
+// Sends the oldest message with `send`; returns how many messages were
+// delivered (0/1).
+static uint32_t sendQueueFront(uint32_t now, bool (*send)(const char *, size_t))
+{
+  static char buf[TelemetryQueue::MAX_MESSAGE + 1];
+  size_t n = g_txQueue.peek(buf, TelemetryQueue::MAX_MESSAGE, now);
+  if (n == 0)
+    return 0;
+  buf[n] = '\0';
+  return send(buf, n) ? 1 : 0;
+}
+
+static bool httpPostOne(const char *payload, size_t len)
+{
+  return httpPost(payload, len, "application/json", 1);
+}
+
+static bool mqttPublishOne(const char *payload, size_t len)
+{
+  return mqttPublish(payload, len, 1);
+}
+
+// HTTP only: packs up to HTTP_BATCH_MAX_MESSAGES pending messages into one
+// IoT Hub batch request.
+static uint32_t sendHttpBatch(uint32_t now)
+{
+  static char batch[HTTP_BATCH_MAX_BYTES];
+  IoTHubBatchWriter w(batch, sizeof(batch));
+  uint32_t n = g_txQueue.peekMany(HTTP_BATCH_MAX_MESSAGES, now, addToBatch, &w);
+  if (n < 2)
+    return sendQueueFront(now, httpPostOne);
+  size_t len = w.finish();
+  return httpPost(batch, len, IOTHUB_BATCH_CONTENT_TYPE, n) ? n : 0;
+}
+
+static bool addToMqttBatch(const char *data, size_t len, void *ctx)
+{
+  return ((MqttBatchWriter *)ctx)->add(data, len);
+}
+
+// MQTT only: coalesces up to MQTT_BATCH_MAX_MESSAGES pending messages into
+// one publish (a JSON array of the messages).
+static uint32_t sendMqttBatch(uint32_t now)
+{
+  static char batch[MQTT_BATCH_MAX_BYTES];
+  MqttBatchWriter w(batch, sizeof(batch));
+  uint32_t n = g_txQueue.peekMany(MQTT_BATCH_MAX_MESSAGES, now, addToMqttBatch, &w);
+  if (n < 2)
+    return sendQueueFront(now, mqttPublishOne);
+  size_t len = w.finish();
+  return mqttPublish(batch, len, n) ? n : 0;
+}
+
+// --- UPLINK DRIVERS ---
+static void httpBegin()
+{
+  g_httpEventsUrl = "https://" + g_iothubHost + "/devices/" + g_uplinkDeviceId +
+                    "/messages/events?api-version=2018-06-30";
+  g_http.setReuse(true);
+#ifdef ESP32
+  espClient.setInsecure();
+#endif
+}
+
+static void httpEnd()
+{
+  g_http.end();
+}
+
+static uint32_t httpSend(uint32_t now)
+{
+  return g_txQueue.size() > 1 ? sendHttpBatch(now) : sendQueueFront(now, httpPostOne);
+}
+
+#ifdef ESP32
+static void mqttEnd()
+{
+  g_mqtt.stop();
+  g_metrics.mqtt.connected.set(0);
+  mqttClient.disconnect();
+}
+
+static bool mqttReady()
+{
+  return g_mqtt.connected(); // otherwise kept queued until serviceMqtt() reconnects
+}
+
+static uint32_t mqttSend(uint32_t now)
 {
-  g_sensors.clear();
-  for (auto &p : g_onewire_map)
-    delete p.second;
-  for (auto &p : g_dallas_map)
-    delete p.second;
-  g_onewire_map.clear();
-  g_dallas_map.clear();
+  return g_txQueue.size() > 1 ? sendMqttBatch(now) : sendQueueFront(now, mqttPublishOne);
 }
 
-void readConfig()
+static void sdkEnd()
 {
-  // clearSensors();
-  //  if (!FS_BEGIN())
-  //    return;
-  //  File f = LittleFS.open("/littlefs/config.json", "r");
-
-  // if (!f)
-  // return;
-  File f = LittleFS.open("/littlefs/config.json", "r");
-  if (!f)
-  {
-    Serial.println("[CONFIG] No config.json found");
-    return;
-  }
-
-  JsonDocument doc;
-  if (deserializeJson(doc, f) != DeserializationError::Ok)
+  if (g_iotHubClient)
   {
-    f.close();
-    return;
+    IoTHubClient_LL_Destroy(g_iotHubClient); // fails what is still in flight
+    g_iotHubClient = nullptr;
   }
-  f.close();
-
-  String payload;
-  serializeJson(doc, payload);
-  Serial.println("[BOOT] readConfig: " + payload);
+  sdkResetWindow();
+}
+#endif
 
-  String mode = doc["mode"] | "gateway";
-  g_mode = (mode == "node") ? DeviceMode::NODE : DeviceMode::GATEWAY;
-  g_ssid = doc["SSID"] | "";
-  g_password = doc["PASSWORD"] | "";
-  g_iothubHost = doc["IOTHUB_HOST"] | "";
-  g_deviceId = doc["DEVICE_ID"] | "";
-  g_sasToken = doc["SAS_TOKEN"] | "";
-  g_protocol = doc["PROTOCOL"] | "http";
-  g_firmwareUrl = doc["firmwareUrl"] | "";
-  g_sleepSeconds = doc["sleepSeconds"] | 60;
+// Indexed by UplinkProtocol. setupIoTHub() picks one when the config is
+// loaded or reloaded; the uplink task only calls through g_uplink.
+const UplinkDriver kUplinkDrivers[UPLINK_PROTOCOLS] = {
+    {httpBegin, httpEnd, nullptr, nullptr, httpSend},
+#ifdef ESP32
+    {setupMqtt, mqttEnd, serviceMqtt, mqttReady, mqttSend},
+    {setupSdk, sdkEnd, serviceSdk, nullptr, nullptr}, // serviceSdk() moves messages itself
+#else
+    {},
+    {},
+#endif
+};
 
-  for (JsonObject obj : doc["sensors"].as<JsonArray>())
+void setupIoTHub()
+{
+  uint8_t p = UPLINK_HTTP;
+  for (uint8_t i = 0; i < UPLINK_PROTOCOLS; i++)
+    if (g_protocol == kUplinkProtocolNames[i])
+      p = i;
+  if (!kUplinkDrivers[p].begin)
   {
-    Sensor s;
-    s.name = obj["name"] | "";
-    s.type = obj["type"] | "";
-    s.pin = obj["pin"] | 0;
-    if (s.type == "cap_soil_moisture")
-    {
-      s.air_value = obj["air_value"] | 4095;
-      s.water_value = obj["water_value"] | 0;
-    }
-    else if (s.type == "dht22")
-    {
-      s.dht = new DHT(s.pin, DHT22);
-      s.dht->begin();
-    }
-    else if (s.type == "ds18b20")
-    {
-      s.index = obj["index"] | 0;
-      if (g_dallas_map.find(s.pin) == g_dallas_map.end())
-      {
-        OneWire *ow = new OneWire(s.pin);
-        DallasTemperature *dt = new DallasTemperature(ow);
-        dt->begin();
-        g_onewire_map[s.pin] = ow;
-        g_dallas_map[s.pin] = dt;
-      }
-      s.oneWire = g_onewire_map[s.pin];
-      s.sensors = g_dallas_map[s.pin];
-    }
-    else if (s.type == "bme280")
-    {
-      s.address = obj["address"] | 0x76;
-      s.bme = new Adafruit_BME280();
-      s.bme->begin(s.address);
-    }
-    else if (s.type == "bmp280")
-    {
-      s.address = obj["address"] | 0x76;
-      s.bmp = new Adafruit_BMP280();
-      s.bmp->begin(s.address);
-    }
-    g_sensors.push_back(s);
+    Serial.printf("[UPLINK] %s is not available on this board, using http\n", kUplinkProtocolNames[p]);
+    p = UPLINK_HTTP;
   }
-  g_configValid = true && !g_ssid.isEmpty() && !g_password.isEmpty() && !g_deviceId.isEmpty();
+  g_uplinkProto = p;
+  g_uplink = &kUplinkDrivers[p];
+  g_uplink->begin();
 }
 
-// --- WIFI ---
-bool connectSTA()
+// Queue figures for /metrics; called by the queue's owner after draining.
+void updateQueueMetrics()
 {
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(g_ssid.c_str(), g_password.c_str());
-  uint8_t attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 40)
-  {
-    Serial.print(".");
-    delay(500);
-    attempts++;
-  }
-  if (WiFi.status() != WL_CONNECTED)
-  {
-    Serial.println("[STA] Failed to connect!");
-    return false;
-  }
-
-  Serial.printf("[STA] Connected — IP: %s\n", WiFi.localIP().toString().c_str());
-  return true;
+  const TelemetryQueue::Stats &st = g_txQueue.stats();
+  g_metrics.queueDepth.set(g_txQueue.size());
+  g_metrics.queueOnDisk.set(g_txQueue.diskCount());
+  g_metrics.queueDropped.set(st.dropped);
+  g_metrics.queueExpired.set(st.expired);
 }
 
-void startAPMode()
+static void backOffUplink()
 {
-  Serial.println("[AP] Starting AP mode...");
-  WiFi.mode(WIFI_AP);
-  WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
-  WiFi.softAP(AP_SSID, AP_PASSWORD);
-
-  dnsServer.start(53, "*", WiFi.softAPIP());
-
-  // if (!FS_BEGIN()) {
-  //   Serial.println("[AP] LittleFS failed! Formatting...");
-  //   LittleFS.format();  // Works on both ESP32 & ESP8266
-  //   if (FS_BEGIN()) {
-  //     Serial.println("[AP] LittleFS formatted & mounted");
-  //   } else {
-  //     Serial.println("[AP] LittleFS still failed!");
-  //   }
-  // }
-
-  setupWebServer();
+  g_uplinkFailTime = millis();
+  g_uplinkBackoffMs = g_uplinkBackoffMs ? std::min<uint32_t>(g_uplinkBackoffMs * 2, UPLINK_BACKOFF_MAX_MS)
+                                        : UPLINK_BACKOFF_MIN_MS;
+}
 
-  g_apMode = true;
-  g_apStartTime = millis();
-  Serial.printf("[AP] Open: http://%s\n", WiFi.softAPIP().toString().c_str());
+#ifdef ESP32
+// Called from IoTHubClient_LL_DoWork() / _Destroy(), i.e. on the uplink task.
+static void sdkConfirmation(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *ctx)
+{
+  uint32_t id = (uint32_t)(uintptr_t)ctx;
+  if (g_sdkWindow.resolve(id, result == IOTHUB_CLIENT_CONFIRMATION_OK, millis()) &&
+      result != IOTHUB_CLIENT_CONFIRMATION_OK)
+    Serial.printf("[AZURE] Message %u not confirmed (result %d)\n", id, (int)result);
 }
 
-// --- MESH ---
-// In setupMesh()
-void setupMesh()
+// Hands msg to the SDK under a new correlation id ("<boot>-<id>"). A
+// refused send is resolved as failed and handled like a failed confirmation.
+static void sdkSend(IOTHUB_MESSAGE_HANDLE msg, uint8_t attempt)
 {
-  // Only initialize mesh on NODE devices to avoid STA <-> mesh conflicts on Gateway.
-  if (g_mode != DeviceMode::NODE)
+  uint32_t id = g_sdkWindow.add(msg, millis(), attempt);
+  char corr[24];
+  snprintf(corr, sizeof(corr), "%u-%u", g_bootCount, id);
+  IoTHubMessage_SetCorrelationId(msg, corr);
+  IOTHUB_CLIENT_RESULT r = IoTHubClient_LL_SendEventAsync(g_iotHubClient, msg, sdkConfirmation, (void *)(uintptr_t)id);
+  if (r != IOTHUB_CLIENT_OK)
   {
-    g_meshInitialized = false;
-    Serial.println("[MESH] Mesh disabled on Gateway for stability");
-    return;
+    Serial.printf("[AZURE] SendEventAsync refused message %u (result %d)\n", id, (int)r);
+    g_sdkWindow.resolve(id, false, millis());
   }
+}
 
-  mesh.setDebugMsgTypes(ERROR | STARTUP | CONNECTION);
-  mesh.init(String(MESH_PREFIX) + g_deviceId, MESH_PASSWORD, MESH_PORT);
-  mesh.onReceive(&meshReceivedCallback);
-  g_meshInitialized = true; // Mark as ready
-  Serial.println("[MESH] Mesh initialized (NODE mode)");
+static SdkEntry *sdkEntry(IOTHUB_MESSAGE_HANDLE msg)
+{
+  for (uint8_t i = 0; i < g_sdkSentCount; i++)
+    if (g_sdkSent[i].msg == msg)
+      return &g_sdkSent[i];
+  return nullptr;
 }
 
-// --- IOT HUB ---
-#ifdef ESP32
-void setupIoTHub()
+static bool sdkFrontSeq(uint32_t seq, const char *, size_t, void *ctx)
 {
-  if (g_protocol == "mqtt")
-  {
-    mqttClient.setServer(g_iothubHost.c_str(), 8883);
-  }
-  else if (g_protocol == "sdk")
+  *(uint32_t *)ctx = seq;
+  return true;
+}
+
+// Pops the confirmed messages at the front of the queue, in order, and
+// forgets entries that are no longer at its front (count / age caps).
+static void sdkPopConfirmed(uint32_t now)
+{
+  while (g_sdkSentCount)
   {
-    if (platform_init() != 0)
-      return;
-    String conn = "HostName=" + g_iothubHost + ";DeviceId=" + g_deviceId +
-                  ";SharedAccessSignature=" + g_sasToken;
-    g_iotHubClient = IoTHubClient_LL_CreateFromConnectionString(conn.c_str(), MQTT_Protocol);
-    if (g_iotHubClient)
+    uint32_t front;
+    SdkEntry &e = g_sdkSent[0];
+    if (g_txQueue.peekMany(1, now / 1000, sdkFrontSeq, &front) == 1 && e.seq == front)
     {
-      IoTHubClient_LL_SetRetryPolicy(g_iotHubClient, IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER, 0);
+      if (!e.confirmed)
+        break;
+      g_txQueue.pop();
     }
+    e.msg = nullptr; // still in flight: destroyed when it settles
+    g_sdkSentCount--;
+    memmove(&g_sdkSent[0], &g_sdkSent[1], g_sdkSentCount * sizeof(SdkEntry));
   }
 }
 
-void checkOTA()
+// Walks the front of the queue: entries in flight or confirmed are skipped,
+// ones given up on are sent again where they are, new ones are added while
+// the window has room.
+static bool sdkRefill(uint32_t seq, const char *data, size_t len, void *ctx)
 {
-  if (g_firmwareUrl.length() < 10)
-    return;
-  Serial.println("[OTA] Checking for firmware at: " + g_firmwareUrl);
-  espClient.setInsecure();
-  t_httpUpdate_return ret = httpUpdate.update(espClient, g_firmwareUrl);
-  switch (ret)
+  uint8_t &i = *(uint8_t *)ctx;
+  SdkEntry *e = i < g_sdkSentCount ? &g_sdkSent[i] : nullptr;
+  if (e && e->seq != seq)
+    return false;
+  if (e && (e->msg || e->confirmed))
   {
-  case HTTP_UPDATE_FAILED:
-    Serial.printf("[OTA] Failed: %d %s\n", httpUpdate.getLastError(), httpUpdate.getLastErrorString().c_str());
-    break;
-  case HTTP_UPDATE_NO_UPDATES:
-    Serial.println("[OTA] No update available");
-    break;
-  case HTTP_UPDATE_OK:
-    Serial.println("[OTA] Update applied successfully. Rebooting...");
-    break;
+    i++;
+    return true;
+  }
+  if (g_sdkWindow.full() || (!e && g_sdkSentCount == SDK_INFLIGHT_MAX))
+    return false;
+  IOTHUB_MESSAGE_HANDLE msg = IoTHubMessage_CreateFromByteArray((const unsigned char *)data, len);
+  if (msg == nullptr)
+  {
+    Serial.println("[AZURE] Failed to create IoT Hub message");
+    return false;
   }
+  if (!e)
+  {
+    e = &g_sdkSent[g_sdkSentCount++];
+    e->seq = seq;
+    e->confirmed = false;
+  }
+  e->msg = msg;
+  i++;
+  sdkSend(msg, 1);
+  return true;
 }
-#endif
 
-// --- WEB SERVER ---
-void setupWebServer()
+// Client teardown: drops the window. Confirmed messages at the front are
+// popped; the rest are still queued and go out again on the next client
+// (one the hub already had may arrive twice).
+void sdkResetWindow()
 {
-  // Serve static files (HTML, CSS, …)
-  server.serveStatic("/", LittleFS, "/littlefs/").setDefaultFile("index.html");
-  
-  // GET current config (for auto-fill on page load)
-  server.on("/get_config", HTTP_GET, [](AsyncWebServerRequest *request)
-            {
-    if (LittleFS.exists("/littlefs/config.json")) {
-      request->send(LittleFS, "/littlefs/config.json", "application/json");
-    } else {
-      request->send(404, "text/plain", "No config yet");
-    } });
-
-  // POST new config → write to LittleFS and restart
-  server.on("/save_config", HTTP_POST, [](AsyncWebServerRequest *request)
-            {
-              // This runs when headers are received
-              request->send(200); 
-            },
-            nullptr, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
-            {
-    static String body;
-    if (index == 0) body = "";
-    body += String((char*)data).substring(0, len);
-
-    if (index + len == total) {
-      Serial.println("[WEB] Saving config:");
-      Serial.println(body);
-
-      File f = LittleFS.open("/littlefs/config.json", "w");
-      if (f) {
-        f.print(body);
-        f.close();
-        Serial.println("[WEB] Config saved – restarting...");
-        request->send(200, "application/json", "{\"status\":\"ok\"}");
-        delay(1000);
-        ESP.restart();
-      } else {
-        Serial.println("[WEB] Failed to write config.json");
-        request->send(500, "text/plain", "Failed to save config");
-      }
-    } });
-
-  // --- LIVE DATA ENDPOINT ---
-  server.on("/live_data", HTTP_GET, [](AsyncWebServerRequest *request)
-            {
-  JsonDocument doc;
-  JsonObject root = doc.to<JsonObject>();
-
-  for (const auto &s : g_sensors) {
-    JsonObject sensor = root.createNestedObject(s.name);
-
-    if (s.type == "cap_soil_moisture") {
-      int raw = analogRead(s.pin);
-      float pct = 100.0 * (s.air_value - raw) / (float)(s.air_value - s.water_value);
-      sensor["moisture"] = constrain(pct, 0, 100);
-    }
-    else if (s.type == "dht22") {
-      sensor["temp"] = s.dht->readTemperature();
-      sensor["hum"] = s.dht->readHumidity();
-    }
-    else if (s.type == "ds18b20") {
-      sensor["temp"] = s.sensors->getTempCByIndex(s.index);
-    }
-    else if (s.type == "bme280") {
-      sensor["temp"] = s.bme->readTemperature();
-      sensor["hum"] = s.bme->readHumidity();
-      sensor["pres"] = s.bme->readPressure() / 100.0F;
-    }
-    else if (s.type == "bmp280") {
-      sensor["temp"] = s.bmp->readTemperature();
-      sensor["pres"] = s.bmp->readPressure() / 100.0F;
-    }
+  InflightWindow<SDK_INFLIGHT_MAX>::Done d;
+  while (g_sdkWindow.takeAny(d))
+  {
+    IOTHUB_MESSAGE_HANDLE msg = (IOTHUB_MESSAGE_HANDLE)d.msg;
+    SdkEntry *e = sdkEntry(msg);
+    if (e && d.status == InflightWindow<SDK_INFLIGHT_MAX>::CONFIRMED)
+      e->confirmed = true;
+    else if (e)
+      g_metrics.sdkRequeued.add();
+    if (e)
+      e->msg = nullptr;
+    IoTHubMessage_Destroy(msg);
   }
-
-  String response;
-  serializeJson(doc, response);
-  request->send(200, "application/json", response); });
-  server.begin();
-  Serial.println("[WEB] HTTP server started");
+  sdkPopConfirmed(millis());
+  g_sdkSentCount = 0;
+  g_metrics.sdkInflight.set(0);
 }
 
-// --- AZURE SEND ---
-void forwardToIoTHub(const String &payload)
+// SDK protocol, uplink task: settles finished sends (confirmed ones are
+// done, failed or unanswered ones are resent up to SDK_MAX_ATTEMPTS, then
+// left queued behind a backoff), pops the confirmed front of the queue,
+// refills the window from it and runs DoWork. Messages leave the queue
+// only once the hub has confirmed them and everything before them.
+void serviceSdk()
 {
-  if (g_mode == DeviceMode::NODE)
-  {
-    mesh.sendBroadcast(payload);
+  if (!g_iotHubClient)
     return;
-  }
-  if (g_protocol == "http")
+  TRACE_SCOPE("iothub.window");
+  uint32_t now = millis();
+  UplinkMetrics &m = g_metrics.uplink[UPLINK_SDK];
+  InflightWindow<SDK_INFLIGHT_MAX>::Done d;
+  while (g_sdkWindow.take(now, d))
   {
-    HTTP_CLIENT http;
-    String url = "https://" + g_iothubHost + "/devices/" + g_deviceId +
-                 "/messages/events?api-version=2018-06-30";
-    http.begin(espClient, url);
-    http.addHeader("Authorization", g_sasToken);
-    http.addHeader("Content-Type", "application/json");
-    http.POST(payload);
-    http.end();
-  }
-  else if (g_protocol == "mqtt")
-  {
-    if (!mqttClient.connected() && millis() - lastReconnectAttempt > 5000)
+    IOTHUB_MESSAGE_HANDLE msg = (IOTHUB_MESSAGE_HANDLE)d.msg;
+    SdkEntry *e = sdkEntry(msg);
+    m.latency.record(d.elapsedMs * 1000);
+    if (d.status == InflightWindow<SDK_INFLIGHT_MAX>::CONFIRMED)
     {
-      lastReconnectAttempt = millis();
-      String user = g_iothubHost + "/" + g_deviceId + "/?api-version=2018-06-30";
-#ifdef ESP32
-      espClient.setInsecure();
-#endif
-      mqttClient.connect(g_deviceId.c_str(), user.c_str(), g_sasToken.c_str());
+      m.sent.add();
+      IoTHubMessage_Destroy(msg);
+      if (e)
+      {
+        e->msg = nullptr;
+        e->confirmed = true;
+      }
+      g_uplinkBackoffMs = 0;
+      noteFirstTransmit();
+      continue;
     }
-    if (mqttClient.connected())
+    m.failed.add();
+    if (e && d.attempt < SDK_MAX_ATTEMPTS)
     {
-      String topic = "devices/" + g_deviceId + "/messages/events/";
-      bool success = mqttClient.publish(topic.c_str(), payload.c_str());
-      Serial.print("[MQTT] Sending message: ");
-      Serial.println(payload.c_str());
-      Serial.print("[MQTT] Publish result: ");
-      Serial.println(success ? "OK" : "FAIL");
+      g_metrics.sdkRetries.add();
+      sdkSend(msg, d.attempt + 1);
+      continue;
     }
+    IoTHubMessage_Destroy(msg);
+    if (!e)
+      continue; // the queue dropped it meanwhile
+    e->msg = nullptr;
+    g_metrics.sdkRequeued.add();
+    backOffUplink();
+    Serial.printf("[AZURE] Message %u left queued after %u attempts, %u pending, retry in %u ms\n", d.id, d.attempt,
+                  g_txQueue.size(), g_uplinkBackoffMs);
   }
-#ifdef ESP32
-  else if (g_protocol == "sdk" && g_iotHubClient)
-  {
-    IOTHUB_MESSAGE_HANDLE msg = IoTHubMessage_CreateFromString(payload.c_str());
+  sdkPopConfirmed(now);
 
-    if (msg == nullptr)
-    {
-      Serial.println("[AZURE] Failed to create IoT Hub message");
-      return;
-    }
+  bool backingOff = g_uplinkBackoffMs && now - g_uplinkFailTime < g_uplinkBackoffMs;
+  if (!backingOff && WiFi.status() == WL_CONNECTED)
+  {
+    uint8_t i = 0;
+    g_txQueue.peekMany(SDK_INFLIGHT_MAX, now / 1000, sdkRefill, &i);
+  }
 
-    Serial.print("[AZURE] Sending message: ");
-    Serial.println(payload.c_str());
+  {
+    TRACE_SCOPE("iothub.DoWork");
+    IoTHubClient_LL_DoWork(g_iotHubClient);
+  }
+  g_metrics.sdkInflight.set(g_sdkWindow.size());
+}
+#else
+void serviceSdk() {}
+#endif
 
-    IOTHUB_CLIENT_RESULT result =
-        IoTHubClient_LL_SendEventAsync(g_iotHubClient, msg, nullptr, nullptr);
+// Sends queued messages oldest-first. Stops at the first failure and backs
+// off exponentially so a dead uplink does not stall loop().
+void drainTelemetryQueue()
+{
+  TRACE_SCOPE("uplink.drain");
+  if (g_txQueue.empty() || !g_uplink->send)
+    return;
+  if (g_uplinkBackoffMs && millis() - g_uplinkFailTime < g_uplinkBackoffMs)
+    return;
+  if (g_uplink->ready && !g_uplink->ready())
+    return;
 
-    if (result == IOTHUB_CLIENT_OK)
+  for (uint8_t i = 0; i < UPLINK_DRAIN_BUDGET && !g_txQueue.empty(); i++)
+  {
+    uint32_t now = millis() / 1000;
+    uint32_t sent = 0;
+    if (WiFi.status() == WL_CONNECTED)
     {
-      Serial.println("[AZURE] Message sent successfully");
+      UplinkMetrics &m = g_metrics.uplink[g_uplinkProto];
+      uint32_t t0 = micros();
+      sent = g_uplink->send(now);
+      m.latency.record(micros() - t0);
+      if (sent)
+        m.sent.add(sent);
+      else
+        m.failed.add();
     }
-    else
+    if (sent == 0)
     {
-      Serial.print("[AZURE] Error sending message: ");
-      Serial.println(result); // prints numeric enum
+      if (g_txQueue.empty())
+        return; // everything left had expired
+      backOffUplink();
+      const TelemetryQueue::Stats &st = g_txQueue.stats();
+      Serial.printf("[QUEUE] Uplink down, %u pending (%u on disk), dropped %u, retry in %u ms\n",
+                    g_txQueue.size(), g_txQueue.diskCount(), st.dropped + st.expired, g_uplinkBackoffMs);
+      return;
     }
-
-    // required after LL APIs
-    IoTHubMessage_Destroy(msg);
+    g_txQueue.pop(sent);
+    g_uplinkBackoffMs = 0;
+    noteFirstTransmit();
   }
-#endif
 }
 //       char c = Serial.read();
 //       if (c == '\n' && jsonStr.endsWith("\n")) break;  // double newline ends input
@@ -555,16 +3766,11 @@ void forwardToIoTHub(const String &payload)
 
 // --- SETUP ---
 
-void setup()
+void mountLittleFS()
 {
-  Serial.begin(115200);
-  delay(200);
-  Serial.println("[BOOT] start");
-
-  pinMode(PIN_BOOT, INPUT_PULLUP);
-  g_bootCount++;
-
-  // MOUNT LITTLEFS ONCE HERE
+  static bool mounted = false;
+  if (mounted)
+    return;
   Serial.println("[BOOT] Mounting LittleFS at /littlefs");
 
   if (!LittleFS.begin(true, "/littlefs"))
@@ -583,18 +3789,61 @@ void setup()
   {
     Serial.println("[BOOT] LittleFS mounted");
   }
+  mounted = true;
+}
+
+// Printed once, when the first message leaves the device.
+void noteFirstTransmit()
+{
+  static bool done = false;
+  if (done)
+    return;
+  done = true;
+  Serial.printf("[BOOT] %s boot: first transmit at %lu ms (config ready %lu ms, Wi-Fi %lu ms)\n",
+                g_warmBoot ? "Warm" : "Cold", millis(), g_bootConfigMs, g_bootWifiMs);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  pinMode(PIN_BOOT, INPUT_PULLUP);
+  g_bootCount++;
+  if (g_bootCount == 1)
+  {
+    // Fresh seq space per power-up: the gateway may still hold old pairs.
+#ifdef ESP32
+    g_meshSeq = esp_random();
+#else
+    g_meshSeq = ESP.random();
+#endif
+  }
 
-  Serial.println("[DEBUG] LittleFS contents:");
-  File root = LittleFS.open("/littlefs/");
-  File file = root.openNextFile();
-  while (file)
+  // Deep-sleep wake with a valid parsed config: no LittleFS, no JSON.
+  g_warmBoot = g_bootCount > 1 && g_cfgImage.valid() && g_cfgImage.node;
+  if (g_warmBoot)
   {
-    Serial.printf("  %s (%u bytes)\n", file.name(), file.size());
-    file = root.openNextFile();
+    applyConfig(g_cfgImage);
   }
+  else
+  {
+    delay(200);
+    Serial.println("[BOOT] start");
+    mountLittleFS();
+
+    Serial.println("[DEBUG] LittleFS contents:");
+    File root = LittleFS.open("/littlefs/");
+    File file = root.openNextFile();
+    while (file)
+    {
+      Serial.printf("  %s (%u bytes)\n", file.name(), file.size());
+      file = root.openNextFile();
+    }
 
-  readConfig();
-  Serial.printf("[BOOT] configValid = %d\n", g_configValid);
+    readConfig();
+  }
+  g_bootConfigMs = millis();
+  Serial.printf("[BOOT] %s boot #%u, configValid = %d (%lu ms)\n", g_warmBoot ? "Warm" : "Cold",
+                g_bootCount, g_configValid, g_bootConfigMs);
 
   if (!g_configValid)
   {
@@ -609,25 +3858,44 @@ void setup()
       startAPMode();
       return;
     }
-    // setupMesh();
-    //  Gateway: do NOT initialize mesh to avoid STA/mesh conflicts (painlessMesh scan issues)
-    g_meshInitialized = false;
-#ifdef ESP32
+    g_bootWifiMs = millis();
+    startClock();
+    setupMesh(); // before checkOTA(): node images are staged only with the mesh up
+    beginTelemetryQueue();
     setupIoTHub();
+#ifdef ESP32
     checkOTA();
 #endif
+    beginMeshOta();
+    startUplinkTask();
     setupWebServer();
   }
   else
   {
-    // NODE mode: connect STA (for optional internet) then start mesh
+    // NODE mode: sample with the radio off; most wakes end right here.
+    g_nodeTransmit = nodeTakeSample();
+    publishLiveSnapshot();
+    for (uint8_t i = 0; i < g_sensors.size(); i++)
+      wateringReading(i, g_sensors[i].last);
+    serviceWatering();
+    // Deep sleep would drop the valve pins: stay up while one is open, and
+    // report every valve event.
+    g_nodeTransmit = g_nodeTransmit || g_watering.running() || g_wateringReportCount;
+    if (!g_nodeTransmit)
+      nodeSleep();
+
+    // connect STA (for optional internet) then start mesh
+    g_radioStartMs = millis();
     WiFi.mode(WIFI_STA);
     if (!connectSTA())
     {
       // If STA fails still initialize mesh in node mode (mesh uses Wi-Fi AP/station internally)
       Serial.println("[SETUP] STA failed, proceeding to initialize mesh (NODE mode)");
     }
+    g_bootWifiMs = millis();
+    startClock();
     setupMesh();
+    mountLittleFS(); // web UI files; skipped on wakes that do not transmit
     setupWebServer();
   }
 
@@ -637,150 +3905,117 @@ void setup()
 // --- LOOP ---
 void loop()
 {
+  static uint32_t loopStart = micros();
+  uint32_t loopNow = micros();
+  g_metrics.loop.record(loopNow - loopStart); // whole previous pass, incl. the core's yield
+  loopStart = loopNow;
+  TRACE_SCOPE("loop");
+
   if (g_apMode)
   {
+    TRACE_SCOPE("dns");
     dnsServer.processNextRequest();
   }
+  {
+    TRACE_SCOPE("livePush");
+    pumpLivePush();
+  }
+  if (g_cfgPending)
+  {
+    TRACE_SCOPE("config.reload");
+    if (reloadConfig(g_pendingCfg))
+      g_cfgPending = false;
+  }
+#ifdef LOOP_TRACE
+  if (Serial.available() && Serial.read() == 't')
+    dumpTrace(Serial);
+#endif
   if (digitalRead(PIN_BOOT) == LOW && g_buttonPressTime == 0)
     g_buttonPressTime = millis();
   if (digitalRead(PIN_BOOT) == LOW && millis() - g_buttonPressTime > 3000)
   {
-    LittleFS.remove("/littlefs/config.json");
+    LittleFS.remove(CONFIG_PATH);
     delay(500);
     ESP.restart();
   }
   if (digitalRead(PIN_BOOT) == HIGH)
     g_buttonPressTime = 0;
   if (g_apMode && millis() - g_apStartTime > CONFIG_TIMEOUT_MS)
+  {
+    persistTelemetryQueue();
     ESP.restart();
+  }
   // mesh.update();
   if (g_meshInitialized)
   {
+    TRACE_SCOPE("mesh.update");
     mesh.update();
   }
-  // === GATEWAY: READ OWN SENSORS EVERY 100 SECONDS ===
-  static unsigned long lastSensorRead = 0;
-  // Serial.printf("[GATEWAY] g_mode: %s, g_configValid: %d, time_since_last: %lu, send_now: %d\n",
-  //               (g_mode == DeviceMode::GATEWAY ? "GATEWAY" : "NODE"),
-  //               g_configValid,
-  //               (millis() - lastSensorRead),
-  //               (g_mode == DeviceMode::GATEWAY && g_configValid && millis() - lastSensorRead > 10000));
-  //               static uint32_t lastHeap = 0;
-  // if (millis() - lastHeap > 10000) {
-  //   lastHeap = millis();
-  //   Serial.printf("[MEM] Free heap: %d\n", ESP.getFreeHeap());
-  // }
-  if (g_mode == DeviceMode::GATEWAY && g_configValid && millis() - lastSensorRead > 10000)
+  if (g_mode == DeviceMode::GATEWAY)
   {
-    lastSensorRead = millis();
+    TRACE_SCOPE("mesh.ota");
+    serviceMeshOta();
+  }
+  // === GATEWAY: SAMPLE ON EACH SENSOR'S PERIOD, REPORT EVERY 10 SECONDS ===
+  if (g_mode == DeviceMode::GATEWAY && g_configValid)
+  {
+    TRACE_SCOPE("sensors.poll");
+    if (pollSensors())
+      publishLiveSnapshot();
+  }
 
-    JsonDocument doc;
-    doc["deviceId"] = g_deviceId;
-    doc["firmwareVersion"] = FIRMWARE_VERSION;
-    doc["rssi"] = WiFi.RSSI();
-    doc["gateway"] = true;
-
-    // Request temperature for all DS18B20
-    std::set<int> dsPins;
-    for (const auto &s : g_sensors)
-      if (s.type == "ds18b20")
-        dsPins.insert(s.pin);
-    for (int p : dsPins)
-      g_dallas_map[p]->requestTemperatures();
-
-    for (const auto &s : g_sensors)
-    {
-      if (s.type == "cap_soil_moisture")
-      {
-        int raw = analogRead(s.pin);
-        float pct = 100.0 * (s.air_value - raw) / (float)(s.air_value - s.water_value);
-        doc[s.name] = constrain(pct, 0, 100);
-      }
-      else if (s.type == "dht22")
-      {
-        doc[s.name + "_temp"] = s.dht->readTemperature();
-        doc[s.name + "_hum"] = s.dht->readHumidity();
-      }
-      else if (s.type == "ds18b20")
-      {
-        doc[s.name] = s.sensors->getTempCByIndex(s.index);
-      }
-      else if (s.type == "bme280")
-      {
-        doc[s.name + "_temp"] = s.bme->readTemperature();
-        doc[s.name + "_hum"] = s.bme->readHumidity();
-        doc[s.name + "_pres"] = s.bme->readPressure() / 100.0F;
-      }
-      else if (s.type == "bmp280")
-      {
-        doc[s.name + "_temp"] = s.bmp->readTemperature();
-        doc[s.name + "_pres"] = s.bmp->readPressure() / 100.0F;
-      }
+  // Aggregating: a summary per window, raw values only on a limit crossing.
+  static unsigned long lastSensorRead = 0;
+  if (g_mode == DeviceMode::GATEWAY && g_configValid && g_window.enabled())
+  {
+    if (g_alertPending)
+    {
+      TRACE_SCOPE("telemetry.alert");
+      g_alertPending = false;
+      sendOwnTelemetry(true);
     }
-
-    String payload;
-    serializeJson(doc, payload);
-    Serial.println("[GATEWAY] Sending own sensors: " + payload);
-    forwardToIoTHub(payload);
+    if (g_window.due(millis()))
+    {
+      TRACE_SCOPE("telemetry.summary");
+      sendWindowSummary(millis());
+    }
+  }
+  else if (g_mode == DeviceMode::GATEWAY && g_configValid && millis() - lastSensorRead > TELEMETRY_INTERVAL_MS)
+  {
+    TRACE_SCOPE("telemetry");
+    lastSensorRead = millis();
+    sendOwnTelemetry(false);
   }
 
-  if (g_mode == DeviceMode::NODE && g_bootCount == 1)
+  if (g_configValid)
+    serviceWatering();
+
+  if (g_mode == DeviceMode::NODE && g_nodeTransmit)
   {
     static bool sent = false;
+    static unsigned long sentAt = 0;
     if (!sent && (mesh.getNodeList().size() > 0 || millis() > 10000))
     {
-      JsonDocument doc;
-      doc["deviceId"] = g_deviceId;
-      doc["firmwareVersion"] = FIRMWARE_VERSION;
-      doc["battery"] = analogRead(BATTERY_PIN) * 3.3 / 4095.0;
-      doc["rssi"] = WiFi.RSSI();
-      doc["meshHopCount"] = 0;
-      doc["sleepSeconds"] = g_sleepSeconds;
-
-      for (auto &s : g_sensors)
-      {
-        if (s.type == "cap_soil_moisture")
-        {
-          int raw = analogRead(s.pin);
-          float pct = (float)(s.air_value - raw) / (s.air_value - s.water_value) * 100.0;
-          doc[s.name] = constrain(pct, 0, 100);
-        }
-        else if (s.type == "dht22")
-        {
-          doc[s.name + "_temp"] = s.dht->readTemperature();
-          doc[s.name + "_hum"] = s.dht->readHumidity();
-        }
-        else if (s.type == "ds18b20")
-        {
-          s.sensors->requestTemperatures();
-          doc[s.name] = s.sensors->getTempCByIndex(s.index);
-        }
-        else if (s.type == "bme280")
-        {
-          doc[s.name + "_temp"] = s.bme->readTemperature();
-          doc[s.name + "_hum"] = s.bme->readHumidity();
-          doc[s.name + "_pres"] = s.bme->readPressure();
-        }
-        else if (s.type == "bmp280")
-        {
-          doc[s.name + "_temp"] = s.bmp->readTemperature();
-          doc[s.name + "_pres"] = s.bmp->readPressure();
-        }
-      }
-
-      String payload;
-      serializeJson(doc, payload);
-      Serial.println("[payload] " + payload);
-
-      forwardToIoTHub(payload);
+      TRACE_SCOPE("node.send");
+      sendNodeTelemetry();
       sent = true;
-      delay(3000);
-      ESP.deepSleep(g_sleepSeconds * 1000000ULL);
+      sentAt = millis();
     }
+    if (sent)
+      flushWateringReports();
+    // 3 s for the mesh to deliver (mesh.update() keeps running), longer
+    // while a firmware update is on offer or arriving.
+    bool otaIdle = !g_meshOtaPartAt || millis() - g_meshOtaPartAt > MESH_OTA_NODE_IDLE_MS;
+    if (sent && !g_watering.running() && millis() - sentAt > 3000 && otaIdle)
+      nodeSleep();
   }
 
-#ifdef ESP32
-  if (g_iotHubClient)
-    IoTHubClient_LL_DoWork(g_iotHubClient);
-#endif
+  // Without the uplink task (task start failed / ESP8266) send from here.
+  if (g_mode == DeviceMode::GATEWAY && !g_uplinkTask)
+  {
+    if (g_uplink->service)
+      g_uplink->service();
+    drainTelemetryQueue();
+    updateQueueMetrics();
+  }
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+/*********************************************************************
+ * Host test + benchmark: AdcBurst (moisture burst + trimmed mean)
+ * -------------------------------------------------------
+ * • Trimmed mean: plain mean at 0%, median at 50% (odd and even n),
+ *   outliers on both ends ignored at 25%
+ * • TYPE1 DMA words are split by channel; unknown channels and samples
+ *   past ADC_BURST_SAMPLES are dropped; slots and masks
+ * • Noise: spread of one reading (64 samples, Gaussian noise + 3%
+ *   spikes) for a single read, the mean, the median and the trimmed mean
+ * • Time per 64-sample reduction: selection kernel against a full sort
+ * Run: pio test -e native -f test_adc_burst -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <AdcBurst.h>
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void test_trimmed_mean()
+{
+  uint16_t a[] = {10, 20, 30, 40};
+  TEST_ASSERT_EQUAL_UINT16(25, adcTrimmedMean(a, 4, 0));
+  uint16_t b[] = {7, 1, 9, 3, 5};
+  TEST_ASSERT_EQUAL_UINT16(5, adcTrimmedMean(b, 5, 50));
+  uint16_t c[] = {8, 2, 6, 4};
+  TEST_ASSERT_EQUAL_UINT16(5, adcTrimmedMean(c, 4, 50)); // (4 + 6) / 2
+  uint16_t d[] = {1000, 0, 4095, 1002, 998, 1001, 999, 1000};
+  TEST_ASSERT_EQUAL_UINT16(1000, adcTrimmedMean(d, 8, 25));
+  uint16_t e[] = {42};
+  TEST_ASSERT_EQUAL_UINT16(42, adcTrimmedMean(e, 1, 25));
+  TEST_ASSERT_EQUAL_UINT16(0, adcTrimmedMean(nullptr, 0, 25));
+}
+
+void test_split_type1()
+{
+  static AdcBurst burst;
+  burst.clear();
+  TEST_ASSERT_EQUAL(0, burst.addChannel(6));
+  TEST_ASSERT_EQUAL(1, burst.addChannel(3));
+  TEST_ASSERT_EQUAL(0, burst.addChannel(6)); // already there
+  TEST_ASSERT_EQUAL(-1, burst.addChannel(16));
+  TEST_ASSERT_EQUAL_HEX32(0x48, burst.channelMask());
+  TEST_ASSERT_EQUAL_UINT32(2 * ADC_BURST_SAMPLES, burst.conversions());
+
+  std::vector<uint8_t> raw;
+  for (int i = 0; i < ADC_BURST_SAMPLES + 10; i++)
+  {
+    const uint16_t words[] = {(uint16_t)(6 << 12 | 1500), (uint16_t)(3 << 12 | 3000), (uint16_t)(5 << 12 | 7)};
+    for (uint16_t w : words)
+    {
+      raw.push_back(w & 0xFF);
+      raw.push_back(w >> 8);
+    }
+  }
+  raw.push_back(0x12); // odd trailing byte
+  burst.reset();
+  burst.feedType1(raw.data(), raw.size());
+  TEST_ASSERT_EQUAL_UINT16(ADC_BURST_SAMPLES, burst.count(0));
+  TEST_ASSERT_EQUAL_UINT16(ADC_BURST_SAMPLES, burst.count(1));
+  burst.reduce(25);
+  TEST_ASSERT_EQUAL_UINT16(1500, burst.value(0));
+  TEST_ASSERT_EQUAL_UINT16(3000, burst.value(1));
+
+  burst.reset();
+  TEST_ASSERT_EQUAL_UINT16(0, burst.count(0));
+  burst.clear();
+  TEST_ASSERT_EQUAL(0, burst.channels());
+  TEST_ASSERT_EQUAL(0, burst.addChannel(3));
+}
+
+namespace
+{
+  // ESP32-like ADC reading: Gaussian noise plus occasional spikes.
+  uint16_t noisy(std::mt19937 &rng, double truth)
+  {
+    std::normal_distribution<double> noise(0, 25);
+    double v = truth + noise(rng);
+    if (rng() % 100 < 3)
+      v += (rng() % 2 ? 1 : -1) * (300.0 + rng() % 700);
+    return (uint16_t)std::max(0.0, std::min(4095.0, v));
+  }
+
+  double spread(const std::vector<double> &v, double truth)
+  {
+    double sq = 0;
+    for (double x : v)
+      sq += (x - truth) * (x - truth);
+    return sqrt(sq / v.size());
+  }
+}
+
+void bench_noise()
+{
+  std::mt19937 rng(21);
+  const double truth = 2200;
+  const int readings = 2000;
+  std::vector<double> single, mean, median, trimmed;
+  uint16_t buf[ADC_BURST_SAMPLES], work[ADC_BURST_SAMPLES];
+  for (int r = 0; r < readings; r++)
+  {
+    for (uint16_t &v : buf)
+      v = noisy(rng, truth);
+    single.push_back(buf[0]);
+    std::copy(buf, buf + ADC_BURST_SAMPLES, work);
+    mean.push_back(adcTrimmedMean(work, ADC_BURST_SAMPLES, 0));
+    std::copy(buf, buf + ADC_BURST_SAMPLES, work);
+    median.push_back(adcTrimmedMean(work, ADC_BURST_SAMPLES, 50));
+    std::copy(buf, buf + ADC_BURST_SAMPLES, work);
+    trimmed.push_back(adcTrimmedMean(work, ADC_BURST_SAMPLES, 25));
+  }
+  double s = spread(single, truth), m = spread(mean, truth), md = spread(median, truth),
+         t = spread(trimmed, truth);
+  TEST_ASSERT_TRUE(t < m && t < s / 4);
+
+  char msg[200];
+  snprintf(msg, sizeof(msg),
+           "RMS error, %d samples: single read %.1f, mean %.1f, median %.1f, 25%% trimmed mean %.1f counts (%.2f%% moisture) (host)",
+           ADC_BURST_SAMPLES, s, m, md, t, 100.0 * t / 4095);
+  TEST_MESSAGE(msg);
+}
+
+void bench_kernel()
+{
+  std::mt19937 rng(7);
+  const int iters = 20000;
+  std::vector<uint16_t> data(ADC_BURST_SAMPLES * 64);
+  for (uint16_t &v : data)
+    v = noisy(rng, 1800);
+  uint16_t work[ADC_BURST_SAMPLES];
+  volatile uint32_t sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++)
+  {
+    std::copy_n(&data[(i % 64) * ADC_BURST_SAMPLES], ADC_BURST_SAMPLES, work);
+    sink = sink + adcTrimmedMean(work, ADC_BURST_SAMPLES, 25);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++)
+  {
+    std::copy_n(&data[(i % 64) * ADC_BURST_SAMPLES], ADC_BURST_SAMPLES, work);
+    std::sort(work, work + ADC_BURST_SAMPLES);
+    uint32_t sum = 0;
+    for (int k = ADC_BURST_SAMPLES / 4; k < ADC_BURST_SAMPLES * 3 / 4; k++)
+      sum += work[k];
+    sink = sink + sum / (ADC_BURST_SAMPLES / 2);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%d-sample reduction: selection %.3f us, full sort %.3f us (host)", ADC_BURST_SAMPLES,
+           std::chrono::duration<double, std::micro>(t1 - t0).count() / iters,
+           std::chrono::duration<double, std::micro>(t2 - t1).count() / iters);
+  TEST_MESSAGE(msg);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_trimmed_mean);
+  RUN_TEST(test_split_type1);
+  RUN_TEST(bench_noise);
+  RUN_TEST(bench_kernel);
+  return UNITY_END();
+}
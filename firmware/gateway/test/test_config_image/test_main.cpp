@@ -0,0 +1,227 @@
+/*********************************************************************
+ * Host test: ConfigImage / WifiCache (warm-boot caches)
+ * -------------------------------------------------------
+ * • Zeroed (cold) and corrupted images are rejected
+ * • Over-long strings are refused instead of silently truncated
+ * • Diff classifies what a live reload must redo (alert limits are a
+ *   sensor change, the aggregation window a setting); check rejects bad
+ *   values
+ * • Watering zones: own valve pins, not a sensor's, a soil sensor or a schedule
+ *********************************************************************/
+
+#include <unity.h>
+#include <ConfigImage.h>
+
+void setUp() {}
+void tearDown() {}
+
+void test_image_validity()
+{
+  static ConfigImage img; // zeroed like RTC memory on cold boot
+  TEST_ASSERT_FALSE(img.valid());
+
+  img.clear();
+  TEST_ASSERT_TRUE(configImageSetString(img.ssid, sizeof(img.ssid), "greenhouse"));
+  img.sensorCount = 1;
+  TEST_ASSERT_TRUE(configImageSetString(img.sensors[0].name, sizeof(img.sensors[0].name), "Soil1"));
+  img.sensors[0].kind = SensorKind::CAP_SOIL_MOISTURE;
+  img.seal();
+  TEST_ASSERT_TRUE(img.valid());
+
+  img.sensors[0].pin = 35; // changed without seal()
+  TEST_ASSERT_FALSE(img.valid());
+  img.seal();
+  ((uint8_t *)&img)[100] ^= 0x10;
+  TEST_ASSERT_FALSE(img.valid());
+}
+
+void test_strings_never_truncate()
+{
+  char field[8];
+  TEST_ASSERT_TRUE(configImageSetString(field, sizeof(field), "1234567"));
+  TEST_ASSERT_EQUAL_STRING("1234567", field);
+  TEST_ASSERT_FALSE(configImageSetString(field, sizeof(field), "12345678"));
+  TEST_ASSERT_EQUAL_STRING("", field);
+  TEST_ASSERT_TRUE(configImageSetString(field, sizeof(field), nullptr));
+  TEST_ASSERT_EQUAL_STRING("", field);
+}
+
+void test_wifi_cache()
+{
+  WifiCache a;
+  a.clear();
+  TEST_ASSERT_FALSE(a.valid());
+  const uint8_t bssid[6] = {0x24, 0x0a, 0xc4, 1, 2, 3};
+  memcpy(a.bssid, bssid, 6);
+  a.channel = 6;
+  a.ip = 0x6401A8C0;
+  a.savedBoot = 1;
+  a.seal();
+  TEST_ASSERT_TRUE(a.valid());
+
+  WifiCache b = a;
+  b.savedBoot = 50;
+  TEST_ASSERT_TRUE(a.sameLink(b));
+  b.channel = 11;
+  TEST_ASSERT_FALSE(a.sameLink(b));
+}
+
+static void sampleImage(ConfigImage &img)
+{
+  img.clear();
+  configImageSetString(img.ssid, sizeof(img.ssid), "greenhouse");
+  configImageSetString(img.deviceId, sizeof(img.deviceId), "gw1");
+  configImageSetString(img.protocol, sizeof(img.protocol), "http");
+  img.sleepSeconds = 60;
+  img.batchWakes = 10;
+  img.sensorCount = 2;
+  configImageSetString(img.sensors[0].name, sizeof(img.sensors[0].name), "Soil1");
+  img.sensors[0].kind = SensorKind::CAP_SOIL_MOISTURE;
+  img.sensors[0].pin = 34;
+  img.sensors[0].airValue = 2514;
+  img.sensors[0].waterValue = 950;
+  img.sensors[0].periodMs = 10000;
+  configImageSetString(img.sensors[1].name, sizeof(img.sensors[1].name), "Air");
+  img.sensors[1].kind = SensorKind::BME280;
+  img.sensors[1].address = 0x76;
+  img.sensors[1].periodMs = 10000;
+  img.seal();
+}
+
+void test_diff_and_check()
+{
+  static ConfigImage a, b;
+  sampleImage(a);
+  b = a;
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_NONE, configImageDiff(a, b));
+  TEST_ASSERT_NULL(configImageCheck(a));
+
+  b.sleepSeconds = 300;
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_SETTINGS, configImageDiff(a, b));
+  b = a;
+  configImageSetString(b.nodeFirmwareUrl, sizeof(b.nodeFirmwareUrl), "http://fw/node.json");
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_SETTINGS, configImageDiff(a, b));
+  b = a;
+  configImageSetString(b.protocol, sizeof(b.protocol), "mqtt");
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_UPLINK, configImageDiff(a, b));
+  b = a;
+  b.sensors[1].periodMs = 2000; // same driver, still a sensor change
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_SENSORS, configImageDiff(a, b));
+  TEST_ASSERT_TRUE(sensorConfigSameDriver(a.sensors[1], b.sensors[1]));
+  b.sensors[0].pin = 35;
+  TEST_ASSERT_FALSE(sensorConfigSameDriver(a.sensors[0], b.sensors[0]));
+  b = a;
+  b.sensors[0].alertMask = 1; // moisture below
+  b.sensors[0].alertBelow[FIELD_MOISTURE] = 200;
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_SENSORS, configImageDiff(a, b));
+  TEST_ASSERT_TRUE(sensorConfigSameDriver(a.sensors[0], b.sensors[0]));
+  b = a;
+  b.windowSec = 300;
+  b.ewmaPercent = 20;
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_SETTINGS, configImageDiff(a, b));
+  TEST_ASSERT_NULL(configImageCheck(b));
+  b.ewmaPercent = 0;
+  TEST_ASSERT_NOT_NULL(configImageCheck(b));
+  b = a;
+  configImageSetString(b.password, sizeof(b.password), "new");
+  TEST_ASSERT_TRUE(configImageDiff(a, b) & CONFIG_CHANGE_RESTART);
+
+  // The device id names the mesh, which the gateway runs as root too.
+  b = a;
+  configImageSetString(b.deviceId, sizeof(b.deviceId), "gw2");
+  TEST_ASSERT_TRUE(configImageDiff(a, b) & CONFIG_CHANGE_RESTART);
+  a.node = b.node = true;
+  TEST_ASSERT_TRUE(configImageDiff(a, b) & CONFIG_CHANGE_RESTART);
+
+  sampleImage(b);
+  configImageSetString(b.protocol, sizeof(b.protocol), "ftp");
+  TEST_ASSERT_NOT_NULL(configImageCheck(b));
+  sampleImage(b);
+  configImageSetString(b.sensors[1].name, sizeof(b.sensors[1].name), "Soil1");
+  TEST_ASSERT_EQUAL_STRING("sensor names must be unique", configImageCheck(b));
+  sampleImage(b);
+  b.sensors[0].waterValue = b.sensors[0].airValue;
+  TEST_ASSERT_NOT_NULL(configImageCheck(b));
+  sampleImage(b);
+  b.sensors[1].alertMask = 3 << (2 * FIELD_TEMP); // both limits on temp
+  b.sensors[1].alertBelow[FIELD_TEMP] = 300;
+  b.sensors[1].alertAbove[FIELD_TEMP] = 100;
+  TEST_ASSERT_EQUAL_STRING("alertBelow must be lower than alertAbove", configImageCheck(b));
+  sampleImage(b);
+  b.deviceId[0] = '\0';
+  TEST_ASSERT_NOT_NULL(configImageCheck(b));
+}
+
+void test_watering_zones()
+{
+  static ConfigImage a, b;
+  sampleImage(a);
+  a.pumpPin = 26;
+  a.maxConcurrent = 1;
+  a.zoneCount = 2;
+  configImageSetString(a.zones[0].name, sizeof(a.zones[0].name), "Bed1");
+  a.zones[0].sensor = 0;
+  a.zones[0].valvePin = 25;
+  a.zones[0].startBelow = 300; // 30.0 %
+  a.zones[0].stopAbove = 450;
+  a.zones[0].maxRunSec = 300;
+  configImageSetString(a.zones[1].name, sizeof(a.zones[1].name), "Hedge");
+  a.zones[1].sensor = CONFIG_IMAGE_NO_PIN;
+  a.zones[1].valvePin = 27;
+  a.zones[1].maxRunSec = 600;
+  a.zones[1].fromMin = 6 * 60;
+  a.zones[1].toMin = 7 * 60;
+  a.seal();
+  TEST_ASSERT_NULL(configImageCheck(a));
+
+  b = a;
+  b.zones[1].toMin = 8 * 60;
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_WATERING, configImageDiff(a, b));
+  b = a;
+  configImageSetString(b.timezone, sizeof(b.timezone), "CET-1CEST,M3.5.0,M10.5.0/3");
+  TEST_ASSERT_EQUAL_UINT8(CONFIG_CHANGE_WATERING, configImageDiff(a, b));
+
+  b = a;
+  b.zones[1].valvePin = 25;
+  TEST_ASSERT_EQUAL_STRING("every zone needs its own valvePin", configImageCheck(b));
+  b = a;
+  b.zones[0].valvePin = 26; // the pump
+  TEST_ASSERT_EQUAL_STRING("every zone needs its own valvePin", configImageCheck(b));
+  b = a;
+  b.zones[1].valvePin = 34; // Soil1's input
+  TEST_ASSERT_EQUAL_STRING("zone valvePin is used by a sensor", configImageCheck(b));
+  b = a;
+  b.pumpPin = 34;
+  TEST_ASSERT_EQUAL_STRING("watering pumpPin is used by a sensor", configImageCheck(b));
+  b = a;
+  b.sensors[1].pin = 27; // BME280 is on I2C, its pin is unused
+  TEST_ASSERT_NULL(configImageCheck(b));
+  b = a;
+  b.zones[0].sensor = 1; // BME280
+  TEST_ASSERT_EQUAL_STRING("zone sensor must name a cap_soil_moisture sensor", configImageCheck(b));
+  b = a;
+  b.zones[0].stopAbove = 300;
+  TEST_ASSERT_EQUAL_STRING("zone startBelow must be lower than stopAbove", configImageCheck(b));
+  b = a;
+  b.zones[1].toMin = b.zones[1].fromMin; // timer without window or rest: always on
+  TEST_ASSERT_EQUAL_STRING("a zone without sensor needs a schedule or minOffSec", configImageCheck(b));
+  b.zones[1].minOffSec = 3600;
+  TEST_ASSERT_NULL(configImageCheck(b));
+  b = a;
+  b.maxConcurrent = 0;
+  TEST_ASSERT_NOT_NULL(configImageCheck(b));
+  b = a;
+  b.zones[0].maxRunSec = 0;
+  TEST_ASSERT_NOT_NULL(configImageCheck(b));
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_image_validity);
+  RUN_TEST(test_strings_never_truncate);
+  RUN_TEST(test_wifi_cache);
+  RUN_TEST(test_diff_and_check);
+  RUN_TEST(test_watering_zones);
+  return UNITY_END();
+}
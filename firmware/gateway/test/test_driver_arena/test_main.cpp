@@ -0,0 +1,310 @@
+/*********************************************************************
+ * Host test + soak: DriverArena (sensor driver storage)
+ * -------------------------------------------------------
+ * • Handles: type-checked get, shared references, stale / double release
+ * • Soak: thousands of random config reloads through sensorRebuild(),
+ *   the helper buildSensors() uses, with stand-in drivers that allocate
+ *   internally like the Adafruit ones. A reload may allocate nothing but
+ *   the new drivers' own buffers, the heap peak during it stays within
+ *   the larger of the old and new sets (the old drivers are gone before
+ *   the new ones are built), heap in use comes back to the same figure
+ *   and no slot may leak.
+ *********************************************************************/
+
+#include <unity.h>
+#include <DriverArena.h>
+#include <SensorRebuild.h>
+#include <ConfigImage.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+// --- heap accounting (whole test binary) ---
+static size_t g_heapLive = 0, g_heapPeak = 0;
+static uint32_t g_allocs = 0;
+
+void *operator new(size_t n)
+{
+  size_t *p = (size_t *)malloc(n + sizeof(size_t) * 2);
+  if (!p)
+    abort();
+  p[0] = n;
+  g_heapLive += n;
+  if (g_heapLive > g_heapPeak)
+    g_heapPeak = g_heapLive;
+  g_allocs++;
+  return p + 2;
+}
+
+void operator delete(void *ptr) noexcept
+{
+  if (!ptr)
+    return;
+  size_t *p = (size_t *)ptr - 2;
+  g_heapLive -= p[0];
+  free(p);
+}
+
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { operator delete(ptr); }
+
+void setUp() {}
+void tearDown() {}
+
+// --- stand-in drivers ---
+static int g_liveDrivers = 0;
+
+struct FakeDht
+{
+  uint8_t pin;
+  uint8_t state[12];
+  explicit FakeDht(int p) : pin((uint8_t)p) { g_liveDrivers++; }
+  ~FakeDht() { g_liveDrivers--; }
+};
+
+// Like Adafruit_BME280: begin() news an I2C device, the destructor deletes it.
+struct FakeBme
+{
+  uint8_t calib[96];
+  int *i2c = nullptr;
+  FakeBme() { g_liveDrivers++; }
+  ~FakeBme()
+  {
+    delete[] i2c;
+    g_liveDrivers--;
+  }
+  void begin() { i2c = new int[12]; }
+};
+
+struct FakeBus
+{
+  uint8_t pin;
+  uint8_t rom[40];
+  explicit FakeBus(uint8_t p) : pin(p) { g_liveDrivers++; }
+  ~FakeBus() { g_liveDrivers--; }
+};
+
+typedef DriverArena<128, CONFIG_IMAGE_MAX_SENSORS> Arena;
+
+void test_handles()
+{
+  Arena arena;
+  DriverHandle a = arena.create<FakeDht>(4);
+  DriverHandle b = arena.create<FakeBus>((uint8_t)5);
+  TEST_ASSERT_TRUE(a.valid());
+  TEST_ASSERT_NOT_NULL(arena.get<FakeDht>(a));
+  TEST_ASSERT_NULL(arena.get<FakeBus>(a)); // wrong type
+  TEST_ASSERT_EQUAL(2, arena.used());
+
+  // Shared bus: destroyed with its last reference.
+  DriverHandle b2 = b;
+  TEST_ASSERT_TRUE(arena.retain(b2));
+  arena.release(b);
+  TEST_ASSERT_FALSE(b.valid());
+  TEST_ASSERT_NOT_NULL(arena.get<FakeBus>(b2));
+  DriverHandle stale = b2;
+  arena.release(b2);
+  TEST_ASSERT_NULL(arena.get<FakeBus>(stale));
+  TEST_ASSERT_EQUAL(1, arena.used());
+
+  // The freed slot is reused; the old handle stays stale and releasing it
+  // again does not touch the new object.
+  DriverHandle c = arena.create<FakeDht>(6);
+  TEST_ASSERT_EQUAL_UINT8(stale.slot, c.slot);
+  arena.release(stale);
+  TEST_ASSERT_EQUAL_UINT32(1, arena.stats().stale);
+  TEST_ASSERT_NOT_NULL(arena.get<FakeDht>(c));
+  TEST_ASSERT_FALSE(arena.retain(stale));
+
+  DriverHandle all[CONFIG_IMAGE_MAX_SENSORS];
+  uint8_t n = 0;
+  while ((all[n] = arena.create<FakeDht>(n)).valid())
+    n++;
+  TEST_ASSERT_EQUAL(CONFIG_IMAGE_MAX_SENSORS - 2, n);
+  TEST_ASSERT_EQUAL_UINT32(1, arena.stats().full);
+  arena.clear();
+  TEST_ASSERT_EQUAL(0, arena.used());
+  TEST_ASSERT_EQUAL(0, g_liveDrivers);
+}
+
+// --- soak: the firmware's buildSensors() with stand-ins ---
+struct SoakSensor
+{
+  SensorKind kind = SensorKind::UNKNOWN;
+  DriverHandle driver;
+};
+
+static Arena g_arena;
+static DriverHandle g_buses[CONFIG_IMAGE_MAX_SENSORS];
+static uint32_t g_rng = 12345;
+
+static uint32_t rnd(uint32_t n)
+{
+  g_rng = g_rng * 1664525u + 1013904223u;
+  return (g_rng >> 8) % n;
+}
+
+static uint32_t g_bmeBegins = 0;
+
+static void setupSensor(SoakSensor &s, const SensorConfig &sc)
+{
+  s.kind = sc.kind;
+  switch (sc.kind)
+  {
+  case SensorKind::DHT22:
+    s.driver = g_arena.create<FakeDht>(sc.pin);
+    break;
+  case SensorKind::BME280:
+    s.driver = g_arena.create<FakeBme>();
+    if (FakeBme *bme = g_arena.get<FakeBme>(s.driver))
+    {
+      bme->begin();
+      g_bmeBegins++;
+    }
+    break;
+  case SensorKind::DS18B20:
+  {
+    DriverHandle *slot = nullptr;
+    for (DriverHandle &h : g_buses)
+    {
+      FakeBus *bus = g_arena.get<FakeBus>(h);
+      if (bus && bus->pin == sc.pin)
+      {
+        g_arena.retain(h);
+        s.driver = h;
+        return;
+      }
+      if (!bus && !slot)
+        slot = &h;
+    }
+    s.driver = g_arena.create<FakeBus>(sc.pin);
+    *slot = s.driver;
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static void randomImage(ConfigImage &img)
+{
+  static const SensorKind kinds[] = {SensorKind::CAP_SOIL_MOISTURE, SensorKind::DHT22, SensorKind::DS18B20,
+                                     SensorKind::BME280};
+  img.clear();
+  img.sensorCount = 1 + rnd(CONFIG_IMAGE_MAX_SENSORS);
+  for (uint8_t i = 0; i < img.sensorCount; i++)
+  {
+    SensorConfig &sc = img.sensors[i];
+    sc.kind = kinds[rnd(4)];
+    sc.pin = 4 + rnd(6); // few pins: buses get shared, drivers get reused
+    sc.index = rnd(2);
+    sc.address = 0x76;
+    sc.airValue = 2500;
+    sc.waterValue = 900;
+  }
+}
+
+static size_t bmeCount(const ConfigImage &img)
+{
+  size_t n = 0;
+  for (uint8_t i = 0; i < img.sensorCount; i++)
+    n += img.sensors[i].kind == SensorKind::BME280;
+  return n;
+}
+
+// Drivers the image needs: one per DHT/BME, one per distinct DS18B20 pin.
+static uint8_t expectedDrivers(const ConfigImage &img)
+{
+  bool pins[256] = {false};
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < img.sensorCount; i++)
+  {
+    const SensorConfig &sc = img.sensors[i];
+    if (sc.kind == SensorKind::DHT22 || sc.kind == SensorKind::BME280)
+      n++;
+    else if (sc.kind == SensorKind::DS18B20 && !pins[sc.pin])
+    {
+      pins[sc.pin] = true;
+      n++;
+    }
+  }
+  return n;
+}
+
+void test_reload_soak()
+{
+  const uint32_t reloads = 5000;
+  const size_t bmeBytes = 12 * sizeof(int);
+  static ConfigImage prev, next;
+  std::vector<SoakSensor> sensors;
+  sensors.reserve(CONFIG_IMAGE_MAX_SENSORS);
+  std::vector<SoakSensor> built;
+  built.reserve(CONFIG_IMAGE_MAX_SENSORS);
+  prev.clear();
+
+  size_t heapBase = g_heapLive; // vectors reserved up front
+  size_t heapMin = (size_t)-1, heapMax = 0, peakOver = 0;
+  uint32_t kept = 0, mismatches = 0, extraAllocs = 0;
+  for (uint32_t r = 0; r < reloads; r++)
+  {
+    randomImage(next);
+    uint32_t allocs = g_allocs, begins = g_bmeBegins;
+    g_heapPeak = g_heapLive;
+    kept += sensorRebuild(g_arena, &prev, next, sensors, built, setupSensor);
+    sensors.swap(built);
+    extraAllocs += (g_allocs - allocs) - (g_bmeBegins - begins);
+    // Release-then-build: never the old and the new drivers at once.
+    size_t bound = heapBase + std::max(bmeCount(prev), bmeCount(next)) * bmeBytes;
+    if (g_heapPeak > bound && g_heapPeak - bound > peakOver)
+      peakOver = g_heapPeak - bound;
+    prev = next;
+
+    if (g_arena.used() != expectedDrivers(next) || g_liveDrivers != g_arena.used())
+      mismatches++;
+    // Everything on the heap now is the BME I2C devices of live drivers.
+    size_t bmes = bmeCount(next);
+    if (g_heapLive != heapBase + bmes * bmeBytes)
+      mismatches++;
+    size_t beyondDrivers = g_heapLive - bmes * bmeBytes;
+    if (beyondDrivers < heapMin)
+      heapMin = beyondDrivers;
+    if (beyondDrivers > heapMax)
+      heapMax = beyondDrivers;
+  }
+
+  for (SoakSensor &s : sensors)
+    g_arena.release(s.driver);
+  const Arena::Stats &st = g_arena.stats();
+  char msg[200];
+  snprintf(msg, sizeof(msg),
+           "%u reloads: %u drivers created, %u destroyed, %u kept; heap besides drivers %u..%u B "
+           "(start %u), %u allocations besides drivers, arena %u x %u B, full %u, stale %u",
+           reloads, st.created, st.destroyed, kept, (unsigned)heapMin, (unsigned)heapMax, (unsigned)heapBase,
+           extraAllocs, g_arena.capacity(), (unsigned)Arena::slotBytes(), st.full, st.stale);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+  TEST_ASSERT_EQUAL_UINT32(0, extraAllocs);
+  TEST_ASSERT_EQUAL(0, peakOver);
+  TEST_ASSERT_EQUAL(heapBase, heapMin);
+  TEST_ASSERT_EQUAL(heapBase, heapMax);
+  TEST_ASSERT_EQUAL(heapBase, g_heapLive);
+  TEST_ASSERT_EQUAL(0, g_arena.used());
+  TEST_ASSERT_EQUAL(0, g_liveDrivers);
+  TEST_ASSERT_EQUAL_UINT32(st.created, st.destroyed);
+  TEST_ASSERT_EQUAL_UINT32(0, st.full);
+  TEST_ASSERT_EQUAL_UINT32(0, st.stale);
+  TEST_ASSERT_GREATER_THAN(0, kept);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_handles);
+  RUN_TEST(test_reload_soak);
+  return UNITY_END();
+}
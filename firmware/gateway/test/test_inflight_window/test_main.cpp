@@ -0,0 +1,161 @@
+/*********************************************************************
+ * Host test + benchmark: InflightWindow (SDK confirmation tracking)
+ * -------------------------------------------------------
+ * • Ids are unique and never 0; a full window refuses new sends
+ * • Confirmations free slots in any order; take() returns the oldest
+ *   finished send first, with its attempt count and elapsed time
+ * • Unanswered sends time out; a late or unknown confirmation is stale
+ * • takeAny() empties the window (client teardown)
+ * • Messages per second for window sizes 1 (the old one-at-a-time
+ *   pattern), 4 and 8, over a simulated hub that confirms each message
+ *   after a fixed round trip, with 5% failures retried
+ * Run: pio test -e native -f test_inflight_window -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <InflightWindow.h>
+
+#include <deque>
+#include <random>
+#include <stdio.h>
+
+void setUp() {}
+void tearDown() {}
+
+static int g_msgs[16];
+
+void test_add_full()
+{
+  InflightWindow<3> w(1000, 0);
+  uint32_t a = w.add(&g_msgs[0], 0);
+  uint32_t b = w.add(&g_msgs[1], 0);
+  uint32_t c = w.add(&g_msgs[2], 0);
+  TEST_ASSERT_TRUE(a && b && c && a != b && b != c && a != c);
+  TEST_ASSERT_TRUE(w.full());
+  TEST_ASSERT_EQUAL_UINT32(0, w.add(&g_msgs[3], 0));
+  TEST_ASSERT_EQUAL(3, w.stats().highWater);
+
+  // Id counter wraps past 0.
+  InflightWindow<2> wrap(1000, 0xFFFFFFFFu);
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFu, wrap.add(&g_msgs[0], 0));
+  TEST_ASSERT_EQUAL_UINT32(1, wrap.add(&g_msgs[1], 0));
+}
+
+void test_confirm_out_of_order()
+{
+  InflightWindow<4> w(1000);
+  uint32_t id[4];
+  for (int i = 0; i < 4; i++)
+    id[i] = w.add(&g_msgs[i], 100 + i, 1 + i % 2);
+
+  InflightWindow<4>::Done d;
+  TEST_ASSERT_FALSE(w.take(200, d)); // nothing confirmed yet
+
+  TEST_ASSERT_TRUE(w.resolve(id[2], true, 250));
+  TEST_ASSERT_TRUE(w.resolve(id[1], false, 260));
+  TEST_ASSERT_FALSE(w.resolve(id[1], true, 270)); // already settled
+  TEST_ASSERT_TRUE(w.take(300, d));
+  TEST_ASSERT_EQUAL_PTR(&g_msgs[1], d.msg);
+  TEST_ASSERT_EQUAL(InflightWindow<4>::FAILED, d.status);
+  TEST_ASSERT_EQUAL(2, d.attempt);
+  TEST_ASSERT_EQUAL_UINT32(159, d.elapsedMs);
+  TEST_ASSERT_TRUE(w.take(300, d));
+  TEST_ASSERT_EQUAL_PTR(&g_msgs[2], d.msg);
+  TEST_ASSERT_EQUAL(InflightWindow<4>::CONFIRMED, d.status);
+  TEST_ASSERT_FALSE(w.take(300, d));
+  TEST_ASSERT_EQUAL(2, w.size());
+  TEST_ASSERT_FALSE(w.full());
+}
+
+void test_timeout_and_stale()
+{
+  InflightWindow<2> w(1000);
+  uint32_t a = w.add(&g_msgs[0], 0);
+  uint32_t b = w.add(&g_msgs[1], 500);
+  InflightWindow<2>::Done d;
+  TEST_ASSERT_FALSE(w.take(999, d));
+  TEST_ASSERT_TRUE(w.take(1000, d));
+  TEST_ASSERT_EQUAL_UINT32(a, d.id);
+  TEST_ASSERT_EQUAL(InflightWindow<2>::TIMED_OUT, d.status);
+  TEST_ASSERT_FALSE(w.resolve(a, true, 1200)); // arrived after we gave up
+  TEST_ASSERT_FALSE(w.resolve(0, true, 1200));
+  TEST_ASSERT_EQUAL_UINT32(2, w.stats().stale);
+  TEST_ASSERT_EQUAL_UINT32(1, w.stats().timedOut);
+
+  TEST_ASSERT_TRUE(w.takeAny(d));
+  TEST_ASSERT_EQUAL_UINT32(b, d.id);
+  TEST_ASSERT_EQUAL(InflightWindow<2>::PENDING, d.status);
+  TEST_ASSERT_FALSE(w.takeAny(d));
+  TEST_ASSERT_TRUE(w.empty());
+}
+
+// Simulated hub: each send is confirmed rttMs later (FIFO, like one MQTT
+// connection), 5% of confirmations fail and are retried.
+template <uint8_t N>
+static double deliverRate(uint32_t messages, uint32_t rttMs, uint32_t stepMs, uint32_t &retries)
+{
+  struct Pending
+  {
+    uint32_t id, atMs;
+    bool ok;
+  };
+  std::mt19937 rng(5);
+  std::deque<Pending> hub;
+  InflightWindow<N> w(30000);
+  uint32_t now = 0, queued = messages, delivered = 0;
+  retries = 0;
+  while (delivered < messages)
+  {
+    while (!hub.empty() && hub.front().atMs <= now)
+    {
+      w.resolve(hub.front().id, hub.front().ok, now);
+      hub.pop_front();
+    }
+    typename InflightWindow<N>::Done d;
+    while (w.take(now, d))
+    {
+      if (d.status == InflightWindow<N>::CONFIRMED)
+      {
+        delivered++;
+        continue;
+      }
+      retries++;
+      hub.push_back({w.add(d.msg, now, d.attempt + 1), now + rttMs, rng() % 100 >= 5});
+    }
+    while (queued && !w.full())
+    {
+      queued--;
+      hub.push_back({w.add(&g_msgs[0], now), now + rttMs, rng() % 100 >= 5});
+    }
+    now += stepMs;
+  }
+  return messages * 1000.0 / now;
+}
+
+void bench_window_sizes()
+{
+  const uint32_t rtts[] = {50, 200};
+  for (uint32_t rtt : rtts)
+  {
+    uint32_t r1, r4, r8;
+    double one = deliverRate<1>(2000, rtt, 10, r1);
+    double four = deliverRate<4>(2000, rtt, 10, r4);
+    double eight = deliverRate<8>(2000, rtt, 10, r8);
+    TEST_ASSERT_TRUE(eight > one);
+    char msg[160];
+    snprintf(msg, sizeof(msg),
+             "rtt %3u ms, 10 ms DoWork: window 1 %.1f msg/s, 4 %.1f msg/s, 8 %.1f msg/s (%u/%u/%u retries, simulated time)",
+             (unsigned)rtt, one, four, eight, (unsigned)r1, (unsigned)r4, (unsigned)r8);
+    TEST_MESSAGE(msg);
+  }
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_add_full);
+  RUN_TEST(test_confirm_out_of_order);
+  RUN_TEST(test_timeout_and_stale);
+  RUN_TEST(bench_window_sizes);
+  return UNITY_END();
+}
@@ -0,0 +1,71 @@
+/*********************************************************************
+ * Host test: IoT Hub HTTPS batch body
+ *********************************************************************/
+
+#include <unity.h>
+#include <IoTHubBatch.h>
+
+#include <string.h>
+
+void setUp() {}
+void tearDown() {}
+
+void test_base64_vectors()
+{
+  const char *in[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+  const char *out[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+  char buf[16];
+  for (int i = 0; i < 7; i++)
+  {
+    size_t n = base64Encode((const uint8_t *)in[i], strlen(in[i]), buf, sizeof(buf));
+    buf[n] = '\0';
+    TEST_ASSERT_EQUAL_STRING(out[i], buf);
+
+    uint8_t raw[16];
+    TEST_ASSERT_EQUAL(strlen(in[i]), base64Decode(out[i], strlen(out[i]), raw, sizeof(raw)));
+    TEST_ASSERT_EQUAL_MEMORY(in[i], raw, strlen(in[i]));
+  }
+  TEST_ASSERT_EQUAL(0, base64Encode((const uint8_t *)"foobar", 6, buf, 7));
+  uint8_t raw[16];
+  TEST_ASSERT_EQUAL(0, base64Decode("Zm9", 3, raw, sizeof(raw)));
+  TEST_ASSERT_EQUAL(0, base64Decode("Zm=v", 4, raw, sizeof(raw)));
+  TEST_ASSERT_EQUAL(0, base64Decode("Zm9vYmFy", 8, raw, 5));
+}
+
+void test_batch_body()
+{
+  char buf[256];
+  IoTHubBatchWriter w(buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(0, w.finish());
+  TEST_ASSERT_TRUE(w.add("{\"a\":1}", 7));
+  TEST_ASSERT_TRUE(w.add("{}", 2));
+  size_t n = w.finish();
+  TEST_ASSERT_EQUAL_STRING("[{\"body\":\"eyJhIjoxfQ==\",\"base64Encoded\":true},"
+                           "{\"body\":\"e30=\",\"base64Encoded\":true}]",
+                           buf);
+  TEST_ASSERT_EQUAL(strlen(buf), n);
+  TEST_ASSERT_EQUAL(2, w.count());
+}
+
+void test_batch_rejects_overflow()
+{
+  char buf[100];
+  IoTHubBatchWriter w(buf, sizeof(buf));
+  char msg[40];
+  memset(msg, 'x', sizeof(msg));
+  TEST_ASSERT_TRUE(w.add(msg, sizeof(msg)));
+  size_t before = w.length();
+  TEST_ASSERT_FALSE(w.add(msg, sizeof(msg)));
+  TEST_ASSERT_EQUAL(before, w.length());
+  TEST_ASSERT_EQUAL(1, w.count());
+  TEST_ASSERT_LESS_THAN(sizeof(buf), w.finish());
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_base64_vectors);
+  RUN_TEST(test_batch_body);
+  RUN_TEST(test_batch_rejects_overflow);
+  return UNITY_END();
+}
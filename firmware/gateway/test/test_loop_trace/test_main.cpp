@@ -0,0 +1,139 @@
+/*********************************************************************
+ * Host test + benchmark: LoopTrace (scoped trace ring, Chrome JSON)
+ * -------------------------------------------------------
+ * • Export: thread names, complete events, µs timestamps from the
+ *   earliest start (outer scopes are recorded after inner ones)
+ * • Wrap-around keeps the newest N events
+ * • Two writer threads + concurrent dumps: no torn events
+ * • Cost of one record()
+ *********************************************************************/
+
+#include <unity.h>
+#include <LoopTrace.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+void setUp() {}
+void tearDown() {}
+
+static void toString(const char *data, size_t len, void *ctx)
+{
+  ((std::string *)ctx)->append(data, len);
+}
+
+static const char *const kThreads[] = {"core0", "core1"};
+
+static size_t countOf(const std::string &s, const char *needle)
+{
+  size_t n = 0;
+  for (size_t at = s.find(needle); at != std::string::npos; at = s.find(needle, at + 1))
+    n++;
+  return n;
+}
+
+void test_chrome_export()
+{
+  static TraceRing<8> ring;
+  // loop() at t=1000 µs for 500 µs; mesh.update inside it, recorded first.
+  ring.record("mesh.update", 1, 1100, 240 * 50);
+  ring.record("loop", 1, 1000, 240 * 500);
+  std::string out;
+  uint32_t n = ring.writeChromeJson(toString, &out, 240, kThreads, 2);
+  TEST_ASSERT_EQUAL_UINT32(2, n);
+  const char *want = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":["
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"core0\"}},"
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"core1\"}},"
+                     "{\"name\":\"mesh.update\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":100,\"dur\":50.000},"
+                     "{\"name\":\"loop\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":0,\"dur\":500.000}]}\n";
+  TEST_ASSERT_EQUAL_STRING(want, out.c_str());
+}
+
+void test_wraps_to_newest()
+{
+  static TraceRing<8> ring;
+  for (uint32_t i = 0; i < 20; i++)
+    ring.record("tick", 1, 0xFFFFFF00u + i * 10, 100); // crosses the µs clock wrap
+  TEST_ASSERT_EQUAL_UINT32(20, ring.written());
+  TraceEvent e;
+  TEST_ASSERT_FALSE(ring.read(11, e)); // overwritten
+  TEST_ASSERT_TRUE(ring.read(12, e));
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFF00u + 120, e.startUs);
+
+  std::string out;
+  TEST_ASSERT_EQUAL_UINT32(8, ring.writeChromeJson(toString, &out, 100, kThreads, 0));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, out.find("\"ts\":0,"));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, out.find("\"ts\":70,")); // after the wrap
+  TEST_ASSERT_EQUAL(8, countOf(out, "\"ph\":\"X\""));
+}
+
+// Each writer encodes its tid in the event so a torn read is visible.
+void test_concurrent_writers_and_dumps()
+{
+  static TraceRing<64> ring;
+  static const char *const names[] = {"w0", "w1"};
+  std::atomic<bool> stop{false};
+  auto writer = [&](uint8_t tid)
+  {
+    uint32_t i = 0;
+    while (!stop)
+    {
+      ring.record(names[tid], tid, i * 2 + tid, i * 2 + tid);
+      i++;
+    }
+  };
+  std::thread a(writer, 0), b(writer, 1);
+
+  uint32_t dumps = 0, events = 0, torn = 0;
+  auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+  while (std::chrono::steady_clock::now() < until)
+  {
+    uint32_t end = ring.written();
+    TraceEvent e;
+    for (uint32_t i = end > 64 ? end - 64 : 0; i < end; i++)
+    {
+      if (!ring.read(i, e))
+        continue;
+      events++;
+      if (e.name != names[e.tid & 1] || e.tid > 1 || e.cycles != e.startUs || (e.startUs & 1) != e.tid)
+        torn++;
+    }
+    dumps++;
+  }
+  stop = true;
+  a.join();
+  b.join();
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%u dumps, %u events read, %u recorded", dumps, events, ring.written());
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_GREATER_THAN(0, events);
+}
+
+void test_record_cost()
+{
+  static TraceRing<256> ring;
+  const uint32_t n = 5000000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++)
+    ring.record("bench", 1, i, i);
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / n;
+  char msg[64];
+  snprintf(msg, sizeof(msg), "record() %.1f ns (host)", ns);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(n, ring.written());
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_chrome_export);
+  RUN_TEST(test_wraps_to_newest);
+  RUN_TEST(test_concurrent_writers_and_dumps);
+  RUN_TEST(test_record_cost);
+  return UNITY_END();
+}
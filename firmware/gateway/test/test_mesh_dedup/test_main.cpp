@@ -0,0 +1,112 @@
+/*********************************************************************
+ * Host test: MeshDedup (seq prefix + gateway duplicate filter)
+ * -------------------------------------------------------
+ * • Prefix round trip; untagged / malformed messages are not parsed
+ * • Same (node, seq) is accepted once per window, then again after it
+ * • Same seq from different nodes are distinct
+ * • Full probe window evicts the oldest entry, not the newest
+ * • Multipath: 200 nodes at 50 messages/s, each arriving 1–3 times
+ *   up to 2 s apart, is forwarded exactly once
+ *********************************************************************/
+
+#include <unity.h>
+#include <MeshDedup.h>
+
+#include <algorithm>
+#include <random>
+#include <string.h>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void test_prefix_round_trip()
+{
+  char buf[32];
+  TEST_ASSERT_EQUAL(MESH_SEQ_PREFIX_BYTES, meshSeqPrefix(0xDEADBEEF, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_STRING("#deadbeef:", buf);
+  strcat(buf, "{\"a\":1}");
+  uint32_t seq = 0;
+  TEST_ASSERT_EQUAL(MESH_SEQ_PREFIX_BYTES, meshSeqParse(buf, strlen(buf), seq));
+  TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, seq);
+
+  TEST_ASSERT_EQUAL(0, meshSeqPrefix(1, buf, MESH_SEQ_PREFIX_BYTES)); // no room for NUL
+  TEST_ASSERT_EQUAL(0, meshSeqParse("{\"a\":1}", 7, seq));
+  TEST_ASSERT_EQUAL(0, meshSeqParse("~1234567890", 11, seq));
+  TEST_ASSERT_EQUAL(0, meshSeqParse("#0000000g:x", 11, seq));
+  TEST_ASSERT_EQUAL(0, meshSeqParse("#00000001;x", 11, seq));
+  TEST_ASSERT_EQUAL(0, meshSeqParse("#0000", 5, seq));
+}
+
+void test_window()
+{
+  MeshDedup<16> d(1000);
+  TEST_ASSERT_TRUE(d.firstSeen(7, 1, 100));
+  TEST_ASSERT_FALSE(d.firstSeen(7, 1, 500));
+  TEST_ASSERT_TRUE(d.firstSeen(8, 1, 500)); // other node, same seq
+  TEST_ASSERT_TRUE(d.firstSeen(7, 2, 500));
+  TEST_ASSERT_FALSE(d.firstSeen(7, 1, 1099));
+  TEST_ASSERT_TRUE(d.firstSeen(7, 1, 1100)); // expired: a new message
+  TEST_ASSERT_EQUAL_UINT32(4, d.stats().accepted);
+  TEST_ASSERT_EQUAL_UINT32(2, d.stats().duplicates);
+  TEST_ASSERT_EQUAL_UINT32(0, d.stats().evicted);
+
+  // millis() wrap
+  MeshDedup<16> w(1000);
+  TEST_ASSERT_TRUE(w.firstSeen(1, 1, 0xFFFFFF00u));
+  TEST_ASSERT_FALSE(w.firstSeen(1, 1, 0x00000100u));
+}
+
+// A table of 4 slots probed fully: the 5th pair evicts the oldest.
+void test_evicts_oldest()
+{
+  MeshDedup<4, 4> d(10000);
+  for (uint32_t i = 0; i < 4; i++)
+    TEST_ASSERT_TRUE(d.firstSeen(1, i, 100 + i));
+  TEST_ASSERT_TRUE(d.firstSeen(1, 99, 200));
+  TEST_ASSERT_EQUAL_UINT32(1, d.stats().evicted);
+  TEST_ASSERT_TRUE(d.firstSeen(1, 0, 201)); // seq 0 (oldest) was evicted
+  TEST_ASSERT_FALSE(d.firstSeen(1, 3, 202));
+  TEST_ASSERT_FALSE(d.firstSeen(1, 99, 203));
+}
+
+void test_multipath()
+{
+  struct Copy
+  {
+    uint32_t node, seq, atMs;
+  };
+  std::mt19937 rng(42);
+  std::vector<Copy> arrivals;
+  const uint32_t nodes = 200, perNode = 5;
+  for (uint32_t n = 0; n < nodes; n++)
+  {
+    uint32_t seq = (uint32_t)rng();
+    for (uint32_t m = 0; m < perNode; m++, seq++)
+    {
+      uint32_t sentMs = (n * perNode + m) * 20; // 50 messages/s
+      uint32_t copies = 1 + (uint32_t)(rng() % 3);
+      for (uint32_t c = 0; c < copies; c++)
+        arrivals.push_back({0x10000 + n, seq, sentMs + (uint32_t)(rng() % 2000)});
+    }
+  }
+  std::sort(arrivals.begin(), arrivals.end(), [](const Copy &a, const Copy &b)
+            { return a.atMs < b.atMs; });
+
+  MeshDedup<256> d(2500);
+  uint32_t forwarded = 0;
+  for (const Copy &c : arrivals)
+    forwarded += d.firstSeen(c.node, c.seq, c.atMs);
+  TEST_ASSERT_EQUAL_UINT32(nodes * perNode, forwarded);
+  TEST_ASSERT_EQUAL_UINT32(arrivals.size() - forwarded, d.stats().duplicates);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_prefix_round_trip);
+  RUN_TEST(test_window);
+  RUN_TEST(test_evicts_oldest);
+  RUN_TEST(test_multipath);
+  return UNITY_END();
+}
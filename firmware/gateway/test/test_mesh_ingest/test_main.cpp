@@ -0,0 +1,137 @@
+/*********************************************************************
+ * Host test: MeshIngest (gateway frame -> JSON telemetry)
+ * -------------------------------------------------------
+ * • Announced schema: named keys, "<name>_<field>" for multi-value
+ *   sensors, firmware version, one message per record
+ * • Unknown or stale schema: index keys ("s1_temp")
+ * • Bad frame texts are rejected; schema table stays bounded
+ * • Strings are escaped
+ *********************************************************************/
+
+#include <unity.h>
+#include <MeshIngest.h>
+#include <TelemetryFrame.h>
+
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+namespace
+{
+  const SensorKind kKinds[] = {SensorKind::CAP_SOIL_MOISTURE, SensorKind::DHT22};
+  const char *const kNames[] = {"Soil1", "Air"};
+
+  std::vector<std::string> g_out;
+
+  void collect(uint32_t from, const char *json, size_t len, void *ctx)
+  {
+    g_out.push_back(std::string(json, len));
+    *(uint32_t *)ctx = from;
+  }
+
+  std::string frameText(const char *deviceId, uint16_t schema)
+  {
+    TelemetryFrameHeader h;
+    h.schema = schema;
+    h.batteryMv = 3712;
+    h.sleepSec = 300;
+    h.hops = 2;
+    uint8_t frame[128];
+    TelemetryFrameWriter w(frame, sizeof(frame));
+    w.begin(deviceId, h);
+    w.beginRecord(600);
+    w.add(0, FIELD_MOISTURE, 40.5f);
+    w.beginRecord(0);
+    w.add(0, FIELD_MOISTURE, 41.25f);
+    w.add(1, FIELD_TEMP, 21.5f);
+    w.add(1, FIELD_HUM, 55.0f);
+    size_t len = w.finish();
+    char text[256];
+    size_t n = telemetryFrameToText(frame, len, text, sizeof(text));
+    return std::string(text, n);
+  }
+}
+
+void test_named_keys()
+{
+  MeshIngest ingest(8);
+  uint16_t schema = telemetrySchemaId(kNames, kKinds, 2);
+  ingest.setSchema(42, schema, "1.4.0", kNames, kKinds, 2);
+  g_out.clear();
+  uint32_t from = 0;
+  std::string text = frameText("node-7", schema);
+  TEST_ASSERT_EQUAL(2, ingest.onFrameText(42, text.c_str(), text.size(), -61, collect, &from));
+  TEST_ASSERT_EQUAL_UINT32(42, from);
+  TEST_ASSERT_EQUAL_STRING("{\"deviceId\":\"node-7\",\"firmwareVersion\":\"1.4.0\",\"battery\":3.712,\"rssi\":-61,"
+                           "\"meshHopCount\":2,\"sleepSeconds\":300,\"sampleAgeSec\":600,\"Soil1\":40.5}",
+                           g_out[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"deviceId\":\"node-7\",\"firmwareVersion\":\"1.4.0\",\"battery\":3.712,\"rssi\":-61,"
+                           "\"meshHopCount\":2,\"sleepSeconds\":300,\"Soil1\":41.25,\"Air_temp\":21.5,\"Air_hum\":55}",
+                           g_out[1].c_str());
+  TEST_ASSERT_EQUAL_UINT32(1, ingest.stats().frames);
+  TEST_ASSERT_EQUAL_UINT32(2, ingest.stats().messages);
+}
+
+void test_unknown_schema_uses_indexes()
+{
+  MeshIngest ingest(8);
+  ingest.setSchema(42, 0x1111, "1.4.0", kNames, kKinds, 2); // stale announcement
+  g_out.clear();
+  uint32_t from = 0;
+  std::string text = frameText("node-7", 0x2222);
+  TEST_ASSERT_EQUAL(2, ingest.onFrameText(42, text.c_str(), text.size(), -61, collect, &from));
+  TEST_ASSERT_EQUAL_STRING("{\"deviceId\":\"node-7\",\"battery\":3.712,\"rssi\":-61,\"meshHopCount\":2,"
+                           "\"sleepSeconds\":300,\"s0_moisture\":41.25,\"s1_temp\":21.5,\"s1_hum\":55}",
+                           g_out[1].c_str());
+  TEST_ASSERT_EQUAL_UINT32(1, ingest.stats().unknownSchema);
+}
+
+void test_rejects_bad_text()
+{
+  MeshIngest ingest(8);
+  g_out.clear();
+  uint32_t from = 0;
+  std::string text = frameText("node-7", 1);
+  TEST_ASSERT_EQUAL(-1, ingest.onFrameText(1, text.c_str(), text.size() - 4, 0, collect, &from));
+  TEST_ASSERT_EQUAL(-1, ingest.onFrameText(1, "~!!!!", 5, 0, collect, &from));
+  TEST_ASSERT_EQUAL(-1, ingest.onFrameText(1, "{\"a\":1}", 7, 0, collect, &from));
+  TEST_ASSERT_EQUAL_UINT32(3, ingest.stats().invalid);
+  TEST_ASSERT_EQUAL(0, g_out.size());
+}
+
+void test_schema_table_bounded()
+{
+  MeshIngest ingest(4);
+  for (uint32_t node = 1; node <= 10; node++)
+    ingest.setSchema(node, 1, "", kNames, kKinds, 2);
+  TEST_ASSERT_EQUAL(4, ingest.nodes());
+  ingest.setSchema(10, 2, "", kNames, kKinds, 2); // update, not a new node
+  TEST_ASSERT_EQUAL(4, ingest.nodes());
+}
+
+void test_escapes_strings()
+{
+  const char *const names[] = {"Bed \"A\"", "Air"};
+  MeshIngest ingest(8);
+  uint16_t schema = telemetrySchemaId(names, kKinds, 2);
+  ingest.setSchema(5, schema, "1.4\\beta", names, kKinds, 2);
+  g_out.clear();
+  uint32_t from = 0;
+  std::string text = frameText("node-7", schema);
+  ingest.onFrameText(5, text.c_str(), text.size(), -61, collect, &from);
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, g_out[1].find("\"firmwareVersion\":\"1.4\\\\beta\""));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, g_out[1].find("\"Bed \\\"A\\\"\":41.25"));
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_named_keys);
+  RUN_TEST(test_unknown_schema_uses_indexes);
+  RUN_TEST(test_rejects_bad_text);
+  RUN_TEST(test_schema_table_bounded);
+  RUN_TEST(test_escapes_strings);
+  return UNITY_END();
+}
@@ -0,0 +1,258 @@
+/*********************************************************************
+ * Host test + benchmark: MeshOtaServer (firmware over the mesh)
+ * -------------------------------------------------------
+ * • Requests are queued once; a full queue or an unknown part drops them
+ * • Pacing: a burst, then the sustained rate; nothing while held
+ * • Per-node progress: highest part, repeats for parts asked again,
+ *   done after the last part; finished nodes free their slot
+ * • MeshOtaImage is rejected when zeroed or corrupted
+ * • A simulated site (nodes pulling a 1.2 MB image, lost replies asked
+ *   again after a timeout, telemetry holding the server) at several
+ *   rates: time until every node has the image, repeats, time held,
+ *   and the backhaul of one download against one per node
+ * Run: pio test -e native -f test_mesh_ota_server -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <MeshOtaServer.h>
+
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void test_queue()
+{
+  MeshOtaServer s;
+  MeshOtaServer::Config cfg;
+  s.begin(100, cfg, 0);
+  TEST_ASSERT_TRUE(s.request(1, 0, 0));
+  TEST_ASSERT_FALSE(s.request(1, 0, 10)); // asked again before the reply went out
+  TEST_ASSERT_FALSE(s.request(1, 100, 10));
+  for (uint32_t n = 2; n <= MESH_OTA_QUEUE; n++)
+    TEST_ASSERT_TRUE(s.request(n, 0, 10));
+  TEST_ASSERT_FALSE(s.request(99, 0, 10));
+  TEST_ASSERT_EQUAL_UINT32(1, s.stats().duplicates);
+  TEST_ASSERT_EQUAL_UINT32(1, s.stats().dropped);
+
+  MeshOtaServer::Request r;
+  TEST_ASSERT_TRUE(s.next(10, false, r));
+  TEST_ASSERT_EQUAL_UINT32(1, r.node); // oldest first
+  TEST_ASSERT_EQUAL_UINT32(0, r.part);
+}
+
+void test_pacing()
+{
+  MeshOtaServer s;
+  MeshOtaServer::Config cfg;
+  cfg.partsPerSec = 10;
+  cfg.burst = 2;
+  s.begin(1000, cfg, 0);
+  for (uint32_t p = 0; p < 10; p++)
+    s.request(7, p, 0);
+  MeshOtaServer::Request r;
+  TEST_ASSERT_TRUE(s.next(0, false, r));
+  TEST_ASSERT_TRUE(s.next(0, false, r));
+  TEST_ASSERT_FALSE(s.next(0, false, r)); // burst used up
+  TEST_ASSERT_FALSE(s.next(50, false, r));
+  TEST_ASSERT_TRUE(s.next(100, false, r)); // one per 100 ms
+  TEST_ASSERT_FALSE(s.next(150, false, r));
+
+  TEST_ASSERT_FALSE(s.next(400, true, r)); // held for telemetry
+  TEST_ASSERT_EQUAL_UINT32(1, s.stats().held);
+  TEST_ASSERT_TRUE(s.next(400, false, r)); // tokens kept while held, up to the burst
+  TEST_ASSERT_TRUE(s.next(400, false, r));
+  TEST_ASSERT_FALSE(s.next(400, false, r));
+
+  s.begin(1000, cfg, 0);
+  s.request(7, 0, 0);
+  TEST_ASSERT_TRUE(s.next(0xFFFFF000u, false, r)); // long idle: no overflow
+}
+
+void test_progress()
+{
+  MeshOtaServer s;
+  MeshOtaServer::Config cfg;
+  cfg.partsPerSec = 1000;
+  cfg.burst = 100;
+  s.begin(4, cfg, 0);
+  MeshOtaServer::Request r;
+  const uint32_t asked[] = {0, 1, 1, 2, 3};
+  const bool fresh[] = {true, true, false, true, true}; // part 1 again: a repeat
+  for (uint8_t i = 0; i < 5; i++)
+  {
+    TEST_ASSERT_TRUE(s.request(42, asked[i], 0));
+    TEST_ASSERT_TRUE(s.next(0, false, r));
+    TEST_ASSERT_EQUAL(fresh[i], r.fresh);
+    if (asked[i] == 1)
+      TEST_ASSERT_EQUAL_UINT8(50, s.percent(s.node(0)));
+  }
+  TEST_ASSERT_EQUAL_UINT8(1, s.nodes());
+  const MeshOtaServer::Node &n = s.node(0);
+  TEST_ASSERT_EQUAL_UINT32(42, n.id);
+  TEST_ASSERT_EQUAL_UINT32(5, n.served);
+  TEST_ASSERT_EQUAL_UINT32(1, n.repeats);
+  TEST_ASSERT_TRUE(n.done);
+  TEST_ASSERT_EQUAL_UINT8(100, s.percent(n));
+
+  // All slots busy: a new node is served but not tracked until one is done.
+  s.begin(4, cfg, 0);
+  for (uint32_t id = 1; id <= MESH_OTA_MAX_NODES; id++)
+  {
+    s.request(id, 0, id);
+    s.next(id, false, r);
+  }
+  TEST_ASSERT_TRUE(s.request(1000, 0, 100));
+  TEST_ASSERT_TRUE(s.next(100, false, r));
+  TEST_ASSERT_EQUAL_UINT8(MESH_OTA_MAX_NODES, s.nodes());
+  for (uint32_t p = 1; p < 4; p++)
+  {
+    s.request(5, p, 200);
+    s.next(200, false, r);
+  }
+  s.request(1000, 1, 300); // takes node 5's slot
+  s.next(300, false, r);
+  bool tracked = false;
+  for (uint8_t i = 0; i < s.nodes(); i++)
+    tracked |= s.node(i).id == 1000;
+  TEST_ASSERT_TRUE(tracked);
+}
+
+void test_image_record()
+{
+  static MeshOtaImage img; // zeroed like fresh NVS
+  TEST_ASSERT_FALSE(img.valid());
+  img.clear();
+  strcpy(img.version, "1.4.0");
+  strcpy(img.md5, "0123456789abcdef0123456789abcdef");
+  img.size = 1200001;
+  img.seal();
+  TEST_ASSERT_TRUE(img.valid());
+  TEST_ASSERT_EQUAL_UINT32(1172, img.parts(1024));
+  img.size++;
+  TEST_ASSERT_FALSE(img.valid());
+}
+
+namespace
+{
+  struct SimNode
+  {
+    uint32_t id;
+    uint32_t part = 0;       // next part wanted
+    uint32_t askedAt = 0;
+    uint32_t replyAt = 0;    // reply in flight, arrives then
+    bool inFlight = false, waiting = false, done = false;
+    uint32_t telemetryAt;
+  };
+
+  struct SiteResult
+  {
+    double minutes;
+    uint32_t repeats, dropped;
+    double heldPercent; // of the time, while requests were waiting
+  };
+
+  // Every node asks for its next part when the last one arrived, and asks
+  // again after `retryMs` when the reply was lost. Each node sends
+  // telemetry every minute; the gateway holds OTA for 200 ms after it.
+  SiteResult simulateSite(uint16_t nodes, uint32_t parts, uint16_t rate, uint32_t lossPerMille, uint32_t seed)
+  {
+    const uint32_t stepMs = 10, hopMs = 40, retryMs = 10000, holdMs = 200;
+    std::mt19937 rng(seed);
+    MeshOtaServer s;
+    MeshOtaServer::Config cfg;
+    cfg.partsPerSec = rate;
+    s.begin(parts, cfg, 0);
+    std::vector<SimNode> site(nodes);
+    for (uint16_t i = 0; i < nodes; i++)
+    {
+      site[i].id = 100 + i;
+      site[i].telemetryAt = rng() % 60000;
+    }
+    uint32_t lastTelemetry = 0;
+    bool anyTelemetry = false;
+    uint16_t finished = 0;
+    uint32_t now = 0;
+    for (; finished < nodes && now < 6 * 3600 * 1000u; now += stepMs)
+    {
+      for (auto &n : site)
+      {
+        if (now >= n.telemetryAt)
+        {
+          n.telemetryAt += 60000;
+          lastTelemetry = now;
+          anyTelemetry = true;
+        }
+        if (n.done)
+          continue;
+        if (n.inFlight && now >= n.replyAt)
+        {
+          n.inFlight = n.waiting = false;
+          if (++n.part == parts)
+          {
+            n.done = true;
+            finished++;
+            continue;
+          }
+        }
+        if (!n.waiting || now - n.askedAt >= retryMs)
+        {
+          s.request(n.id, n.part, now);
+          n.waiting = true;
+          n.askedAt = now;
+        }
+      }
+      MeshOtaServer::Request r;
+      bool hold = anyTelemetry && now - lastTelemetry < holdMs;
+      while (s.next(now, hold, r))
+      {
+        if (rng() % 1000 < lossPerMille)
+          continue; // reply lost: the node asks again after retryMs
+        SimNode &n = site[r.node - 100];
+        if (r.part == n.part && !n.inFlight)
+        {
+          n.inFlight = true;
+          n.replyAt = now + hopMs;
+        }
+      }
+    }
+    uint32_t repeats = 0;
+    for (uint8_t i = 0; i < s.nodes(); i++)
+      repeats += s.node(i).repeats;
+    return {now / 60000.0, repeats, s.stats().dropped, 100.0 * s.stats().held * stepMs / now};
+  }
+}
+
+void bench_site_update()
+{
+  const uint16_t nodes = 20;
+  const uint32_t imageBytes = 1200000, partBytes = 1024;
+  const uint32_t parts = (imageBytes + partBytes - 1) / partBytes;
+  char msg[200];
+  for (uint16_t rate : {4, 8, 16})
+  {
+    SiteResult r = simulateSite(nodes, parts, rate, 30, 11);
+    snprintf(msg, sizeof(msg),
+             "%u nodes, %u parts/s, 3%% replies lost: all updated after %.0f min, %u parts re-sent, "
+             "held for telemetry %.1f%% of the time (simulated time)",
+             nodes, rate, r.minutes, (unsigned)r.repeats, r.heldPercent);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(r.minutes < 360);
+  }
+  snprintf(msg, sizeof(msg), "backhaul: %.1f MB once at the gateway vs %.1f MB with a download per node",
+           imageBytes / 1e6, nodes * (double)imageBytes / 1e6);
+  TEST_MESSAGE(msg);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_queue);
+  RUN_TEST(test_pacing);
+  RUN_TEST(test_progress);
+  RUN_TEST(test_image_record);
+  RUN_TEST(bench_site_update);
+  return UNITY_END();
+}
@@ -0,0 +1,390 @@
+/*********************************************************************
+ * Host benchmark: simulated N-node mesh against the gateway pipeline
+ * -------------------------------------------------------
+ * • Virtual nodes send TelemetryFrames at a fixed rate (phases spread
+ *   evenly) into a stand-in for painlessMesh's receive queue, which
+ *   drops when the gateway falls behind
+ * • The gateway thread runs the firmware's frame path: MeshIngest ->
+ *   SpscRing hand-off (sizes from GatewayPipeline.h, as main.cpp)
+ * • The uplink thread runs the uplink task's path: ring -> TelemetryQueue
+ *   (segment file in the working directory stands in for LittleFS) ->
+ *   IoT Hub batch bodies -> a stand-in client with fixed post latency
+ * • Reports throughput, node-to-uplink latency percentiles and drops at
+ *   every stage; sent == delivered + drops + still queued
+ * Run: pio test -e native_sim -v
+ * Tune with -D MESH_SIM_NODES=... etc. (see below)
+ *********************************************************************/
+
+#include <unity.h>
+#include <GatewayPipeline.h>
+#include <IoTHubBatch.h>
+#include <MeshIngest.h>
+#include <SpscRing.h>
+#include <TelemetryFrame.h>
+#include <TelemetryQueue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef MESH_SIM_NODES
+#define MESH_SIM_NODES 300 // virtual nodes
+#endif
+#ifndef MESH_SIM_RATE_HZ
+#define MESH_SIM_RATE_HZ 5.0 // frames per node per second
+#endif
+#ifndef MESH_SIM_SECONDS
+#define MESH_SIM_SECONDS 2 // send phase; the pipeline then drains
+#endif
+#ifndef MESH_SIM_SENSORS
+#define MESH_SIM_SENSORS 4 // sensors per node (kinds cycle)
+#endif
+#ifndef MESH_SIM_RX_QUEUE
+#define MESH_SIM_RX_QUEUE 64 // painlessMesh receive backlog before drops
+#endif
+#ifndef MESH_SIM_POST_US
+#define MESH_SIM_POST_US 20000 // stand-in uplink: time per request
+#endif
+
+
+void setUp() {}
+void tearDown() {}
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  const SensorKind kKinds[] = {SensorKind::CAP_SOIL_MOISTURE, SensorKind::BME280, SensorKind::DS18B20,
+                               SensorKind::DHT22};
+  const char *const kNames[] = {"Soil1", "Air", "Probe", "Shed", "Soil2", "Air2", "Probe2", "Shed2"};
+  const char *const kSeg = "mesh_sim_txq.seg";
+
+  uint64_t nowUs(Clock::time_point epoch)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - epoch).count();
+  }
+
+  // --- painlessMesh stand-in: bounded receive queue, drop on overflow ---
+  struct MeshMessage
+  {
+    uint32_t from;
+    uint64_t sentUs;
+    std::string text;
+  };
+
+  class SimMesh
+  {
+  public:
+    bool deliver(MeshMessage &&m)
+    {
+      std::lock_guard<std::mutex> lock(m_mu);
+      if (m_q.size() >= MESH_SIM_RX_QUEUE)
+      {
+        dropped++;
+        return false;
+      }
+      m_q.push_back(std::move(m));
+      if (m_q.size() > highWater)
+        highWater = m_q.size();
+      return true;
+    }
+    bool receive(MeshMessage &out)
+    {
+      std::lock_guard<std::mutex> lock(m_mu);
+      if (m_q.empty())
+        return false;
+      out = std::move(m_q.front());
+      m_q.pop_front();
+      return true;
+    }
+    size_t pending()
+    {
+      std::lock_guard<std::mutex> lock(m_mu);
+      return m_q.size();
+    }
+
+    uint32_t dropped = 0; // guarded by m_mu
+    size_t highWater = 0;
+
+  private:
+    std::mutex m_mu;
+    std::deque<MeshMessage> m_q;
+  };
+
+  // --- virtual node: sensor stand-ins + frame encoder ---
+  struct VirtualNode
+  {
+    uint32_t id;
+    char deviceId[24];
+    uint16_t schema;
+    uint32_t seq = 0;
+
+    std::string nextFrame()
+    {
+      TelemetryFrameHeader h;
+      h.schema = schema;
+      h.batteryMv = 3600 + id % 500;
+      h.sleepSec = 60;
+      h.hops = 1 + id % 4;
+      uint8_t frame[256];
+      TelemetryFrameWriter w(frame, sizeof(frame));
+      w.begin(deviceId, h);
+      w.beginRecord(0);
+      for (uint8_t i = 0; i < MESH_SIM_SENSORS; i++)
+      {
+        SensorSample v;
+        uint8_t fields = sensorKindFields(kKinds[i % 4]);
+        for (uint8_t f = 0; f < FIELD_COUNT; f++)
+          if (fields & FIELD_BIT(f))
+            v.set((SensorField)f, 20.0f + (seq + i * 7 + f) % 50 * 0.25f);
+        w.add(i, v);
+      }
+      seq++;
+      char text[2 + (sizeof(frame) + 2) / 3 * 4];
+      size_t n = telemetryFrameToText(frame, w.finish(), text, sizeof(text));
+      return std::string(text, n);
+    }
+  };
+
+  // --- gateway ---
+  // Each hand-off carries the frame's send time ahead of the JSON so the
+  // uplink side can measure node-to-uplink latency.
+  struct Gateway
+  {
+    MeshIngest ingest{MESH_SCHEMA_MAX_NODES};
+    SpscRing<UPLINK_RING_SLOTS, UPLINK_RING_SLOT_BYTES> ring;
+    uint64_t currentSentUs = 0;
+    uint64_t callbackNs = 0;
+    uint32_t callbacks = 0;
+  };
+
+  void handOff(uint32_t, const char *json, size_t len, void *ctx)
+  {
+    Gateway &gw = *(Gateway *)ctx;
+    char slot[UPLINK_RING_SLOT_BYTES];
+    if (len + sizeof(uint64_t) > sizeof(slot))
+      return;
+    memcpy(slot, &gw.currentSentUs, sizeof(uint64_t));
+    memcpy(slot + sizeof(uint64_t), json, len);
+    gw.ring.push(slot, len + sizeof(uint64_t));
+  }
+
+  // meshReceivedCallback() for '~' frames, with WiFi.RSSI() stood in.
+  void meshReceived(Gateway &gw, const MeshMessage &m)
+  {
+    gw.currentSentUs = m.sentUs;
+    auto t0 = Clock::now();
+    gw.ingest.onFrameText(m.from, m.text.c_str(), m.text.size(), -58, handOff, &gw);
+    gw.callbackNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+    gw.callbacks++;
+  }
+
+  // --- uplink task + stand-in IoT Hub client ---
+  struct Uplink
+  {
+    TelemetryQueue queue;
+    Clock::time_point epoch;
+    std::vector<uint32_t> latencyUs;
+    uint32_t posts = 0;
+    uint32_t delivered = 0;
+  };
+
+  struct BatchCtx
+  {
+    IoTHubBatchWriter *w;
+    std::vector<uint64_t> *sent;
+  };
+
+  bool addToBatch(const char *data, size_t len, void *ctx)
+  {
+    BatchCtx &b = *(BatchCtx *)ctx;
+    uint64_t sentUs;
+    memcpy(&sentUs, data, sizeof(sentUs));
+    if (!b.w->add(data + sizeof(sentUs), len - sizeof(sentUs)))
+      return false;
+    b.sent->push_back(sentUs);
+    return true;
+  }
+
+  // sendHttpBatch() + drainTelemetryQueue(); the stand-in post always succeeds.
+  void drain(Uplink &up)
+  {
+    static char batch[HTTP_BATCH_MAX_BYTES];
+    std::vector<uint64_t> sent;
+    for (uint8_t i = 0; i < UPLINK_DRAIN_BUDGET && !up.queue.empty(); i++)
+    {
+      IoTHubBatchWriter w(batch, sizeof(batch));
+      BatchCtx ctx = {&w, &sent};
+      sent.clear();
+      uint32_t n = up.queue.peekMany(HTTP_BATCH_MAX_MESSAGES, 0, addToBatch, &ctx);
+      if (!n)
+        break;
+      w.finish();
+      std::this_thread::sleep_for(std::chrono::microseconds(MESH_SIM_POST_US));
+      up.queue.pop(n);
+      up.posts++;
+      up.delivered += n;
+      uint64_t done = nowUs(up.epoch);
+      for (uint64_t s : sent)
+        up.latencyUs.push_back((uint32_t)(done - s));
+    }
+  }
+
+  uint32_t percentile(std::vector<uint32_t> &v, double p)
+  {
+    if (v.empty())
+      return 0;
+    size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+  }
+
+  struct Due
+  {
+    uint64_t atUs;
+    uint32_t node;
+    bool operator<(const Due &o) const { return atUs > o.atUs; } // min-heap
+  };
+}
+
+void test_simulated_mesh()
+{
+  remove(kSeg);
+  Clock::time_point epoch = Clock::now();
+  SimMesh mesh;
+  Gateway gw;
+  Uplink up;
+  up.epoch = epoch;
+  TelemetryQueueConfig qc;
+  qc.segmentPath = kSeg;
+  TEST_ASSERT_TRUE(up.queue.begin(qc));
+
+  // Nodes join and announce their schema (a JSON message on the device).
+  std::vector<VirtualNode> nodes(MESH_SIM_NODES);
+  SensorKind kinds[MESH_SIM_SENSORS];
+  for (uint8_t i = 0; i < MESH_SIM_SENSORS; i++)
+    kinds[i] = kKinds[i % 4];
+  uint16_t schema = telemetrySchemaId(kNames, kinds, MESH_SIM_SENSORS);
+  for (uint32_t i = 0; i < nodes.size(); i++)
+  {
+    nodes[i].id = 0x10000 + i;
+    snprintf(nodes[i].deviceId, sizeof(nodes[i].deviceId), "sim-node-%03u", (unsigned)i);
+    nodes[i].schema = schema;
+    gw.ingest.setSchema(nodes[i].id, schema, "sim", kNames, kinds, MESH_SIM_SENSORS);
+  }
+
+  std::atomic<bool> sending{true}, running{true};
+  uint32_t sent = 0;
+  std::thread radio([&]
+                    {
+    const uint64_t periodUs = (uint64_t)(1e6 / MESH_SIM_RATE_HZ);
+    const uint64_t endUs = (uint64_t)MESH_SIM_SECONDS * 1000000;
+    std::priority_queue<Due> due;
+    for (uint32_t i = 0; i < nodes.size(); i++)
+      due.push({periodUs * i / nodes.size(), i});
+    while (!due.empty() && due.top().atUs < endUs)
+    {
+      Due d = due.top();
+      due.pop();
+      uint64_t now = nowUs(epoch);
+      if (d.atUs > now)
+        std::this_thread::sleep_for(std::chrono::microseconds(d.atUs - now));
+      MeshMessage m;
+      m.from = nodes[d.node].id;
+      m.text = nodes[d.node].nextFrame();
+      m.sentUs = nowUs(epoch);
+      mesh.deliver(std::move(m));
+      sent++;
+      due.push({d.atUs + periodUs, d.node});
+    }
+    sending = false; });
+
+  std::thread gateway([&]
+                      {
+    MeshMessage m;
+    while (sending || mesh.pending())
+    {
+      if (mesh.receive(m))
+        meshReceived(gw, m);
+      else
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    } });
+
+  std::thread uplink([&]
+                     {
+    static char buf[UPLINK_RING_SLOT_BYTES];
+    while (running)
+    {
+      size_t n;
+      while ((n = gw.ring.pop(buf, sizeof(buf))) > 0)
+        up.queue.push(buf, n, 0);
+      drain(up);
+      if (up.queue.empty())
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    } });
+
+  radio.join();
+  gateway.join();
+  // Give the uplink a bounded time to catch up, then stop it.
+  auto deadline = Clock::now() + std::chrono::seconds(10);
+  while (Clock::now() < deadline && (!gw.ring.empty() || !up.queue.empty()))
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  running = false;
+  uplink.join();
+  double elapsedSec = nowUs(epoch) / 1e6;
+
+  SpscRing<UPLINK_RING_SLOTS, UPLINK_RING_SLOT_BYTES>::Stats ring = gw.ring.stats();
+  const TelemetryQueue::Stats &qs = up.queue.stats();
+  uint32_t queued = up.queue.size();
+  uint32_t delivered = up.delivered;
+
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%u nodes x %.1f Hz x %u s, %u sensors/frame, uplink post %u us",
+           (unsigned)MESH_SIM_NODES, (double)MESH_SIM_RATE_HZ, (unsigned)MESH_SIM_SECONDS,
+           (unsigned)MESH_SIM_SENSORS, (unsigned)MESH_SIM_POST_US);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "sent %u, delivered %u in %u posts (%.0f msg/s over %.2f s), queued %u",
+           sent, delivered, up.posts, delivered / elapsedSec, elapsedSec, queued);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "drops: mesh rx %u (backlog peak %u/%u), hand-off ring %u, queue %u + %u expired",
+           mesh.dropped, (unsigned)mesh.highWater, (unsigned)MESH_SIM_RX_QUEUE, ring.dropped, qs.dropped,
+           qs.expired);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "gateway callback %.1f us/frame, ring high water %u/%u, %u spilled to disk",
+           gw.callbacks ? gw.callbackNs / 1000.0 / gw.callbacks : 0.0, ring.highWater,
+           (unsigned)UPLINK_RING_SLOTS, qs.spilled);
+  TEST_MESSAGE(msg);
+  // Nodes beyond MESH_SCHEMA_MAX_NODES evict each other's schema and fall
+  // back to index keys.
+  snprintf(msg, sizeof(msg), "schema cache %u/%u nodes, %u frames with index keys", (unsigned)gw.ingest.nodes(),
+           (unsigned)MESH_SIM_NODES, gw.ingest.stats().unknownSchema);
+  TEST_MESSAGE(msg);
+  uint32_t p50 = percentile(up.latencyUs, 0.50), p95 = percentile(up.latencyUs, 0.95);
+  uint32_t p99 = percentile(up.latencyUs, 0.99), pMax = percentile(up.latencyUs, 1.0);
+  snprintf(msg, sizeof(msg), "node->uplink latency ms: p50 %.2f, p95 %.2f, p99 %.2f, max %.2f", p50 / 1000.0,
+           p95 / 1000.0, p99 / 1000.0, pMax / 1000.0);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL_UINT32(0, gw.ingest.stats().invalid);
+  TEST_ASSERT_EQUAL_UINT32(sent - mesh.dropped, gw.ingest.stats().messages); // one record per frame
+  TEST_ASSERT_EQUAL_UINT32(gw.ingest.stats().messages, ring.pushed);
+  TEST_ASSERT_EQUAL_UINT32(sent, delivered + queued + mesh.dropped + ring.dropped + qs.dropped + qs.expired);
+  TEST_ASSERT_GREATER_THAN(0, delivered);
+  up.queue.end();
+  remove(kSeg);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_simulated_mesh);
+  return UNITY_END();
+}
@@ -0,0 +1,147 @@
+/*********************************************************************
+ * Host test + benchmark: Metrics (/metrics)
+ * -------------------------------------------------------
+ * • Prometheus text format: HELP/TYPE, labels, cumulative buckets
+ * • Sums stay exact to the ms across sub-ms samples
+ * • A scrape racing a writer thread always sees +Inf == _count
+ * • Cost of one record() / add()
+ *********************************************************************/
+
+#include <unity.h>
+#include <Metrics.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+void setUp() {}
+void tearDown() {}
+
+static void toString(const char *data, size_t len, void *ctx)
+{
+  ((std::string *)ctx)->append(data, len);
+}
+
+static const uint32_t kBounds[] = {1000, 10000, 100000};
+
+void test_text_format()
+{
+  MetricCounter sent;
+  sent.add(3);
+  LatencyHistogram h(kBounds, 3);
+  h.record(500);     // <= 1 ms
+  h.record(1000);    // bounds are inclusive
+  h.record(20000);   // <= 100 ms
+  h.record(2000000); // +Inf
+
+  std::string out;
+  PromWriter w(toString, &out);
+  w.family("uplink_sent_total", "counter", "Messages delivered.");
+  w.sample("uplink_sent_total", "protocol=\"http\"", sent.value());
+  w.family("uplink_seconds", "histogram", "Uplink latency.");
+  w.histogram("uplink_seconds", "protocol=\"http\"", h);
+  w.family("uptime_seconds", "gauge", "Seconds since boot.");
+  w.sample("uptime_seconds", nullptr, 12.5);
+
+  const char *want = "# HELP uplink_sent_total Messages delivered.\n"
+                     "# TYPE uplink_sent_total counter\n"
+                     "uplink_sent_total{protocol=\"http\"} 3\n"
+                     "# HELP uplink_seconds Uplink latency.\n"
+                     "# TYPE uplink_seconds histogram\n"
+                     "uplink_seconds_bucket{protocol=\"http\",le=\"0.001\"} 2\n"
+                     "uplink_seconds_bucket{protocol=\"http\",le=\"0.01\"} 2\n"
+                     "uplink_seconds_bucket{protocol=\"http\",le=\"0.1\"} 3\n"
+                     "uplink_seconds_bucket{protocol=\"http\",le=\"+Inf\"} 4\n"
+                     "uplink_seconds_sum{protocol=\"http\"} 2.021\n"
+                     "uplink_seconds_count{protocol=\"http\"} 4\n"
+                     "# HELP uptime_seconds Seconds since boot.\n"
+                     "# TYPE uptime_seconds gauge\n"
+                     "uptime_seconds 12.5\n";
+  TEST_ASSERT_EQUAL_STRING(want, out.c_str());
+  TEST_ASSERT_EQUAL(out.size(), w.bytes());
+}
+
+void test_sum_keeps_sub_ms()
+{
+  LatencyHistogram h(kBounds, 3);
+  for (int i = 0; i < 1000; i++)
+    h.record(250);
+  TEST_ASSERT_EQUAL_UINT32(250, h.sumMs());
+  h.record(1999);
+  TEST_ASSERT_EQUAL_UINT32(251, h.sumMs()); // remainder 999 µs carried
+  h.record(1);
+  TEST_ASSERT_EQUAL_UINT32(252, h.sumMs());
+}
+
+// Counts "<name>_bucket{le="+Inf"} N" and "<name>_count N" in one scrape.
+static bool consistent(const std::string &text)
+{
+  size_t a = text.find("le=\"+Inf\"} ");
+  size_t b = text.find("loop_seconds_count ");
+  if (a == std::string::npos || b == std::string::npos)
+    return false;
+  return strtoul(text.c_str() + a + 11, nullptr, 10) == strtoul(text.c_str() + b + 19, nullptr, 10);
+}
+
+void test_scrape_during_writes()
+{
+  static LatencyHistogram h(kBounds, 3);
+  std::atomic<bool> stop{false};
+  std::thread writer([&]
+                     {
+    uint32_t x = 1;
+    while (!stop) {
+      x = x * 1103515245u + 12345u;
+      h.record(x % 200000);
+    } });
+
+  uint32_t scrapes = 0, bad = 0;
+  auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+  while (std::chrono::steady_clock::now() < until)
+  {
+    std::string out;
+    PromWriter w(toString, &out);
+    w.histogram("loop_seconds", nullptr, h);
+    bad += !consistent(out);
+    scrapes++;
+  }
+  stop = true;
+  writer.join();
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%u scrapes during writes", scrapes);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, bad);
+}
+
+void test_record_cost()
+{
+  static LatencyHistogram h(kBounds, 3);
+  MetricCounter c;
+  const uint32_t n = 5000000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++)
+    h.record(i & 0x3FFFF);
+  auto t1 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++)
+    c.add();
+  auto t2 = std::chrono::steady_clock::now();
+  double recNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+  double addNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / n;
+  char msg[96];
+  snprintf(msg, sizeof(msg), "histogram record %.1f ns, counter add %.1f ns (host)", recNs, addNs);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(n, c.value());
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_text_format);
+  RUN_TEST(test_sum_keeps_sub_ms);
+  RUN_TEST(test_scrape_during_writes);
+  RUN_TEST(test_record_cost);
+  return UNITY_END();
+}
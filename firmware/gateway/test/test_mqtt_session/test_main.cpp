@@ -0,0 +1,260 @@
+/*********************************************************************
+ * Host test + benchmark: MqttSession (uplink MQTT state machine)
+ * -------------------------------------------------------
+ * • First connect is immediate; failures back off with equal jitter,
+ *   doubling up to the cap, and a connect resets the backoff
+ * • A lost link is noticed on the next step and reconnected; the
+ *   reconnect latency runs from loss to connect
+ * • Keepalive (poll) is serviced only while connected; stop() is final
+ * • Batch writer: JSON array, overflow leaves the buffer unchanged
+ * • Sustained publish rate, one message per publish against coalesced
+ *   batches, over a fake broker charging a fixed cost per publish
+ * • Reconnect latency over a flaky broker (connects fail 30% of the time)
+ * Run: pio test -e native -f test_mqtt_session -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <MqttSession.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct FakeBroker
+  {
+    bool up = false;       // link state
+    bool accept = true;    // next connect succeeds
+    uint32_t connects = 0; // attempts
+    uint32_t polls = 0;
+    std::mt19937 *rng = nullptr;
+    uint32_t failPercent = 0; // random connect failures when rng is set
+  };
+
+  bool fakeConnect(void *ctx)
+  {
+    FakeBroker *b = (FakeBroker *)ctx;
+    b->connects++;
+    bool ok = b->accept;
+    if (b->rng)
+      ok = (*b->rng)() % 100 >= b->failPercent;
+    b->up = ok;
+    return ok;
+  }
+  bool fakeConnected(void *ctx) { return ((FakeBroker *)ctx)->up; }
+  void fakePoll(void *ctx) { ((FakeBroker *)ctx)->polls++; }
+
+  MqttTransport transport(FakeBroker &b) { return {fakeConnect, fakeConnected, fakePoll, &b}; }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_backoff()
+{
+  FakeBroker b;
+  b.accept = false;
+  MqttSessionConfig cfg;
+  cfg.backoffMinMs = 1000;
+  cfg.backoffMaxMs = 8000;
+  MqttSession s;
+  s.begin(transport(b), cfg, 12345, 0);
+  TEST_ASSERT_EQUAL(MqttSession::WAITING, s.state());
+
+  uint32_t now = 0;
+  const uint32_t ceilings[] = {1000, 2000, 4000, 8000, 8000, 8000};
+  for (uint32_t ceiling : ceilings)
+  {
+    TEST_ASSERT_EQUAL(MqttSession::FAILED, s.step(now));
+    uint32_t wait = s.retryInMs(now);
+    TEST_ASSERT_TRUE(wait >= ceiling / 2 && wait <= ceiling);
+    TEST_ASSERT_EQUAL(MqttSession::NONE, s.step(now + wait - 1)); // not due yet
+    now += wait;
+  }
+  TEST_ASSERT_EQUAL_UINT32(6, b.connects);
+  TEST_ASSERT_EQUAL_UINT32(0, b.polls);
+
+  b.accept = true;
+  TEST_ASSERT_EQUAL(MqttSession::UP, s.step(now));
+  TEST_ASSERT_TRUE(s.connected());
+  TEST_ASSERT_EQUAL_UINT32(now, s.lastReconnectMs());
+
+  // After a connect the backoff starts over.
+  b.up = false;
+  b.accept = false;
+  TEST_ASSERT_EQUAL(MqttSession::LOST, s.step(now + 10));
+  TEST_ASSERT_EQUAL(MqttSession::FAILED, s.step(now + 10));
+  TEST_ASSERT_TRUE(s.retryInMs(now + 10) <= 1000);
+}
+
+// Two gateways seeded differently do not retry in lockstep.
+void test_jitter_spreads()
+{
+  FakeBroker a, b;
+  a.accept = b.accept = false;
+  MqttSession sa, sb;
+  sa.begin(transport(a), MqttSessionConfig(), 1, 0);
+  sb.begin(transport(b), MqttSessionConfig(), 2, 0);
+  uint32_t same = 0;
+  for (int i = 0; i < 8; i++)
+  {
+    sa.step(0);
+    sb.step(0);
+    same += sa.retryInMs(0) == sb.retryInMs(0);
+    sa.begin(transport(a), MqttSessionConfig(), 1 + i * 7919, 0);
+    sb.begin(transport(b), MqttSessionConfig(), 2 + i * 104729, 0);
+  }
+  TEST_ASSERT_LESS_THAN(2, same);
+}
+
+void test_loss_and_keepalive()
+{
+  FakeBroker b;
+  MqttSession s;
+  s.begin(transport(b), MqttSessionConfig(), 7, 100);
+  TEST_ASSERT_EQUAL(MqttSession::UP, s.step(100)); // first connect is immediate
+  TEST_ASSERT_EQUAL_UINT32(0, s.lastReconnectMs());
+  for (uint32_t t = 200; t < 1000; t += 100)
+    TEST_ASSERT_EQUAL(MqttSession::NONE, s.step(t));
+  TEST_ASSERT_EQUAL_UINT32(8, b.polls);
+
+  b.up = false; // broker dropped us
+  TEST_ASSERT_EQUAL(MqttSession::LOST, s.step(1000));
+  TEST_ASSERT_FALSE(s.connected());
+  b.accept = false;
+  TEST_ASSERT_EQUAL(MqttSession::FAILED, s.step(1000));
+  uint32_t retry = 1000 + s.retryInMs(1000);
+  b.accept = true;
+  TEST_ASSERT_EQUAL(MqttSession::UP, s.step(retry));
+  TEST_ASSERT_EQUAL_UINT32(retry - 1000, s.lastReconnectMs());
+  TEST_ASSERT_EQUAL_UINT32(1, s.stats().losses);
+  TEST_ASSERT_EQUAL_UINT32(3, s.stats().attempts);
+  TEST_ASSERT_EQUAL_UINT32(2, s.stats().connects);
+
+  s.published(5);
+  s.published(1);
+  s.publishFailed();
+  TEST_ASSERT_EQUAL_UINT32(2, s.stats().publishes);
+  TEST_ASSERT_EQUAL_UINT32(6, s.stats().messages);
+  TEST_ASSERT_EQUAL_UINT32(1, s.stats().publishFailures);
+
+  s.stop();
+  uint32_t polls = b.polls;
+  TEST_ASSERT_EQUAL(MqttSession::NONE, s.step(retry + 100));
+  TEST_ASSERT_EQUAL_UINT32(polls, b.polls);
+  TEST_ASSERT_FALSE(s.connected());
+}
+
+void test_batch_writer()
+{
+  char buf[18];
+  MqttBatchWriter w(buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(0, w.finish());
+  TEST_ASSERT_TRUE(w.add("{\"a\":1}", 7));
+  TEST_ASSERT_TRUE(w.add("{\"b\":2}", 7)); // exactly fills "[..,..]" + NUL
+  TEST_ASSERT_FALSE(w.add("{}", 2));
+  TEST_ASSERT_EQUAL(2, w.count());
+  TEST_ASSERT_EQUAL(17, w.finish());
+  TEST_ASSERT_EQUAL_STRING("[{\"a\":1},{\"b\":2}]", buf);
+}
+
+// Queued messages drained by the uplink task over a broker that charges a
+// fixed per-publish cost (TLS record + round trip) plus a per-byte cost.
+// Compares one message per publish with MQTT_BATCH-style coalescing.
+void bench_publish_rate()
+{
+  const double perPublishUs = 2500, perByteUs = 0.8; // modelled link, not measured
+  const uint32_t messages = 20000;
+  std::string msg = "{\"deviceId\":\"node-0001\",\"battery\":3.71,\"rssi\":-71,\"meshHopCount\":2,\"Soil1\":43.5}";
+  static char batch[4096];
+  const uint32_t batchSizes[] = {1, 4, 16};
+  for (uint32_t perBatch : batchSizes)
+  {
+    FakeBroker b;
+    MqttSession s;
+    s.begin(transport(b), MqttSessionConfig(), 3, 0);
+    s.step(0);
+    double linkUs = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t sent = 0; sent < messages;)
+    {
+      MqttBatchWriter w(batch, sizeof(batch));
+      uint32_t n = 0;
+      while (n < perBatch && sent + n < messages && w.add(msg.data(), msg.size()))
+        n++;
+      size_t len = perBatch == 1 ? msg.size() : w.finish();
+      linkUs += perPublishUs + perByteUs * len;
+      s.published(n);
+      s.step(0);
+      sent += n;
+    }
+    double cpuUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    TEST_ASSERT_EQUAL_UINT32(messages, s.stats().messages);
+
+    char out[160];
+    snprintf(out, sizeof(out), "%2u msg/publish: %u publishes, %.0f msg/s over the modelled link, %.3f us CPU/msg (host)",
+             (unsigned)perBatch, (unsigned)s.stats().publishes, messages / (linkUs / 1e6 + cpuUs / 1e6),
+             cpuUs / messages);
+    TEST_MESSAGE(out);
+  }
+}
+
+// Broker outages: each outage ends after a random 0–20 s, connects during it
+// fail, and after it fail 30% of the time. Steps every 100 ms like the
+// uplink task.
+void bench_reconnect_latency()
+{
+  std::mt19937 rng(99);
+  FakeBroker b;
+  MqttSessionConfig cfg;
+  MqttSession s;
+  s.begin(transport(b), cfg, 4242, 0);
+  uint32_t now = 0;
+  s.step(now);
+  std::vector<uint32_t> latencies;
+  for (int outage = 0; outage < 500; outage++)
+  {
+    now += 1000 + rng() % 60000;
+    b.up = false;
+    uint32_t healsAt = now + rng() % 20000;
+    while (true)
+    {
+      b.rng = now >= healsAt ? &rng : nullptr;
+      b.failPercent = 30;
+      b.accept = false;
+      if (s.step(now) == MqttSession::UP)
+        break;
+      now += 100;
+    }
+    b.rng = nullptr;
+    latencies.push_back(s.lastReconnectMs());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto pct = [&](double p) { return latencies[(size_t)(p * (latencies.size() - 1))]; };
+  TEST_ASSERT_EQUAL_UINT32(501, s.stats().connects);
+  TEST_ASSERT_EQUAL_UINT32(500, s.stats().losses);
+
+  char out[200];
+  snprintf(out, sizeof(out),
+           "reconnect after outage: p50 %u ms, p95 %u ms, max %u ms; %u attempts for %u outages (host, simulated time)",
+           (unsigned)pct(0.50), (unsigned)pct(0.95), (unsigned)latencies.back(), (unsigned)s.stats().attempts,
+           (unsigned)latencies.size());
+  TEST_MESSAGE(out);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_backoff);
+  RUN_TEST(test_jitter_spreads);
+  RUN_TEST(test_loss_and_keepalive);
+  RUN_TEST(test_batch_writer);
+  RUN_TEST(bench_publish_rate);
+  RUN_TEST(bench_reconnect_latency);
+  return UNITY_END();
+}
@@ -0,0 +1,133 @@
+/*********************************************************************
+ * Host test: NodeSampleLog (deep-sleep sample batching)
+ * -------------------------------------------------------
+ * • Ring order / drop-oldest, CRC validity across "wakes"
+ * • Threshold crossing against the last transmitted values
+ * • Simulated day of wakes: radio-on time per sample, send-every-wake
+ *   vs batched (same radio cost model for both)
+ *********************************************************************/
+
+#include <unity.h>
+#include <NodeSampleLog.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  typedef NodeSampleLog<32, 8> Log;
+
+  NodeSampleReading moisture(uint8_t sensor, float pct)
+  {
+    NodeSampleReading r;
+    r.tag = (uint8_t)(sensor << 2 | FIELD_MOISTURE);
+    r.raw = telemetryScale(FIELD_MOISTURE, pct);
+    return r;
+  }
+
+  const int16_t kDelta[FIELD_COUNT] = {500, 100, 500, 20}; // 5 %, 1 °C, 5 %RH, 2 hPa
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_ring_and_crc()
+{
+  static Log log; // zeroed like RTC memory on cold boot
+  TEST_ASSERT_FALSE(log.valid());
+  log.reset();
+  TEST_ASSERT_TRUE(log.valid());
+
+  for (uint32_t i = 0; i < 40; i++)
+  {
+    NodeSampleReading r = moisture(0, (float)i);
+    TEST_ASSERT_EQUAL(i < 32, log.append(i * 60, &r, 1));
+    log.seal();
+  }
+  TEST_ASSERT_TRUE(log.full());
+  TEST_ASSERT_EQUAL_UINT32(8 * 60, log.at(0).t); // 8 oldest dropped
+  TEST_ASSERT_EQUAL_UINT32(39 * 60, log.at(31).t);
+  TEST_ASSERT_TRUE(log.valid());
+
+  ((uint8_t *)&log)[20] ^= 1; // bit flip in RTC memory
+  TEST_ASSERT_FALSE(log.valid());
+}
+
+void test_threshold_against_last_sent()
+{
+  static Log log;
+  log.reset();
+  NodeSampleReading r = moisture(2, 40.0f);
+  TEST_ASSERT_TRUE(log.crossed(&r, 1, kDelta)); // never sent
+  log.append(0, &r, 1);
+  log.markSent();
+  TEST_ASSERT_EQUAL(0, log.count);
+
+  r = moisture(2, 44.0f);
+  TEST_ASSERT_FALSE(log.crossed(&r, 1, kDelta));
+  r = moisture(2, 34.9f);
+  TEST_ASSERT_TRUE(log.crossed(&r, 1, kDelta));
+
+  const int16_t off[FIELD_COUNT] = {0, 0, 0, 0};
+  TEST_ASSERT_FALSE(log.crossed(&r, 1, off));
+}
+
+void test_batch_due()
+{
+  static Log log;
+  log.reset();
+  NodeSampleReading r = moisture(0, 50.0f);
+  for (int i = 0; i < 9; i++)
+  {
+    log.append(i, &r, 1);
+    TEST_ASSERT_FALSE(log.due(10));
+  }
+  log.append(9, &r, 1);
+  TEST_ASSERT_TRUE(log.due(10));
+}
+
+// Rough radio cost per transmission on a node: Wi-Fi + mesh join, then
+// one broadcast per message. Sampling without the radio costs nothing here.
+void bench_radio_on_per_sample()
+{
+  const double joinMs = 3500, perMessageMs = 40, settleMs = 3000;
+  const int wakes = 1440; // one day at 60 s
+  const uint16_t batches[] = {1, 10, 30};
+  for (uint16_t batch : batches)
+  {
+    static Log log;
+    log.reset();
+    double radioMs = 0;
+    int sends = 0;
+    for (int w = 0; w < wakes; w++)
+    {
+      // Slow drift plus one watering event at noon.
+      float pct = 45.0f - w * 0.002f + (w >= 720 && w < 725 ? 20.0f : 0.0f);
+      NodeSampleReading r = moisture(0, pct);
+      bool crossed = log.crossed(&r, 1, kDelta);
+      log.append((uint32_t)w * 60, &r, 1);
+      if (crossed || log.due(batch))
+      {
+        radioMs += joinMs + settleMs + perMessageMs * (batch > 1 ? 1 : log.count);
+        sends++;
+        log.markSent();
+      }
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "batch %2u: %4d radio sessions/day, %.0f ms radio-on per sample",
+             batch, sends, radioMs / wakes);
+    TEST_MESSAGE(msg);
+    if (batch == 10)
+      TEST_ASSERT_LESS_THAN(wakes / 8, sends);
+  }
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_and_crc);
+  RUN_TEST(test_threshold_against_last_sent);
+  RUN_TEST(test_batch_due);
+  RUN_TEST(bench_radio_on_per_sample);
+  return UNITY_END();
+}
@@ -0,0 +1,390 @@
+/*********************************************************************
+ * Host test + benchmark: OtaUpdate (conditional check, resumable download)
+ * -------------------------------------------------------
+ * • Versions compare numerically per part; hex digests parse strictly
+ * • otaDecide: newer version only; a plain image URL by ETag; gives up
+ *   on an image after OTA_MAX_FAILURES, a new image resets that
+ * • Cache is rejected when zeroed or corrupted
+ * • Download resumes with Range after drops; a server that ignores
+ *   Range is read past the flashed bytes; the flash gets the exact image
+ * • Hash mismatch, HTTP errors, an image changed mid-download and too
+ *   many drops abort the update without committing
+ * • Bytes per boot: probe + conditional download against an
+ *   unconditional image fetch; bytes fetched over a flaky link with and
+ *   without Range support
+ * Run: pio test -e native -f test_ota_update -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <OtaUpdate.h>
+
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+  // Stand-in digest (the firmware uses mbedtls SHA-256): the code under
+  // test only hashes the written bytes in order and compares.
+  struct TestHash
+  {
+    uint8_t d[OTA_SHA256_BYTES];
+    uint32_t n;
+    void start()
+    {
+      memset(d, 0, sizeof(d));
+      n = 0;
+    }
+    void update(const uint8_t *p, size_t len)
+    {
+      for (size_t i = 0; i < len; i++, n++)
+        d[n % OTA_SHA256_BYTES] = (uint8_t)(d[n % OTA_SHA256_BYTES] * 31 + p[i] + 1);
+    }
+  };
+
+  struct FakeOta
+  {
+    std::vector<uint8_t> image;
+    bool ranges = true;         // server honours Range
+    int status = 0;             // forced status for every open, 0 = normal
+    uint32_t dropAfter = 0;     // body bytes per connection before it drops, 0 = never
+    uint32_t dropOpens = ~0u;   // ...on the first n connections only
+    uint32_t dropPerMille = 0;  // or: chance per read that the connection drops
+    std::mt19937 *rng = nullptr;
+    uint32_t changeAtOpen = 0;  // open #n reports a different total
+    uint32_t slotBytes = 1 << 21;
+
+    uint32_t opens = 0, pos = 0, sent = 0;
+    bool connected = false;
+    std::vector<uint8_t> flash;
+    bool begun = false, committed = false, aborted = false;
+    uint32_t waitedMs = 0;
+    TestHash hash;
+  };
+
+  int fakeOpen(void *ctx, const char *, uint32_t offset, uint32_t &total)
+  {
+    FakeOta &f = *(FakeOta *)ctx;
+    f.opens++;
+    if (f.status)
+      return f.status;
+    total = (uint32_t)f.image.size() + (f.changeAtOpen == f.opens ? 1 : 0);
+    f.connected = true;
+    f.sent = 0;
+    f.pos = f.ranges ? offset : 0;
+    return offset && f.ranges ? 206 : 200;
+  }
+
+  int fakeRead(void *ctx, uint8_t *buf, size_t cap)
+  {
+    FakeOta &f = *(FakeOta *)ctx;
+    if (!f.connected || f.pos >= f.image.size())
+      return -1;
+    bool drops = f.dropAfter && f.opens <= f.dropOpens;
+    if (drops && f.sent >= f.dropAfter)
+      return -1;
+    if (f.rng && f.dropPerMille && (*f.rng)() % 1000 < f.dropPerMille)
+      return -1;
+    size_t n = f.image.size() - f.pos;
+    n = n < cap ? n : cap;
+    if (drops && n > f.dropAfter - f.sent)
+      n = f.dropAfter - f.sent;
+    memcpy(buf, f.image.data() + f.pos, n);
+    f.pos += (uint32_t)n;
+    f.sent += (uint32_t)n;
+    return (int)n;
+  }
+
+  void fakeClose(void *ctx) { ((FakeOta *)ctx)->connected = false; }
+
+  bool fakeBegin(void *ctx, uint32_t size)
+  {
+    FakeOta &f = *(FakeOta *)ctx;
+    if (size > f.slotBytes)
+      return false;
+    f.begun = true;
+    f.flash.clear();
+    return true;
+  }
+
+  bool fakeWrite(void *ctx, const uint8_t *data, size_t len)
+  {
+    FakeOta &f = *(FakeOta *)ctx;
+    f.flash.insert(f.flash.end(), data, data + len);
+    return true;
+  }
+
+  bool fakeEnd(void *ctx, bool commit)
+  {
+    FakeOta &f = *(FakeOta *)ctx;
+    (commit ? f.committed : f.aborted) = true;
+    return true;
+  }
+
+  void fakeHashStart(void *ctx) { ((FakeOta *)ctx)->hash.start(); }
+  void fakeHashUpdate(void *ctx, const uint8_t *p, size_t len) { ((FakeOta *)ctx)->hash.update(p, len); }
+  void fakeHashFinish(void *ctx, uint8_t out[OTA_SHA256_BYTES]) { memcpy(out, ((FakeOta *)ctx)->hash.d, OTA_SHA256_BYTES); }
+  void fakeWait(void *ctx, uint32_t ms) { ((FakeOta *)ctx)->waitedMs += ms; }
+
+  OtaIo ioFor(FakeOta &f)
+  {
+    return {fakeOpen, fakeRead, fakeClose, fakeBegin, fakeWrite, fakeEnd,
+            fakeHashStart, fakeHashUpdate, fakeHashFinish, fakeWait, &f};
+  }
+
+  std::vector<uint8_t> makeImage(size_t n, uint32_t seed)
+  {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> v(n);
+    for (auto &b : v)
+      b = (uint8_t)rng();
+    return v;
+  }
+
+  void manifestFor(const std::vector<uint8_t> &image, OtaManifest &m)
+  {
+    memset(&m, 0, sizeof(m));
+    strcpy(m.version, "1.4.0");
+    strcpy(m.url, "https://example.com/fw.bin");
+    strcpy(m.etag, "\"m1\"");
+    TestHash h;
+    h.start();
+    h.update(image.data(), image.size());
+    memcpy(m.sha256, h.d, OTA_SHA256_BYTES);
+    m.hasSha = true;
+    m.size = (uint32_t)image.size();
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_versions()
+{
+  TEST_ASSERT_TRUE(otaCompareVersions("1.3.10", "1.3.9") > 0);
+  TEST_ASSERT_TRUE(otaCompareVersions("1.3.4", "1.4") < 0);
+  TEST_ASSERT_EQUAL_INT(0, otaCompareVersions("1.3", "1.3.0"));
+  TEST_ASSERT_EQUAL_INT(0, otaCompareVersions("1.3.4", "1.3.4-dev"));
+  TEST_ASSERT_TRUE(otaCompareVersions("2", "1.99.99") > 0);
+
+  uint8_t out[2];
+  TEST_ASSERT_TRUE(otaParseHex("0aFf", out, 2));
+  TEST_ASSERT_EQUAL_HEX8(0x0a, out[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xff, out[1]);
+  TEST_ASSERT_FALSE(otaParseHex("0aF", out, 2));
+  TEST_ASSERT_FALSE(otaParseHex("0aFg", out, 2));
+}
+
+void test_decide_and_cache()
+{
+  static OtaCache cache; // zeroed like fresh NVS
+  TEST_ASSERT_FALSE(cache.valid());
+  OtaManifest m;
+  manifestFor(makeImage(100, 1), m);
+
+  TEST_ASSERT_EQUAL_UINT8(OTA_DOWNLOAD, otaDecide(m, "1.3.4", cache));
+  TEST_ASSERT_EQUAL_UINT8(OTA_UP_TO_DATE, otaDecide(m, "1.4.0", cache));
+  TEST_ASSERT_EQUAL_UINT8(OTA_UP_TO_DATE, otaDecide(m, "1.5", cache)); // no downgrades
+
+  // The same image failing again and again is left alone...
+  cache.clear();
+  cache.last = m;
+  cache.failures = OTA_MAX_FAILURES;
+  cache.seal();
+  TEST_ASSERT_TRUE(cache.valid());
+  TEST_ASSERT_EQUAL_UINT8(OTA_GIVE_UP, otaDecide(m, "1.3.4", cache));
+  // ...until the manifest names another one.
+  OtaManifest fixed = m;
+  fixed.sha256[0] ^= 1;
+  TEST_ASSERT_EQUAL_UINT8(OTA_DOWNLOAD, otaDecide(fixed, "1.3.4", cache));
+
+  // Plain image URL: keyed on its ETag.
+  OtaManifest plain;
+  memset(&plain, 0, sizeof(plain));
+  strcpy(plain.url, "https://example.com/fw.bin");
+  TEST_ASSERT_EQUAL_UINT8(OTA_UP_TO_DATE, otaDecide(plain, "1.3.4", cache)); // no ETag
+  strcpy(plain.etag, "\"abc\"");
+  TEST_ASSERT_EQUAL_UINT8(OTA_DOWNLOAD, otaDecide(plain, "1.3.4", cache));
+  strcpy(cache.installedEtag, "\"abc\"");
+  cache.seal();
+  TEST_ASSERT_EQUAL_UINT8(OTA_UP_TO_DATE, otaDecide(plain, "1.3.4", cache));
+
+  ((uint8_t *)&cache)[20] ^= 0x40;
+  TEST_ASSERT_FALSE(cache.valid());
+}
+
+void test_download_resumes()
+{
+  static uint8_t buf[1024];
+  FakeOta f;
+  f.image = makeImage(50000, 2);
+  OtaManifest m;
+  manifestFor(f.image, m);
+  f.dropAfter = 12000;
+  OtaIo io = ioFor(f);
+  OtaDownload d;
+  TEST_ASSERT_EQUAL_UINT8(OTA_OK, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(f.committed);
+  TEST_ASSERT_TRUE(f.flash == f.image);
+  TEST_ASSERT_EQUAL_UINT8(4, d.stats().resumes);
+  TEST_ASSERT_EQUAL_UINT8(0, d.stats().restarts);
+  TEST_ASSERT_EQUAL_UINT32(50000, d.stats().fetched);
+  TEST_ASSERT_EQUAL_UINT32(2000 + 4000 + 8000 + 16000, f.waitedMs);
+
+  // No Range support: every reconnect starts at byte 0, the flashed part
+  // is skipped.
+  FakeOta g;
+  g.image = f.image;
+  g.ranges = false;
+  g.dropAfter = 30000;
+  g.dropOpens = 1;
+  io = ioFor(g);
+  TEST_ASSERT_EQUAL_UINT8(OTA_OK, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(g.flash == g.image);
+  TEST_ASSERT_EQUAL_UINT8(1, d.stats().restarts);
+  TEST_ASSERT_EQUAL_UINT32(30000 + 50000, d.stats().fetched);
+
+  // Size from the response when the manifest has none.
+  FakeOta h;
+  h.image = f.image;
+  m.size = 0;
+  io = ioFor(h);
+  TEST_ASSERT_EQUAL_UINT8(OTA_OK, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(h.flash == h.image);
+}
+
+void test_download_failures()
+{
+  static uint8_t buf[1024];
+  OtaManifest m;
+  OtaDownload d;
+
+  FakeOta bad;
+  bad.image = makeImage(20000, 3);
+  manifestFor(bad.image, m);
+  bad.image[777] ^= 0x01; // corrupted on the server
+  OtaIo io = ioFor(bad);
+  TEST_ASSERT_EQUAL_UINT8(OTA_HASH_MISMATCH, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(bad.aborted);
+  TEST_ASSERT_FALSE(bad.committed);
+
+  FakeOta missing;
+  missing.image = makeImage(20000, 3);
+  missing.status = 404;
+  io = ioFor(missing);
+  TEST_ASSERT_EQUAL_UINT8(OTA_HTTP_ERROR, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_FALSE(missing.begun);
+  TEST_ASSERT_EQUAL_UINT32(1, missing.opens);
+
+  FakeOta offline;
+  offline.status = -1;
+  io = ioFor(offline);
+  TEST_ASSERT_EQUAL_UINT8(OTA_HTTP_ERROR, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_UINT32(6, offline.opens); // first try + maxResumes
+
+  FakeOta republished;
+  republished.image = makeImage(20000, 3);
+  manifestFor(republished.image, m);
+  republished.dropAfter = 8000;
+  republished.changeAtOpen = 2;
+  io = ioFor(republished);
+  TEST_ASSERT_EQUAL_UINT8(OTA_SIZE_MISMATCH, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(republished.aborted);
+
+  FakeOta flaky;
+  flaky.image = republished.image;
+  flaky.dropAfter = 1000;
+  io = ioFor(flaky);
+  TEST_ASSERT_EQUAL_UINT8(OTA_NETWORK_ERROR, d.run(io, m, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(flaky.aborted);
+
+  FakeOta big;
+  big.image = republished.image;
+  big.slotBytes = 10000;
+  io = ioFor(big);
+  TEST_ASSERT_EQUAL_UINT8(OTA_FLASH_ERROR, d.run(io, m, buf, sizeof(buf)));
+}
+
+// Bytes over the uplink: 30 boots, two releases. Unconditional: every boot
+// fetches the image. Conditional: a manifest probe per boot (304 once the
+// ETag is cached) and the image only for a new version.
+void bench_bytes_per_boot()
+{
+  const uint32_t imageBytes = 1200000, manifestBytes = 180, headerBytes = 250, boots = 30;
+  uint64_t unconditional = 0, conditional = 0;
+  static OtaCache cache;
+  cache.clear();
+  cache.seal();
+  char running[24] = "1.3.4";
+  for (uint32_t boot = 0; boot < boots; boot++)
+  {
+    unconditional += headerBytes + imageBytes;
+    OtaManifest m;
+    memset(&m, 0, sizeof(m));
+    strcpy(m.url, "https://example.com/fw.bin");
+    strcpy(m.version, boot < 10 ? "1.3.4" : boot < 20 ? "1.3.5" : "1.4.0");
+    snprintf(m.etag, sizeof(m.etag), "\"%s\"", m.version);
+    conditional += headerBytes;
+    if (cache.last.etag[0] && !strcmp(cache.last.etag, m.etag))
+      m = cache.last; // 304: no body
+    else
+      conditional += manifestBytes;
+    cache.last = m;
+    cache.seal();
+    if (otaDecide(m, running, cache) == OTA_DOWNLOAD)
+    {
+      conditional += headerBytes + imageBytes;
+      strcpy(running, m.version);
+    }
+  }
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%u boots, 2 releases: unconditional %.1f MB, probe first %.2f MB (simulated)",
+           (unsigned)boots, unconditional / 1e6, conditional / 1e6);
+  TEST_MESSAGE(msg);
+}
+
+// A 1.2 MB image over a link that drops on 0.3% of the 1 KB reads (about
+// every 330 KB). Without Range every reconnect re-reads from byte 0.
+void bench_flaky_link()
+{
+  static uint8_t buf[1024];
+  std::mt19937 rng(7);
+  OtaDownloadConfig cfg;
+  cfg.maxResumes = 200;
+  cfg.backoffMs = 0;
+  for (int ranges = 1; ranges >= 0; ranges--)
+  {
+    FakeOta f;
+    f.image = makeImage(1200000, 4);
+    OtaManifest m;
+    manifestFor(f.image, m);
+    f.ranges = ranges;
+    f.rng = &rng;
+    f.dropPerMille = 3;
+    OtaIo io = ioFor(f);
+    OtaDownload d;
+    OtaResult r = d.run(io, m, buf, sizeof(buf), cfg);
+    if (ranges)
+      TEST_ASSERT_EQUAL_UINT8(OTA_OK, r);
+    if (r == OTA_OK)
+      TEST_ASSERT_TRUE(f.flash == f.image);
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s: %s after %u drops, %.2f MB fetched for a %.2f MB image (simulated)",
+             ranges ? "Range resume" : "no Range", otaResultName(r), d.stats().resumes,
+             d.stats().fetched / 1e6, f.image.size() / 1e6);
+    TEST_MESSAGE(msg);
+  }
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_versions);
+  RUN_TEST(test_decide_and_cache);
+  RUN_TEST(test_download_resumes);
+  RUN_TEST(test_download_failures);
+  RUN_TEST(bench_bytes_per_boot);
+  RUN_TEST(bench_flaky_link);
+  return UNITY_END();
+}
@@ -0,0 +1,155 @@
+/*********************************************************************
+ * Host test: PushFanout (live push to web clients)
+ * -------------------------------------------------------
+ * • Every client gets each event once, in order, plus the latest sample
+ * • A busy client gets only the newest sample once it drains (coalesced)
+ * • A client that lags a whole event ring skips the overwritten events
+ * • Client limit
+ *********************************************************************/
+
+#include <unity.h>
+#include <PushFanout.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct FakeTransport
+  {
+    std::set<uint32_t> busy;
+    std::map<uint32_t, std::vector<std::string>> got;
+  };
+
+  bool ready(uint32_t client, void *ctx)
+  {
+    return ((FakeTransport *)ctx)->busy.count(client) == 0;
+  }
+
+  bool send(uint32_t client, const char *data, size_t len, void *ctx)
+  {
+    ((FakeTransport *)ctx)->got[client].push_back(std::string(data, len));
+    return true;
+  }
+
+  PushFanoutConfig smallConfig()
+  {
+    PushFanoutConfig cfg;
+    cfg.maxClients = 3;
+    cfg.eventSlots = 4;
+    cfg.eventBytes = 32;
+    cfg.latestBytes = 32;
+    return cfg;
+  }
+
+  void event(PushFanout &f, int i)
+  {
+    std::string s = "e" + std::to_string(i);
+    f.publishEvent(s.c_str(), s.size());
+  }
+
+  void latest(PushFanout &f, int i)
+  {
+    std::string s = "s" + std::to_string(i);
+    f.publishLatest(s.c_str(), s.size());
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_each_frame_once_per_client()
+{
+  PushFanout f;
+  TEST_ASSERT_TRUE(f.begin(smallConfig()));
+  FakeTransport t;
+  TEST_ASSERT_TRUE(f.addClient(1));
+  TEST_ASSERT_TRUE(f.addClient(2));
+
+  event(f, 0);
+  latest(f, 0);
+  event(f, 1);
+  TEST_ASSERT_EQUAL_UINT32(6, f.pump(ready, send, &t));
+  TEST_ASSERT_EQUAL_UINT32(0, f.pump(ready, send, &t)); // nothing new
+
+  std::vector<std::string> want = {"e0", "e1", "s0"};
+  TEST_ASSERT_TRUE(t.got[1] == want);
+  TEST_ASSERT_TRUE(t.got[2] == want);
+}
+
+void test_busy_client_gets_newest_sample_only()
+{
+  PushFanout f;
+  TEST_ASSERT_TRUE(f.begin(smallConfig()));
+  FakeTransport t;
+  f.addClient(1);
+  f.addClient(2);
+  t.busy.insert(2);
+
+  for (int i = 0; i < 10; i++)
+  {
+    latest(f, i);
+    f.pump(ready, send, &t);
+  }
+  TEST_ASSERT_EQUAL(10, t.got[1].size());
+  TEST_ASSERT_EQUAL(0, t.got[2].size());
+
+  t.busy.clear();
+  f.pump(ready, send, &t);
+  TEST_ASSERT_EQUAL(1, t.got[2].size());
+  TEST_ASSERT_EQUAL_STRING("s9", t.got[2][0].c_str());
+  TEST_ASSERT_EQUAL_UINT32(9, f.stats().coalesced);
+}
+
+void test_lagging_client_skips_overwritten_events()
+{
+  PushFanout f;
+  TEST_ASSERT_TRUE(f.begin(smallConfig()));
+  FakeTransport t;
+  f.addClient(7);
+  t.busy.insert(7);
+  for (int i = 0; i < 10; i++)
+    event(f, i);
+
+  t.busy.clear();
+  f.pump(ready, send, &t);
+  std::vector<std::string> want = {"e6", "e7", "e8", "e9"};
+  TEST_ASSERT_TRUE(t.got[7] == want);
+  TEST_ASSERT_EQUAL_UINT32(6, f.stats().skipped);
+}
+
+void test_client_limit_and_late_join()
+{
+  PushFanout f;
+  TEST_ASSERT_TRUE(f.begin(smallConfig()));
+  FakeTransport t;
+  event(f, 0);
+  latest(f, 0);
+  TEST_ASSERT_TRUE(f.addClient(1));
+  TEST_ASSERT_TRUE(f.addClient(2));
+  TEST_ASSERT_TRUE(f.addClient(3));
+  TEST_ASSERT_FALSE(f.addClient(4));
+  TEST_ASSERT_EQUAL_UINT32(1, f.stats().rejected);
+
+  // Joined after e0: only the current sample.
+  f.pump(ready, send, &t);
+  TEST_ASSERT_EQUAL(1, t.got[1].size());
+  TEST_ASSERT_EQUAL_STRING("s0", t.got[1][0].c_str());
+
+  f.removeClient(2);
+  TEST_ASSERT_EQUAL(2, f.clientCount());
+  TEST_ASSERT_TRUE(f.addClient(4));
+  TEST_ASSERT_FALSE(f.publishEvent("0123456789012345678901234567890123", 34));
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_each_frame_once_per_client);
+  RUN_TEST(test_busy_client_gets_newest_sample_only);
+  RUN_TEST(test_lagging_client_skips_overwritten_events);
+  RUN_TEST(test_client_limit_and_late_join);
+  return UNITY_END();
+}
@@ -0,0 +1,179 @@
+/*********************************************************************
+ * Host test + microbenchmark: sensor dispatch
+ * -------------------------------------------------------
+ * • Legacy path: walk sensors, compare Sensor::type strings per read,
+ *   collect DS18B20 pins into a std::set every cycle
+ * • Registry path: kind resolved once, function table indexed by kind
+ * Run: pio test -e native -f test_sensor_dispatch -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <SensorKind.h>
+
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+  volatile float g_sink;
+  volatile int g_raw = 1800;
+
+  float fakeRead(float base) { return base + (float)(g_raw & 1); }
+
+  struct LegacySensor
+  {
+    std::string name, type;
+    int pin;
+  };
+
+  struct TypedSensor
+  {
+    SensorKind kind;
+    int pin;
+  };
+
+  typedef void (*SampleFn)(const TypedSensor &, SensorSample &);
+
+  void sampleSoil(const TypedSensor &, SensorSample &o) { o.set(FIELD_MOISTURE, fakeRead(40)); }
+  void sampleDht(const TypedSensor &, SensorSample &o)
+  {
+    o.set(FIELD_TEMP, fakeRead(21));
+    o.set(FIELD_HUM, fakeRead(55));
+  }
+  void sampleDs(const TypedSensor &, SensorSample &o) { o.set(FIELD_TEMP, fakeRead(19)); }
+  void sampleBme(const TypedSensor &, SensorSample &o)
+  {
+    o.set(FIELD_TEMP, fakeRead(21));
+    o.set(FIELD_HUM, fakeRead(55));
+    o.set(FIELD_PRES, fakeRead(1013));
+  }
+  void sampleBmp(const TypedSensor &, SensorSample &o)
+  {
+    o.set(FIELD_TEMP, fakeRead(21));
+    o.set(FIELD_PRES, fakeRead(1013));
+  }
+
+  const SampleFn kTable[(uint8_t)SensorKind::COUNT] = {nullptr, sampleSoil, sampleDht, sampleDs, sampleBme, sampleBmp};
+
+  const char *const kTypes[] = {"cap_soil_moisture", "dht22", "ds18b20", "bme280", "bmp280"};
+
+  // Mirrors the if/else chain that used to live in loop() and /live_data.
+  void legacyCycle(const std::vector<LegacySensor> &sensors)
+  {
+    std::set<int> dsPins;
+    for (const auto &s : sensors)
+      if (s.type == "ds18b20")
+        dsPins.insert(s.pin);
+    g_sink = (float)dsPins.size();
+
+    for (const auto &s : sensors)
+    {
+      if (s.type == "cap_soil_moisture")
+        g_sink = fakeRead(40);
+      else if (s.type == "dht22")
+      {
+        g_sink = fakeRead(21);
+        g_sink = fakeRead(55);
+      }
+      else if (s.type == "ds18b20")
+        g_sink = fakeRead(19);
+      else if (s.type == "bme280")
+      {
+        g_sink = fakeRead(21);
+        g_sink = fakeRead(55);
+        g_sink = fakeRead(1013);
+      }
+      else if (s.type == "bmp280")
+      {
+        g_sink = fakeRead(21);
+        g_sink = fakeRead(1013);
+      }
+    }
+  }
+
+  void registryCycle(const std::vector<TypedSensor> &sensors)
+  {
+    SensorSample v;
+    for (const auto &s : sensors)
+    {
+      v.mask = 0;
+      kTable[(uint8_t)s.kind](s, v);
+      for (uint8_t f = 0; f < FIELD_COUNT; f++)
+        if (v.has((SensorField)f))
+          g_sink = v.value[f];
+    }
+  }
+
+  template <typename F>
+  double nsPerSensor(F fn, size_t sensors, int cycles)
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < cycles; i++)
+      fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)(cycles * sensors);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_kind_round_trip()
+{
+  for (uint8_t k = 1; k < (uint8_t)SensorKind::COUNT; k++)
+  {
+    SensorKind kind = (SensorKind)k;
+    TEST_ASSERT_TRUE(sensorKindFromString(sensorKindName(kind)) == kind);
+  }
+  TEST_ASSERT_TRUE(sensorKindFromString("dht11") == SensorKind::UNKNOWN);
+  TEST_ASSERT_TRUE(sensorKindFromString("") == SensorKind::UNKNOWN);
+  TEST_ASSERT_TRUE(sensorKindFromString(nullptr) == SensorKind::UNKNOWN);
+}
+
+void test_kind_fields()
+{
+  TEST_ASSERT_TRUE(sensorKindIsScalar(SensorKind::CAP_SOIL_MOISTURE));
+  TEST_ASSERT_TRUE(sensorKindIsScalar(SensorKind::DS18B20));
+  TEST_ASSERT_FALSE(sensorKindIsScalar(SensorKind::DHT22));
+  TEST_ASSERT_FALSE(sensorKindIsScalar(SensorKind::UNKNOWN));
+  TEST_ASSERT_EQUAL_UINT8(FIELD_BIT(FIELD_TEMP) | FIELD_BIT(FIELD_HUM) | FIELD_BIT(FIELD_PRES),
+                          sensorKindFields(SensorKind::BME280));
+  TEST_ASSERT_EQUAL_STRING("pres", sensorFieldName(FIELD_PRES));
+}
+
+void bench_dispatch()
+{
+  const size_t counts[] = {4, 16, 64};
+  for (size_t n : counts)
+  {
+    std::vector<LegacySensor> legacy;
+    std::vector<TypedSensor> typed;
+    for (size_t i = 0; i < n; i++)
+    {
+      const char *t = kTypes[i % 5];
+      legacy.push_back({"Sensor" + std::to_string(i), t, (int)(i % 4)});
+      typed.push_back({sensorKindFromString(t), (int)(i % 4)});
+    }
+    const int cycles = 200000 / (int)n;
+    double before = nsPerSensor([&]
+                                { legacyCycle(legacy); }, n, cycles);
+    double after = nsPerSensor([&]
+                               { registryCycle(typed); }, n, cycles);
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%3zu sensors: string chain %.1f ns/sensor, registry %.1f ns/sensor (x%.1f)",
+             n, before, after, before / after);
+    TEST_MESSAGE(msg);
+  }
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_kind_round_trip);
+  RUN_TEST(test_kind_fields);
+  RUN_TEST(bench_dispatch);
+  return UNITY_END();
+}
@@ -0,0 +1,122 @@
+/*********************************************************************
+ * Host test: SpscRing (lock-free SPSC, drop-oldest)
+ * -------------------------------------------------------
+ * • Single-threaded FIFO / overflow semantics
+ * • Two threads: fast producer, slow consumer – every delivered message
+ *   is intact and in order, and pushed == popped + dropped
+ *********************************************************************/
+
+#include <unity.h>
+#include <SpscRing.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+void setUp() {}
+void tearDown() {}
+
+void test_fifo_and_drop_oldest()
+{
+  SpscRing<4, 32> ring;
+  char buf[32];
+  for (int i = 0; i < 6; i++)
+  {
+    int n = snprintf(buf, sizeof(buf), "m%d", i);
+    TEST_ASSERT_TRUE(ring.push(buf, n));
+  }
+  // m0, m1 were overwritten.
+  for (int i = 2; i < 6; i++)
+  {
+    size_t n = ring.pop(buf, sizeof(buf));
+    buf[n] = '\0';
+    char want[8];
+    snprintf(want, sizeof(want), "m%d", i);
+    TEST_ASSERT_EQUAL_STRING(want, buf);
+  }
+  TEST_ASSERT_EQUAL(0, ring.pop(buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(ring.empty());
+  SpscRing<4, 32>::Stats st = ring.stats();
+  TEST_ASSERT_EQUAL_UINT32(6, st.pushed);
+  TEST_ASSERT_EQUAL_UINT32(4, st.popped);
+  TEST_ASSERT_EQUAL_UINT32(2, st.dropped);
+  TEST_ASSERT_EQUAL_UINT32(4, st.highWater);
+}
+
+void test_oversize_rejected()
+{
+  SpscRing<2, 8> ring;
+  char big[9] = {0};
+  TEST_ASSERT_FALSE(ring.push(big, sizeof(big)));
+  TEST_ASSERT_EQUAL_UINT32(1, ring.stats().oversize);
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+struct Msg
+{
+  uint32_t seq;
+  uint32_t check;
+  uint8_t fill[56];
+};
+
+void test_threads_intact_and_ordered()
+{
+  static SpscRing<8, sizeof(Msg)> ring;
+  const uint32_t total = 200000;
+
+  std::thread producer([&]
+                       {
+    Msg m;
+    for (uint32_t i = 1; i <= total; i++) {
+      m.seq = i;
+      memset(m.fill, (int)(i & 0xFF), sizeof(m.fill));
+      m.check = i * 2654435761u;
+      ring.push(&m, sizeof(m));
+      if ((i & 63) == 0)
+        std::this_thread::yield();
+    } });
+
+  uint32_t last = 0, got = 0, bad = 0;
+  Msg m;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+  while (std::chrono::steady_clock::now() < deadline)
+  {
+    size_t n = ring.pop(&m, sizeof(m));
+    if (n == 0)
+    {
+      if (last == total)
+        break;
+      std::this_thread::yield();
+      continue;
+    }
+    got++;
+    if (n != sizeof(m) || m.seq <= last || m.check != m.seq * 2654435761u ||
+        m.fill[0] != (uint8_t)(m.seq & 0xFF) || m.fill[55] != (uint8_t)(m.seq & 0xFF))
+      bad++;
+    last = m.seq;
+    if ((got & 1023) == 0) // slow consumer: forces overruns
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  producer.join();
+  while (ring.pop(&m, sizeof(m)))
+    got++;
+
+  SpscRing<8, sizeof(Msg)>::Stats st = ring.stats();
+  char msg[128];
+  snprintf(msg, sizeof(msg), "pushed %u popped %u dropped %u", st.pushed, st.popped, st.dropped);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, bad);
+  TEST_ASSERT_EQUAL_UINT32(total, st.pushed);
+  TEST_ASSERT_EQUAL_UINT32(got, st.popped);
+  TEST_ASSERT_EQUAL_UINT32(st.pushed, st.popped + st.dropped);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_and_drop_oldest);
+  RUN_TEST(test_oversize_rejected);
+  RUN_TEST(test_threads_intact_and_ordered);
+  return UNITY_END();
+}
@@ -0,0 +1,243 @@
+/*********************************************************************
+ * Host test + benchmark: TelemetryFrame vs JSON node payloads
+ * -------------------------------------------------------
+ * • Round trip (multi-record), scaling / saturation, schema ids
+ * • Truncated, padded and wrong-version frames are rejected
+ * • Size and encode/decode time against the JSON text a node sends
+ *   today for 1, 4 and 8 sensors
+ * Run: pio test -e native -f test_telemetry_frame -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <TelemetryFrame.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+  const SensorKind kKinds[] = {SensorKind::CAP_SOIL_MOISTURE, SensorKind::BME280, SensorKind::DS18B20,
+                               SensorKind::DHT22};
+  const char *const kNames[] = {"Soil1", "Air", "Probe", "Shed"};
+
+  SensorSample sampleFor(SensorKind kind, int i)
+  {
+    SensorSample v;
+    uint8_t fields = sensorKindFields(kind);
+    if (fields & FIELD_BIT(FIELD_MOISTURE))
+      v.set(FIELD_MOISTURE, 43.589744f + i);
+    if (fields & FIELD_BIT(FIELD_TEMP))
+      v.set(FIELD_TEMP, 21.3125f + i * 0.1f);
+    if (fields & FIELD_BIT(FIELD_HUM))
+      v.set(FIELD_HUM, 55.20508f);
+    if (fields & FIELD_BIT(FIELD_PRES))
+      v.set(FIELD_PRES, 1013.2473f);
+    return v;
+  }
+
+  size_t encodeBinary(int sensors, uint8_t *buf, size_t cap)
+  {
+    TelemetryFrameHeader h;
+    h.schema = 0x1234;
+    h.rssi = -67;
+    h.batteryMv = 3710;
+    h.sleepSec = 60;
+    TelemetryFrameWriter w(buf, cap);
+    w.begin("node-greenhouse-01", h);
+    w.beginRecord(0);
+    for (int i = 0; i < sensors; i++)
+      w.add((uint8_t)i, sampleFor(kKinds[i % 4], i));
+    return w.finish();
+  }
+
+  // Same keys and float formatting as the node's ArduinoJson payload.
+  size_t encodeJson(int sensors, char *buf, size_t cap)
+  {
+    int n = snprintf(buf, cap, "{\"deviceId\":\"node-greenhouse-01\",\"firmwareVersion\":\"1.3.4\","
+                               "\"battery\":3.710256,\"rssi\":-67,\"meshHopCount\":0,\"sleepSeconds\":60");
+    for (int i = 0; i < sensors; i++)
+    {
+      SensorKind kind = kKinds[i % 4];
+      SensorSample v = sampleFor(kind, i);
+      for (uint8_t f = 0; f < FIELD_COUNT; f++)
+      {
+        if (!v.has((SensorField)f))
+          continue;
+        if (sensorKindIsScalar(kind))
+          n += snprintf(buf + n, cap - n, ",\"%s%d\":%.9g", kNames[i % 4], i, v.value[f]);
+        else
+          n += snprintf(buf + n, cap - n, ",\"%s%d_%s\":%.9g", kNames[i % 4], i,
+                        sensorFieldName((SensorField)f), v.value[f]);
+      }
+    }
+    n += snprintf(buf + n, cap - n, "}");
+    return (size_t)n;
+  }
+
+  template <typename F>
+  double nsPerCall(F fn, int calls)
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++)
+      fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / calls;
+  }
+
+  volatile float g_sink;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip()
+{
+  TelemetryFrameHeader h;
+  h.schema = 0xBEEF;
+  h.rssi = -80;
+  h.batteryMv = 3300;
+  h.sleepSec = 600;
+  h.hops = 2;
+  uint8_t buf[128];
+  TelemetryFrameWriter w(buf, sizeof(buf));
+  TEST_ASSERT_TRUE(w.begin("node-7", h));
+  TEST_ASSERT_TRUE(w.beginRecord(120));
+  TEST_ASSERT_TRUE(w.add(0, FIELD_MOISTURE, 43.589744f));
+  TEST_ASSERT_TRUE(w.add(3, FIELD_PRES, 1013.27f));
+  TEST_ASSERT_TRUE(w.beginRecord(0));
+  TEST_ASSERT_TRUE(w.add(63, FIELD_TEMP, -12.345f));
+  size_t len = w.finish();
+  TEST_ASSERT_EQUAL(5 + 6 + 7 + 3 + 6 + 3 + 3, len);
+
+  char text[200];
+  size_t tlen = telemetryFrameToText(buf, len, text, sizeof(text));
+  TEST_ASSERT_EQUAL('~', text[0]);
+  uint8_t back[128];
+  TEST_ASSERT_EQUAL(len, telemetryFrameFromText(text, tlen, back, sizeof(back)));
+
+  TelemetryFrameReader r;
+  TEST_ASSERT_TRUE(r.open(back, len));
+  TEST_ASSERT_EQUAL_STRING("node-7", r.deviceId());
+  TEST_ASSERT_EQUAL_HEX16(0xBEEF, r.header().schema);
+  TEST_ASSERT_EQUAL_INT8(-80, r.header().rssi);
+  TEST_ASSERT_EQUAL_UINT16(3300, r.header().batteryMv);
+  TEST_ASSERT_EQUAL_UINT16(600, r.header().sleepSec);
+  TEST_ASSERT_EQUAL_UINT8(2, r.header().hops);
+  TEST_ASSERT_EQUAL_UINT8(2, r.records());
+
+  uint16_t age;
+  uint8_t sensor;
+  SensorField field;
+  float value;
+  TEST_ASSERT_TRUE(r.nextRecord(age));
+  TEST_ASSERT_EQUAL_UINT16(120, age);
+  TEST_ASSERT_TRUE(r.nextReading(sensor, field, value));
+  TEST_ASSERT_EQUAL(0, sensor);
+  TEST_ASSERT_EQUAL(FIELD_MOISTURE, field);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, 43.59f, value);
+  // Leave the second reading unread: nextRecord() skips it.
+  TEST_ASSERT_TRUE(r.nextRecord(age));
+  TEST_ASSERT_TRUE(r.nextReading(sensor, field, value));
+  TEST_ASSERT_EQUAL(63, sensor);
+  TEST_ASSERT_EQUAL(FIELD_TEMP, field);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, -12.35f, value);
+  TEST_ASSERT_FALSE(r.nextReading(sensor, field, value));
+  TEST_ASSERT_FALSE(r.nextRecord(age));
+}
+
+void test_scaling_saturates()
+{
+  TEST_ASSERT_EQUAL_INT16(32767, telemetryScale(FIELD_TEMP, 500.0f));
+  TEST_ASSERT_EQUAL_INT16(-32768, telemetryScale(FIELD_TEMP, -500.0f));
+  TEST_ASSERT_EQUAL_INT16(-32768, telemetryScale(FIELD_TEMP, NAN));
+  TEST_ASSERT_EQUAL_INT16(10132, telemetryScale(FIELD_PRES, 1013.2f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 1013.2f, telemetryUnscale(FIELD_PRES, 10132));
+}
+
+void test_schema_id_tracks_names_and_kinds()
+{
+  const char *const a[] = {"Soil1", "Air"};
+  const char *const b[] = {"Soil2", "Air"};
+  SensorKind k1[] = {SensorKind::CAP_SOIL_MOISTURE, SensorKind::BME280};
+  SensorKind k2[] = {SensorKind::CAP_SOIL_MOISTURE, SensorKind::BMP280};
+  uint16_t id = telemetrySchemaId(a, k1, 2);
+  TEST_ASSERT_EQUAL_HEX16(id, telemetrySchemaId(a, k1, 2));
+  TEST_ASSERT_NOT_EQUAL(id, telemetrySchemaId(b, k1, 2));
+  TEST_ASSERT_NOT_EQUAL(id, telemetrySchemaId(a, k2, 2));
+}
+
+void test_rejects_bad_frames()
+{
+  uint8_t buf[128];
+  size_t len = encodeBinary(4, buf, sizeof(buf));
+  TelemetryFrameReader r;
+  TEST_ASSERT_TRUE(r.open(buf, len));
+  TEST_ASSERT_FALSE(r.open(buf, len - 1)); // truncated
+  TEST_ASSERT_FALSE(r.open(buf, len + 1)); // trailing garbage
+  buf[1] = TELEMETRY_FRAME_VERSION + 1;
+  TEST_ASSERT_FALSE(r.open(buf, len));
+
+  uint8_t tiny[20];
+  TEST_ASSERT_EQUAL(0, encodeBinary(4, tiny, sizeof(tiny)));
+  TEST_ASSERT_EQUAL(0, telemetryFrameFromText("{\"deviceId\":1}", 14, buf, sizeof(buf)));
+}
+
+void bench_frame_vs_json()
+{
+  const int counts[] = {1, 4, 8};
+  for (int sensors : counts)
+  {
+    char json[1024];
+    uint8_t bin[256];
+    char text[400];
+    size_t jlen = encodeJson(sensors, json, sizeof(json));
+    size_t blen = encodeBinary(sensors, bin, sizeof(bin));
+    size_t tlen = telemetryFrameToText(bin, blen, text, sizeof(text));
+
+    double jsonNs = nsPerCall([&]
+                              { encodeJson(sensors, json, sizeof(json)); }, 20000);
+    double binNs = nsPerCall([&]
+                             {
+      size_t n = encodeBinary(sensors, bin, sizeof(bin));
+      telemetryFrameToText(bin, n, text, sizeof(text)); }, 20000);
+    double jsonDecNs = nsPerCall([&]
+                                 {
+      // Rough stand-in for the gateway's JSON parse: convert every number.
+      for (const char *p = strchr(json, ':'); p; p = strchr(p + 1, ':'))
+        g_sink = strtof(p + 1, nullptr); }, 20000);
+    double binDecNs = nsPerCall([&]
+                                {
+      uint8_t back[256];
+      size_t n = telemetryFrameFromText(text, tlen, back, sizeof(back));
+      TelemetryFrameReader r;
+      r.open(back, n);
+      uint16_t age;
+      uint8_t s;
+      SensorField f;
+      float v;
+      while (r.nextRecord(age))
+        while (r.nextReading(s, f, v))
+          g_sink = v; }, 20000);
+
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%d sensors: JSON %zu B (enc %.0f ns, scan %.0f ns) | frame %zu B, mesh text %zu B "
+                               "(enc %.0f ns, dec %.0f ns) | %.1fx smaller",
+             sensors, jlen, jsonNs, jsonDecNs, blen, tlen, binNs, binDecNs, (double)jlen / tlen);
+    TEST_MESSAGE(msg);
+  }
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_scaling_saturates);
+  RUN_TEST(test_schema_id_tracks_names_and_kinds);
+  RUN_TEST(test_rejects_bad_frames);
+  RUN_TEST(bench_frame_vs_json);
+  return UNITY_END();
+}
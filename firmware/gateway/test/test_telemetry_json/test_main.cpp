@@ -0,0 +1,267 @@
+/*********************************************************************
+ * Host test + benchmark: TelemetryJson (own-sensor payloads)
+ * -------------------------------------------------------
+ * • Keys: bare name for scalar kinds, "<name>_<field>" otherwise,
+ *   escaped once at build time
+ * • Payload text, NaN as null, overflow reported as 0
+ * • A buffer sized from the sensor set always fits the widest values
+ * • Suffixed statistic keys ("Soil1_min"); restore() to a mark drops a
+ *   group that overflowed and leaves valid JSON
+ * • Heap allocations and time per payload for 1, 8 and 32 sensors,
+ *   against string-concatenated keys + a growing payload string + a
+ *   concatenated log line (the previous gateway code, with std::string
+ *   for Arduino String; SSO hides short keys, so its count is a floor)
+ * Run: pio test -e native -f test_telemetry_json -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <TelemetryJson.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// --- allocation counting (whole test binary) ---
+static size_t g_allocs = 0;
+
+void *operator new(size_t n)
+{
+  g_allocs++;
+  void *p = malloc(n ? n : 1);
+  if (!p)
+    abort();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+void setUp() {}
+void tearDown() {}
+
+namespace
+{
+  const SensorKind kKinds[] = {SensorKind::CAP_SOIL_MOISTURE, SensorKind::BME280, SensorKind::DS18B20,
+                               SensorKind::DHT22};
+
+  struct TestSensor
+  {
+    std::string name;
+    SensorKind kind;
+    SensorKeys keys;
+    SensorSample last;
+  };
+
+  std::vector<TestSensor> makeSensors(int count)
+  {
+    std::vector<TestSensor> v(count);
+    for (int i = 0; i < count; i++)
+    {
+      char name[24];
+      snprintf(name, sizeof(name), "GreenhouseBed%02d", i);
+      v[i].name = name;
+      v[i].kind = kKinds[i % 4];
+      sensorKeysBuild(v[i].keys, name, v[i].kind);
+      uint8_t fields = sensorKindFields(v[i].kind);
+      for (uint8_t f = 0; f < FIELD_COUNT; f++)
+        if (fields & FIELD_BIT(f))
+          v[i].last.set((SensorField)f, 21.3125f + i + f * 10.5f);
+    }
+    return v;
+  }
+
+  size_t bufferFor(const std::vector<TestSensor> &sensors)
+  {
+    size_t n = TELEMETRY_HEADER_BYTES;
+    for (const auto &s : sensors)
+      n += sensorKeysMaxBytes(s.keys);
+    return n;
+  }
+
+  size_t buildPayload(const std::vector<TestSensor> &sensors, char *buf, size_t cap)
+  {
+    JsonWriter w(buf, cap);
+    w.string("deviceId", "greenhouse-gateway-01");
+    w.string("firmwareVersion", "1.3.4");
+    w.integer("rssi", -61);
+    w.boolean("gateway", true);
+    for (const auto &s : sensors)
+      w.sample(s.keys, s.last);
+    return w.finish();
+  }
+
+  // Previous shape: key strings per field, appended into a growing string,
+  // then "prefix + payload" for the log line.
+  size_t buildPayloadConcat(const std::vector<TestSensor> &sensors, std::string &logLine)
+  {
+    std::string payload = "{\"deviceId\":\"greenhouse-gateway-01\",\"firmwareVersion\":\"1.3.4\",\"rssi\":-61,"
+                          "\"gateway\":true";
+    char num[24];
+    for (const auto &s : sensors)
+    {
+      bool scalar = sensorKindIsScalar(s.kind);
+      for (uint8_t f = 0; f < FIELD_COUNT; f++)
+      {
+        if (!s.last.has((SensorField)f))
+          continue;
+        std::string key = scalar ? s.name : s.name + "_" + sensorFieldName((SensorField)f);
+        snprintf(num, sizeof(num), "%.7g", s.last.value[f]);
+        payload += ",\"" + key + "\":" + num;
+      }
+    }
+    payload += "}";
+    logLine = "[GATEWAY] Sending own sensors: " + payload;
+    return payload.size();
+  }
+}
+
+void test_keys()
+{
+  SensorKeys k;
+  sensorKeysBuild(k, "Soil1", SensorKind::CAP_SOIL_MOISTURE);
+  TEST_ASSERT_EQUAL(8, k.len[FIELD_MOISTURE]);
+  TEST_ASSERT_EQUAL_STRING_LEN("\"Soil1\":", k.text[FIELD_MOISTURE], k.len[FIELD_MOISTURE]);
+  TEST_ASSERT_EQUAL(0, k.len[FIELD_TEMP]);
+
+  sensorKeysBuild(k, "Air \"2\"", SensorKind::BMP280);
+  TEST_ASSERT_EQUAL(0, k.len[FIELD_MOISTURE]);
+  TEST_ASSERT_EQUAL(0, k.len[FIELD_HUM]);
+  TEST_ASSERT_EQUAL_STRING_LEN("\"Air \\\"2\\\"_temp\":", k.text[FIELD_TEMP], k.len[FIELD_TEMP]);
+  TEST_ASSERT_EQUAL_STRING_LEN("\"Air \\\"2\\\"_pres\":", k.text[FIELD_PRES], k.len[FIELD_PRES]);
+}
+
+void test_payload()
+{
+  SensorKeys soil, air;
+  sensorKeysBuild(soil, "Soil1", SensorKind::CAP_SOIL_MOISTURE);
+  sensorKeysBuild(air, "Air", SensorKind::DHT22);
+  SensorSample s, a;
+  s.set(FIELD_MOISTURE, 43.589744f);
+  a.set(FIELD_TEMP, 21.5f);
+  a.set(FIELD_HUM, NAN); // failed read
+
+  char buf[256];
+  JsonWriter w(buf, sizeof(buf));
+  w.string("deviceId", "gw-1");
+  w.integer("rssi", -61);
+  w.boolean("gateway", true);
+  w.number("battery", 3.3 * 2048 / 4095.0, 4);
+  w.sample(soil, s);
+  w.sample(air, a);
+  TEST_ASSERT_GREATER_THAN(0, w.finish());
+  TEST_ASSERT_EQUAL_STRING("{\"deviceId\":\"gw-1\",\"rssi\":-61,\"gateway\":true,\"battery\":1.65,"
+                           "\"Soil1\":43.58974,\"Air_temp\":21.5,\"Air_hum\":null}",
+                           buf);
+
+  char small[40];
+  JsonWriter tight(small, sizeof(small));
+  tight.string("deviceId", "gw-1");
+  tight.sample(soil, s);
+  tight.sample(air, a);
+  TEST_ASSERT_EQUAL(0, tight.finish());
+  TEST_ASSERT_FALSE(tight.ok());
+
+  JsonWriter empty(nullptr, 0);
+  empty.integer("rssi", 1);
+  TEST_ASSERT_EQUAL(0, empty.finish());
+}
+
+// Longest names and widest numbers still fit the computed size.
+void test_sized_buffer_fits()
+{
+  std::vector<TestSensor> sensors(16);
+  for (int i = 0; i < 16; i++)
+  {
+    sensors[i].kind = SensorKind::BME280;
+    sensorKeysBuild(sensors[i].keys, "\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"", SensorKind::BME280);
+    for (uint8_t f = 0; f < FIELD_COUNT; f++)
+      sensors[i].last.set((SensorField)f, -3.4028235e38f);
+  }
+  std::vector<char> buf(bufferFor(sensors));
+  TEST_ASSERT_GREATER_THAN(0, buildPayload(sensors, buf.data(), buf.size()));
+}
+
+void bench_payloads()
+{
+  const int counts[] = {1, 8, 32};
+  for (int sensors : counts)
+  {
+    std::vector<TestSensor> set = makeSensors(sensors);
+    std::vector<char> buf(bufferFor(set));
+    const int iters = 20000;
+
+    size_t a0 = g_allocs;
+    auto t0 = std::chrono::steady_clock::now();
+    size_t len = 0;
+    for (int i = 0; i < iters; i++)
+      len = buildPayload(set, buf.data(), buf.size());
+    auto t1 = std::chrono::steady_clock::now();
+    size_t allocsFixed = g_allocs - a0;
+
+    std::string logLine;
+    a0 = g_allocs;
+    auto t2 = std::chrono::steady_clock::now();
+    size_t lenConcat = 0;
+    for (int i = 0; i < iters; i++)
+      lenConcat = buildPayloadConcat(set, logLine);
+    auto t3 = std::chrono::steady_clock::now();
+    size_t allocsConcat = g_allocs - a0;
+
+    TEST_ASSERT_EQUAL(lenConcat, len);
+    TEST_ASSERT_EQUAL_STRING(logLine.c_str() + 31, buf.data());
+    TEST_ASSERT_EQUAL(0, allocsFixed);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg),
+             "%2d sensors, %4u B (buffer %4u): fixed %.2f us / %u allocs, concat %.2f us / %.1f allocs (host)",
+             sensors, (unsigned)len, (unsigned)buf.size(),
+             std::chrono::duration<double, std::micro>(t1 - t0).count() / iters, (unsigned)(allocsFixed / iters),
+             std::chrono::duration<double, std::micro>(t3 - t2).count() / iters, (double)allocsConcat / iters);
+    TEST_MESSAGE(msg);
+  }
+}
+
+void test_statistics_and_restore()
+{
+  SensorKeys soil, air;
+  sensorKeysBuild(soil, "Soil1", SensorKind::CAP_SOIL_MOISTURE);
+  sensorKeysBuild(air, "Air", SensorKind::BME280);
+  char buf[64];
+  JsonWriter w(buf, sizeof(buf));
+  w.statistic(soil, FIELD_MOISTURE, "", 41.5);
+  w.statistic(soil, FIELD_MOISTURE, "_min", 40);
+  w.statistic(soil, FIELD_TEMP, "_min", 1); // soil has no temp
+  size_t mark = w.mark();
+  w.statistic(air, FIELD_TEMP, "_max", 23.25);
+  w.statistic(air, FIELD_HUM, "_max", 55);
+  TEST_ASSERT_FALSE(w.ok());
+  w.restore(mark);
+  TEST_ASSERT_TRUE(w.ok());
+  size_t n = w.finish();
+  TEST_ASSERT_EQUAL_STRING("{\"Soil1\":41.5,\"Soil1_min\":40}", buf);
+  TEST_ASSERT_EQUAL(strlen(buf), n);
+  TEST_ASSERT_TRUE(sensorKeysStatBytes(air, 5) >= 3 * (strlen("\"Air_pres_ewma\":") + 1));
+
+  JsonWriter e(buf, sizeof(buf));
+  e.restore(e.mark()); // nothing written yet: no leading comma later
+  e.statistic(soil, FIELD_MOISTURE, "_n", 30);
+  e.finish();
+  TEST_ASSERT_EQUAL_STRING("{\"Soil1_n\":30}", buf);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_keys);
+  RUN_TEST(test_payload);
+  RUN_TEST(test_sized_buffer_fits);
+  RUN_TEST(test_statistics_and_restore);
+  RUN_TEST(bench_payloads);
+  return UNITY_END();
+}
@@ -0,0 +1,385 @@
+/*********************************************************************
+ * Host test: TelemetryQueue store-and-forward
+ * -------------------------------------------------------
+ * • Simulated uplink with injected outages (Wi-Fi flaps)
+ * • Reboot in the middle of an outage (persist + begin)
+ * • Count / age / disk caps, torn segment tails, reset mid-compaction
+ * • Sequence numbers survive spills, pops and restarts
+ *********************************************************************/
+
+#include <unity.h>
+#include <TelemetryQueue.h>
+#include <GatewayPipeline.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const char *kSeg = "txq_test.seg";
+  const char *kSegTmp = "txq_test.seg.tmp"; // compaction copy
+
+  TelemetryQueueConfig smallConfig()
+  {
+    TelemetryQueueConfig cfg;
+    cfg.segmentPath = kSeg;
+    cfg.ramSlots = 4;
+    cfg.slotSize = 64;
+    cfg.maxMessages = 10000;
+    cfg.maxDiskBytes = 1 << 20;
+    cfg.maxAgeSec = 0;
+    return cfg;
+  }
+
+  std::string msg(int i)
+  {
+    char b[48];
+    snprintf(b, sizeof(b), "{\"deviceId\":\"gw\",\"n\":%d}", i);
+    return b;
+  }
+
+  // Uplink that is down whenever `t` falls in one of the outage windows.
+  struct FlakyUplink
+  {
+    std::vector<std::pair<int, int>> outages;
+    std::vector<std::string> received;
+
+    bool up(int t) const
+    {
+      for (const auto &o : outages)
+        if (t >= o.first && t < o.second)
+          return false;
+      return true;
+    }
+  };
+
+  // Drains like the gateway loop does: stop at the first failed send.
+  void drain(TelemetryQueue &q, FlakyUplink &link, int t, int budget)
+  {
+    char buf[TelemetryQueue::MAX_MESSAGE];
+    while (budget-- > 0)
+    {
+      size_t n = q.peek(buf, sizeof(buf), (uint32_t)t);
+      if (n == 0 || !link.up(t))
+        return;
+      link.received.push_back(std::string(buf, n));
+      q.pop();
+    }
+  }
+}
+
+void setUp()
+{
+  remove(kSeg);
+  remove(kSegTmp);
+}
+
+void tearDown()
+{
+  remove(kSeg);
+  remove(kSegTmp);
+}
+
+void test_fifo_in_ram()
+{
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(smallConfig()));
+  for (int i = 0; i < 3; i++)
+    TEST_ASSERT_TRUE(q.push(msg(i).c_str(), msg(i).size(), 0));
+  char buf[128];
+  for (int i = 0; i < 3; i++)
+  {
+    size_t n = q.peek(buf, sizeof(buf), 0);
+    TEST_ASSERT_EQUAL_STRING(msg(i).c_str(), std::string(buf, n).c_str());
+    q.pop();
+  }
+  TEST_ASSERT_TRUE(q.empty());
+  TEST_ASSERT_EQUAL_UINT32(0, q.stats().spilled);
+  TEST_ASSERT_NULL(fopen(kSeg, "rb"));
+}
+
+void test_outages_lose_nothing()
+{
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(smallConfig()));
+  FlakyUplink link;
+  link.outages = {{50, 400}, {420, 430}, {600, 1500}, {1501, 1502}};
+
+  int total = 0;
+  for (int t = 0; t < 2000; t++)
+  {
+    if (t % 2 == 0)
+    {
+      std::string m = msg(total++);
+      TEST_ASSERT_TRUE(q.push(m.c_str(), m.size(), (uint32_t)t));
+    }
+    drain(q, link, t, 8);
+  }
+  drain(q, link, 2000, 100000);
+
+  TEST_ASSERT_TRUE(q.empty());
+  TEST_ASSERT_EQUAL(total, link.received.size());
+  for (int i = 0; i < total; i++)
+    TEST_ASSERT_EQUAL_STRING(msg(i).c_str(), link.received[i].c_str());
+  TEST_ASSERT_GREATER_THAN(0, q.stats().spilled);
+  TEST_ASSERT_EQUAL_UINT32(0, q.stats().dropped);
+  TEST_ASSERT_NULL(fopen(kSeg, "rb")); // segment deleted once drained
+}
+
+void test_reboot_during_outage()
+{
+  FlakyUplink link;
+  link.outages = {{0, 1000}};
+  int total = 0;
+  {
+    TelemetryQueue q;
+    TEST_ASSERT_TRUE(q.begin(smallConfig()));
+    for (; total < 50; total++)
+      q.push(msg(total).c_str(), msg(total).size(), (uint32_t)total);
+    // Partially drain the disk part before the "reboot".
+    link.outages.clear();
+    drain(q, link, 100, 7);
+    q.persist();
+  }
+
+  TelemetryQueue q2;
+  TEST_ASSERT_TRUE(q2.begin(smallConfig()));
+  TEST_ASSERT_EQUAL_UINT32(50 - 7, q2.size());
+  for (; total < 60; total++)
+    q2.push(msg(total).c_str(), msg(total).size(), 200);
+  drain(q2, link, 200, 1000);
+
+  TEST_ASSERT_EQUAL(60, link.received.size());
+  for (int i = 0; i < 60; i++)
+    TEST_ASSERT_EQUAL_STRING(msg(i).c_str(), link.received[i].c_str());
+}
+
+void test_caps_drop_oldest()
+{
+  TelemetryQueueConfig cfg = smallConfig();
+  cfg.maxMessages = 20;
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(cfg));
+  for (int i = 0; i < 30; i++)
+    q.push(msg(i).c_str(), msg(i).size(), 0);
+  TEST_ASSERT_EQUAL_UINT32(20, q.size());
+  TEST_ASSERT_EQUAL_UINT32(10, q.stats().dropped);
+
+  char buf[128];
+  size_t n = q.peek(buf, sizeof(buf), 0);
+  TEST_ASSERT_EQUAL_STRING(msg(10).c_str(), std::string(buf, n).c_str());
+}
+
+void test_disk_cap_and_age()
+{
+  TelemetryQueueConfig cfg = smallConfig();
+  cfg.maxDiskBytes = 120 * 40; // roughly 120 records with headers
+  cfg.maxAgeSec = 100;
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(cfg));
+  for (int i = 0; i < 200; i++)
+    q.push(msg(i).c_str(), msg(i).size(), (uint32_t)i);
+  TEST_ASSERT_LESS_OR_EQUAL(cfg.maxDiskBytes, q.diskBytes());
+  TEST_ASSERT_GREATER_THAN(0, q.stats().dropped);
+
+  // Everything older than 100 s at t=250 is expired; the rest is in order.
+  char buf[128];
+  std::vector<std::string> out;
+  size_t n;
+  while ((n = q.peek(buf, sizeof(buf), 250)) > 0)
+  {
+    out.push_back(std::string(buf, n));
+    q.pop();
+  }
+  TEST_ASSERT_GREATER_THAN(0, q.stats().expired);
+  TEST_ASSERT_EQUAL(50, out.size());
+  TEST_ASSERT_EQUAL_STRING(msg(150).c_str(), out.front().c_str());
+  TEST_ASSERT_EQUAL_STRING(msg(199).c_str(), out.back().c_str());
+}
+
+void test_torn_tail_recovery()
+{
+  {
+    TelemetryQueue q;
+    TEST_ASSERT_TRUE(q.begin(smallConfig()));
+    for (int i = 0; i < 10; i++)
+      q.push(msg(i).c_str(), msg(i).size(), 0);
+    q.persist();
+  }
+  // Simulate power loss halfway through an append.
+  FILE *f = fopen(kSeg, "ab");
+  fwrite("\xA7\x01\x30\x00garbage", 1, 11, f);
+  fclose(f);
+
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(smallConfig()));
+  TEST_ASSERT_EQUAL_UINT32(10, q.size());
+  q.push(msg(10).c_str(), msg(10).size(), 0);
+  q.persist();
+
+  TelemetryQueue q2;
+  TEST_ASSERT_TRUE(q2.begin(smallConfig()));
+  TEST_ASSERT_EQUAL_UINT32(11, q2.size());
+}
+
+void test_reset_during_compaction()
+{
+  {
+    TelemetryQueue q;
+    TEST_ASSERT_TRUE(q.begin(smallConfig()));
+    for (int i = 0; i < 10; i++)
+      q.push(msg(i).c_str(), msg(i).size(), 0);
+    q.persist();
+  }
+  // Reset before the rename: the copy is partial and the segment still there.
+  FILE *f = fopen(kSegTmp, "wb");
+  fwrite("\xA7\x01", 1, 2, f);
+  fclose(f);
+  {
+    TelemetryQueue q;
+    TEST_ASSERT_TRUE(q.begin(smallConfig()));
+    TEST_ASSERT_EQUAL_UINT32(10, q.size());
+    TEST_ASSERT_NULL(fopen(kSegTmp, "rb"));
+  }
+  // Only the copy left (segment gone): it is adopted.
+  TEST_ASSERT_EQUAL(0, rename(kSeg, kSegTmp));
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(smallConfig()));
+  TEST_ASSERT_EQUAL_UINT32(10, q.size());
+  char buf[128];
+  size_t n = q.peek(buf, sizeof(buf), 0);
+  TEST_ASSERT_EQUAL_STRING(msg(0).c_str(), std::string(buf, n).c_str());
+}
+
+// The gateway's setting: a full uplink ring slot (e.g. a summary part at
+// its cap) stays in RAM while the link keeps up.
+void test_ring_slot_stays_in_ram()
+{
+  TelemetryQueueConfig cfg = smallConfig();
+  cfg.slotSize = UPLINK_RING_SLOT_BYTES;
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(cfg));
+  std::string full(UPLINK_RING_SLOT_BYTES, 's');
+  char buf[TelemetryQueue::MAX_MESSAGE];
+  for (int i = 0; i < 20; i++)
+  {
+    TEST_ASSERT_TRUE(q.push(full.c_str(), full.size(), 0));
+    TEST_ASSERT_EQUAL(full.size(), q.peek(buf, sizeof(buf), 0));
+    q.pop();
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, q.stats().spilled);
+  TEST_ASSERT_NULL(fopen(kSeg, "rb"));
+}
+
+void test_large_message_keeps_order()
+{
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(smallConfig()));
+  std::string big(300, 'x');
+  q.push("a", 1, 0);
+  q.push(big.c_str(), big.size(), 0);
+  q.push("b", 1, 0);
+
+  char buf[TelemetryQueue::MAX_MESSAGE];
+  TEST_ASSERT_EQUAL(1, q.peek(buf, sizeof(buf), 0));
+  TEST_ASSERT_EQUAL('a', buf[0]);
+  q.pop();
+  TEST_ASSERT_EQUAL(300, q.peek(buf, sizeof(buf), 0));
+  q.pop();
+  TEST_ASSERT_EQUAL(1, q.peek(buf, sizeof(buf), 0));
+  TEST_ASSERT_EQUAL('b', buf[0]);
+  q.pop();
+  TEST_ASSERT_TRUE(q.empty());
+}
+
+namespace
+{
+  bool collect(const char *data, size_t len, void *ctx)
+  {
+    std::vector<std::string> *out = (std::vector<std::string> *)ctx;
+    if (out->size() == 5)
+      return false; // "batch full"
+    out->push_back(std::string(data, len));
+    return true;
+  }
+}
+
+void test_peek_many_spans_disk_and_ram()
+{
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(smallConfig()));
+  for (int i = 0; i < 12; i++) // 8 spill to disk, 4 stay in RAM
+    q.push(msg(i).c_str(), msg(i).size(), 0);
+  TEST_ASSERT_EQUAL_UINT32(8, q.diskCount());
+
+  int next = 0;
+  while (!q.empty())
+  {
+    std::vector<std::string> batch;
+    uint32_t n = q.peekMany(32, 0, collect, &batch);
+    TEST_ASSERT_EQUAL(batch.size(), n);
+    TEST_ASSERT_GREATER_THAN(0, n);
+    for (const auto &m : batch)
+      TEST_ASSERT_EQUAL_STRING(msg(next++).c_str(), m.c_str());
+    q.pop(n);
+  }
+  TEST_ASSERT_EQUAL(12, next);
+  TEST_ASSERT_EQUAL_UINT32(12, q.stats().delivered);
+  TEST_ASSERT_NULL(fopen(kSeg, "rb"));
+}
+
+namespace
+{
+  bool collectSeq(uint32_t seq, const char *, size_t, void *ctx)
+  {
+    ((std::vector<uint32_t> *)ctx)->push_back(seq);
+    return true;
+  }
+}
+
+void test_seq_stays_with_message()
+{
+  TelemetryQueueConfig cfg = smallConfig();
+  cfg.maxMessages = 10;
+  std::vector<uint32_t> before, after;
+  {
+    TelemetryQueue q;
+    TEST_ASSERT_TRUE(q.begin(cfg));
+    for (int i = 0; i < 12; i++) // two dropped by the count cap, some on disk
+      q.push(msg(i).c_str(), msg(i).size(), 0);
+    TEST_ASSERT_EQUAL_UINT32(10, q.peekMany(32, 0, collectSeq, &before));
+    for (size_t i = 1; i < before.size(); i++)
+      TEST_ASSERT_EQUAL_UINT32(before[i - 1] + 1, before[i]);
+    q.pop(3);
+    q.persist();
+  }
+
+  TelemetryQueue q;
+  TEST_ASSERT_TRUE(q.begin(cfg));
+  TEST_ASSERT_EQUAL_UINT32(7, q.peekMany(32, 0, collectSeq, &after));
+  for (size_t i = 0; i < after.size(); i++)
+    TEST_ASSERT_EQUAL_UINT32(before[i + 3], after[i]);
+  q.push(msg(12).c_str(), msg(12).size(), 0);
+  after.clear();
+  q.peekMany(32, 0, collectSeq, &after);
+  TEST_ASSERT_EQUAL_UINT32(before.back() + 1, after.back());
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_in_ram);
+  RUN_TEST(test_outages_lose_nothing);
+  RUN_TEST(test_reboot_during_outage);
+  RUN_TEST(test_caps_drop_oldest);
+  RUN_TEST(test_disk_cap_and_age);
+  RUN_TEST(test_torn_tail_recovery);
+  RUN_TEST(test_reset_during_compaction);
+  RUN_TEST(test_ring_slot_stays_in_ram);
+  RUN_TEST(test_large_message_keeps_order);
+  RUN_TEST(test_peek_many_spans_disk_and_ram);
+  RUN_TEST(test_seq_stays_with_message);
+  return UNITY_END();
+}
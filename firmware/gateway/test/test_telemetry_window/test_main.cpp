@@ -0,0 +1,220 @@
+/*********************************************************************
+ * Host test + benchmark: TelemetryWindow (own-sensor aggregation)
+ * -------------------------------------------------------
+ * • Count / min / max / mean per field, EWMA carried across windows,
+ *   failed (NaN) reads skipped
+ * • Alerts fire when a field passes a limit or clears it again (past
+ *   the hysteresis margin), not while it stays on one side
+ * • Windows stay on a fixed grid; a long stall restarts the grid
+ * • Messages per day and alert delay for one gateway (4 soil sensors
+ *   + a BME280 sampled every 10 s) sending raw every 10 s against 60 s,
+ *   5 min and 15 min windows, with a few limit crossings a day
+ * Run: pio test -e native -f test_telemetry_window -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <TelemetryWindow.h>
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+
+void setUp() {}
+void tearDown() {}
+
+static SensorSample one(SensorField f, float v)
+{
+  SensorSample s;
+  s.set(f, v);
+  return s;
+}
+
+void test_field_stats()
+{
+  static TelemetryWindow<2> w;
+  w.begin(60000, 0.5f, 0);
+  const float values[] = {10, 14, 6, 10};
+  for (float v : values)
+    w.add(0, one(FIELD_MOISTURE, v));
+  w.add(0, one(FIELD_MOISTURE, NAN)); // failed read
+  const FieldStats &st = w.field(0, FIELD_MOISTURE);
+  TEST_ASSERT_EQUAL_UINT16(4, st.count);
+  TEST_ASSERT_EQUAL_FLOAT(6, st.min);
+  TEST_ASSERT_EQUAL_FLOAT(14, st.max);
+  TEST_ASSERT_EQUAL_FLOAT(10, st.mean);
+  TEST_ASSERT_EQUAL_FLOAT(9.5f, st.ewma); // 10, 12, 9, 9.5
+  TEST_ASSERT_EQUAL_UINT16(0, w.field(1, FIELD_MOISTURE).count);
+  TEST_ASSERT_EQUAL_UINT16(0, w.field(0, FIELD_TEMP).count);
+}
+
+void test_alert_crossings()
+{
+  static TelemetryWindow<1> w;
+  w.begin(60000, 0.2f, 0);
+  FieldLimits limits[FIELD_COUNT] = {};
+  limits[FIELD_MOISTURE].has = FieldLimits::BELOW;
+  limits[FIELD_MOISTURE].below = 25;
+  limits[FIELD_MOISTURE].hysteresis = 2;
+  limits[FIELD_TEMP].has = FieldLimits::BELOW | FieldLimits::ABOVE;
+  limits[FIELD_TEMP].below = 2;
+  limits[FIELD_TEMP].above = 35;
+  w.setLimits(0, limits);
+
+  TEST_ASSERT_FALSE(w.add(0, one(FIELD_MOISTURE, 40)));
+  TEST_ASSERT_TRUE(w.add(0, one(FIELD_MOISTURE, 24.5f))); // enters
+  TEST_ASSERT_EQUAL(FieldLimits::BELOW, w.alert(0, FIELD_MOISTURE));
+  TEST_ASSERT_FALSE(w.add(0, one(FIELD_MOISTURE, 20)));   // stays
+  TEST_ASSERT_FALSE(w.add(0, one(FIELD_MOISTURE, 26.5f))); // inside the margin
+  TEST_ASSERT_TRUE(w.add(0, one(FIELD_MOISTURE, 30)));    // clears
+  TEST_ASSERT_EQUAL(0, w.alert(0, FIELD_MOISTURE));
+
+  TEST_ASSERT_TRUE(w.add(0, one(FIELD_TEMP, 36)));
+  TEST_ASSERT_TRUE(w.add(0, one(FIELD_TEMP, 1))); // straight to the other side
+  TEST_ASSERT_EQUAL(FieldLimits::BELOW, w.alert(0, FIELD_TEMP));
+  TEST_ASSERT_FALSE(w.add(0, one(FIELD_MOISTURE, 31))); // other field, no change
+  TEST_ASSERT_EQUAL_UINT32(4, w.stats().alerts);
+}
+
+void test_window_grid()
+{
+  static TelemetryWindow<1> w;
+  TEST_ASSERT_FALSE(w.enabled());
+  w.begin(0, 0.2f, 0);
+  TEST_ASSERT_FALSE(w.due(1000000)); // off
+
+  w.begin(60000, 0.5f, 1000);
+  w.add(0, one(FIELD_TEMP, 20));
+  TEST_ASSERT_FALSE(w.due(60999));
+  TEST_ASSERT_TRUE(w.due(61000));
+  w.close(61500); // late by 500 ms: next window still ends at 121000
+  TEST_ASSERT_EQUAL_UINT16(0, w.field(0, FIELD_TEMP).count);
+  TEST_ASSERT_FALSE(w.due(120999));
+  TEST_ASSERT_TRUE(w.due(121000));
+  w.add(0, one(FIELD_TEMP, 22));
+  TEST_ASSERT_EQUAL_FLOAT(21, w.field(0, FIELD_TEMP).ewma); // carried over
+  TEST_ASSERT_EQUAL_FLOAT(22, w.field(0, FIELD_TEMP).mean);
+
+  w.close(400000); // stalled for minutes: grid restarts
+  TEST_ASSERT_FALSE(w.due(459999));
+  TEST_ASSERT_TRUE(w.due(460000));
+  TEST_ASSERT_EQUAL_UINT32(2, w.stats().windows);
+}
+
+namespace
+{
+  struct DayResult
+  {
+    uint32_t messages, alerts;
+  };
+
+  // 24 h of 10 s samples: soil moisture drying slowly and jumping back on
+  // each watering, temperature following the day; limits at 25% moisture
+  // and 30 °C. Raw mode sends every sample round.
+  DayResult simulateDay(uint32_t windowSec, float hysteresis)
+  {
+    const uint8_t sensors = 5; // 4 soil + BME280
+    const uint32_t stepMs = 10000, dayMs = 86400000;
+    std::mt19937 rng(3);
+    std::normal_distribution<float> noise(0, 0.4f);
+    TelemetryWindow<sensors> w;
+    w.begin(windowSec * 1000, 0.2f, 0);
+    FieldLimits limits[FIELD_COUNT] = {};
+    limits[FIELD_MOISTURE].has = FieldLimits::BELOW;
+    limits[FIELD_MOISTURE].below = 25;
+    limits[FIELD_MOISTURE].hysteresis = 2 * hysteresis;
+    limits[FIELD_TEMP].has = FieldLimits::ABOVE;
+    limits[FIELD_TEMP].above = 30;
+    limits[FIELD_TEMP].hysteresis = 0.5f * hysteresis;
+    for (uint8_t s = 0; s < sensors; s++)
+      w.setLimits(s, limits);
+
+    DayResult r = {};
+    float moisture[4] = {60, 45, 35, 28};
+    for (uint32_t t = 0; t < dayMs; t += stepMs)
+    {
+      bool alert = false;
+      for (uint8_t s = 0; s < 4; s++)
+      {
+        moisture[s] -= 0.004f * (s + 1);
+        if (moisture[s] < 22)
+          moisture[s] = 65; // watered
+        alert |= w.add(s, one(FIELD_MOISTURE, moisture[s] + noise(rng)));
+      }
+      SensorSample air;
+      air.set(FIELD_TEMP, 22 + 10 * sinf(2 * (float)M_PI * t / dayMs) + noise(rng));
+      air.set(FIELD_HUM, 55 + noise(rng));
+      air.set(FIELD_PRES, 1013 + noise(rng));
+      alert |= w.add(4, air);
+      if (!windowSec)
+        r.messages++;
+      else
+      {
+        if (alert)
+        {
+          r.messages++; // sent in the same loop pass as the sample
+          r.alerts++;
+        }
+        if (w.due(t + stepMs - 1))
+        {
+          r.messages++;
+          w.close(t + stepMs - 1);
+        }
+      }
+    }
+    return r;
+  }
+}
+
+void bench_message_volume()
+{
+  DayResult raw = simulateDay(0, 1);
+  const uint32_t windows[] = {60, 300, 900};
+  for (uint32_t sec : windows)
+  {
+    DayResult r = simulateDay(sec, 1);
+    DayResult flapping = simulateDay(sec, 0);
+    TEST_ASSERT_TRUE(r.messages < raw.messages);
+    TEST_ASSERT_TRUE(r.alerts < flapping.alerts);
+    char msg[220];
+    snprintf(msg, sizeof(msg),
+             "window %4u s: %5u messages/day vs %u raw (%.1fx fewer), %u alerts sent without delay "
+             "(%u without hysteresis) (simulated time)",
+             (unsigned)sec, (unsigned)r.messages, (unsigned)raw.messages, (double)raw.messages / r.messages,
+             (unsigned)r.alerts, (unsigned)flapping.alerts);
+    TEST_MESSAGE(msg);
+  }
+}
+
+void bench_add_cost()
+{
+  static TelemetryWindow<16> w;
+  w.begin(300000, 0.2f, 0);
+  SensorSample v;
+  v.set(FIELD_TEMP, 21.5f);
+  v.set(FIELD_HUM, 40);
+  v.set(FIELD_PRES, 1011);
+  const int iters = 1000000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++)
+  {
+    v.value[FIELD_TEMP] = 20 + (i & 15) * 0.1f;
+    w.add(i & 15, v);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  char msg[160];
+  snprintf(msg, sizeof(msg), "add() of a 3-field sample: %.1f ns; %u bytes for 16 sensors (host)",
+           std::chrono::duration<double, std::nano>(t1 - t0).count() / iters, (unsigned)sizeof(w));
+  TEST_MESSAGE(msg);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_field_stats);
+  RUN_TEST(test_alert_crossings);
+  RUN_TEST(test_window_grid);
+  RUN_TEST(bench_message_volume);
+  RUN_TEST(bench_add_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,317 @@
+/*********************************************************************
+ * Host test + benchmark: WateringController (local valve control)
+ * -------------------------------------------------------
+ * • Hysteresis: opens below startBelow, closes at stopAbove, rests for
+ *   minOff before the next run
+ * • Closes on maxRun, on a failed or stale reading and at the end of its
+ *   schedule window
+ * • maxConcurrent valves at most; waiting zones start oldest first
+ * • Timer zones: one run per window (also over midnight), none without
+ *   a clock; every minOff without a window
+ * • Magic + CRC; stopAll() closes everything
+ * • Soil bed over three days with a 6 h uplink outage: moisture range and
+ *   water used with local control (checked), printed next to a modelled
+ *   cloud controller deciding on 5-minute summaries (command after a 2 s
+ *   round trip, none while the link is down; a simulation, not a check)
+ * Run: pio test -e native -f test_watering_controller -v
+ *********************************************************************/
+
+#include <unity.h>
+#include <WateringController.h>
+
+#include <math.h>
+#include <stdio.h>
+
+void setUp() {}
+void tearDown() {}
+
+static WateringZone sensorZone(float startBelow = 30, float stopAbove = 45)
+{
+  WateringZone z = {};
+  z.hasSensor = true;
+  z.startBelow = startBelow;
+  z.stopAbove = stopAbove;
+  z.maxRunMs = 600000;
+  z.minOffMs = 60000;
+  z.staleMs = 30000;
+  return z;
+}
+
+static WateringZone timerZone(uint16_t fromMin, uint16_t toMin, uint32_t runMs)
+{
+  WateringZone z = {};
+  z.maxRunMs = runMs;
+  z.fromMin = fromMin;
+  z.toMin = toMin;
+  return z;
+}
+
+void test_hysteresis()
+{
+  static WateringController c;
+  c.reset(1, 1);
+  c.configure(0, sensorZone());
+  WateringAction a[4];
+
+  c.reading(0, 35, 0);
+  TEST_ASSERT_EQUAL(0, c.step(0, -1, a, 4));
+  c.reading(0, 29.5f, 10000);
+  TEST_ASSERT_EQUAL(1, c.step(10000, -1, a, 4));
+  TEST_ASSERT_TRUE(a[0].open);
+  TEST_ASSERT_EQUAL(WATER_DRY, a[0].reason);
+  TEST_ASSERT_EQUAL_FLOAT(29.5f, a[0].moisture);
+  TEST_ASSERT_TRUE(c.isOpen(0));
+
+  c.reading(0, 40, 20000); // between the limits: keeps running
+  TEST_ASSERT_EQUAL(0, c.step(20000, -1, a, 4));
+  c.reading(0, 45, 30000);
+  TEST_ASSERT_EQUAL(1, c.step(30000, -1, a, 4));
+  TEST_ASSERT_FALSE(a[0].open);
+  TEST_ASSERT_EQUAL(WATER_WET, a[0].reason);
+  TEST_ASSERT_EQUAL_UINT32(20000, a[0].runMs);
+
+  c.reading(0, 20, 40000); // dry again, but resting
+  TEST_ASSERT_EQUAL(0, c.step(40000, -1, a, 4));
+  c.reading(0, 20, 90000);
+  TEST_ASSERT_EQUAL(1, c.step(90000, -1, a, 4));
+  TEST_ASSERT_TRUE(a[0].open);
+  TEST_ASSERT_EQUAL_UINT32(2, c.stats.runs);
+}
+
+void test_safety_stops()
+{
+  static WateringController c;
+  WateringAction a[4];
+  c.reset(1, 1);
+  c.configure(0, sensorZone());
+  c.reading(0, 10, 0);
+  c.step(0, -1, a, 4);
+  c.reading(0, 12, 599000);
+  TEST_ASSERT_EQUAL(0, c.step(599000, -1, a, 4));
+  c.reading(0, 13, 600000);
+  TEST_ASSERT_EQUAL(1, c.step(600000, -1, a, 4));
+  TEST_ASSERT_EQUAL(WATER_MAX_RUN, a[0].reason);
+
+  c.reset(1, 1);
+  c.configure(0, sensorZone());
+  c.reading(0, 10, 0);
+  c.step(0, -1, a, 4);
+  c.reading(0, NAN, 10000); // failed read
+  TEST_ASSERT_EQUAL(1, c.step(10000, -1, a, 4));
+  TEST_ASSERT_EQUAL(WATER_NO_READING, a[0].reason);
+  TEST_ASSERT_TRUE(isnan(a[0].moisture));
+
+  c.reset(1, 1);
+  c.configure(0, sensorZone());
+  c.reading(0, 10, 0);
+  c.step(0, -1, a, 4);
+  TEST_ASSERT_EQUAL(0, c.step(30000, -1, a, 4));
+  TEST_ASSERT_EQUAL(1, c.step(30001, -1, a, 4)); // sensor went quiet
+  TEST_ASSERT_EQUAL(WATER_NO_READING, a[0].reason);
+  TEST_ASSERT_EQUAL(0, c.step(200000, -1, a, 4)); // and does not restart blind
+}
+
+void test_concurrency()
+{
+  static WateringController c;
+  WateringAction a[8];
+  c.reset(3, 1);
+  for (uint8_t z = 0; z < 3; z++)
+    c.configure(z, sensorZone());
+  c.reading(2, 20, 0);
+  c.step(0, -1, a, 8);
+  c.reading(1, 20, 1000);
+  TEST_ASSERT_EQUAL(0, c.step(1000, -1, a, 8)); // zone 1 waits from here
+  c.reading(0, 20, 2000);
+  c.reading(2, 25, 2000);
+  TEST_ASSERT_EQUAL(0, c.step(2000, -1, a, 8));
+  TEST_ASSERT_EQUAL(1, c.running());
+  TEST_ASSERT_EQUAL(2, c.waiting());
+
+  c.reading(2, 50, 3000);
+  c.reading(1, 20, 3000);
+  c.reading(0, 20, 3000);
+  uint8_t n = c.step(3000, -1, a, 8);
+  TEST_ASSERT_EQUAL(2, n);
+  TEST_ASSERT_EQUAL(2, a[0].zone); // closes first
+  TEST_ASSERT_FALSE(a[0].open);
+  TEST_ASSERT_EQUAL(1, a[1].zone); // waited longest
+  TEST_ASSERT_TRUE(a[1].open);
+  TEST_ASSERT_EQUAL(1, c.stats.highWater);
+
+  c.reading(0, 35, 4000); // no longer dry: leaves the queue
+  c.reading(1, 20, 4000);
+  c.step(4000, -1, a, 8);
+  TEST_ASSERT_EQUAL(0, c.waiting());
+}
+
+void test_schedule()
+{
+  static WateringController c;
+  WateringAction a[4];
+  c.reset(2, 2);
+  c.configure(0, timerZone(6 * 60, 6 * 60 + 10, 300000)); // 06:00-06:10, 5 min
+  c.configure(1, timerZone(23 * 60, 60, 7200000));       // 23:00-01:00, 2 h max
+  TEST_ASSERT_EQUAL(0, c.step(0, -1, a, 4));              // no clock: timers wait
+  TEST_ASSERT_EQUAL(0, c.step(1000, 5 * 60, a, 4));
+
+  TEST_ASSERT_EQUAL(1, c.step(2000, 6 * 60, a, 4));
+  TEST_ASSERT_EQUAL(WATER_TIMER, a[0].reason);
+  TEST_ASSERT_EQUAL(1, c.step(302000, 6 * 60 + 5, a, 4));
+  TEST_ASSERT_EQUAL(WATER_MAX_RUN, a[0].reason);
+  TEST_ASSERT_EQUAL(0, c.step(303000, 6 * 60 + 6, a, 4)); // once per window
+
+  TEST_ASSERT_EQUAL(0, c.step(400000, 12 * 60, a, 4));
+  TEST_ASSERT_EQUAL(1, c.step(500000, 23 * 60 + 30, a, 4));
+  TEST_ASSERT_EQUAL(1, a[0].zone);
+  TEST_ASSERT_EQUAL(0, c.step(600000, 0, a, 4)); // past midnight, same window
+  TEST_ASSERT_EQUAL(1, c.step(700000, 60, a, 4));
+  TEST_ASSERT_EQUAL(WATER_SCHEDULE, a[0].reason);
+
+  TEST_ASSERT_EQUAL(1, c.step(800000, 6 * 60, a, 4)); // next day's window
+  TEST_ASSERT_EQUAL(0, a[0].zone);
+
+  // No window: every minOff.
+  c.reset(1, 1);
+  WateringZone every = timerZone(0, 0, 60000);
+  every.minOffMs = 3600000;
+  c.configure(0, every);
+  TEST_ASSERT_EQUAL(1, c.step(0, -1, a, 4));
+  TEST_ASSERT_EQUAL(1, c.step(60000, -1, a, 4));
+  TEST_ASSERT_EQUAL(0, c.step(3659999, -1, a, 4));
+  TEST_ASSERT_EQUAL(1, c.step(3660000, -1, a, 4));
+
+  // A sensor zone with a window still works without a clock.
+  c.reset(1, 1);
+  WateringZone z = sensorZone();
+  z.fromMin = 5 * 60;
+  z.toMin = 8 * 60;
+  c.configure(0, z);
+  c.reading(0, 20, 0);
+  TEST_ASSERT_EQUAL(0, c.step(0, 12 * 60, a, 4));
+  TEST_ASSERT_EQUAL(1, c.step(0, -1, a, 4));
+}
+
+void test_validity_and_stop_all()
+{
+  static WateringController c; // zeroed like RTC memory on cold boot
+  TEST_ASSERT_FALSE(c.valid());
+  c.reset(2, 2);
+  TEST_ASSERT_TRUE(c.valid());
+  c.configure(0, sensorZone());
+  c.configure(1, timerZone(0, 0, 60000));
+  WateringAction a[4];
+  c.reading(0, 10, 0);
+  TEST_ASSERT_EQUAL(2, c.step(0, -1, a, 4));
+  TEST_ASSERT_TRUE(c.valid());
+  c.zone[0].state = WateringController::IDLE; // changed without seal()
+  TEST_ASSERT_FALSE(c.valid());
+  c.zone[0].state = WateringController::RUNNING;
+  c.seal();
+
+  TEST_ASSERT_EQUAL(2, c.stopAll(5000, a, 4));
+  TEST_ASSERT_EQUAL(WATER_STOPPED, a[1].reason);
+  TEST_ASSERT_EQUAL_UINT32(5000, a[1].runMs);
+  TEST_ASSERT_EQUAL(0, c.running());
+  TEST_ASSERT_EQUAL_STRING("noReading", wateringReasonName(WATER_NO_READING));
+}
+
+namespace
+{
+  struct BedResult
+  {
+    float minPct, maxPct, waterMin, dryMin;
+  };
+
+  // 1 s steps. The bed dries 0.6 %/h (twice that by day) and gains
+  // 1.2 %/min while the valve is open, up to saturation; the sensor is read
+  // every 10 s. Control limits 30 / 45 %.
+  BedResult simulateBed(bool local)
+  {
+    const uint32_t days = 3, stepMs = 1000;
+    const uint32_t outageFrom = 20 * 3600000u, outageTo = 26 * 3600000u;
+    WateringController c;
+    c.reset(1, 1);
+    WateringZone z = sensorZone(30, 45);
+    z.maxRunMs = 900000;
+    z.minOffMs = 600000;
+    c.configure(0, z);
+    float pct = 38;
+    bool valve = false;
+    BedResult r = {100, 0, 0, 0};
+    // Cloud: decides on each 5-minute summary mean; its command lands 2 s later.
+    float windowSum = 0;
+    uint32_t windowN = 0, commandAt = 0;
+    int8_t command = -1;
+    WateringAction a[4];
+    for (uint32_t t = 0; t < days * 86400000u; t += stepMs)
+    {
+      float hour = (t / 3600000u) % 24;
+      pct -= (0.6f + 0.6f * (hour > 9 && hour < 17)) / 3600;
+      if (valve)
+        pct = fminf(pct + 0.02f, 100);
+      r.minPct = fminf(r.minPct, pct);
+      r.maxPct = fmaxf(r.maxPct, pct);
+      r.waterMin += valve ? stepMs / 60000.0f : 0;
+      r.dryMin += pct < 30 ? stepMs / 60000.0f : 0;
+      if (t % 10000 != 0)
+        continue;
+      if (local)
+      {
+        c.reading(0, pct, t);
+        uint8_t n = c.step(t, -1, a, 4);
+        for (uint8_t i = 0; i < n; i++)
+          valve = a[i].open;
+        continue;
+      }
+      if (command >= 0 && t >= commandAt)
+      {
+        valve = command;
+        command = -1;
+      }
+      windowSum += pct;
+      windowN++;
+      bool linkUp = t < outageFrom || t >= outageTo;
+      if (windowN == 30)
+      {
+        float mean = windowSum / windowN;
+        windowSum = 0;
+        windowN = 0;
+        if (linkUp && !valve && mean < 30)
+          command = 1;
+        else if (linkUp && valve && mean >= 45)
+          command = 0;
+        commandAt = t + 2000;
+      }
+    }
+    return r;
+  }
+}
+
+void bench_local_vs_cloud()
+{
+  BedResult local = simulateBed(true);
+  BedResult cloud = simulateBed(false);
+  // Only the local run is checked. The cloud one is a model made up here
+  // for comparison, not something the firmware does.
+  TEST_ASSERT_TRUE(local.minPct >= 29);
+  char msg[200];
+  snprintf(msg, sizeof(msg), "local: moisture %.1f-%.1f %%, %.0f min dry, valve open %.0f min (simulated time)",
+           local.minPct, local.maxPct, local.dryMin, local.waterMin);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "cloud model: moisture %.1f-%.1f %%, %.0f min dry, valve open %.0f min (simulated time)",
+           cloud.minPct, cloud.maxPct, cloud.dryMin, cloud.waterMin);
+  TEST_MESSAGE(msg);
+}
+
+int main(int, char **)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_hysteresis);
+  RUN_TEST(test_safety_stops);
+  RUN_TEST(test_concurrency);
+  RUN_TEST(test_schedule);
+  RUN_TEST(test_validity_and_stop_all);
+  RUN_TEST(bench_local_vs_cloud);
+  return UNITY_END();
+}
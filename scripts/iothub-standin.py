@@ -0,0 +1,411 @@
+#!/usr/bin/env python3
+"""Local IoT Hub stand-in for gateway uplink benchmarks.
+
+Accepts the device-to-cloud traffic the gateway firmware sends:
+  * HTTPS: POST /devices/<id>/messages/events, single JSON or the
+    application/vnd.microsoft.iothub.json batch format
+  * MQTT over TLS (3.1.1): CONNECT, PUBLISH to devices/<id>/messages/events/
+    at QoS 0 (PubSubClient, one message or a coalesced JSON array) or QoS 1
+    (the IoT Hub SDK), SUBSCRIBE and PINGREQ
+It counts messages and TLS handshakes and prints throughput reports.
+
+Usage:
+  # Serve for a real gateway: set IOTHUB_HOST to "<this-pc-ip>:8443" (http)
+  # or "<this-pc-ip>" (mqtt/sdk, port 8883), then read heap use per
+  # protocol from the gateway's /metrics (mywatering_heap_*)
+  ./scripts/iothub-standin.py serve --port 8443 --mqtt-port 8883
+
+  # Host-only comparison of the uplink transports over real TLS on localhost
+  ./scripts/iothub-standin.py bench --messages 1000
+"""
+import argparse
+import base64
+import http.client
+import http.server
+import json
+import os
+import socket
+import socketserver
+import ssl
+import struct
+import subprocess
+import tempfile
+import threading
+import time
+
+BATCH_CONTENT_TYPE = "application/vnd.microsoft.iothub.json"
+
+
+class Counters:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.handshakes = 0
+        self.requests = 0
+        self.messages = 0
+        self.bytes = 0
+        self.largest = 0  # biggest request / PUBLISH body
+        self.arrivals = []  # monotonic receive time per message (bench only)
+        self.started = time.monotonic()
+
+    def count(self, messages, length):
+        now = time.monotonic()
+        with self.lock:
+            self.requests += 1
+            self.messages += messages
+            self.bytes += length
+            self.largest = max(self.largest, length)
+            self.arrivals.extend([now] * messages)
+
+    def snapshot(self):
+        with self.lock:
+            return self.handshakes, self.requests, self.messages, self.bytes
+
+    def reset(self):
+        with self.lock:
+            self.handshakes = self.requests = self.messages = self.bytes = self.largest = 0
+            self.arrivals = []
+            self.started = time.monotonic()
+
+
+def make_cert(directory):
+    cert = os.path.join(directory, "standin.crt")
+    key = os.path.join(directory, "standin.key")
+    subprocess.run(
+        ["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "2",
+         "-subj", "/CN=iothub-standin", "-keyout", key, "-out", cert],
+        check=True, capture_output=True)
+    return cert, key
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive unless the client says otherwise
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+        ctype = self.headers.get("Content-Type", "")
+        count = 1
+        if ctype.startswith(BATCH_CONTENT_TYPE):
+            try:
+                entries = json.loads(body)
+                for e in entries:
+                    if e.get("base64Encoded"):
+                        base64.b64decode(e["body"], validate=True)
+                count = len(entries)
+            except (ValueError, KeyError, TypeError):
+                self.send_response(400)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+        self.server.counters.count(count, length)
+        self.send_response(204)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            super().log_message(fmt, *args)
+
+
+class TLSServer(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+    def __init__(self, addr, context, counters, verbose=False):
+        super().__init__(addr, Handler)
+        self.socket = context.wrap_socket(self.socket, server_side=True)
+        self.counters = counters
+        self.verbose = verbose
+
+    def get_request(self):
+        sock, addr = super().get_request()  # TLS handshake happens here
+        with self.counters.lock:
+            self.counters.handshakes += 1
+        return sock, addr
+
+
+def start_server(port, cert, key, verbose=False):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    ctx.load_cert_chain(cert, key)
+    counters = Counters()
+    server = TLSServer(("0.0.0.0", port), ctx, counters, verbose)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server, counters
+
+
+# --- MQTT stand-in ---
+MQTT_CONNECT, MQTT_CONNACK, MQTT_PUBLISH, MQTT_PUBACK = 1, 2, 3, 4
+MQTT_SUBSCRIBE, MQTT_SUBACK, MQTT_PINGREQ, MQTT_PINGRESP, MQTT_DISCONNECT = 8, 9, 12, 13, 14
+
+
+def mqtt_read_packet(f):
+    """Returns (type, flags, body) or None at EOF."""
+    head = f.read(1)
+    if not head:
+        return None
+    length, shift = 0, 0
+    while True:
+        b = f.read(1)
+        if not b:
+            return None
+        length |= (b[0] & 0x7F) << shift
+        shift += 7
+        if not b[0] & 0x80:
+            break
+    body = f.read(length)
+    if len(body) < length:
+        return None
+    return head[0] >> 4, head[0] & 0x0F, body
+
+
+def mqtt_packet(ptype, flags, body):
+    out = bytearray([ptype << 4 | flags])
+    n = len(body)
+    while True:
+        b = n & 0x7F
+        n >>= 7
+        out.append(b | (0x80 if n else 0))
+        if not n:
+            break
+    return bytes(out) + body
+
+
+def mqtt_string(s):
+    b = s.encode()
+    return struct.pack("!H", len(b)) + b
+
+
+class MqttHandler(socketserver.StreamRequestHandler):
+    def handle(self):
+        c = self.server.counters
+        while True:
+            pkt = mqtt_read_packet(self.rfile)
+            if pkt is None:
+                return
+            ptype, flags, body = pkt
+            if ptype == MQTT_CONNECT:
+                self.wfile.write(mqtt_packet(MQTT_CONNACK, 0, b"\x00\x00"))
+            elif ptype == MQTT_PUBLISH:
+                qos = (flags >> 1) & 3
+                tlen = struct.unpack("!H", body[:2])[0]
+                off = 2 + tlen + (2 if qos else 0)
+                payload = body[off:]
+                count = 1
+                if payload[:1] == b"[":  # coalesced batch (JSON array of messages)
+                    try:
+                        count = len(json.loads(payload))
+                    except ValueError:
+                        return
+                c.count(count, len(payload))
+                if qos == 1:
+                    self.wfile.write(mqtt_packet(MQTT_PUBACK, 0, body[2 + tlen:4 + tlen]))
+            elif ptype == MQTT_SUBSCRIBE:
+                pid, rest, granted = body[:2], body[2:], b""
+                while rest:
+                    tlen = struct.unpack("!H", rest[:2])[0]
+                    granted += bytes([min(rest[2 + tlen], 1)])
+                    rest = rest[3 + tlen:]
+                self.wfile.write(mqtt_packet(MQTT_SUBACK, 0, pid + granted))
+            elif ptype == MQTT_PINGREQ:
+                self.wfile.write(mqtt_packet(MQTT_PINGRESP, 0, b""))
+            elif ptype == MQTT_DISCONNECT:
+                return
+            self.wfile.flush()
+
+
+class MqttTLSServer(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__(self, addr, context, counters):
+        super().__init__(addr, MqttHandler)
+        self.socket = context.wrap_socket(self.socket, server_side=True)
+        self.counters = counters
+
+    def get_request(self):
+        sock, addr = super().get_request()
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        with self.counters.lock:
+            self.counters.handshakes += 1
+        return sock, addr
+
+
+def start_mqtt_server(port, cert, key, counters):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    ctx.load_cert_chain(cert, key)
+    server = MqttTLSServer(("0.0.0.0", port), ctx, counters)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+def report(counters):
+    hs, req, msgs, _ = counters.snapshot()
+    elapsed = max(time.monotonic() - counters.started, 1e-9)
+    per_k = hs * 1000.0 / msgs if msgs else 0.0
+    return "%7d msgs  %6d requests  %8.1f msgs/s  %7.1f handshakes/1000 msgs" % (
+        msgs, req, msgs / elapsed, per_k)
+
+
+def cmd_serve(args, cert, key):
+    server, counters = start_server(args.port, cert, key, args.verbose)
+    mqtt = start_mqtt_server(args.mqtt_port, cert, key, counters)
+    print("[STANDIN] HTTPS on :%d (POST /devices/<id>/messages/events)" % args.port)
+    print("[STANDIN] MQTT/TLS on :%d (PUBLISH devices/<id>/messages/events/)" % args.mqtt_port)
+    try:
+        while True:
+            time.sleep(args.report)
+            with counters.lock:
+                counters.arrivals = []
+            print("[STANDIN] " + report(counters))
+    except KeyboardInterrupt:
+        server.shutdown()
+        mqtt.shutdown()
+
+
+def sample_payload(i):
+    return json.dumps({"deviceId": "bench-gw", "firmwareVersion": "1.3.4", "rssi": -61,
+                       "gateway": True, "Soil1": 41.5 + (i % 7), "Air_temp": 21.3,
+                       "Air_hum": 55.0, "Air_pres": 1013.2}, separators=(",", ":"))
+
+
+def batch_body(payloads):
+    return json.dumps([{"body": base64.b64encode(p.encode()).decode(), "base64Encoded": True}
+                       for p in payloads], separators=(",", ":"))
+
+
+def run_strategy(port, messages, keep_alive, batch, sent):
+    ctx = ssl._create_unverified_context()
+    uri = "/devices/bench-gw/messages/events?api-version=2018-06-30"
+    headers = {"Authorization": "SharedAccessSignature sr=bench"}
+    conn = None
+    i = 0
+    while i < messages:
+        sent.extend([time.monotonic()] * min(batch, messages - i))
+        if conn is None or not keep_alive:
+            if conn:
+                conn.close()
+            conn = http.client.HTTPSConnection("127.0.0.1", port, context=ctx)
+        n = min(batch, messages - i)
+        if n > 1:
+            body = batch_body([sample_payload(i + k) for k in range(n)])
+            headers["Content-Type"] = BATCH_CONTENT_TYPE
+        else:
+            body = sample_payload(i)
+            headers["Content-Type"] = "application/json"
+        conn.request("POST", uri, body=body, headers=headers)
+        resp = conn.getresponse()
+        resp.read()
+        if resp.status // 100 != 2:
+            raise RuntimeError("stand-in returned %d" % resp.status)
+        i += n
+    conn.close()
+
+
+def mqtt_connect(port):
+    ctx = ssl._create_unverified_context()
+    sock = ctx.wrap_socket(socket.create_connection(("127.0.0.1", port)))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    f = sock.makefile("rwb")
+    var = mqtt_string("MQTT") + bytes([4, 0xC2]) + struct.pack("!H", 120)  # v3.1.1, user+pass, clean
+    payload = mqtt_string("bench-gw") + mqtt_string("127.0.0.1/bench-gw/?api-version=2018-06-30") + \
+        mqtt_string("SharedAccessSignature sr=bench")
+    f.write(mqtt_packet(MQTT_CONNECT, 0, var + payload))
+    f.flush()
+    pkt = mqtt_read_packet(f)
+    if not pkt or pkt[0] != MQTT_CONNACK or pkt[2][1] != 0:
+        raise RuntimeError("stand-in refused MQTT connect")
+    return sock, f
+
+
+def run_mqtt(port, messages, batch, qos, window, sent):
+    """QoS 0: PubSubClient (fire and forget, `batch` messages per JSON-array
+    publish). QoS 1: the SDK, up to `window` PUBLISHes awaiting PUBACK."""
+    sock, f = mqtt_connect(port)
+    topic = mqtt_string("devices/bench-gw/messages/events/")
+    i, pid, inflight = 0, 0, 0
+    while i < messages:
+        n = min(batch, messages - i)
+        body = sample_payload(i) if n == 1 else "[" + ",".join(sample_payload(i + k) for k in range(n)) + "]"
+        sent.extend([time.monotonic()] * n)
+        if qos:
+            pid = pid % 65535 + 1
+            f.write(mqtt_packet(MQTT_PUBLISH, 2, topic + struct.pack("!H", pid) + body.encode()))
+            inflight += 1
+        else:
+            f.write(mqtt_packet(MQTT_PUBLISH, 0, topic + body.encode()))
+        f.flush()
+        i += n
+        while inflight >= window or (qos and i >= messages and inflight):
+            pkt = mqtt_read_packet(f)
+            if not pkt or pkt[0] != MQTT_PUBACK:
+                raise RuntimeError("no PUBACK from stand-in")
+            inflight -= 1
+    # QoS 0 has no ack: a ping round trip means everything before it arrived
+    f.write(mqtt_packet(MQTT_PINGREQ, 0, b""))
+    f.flush()
+    mqtt_read_packet(f)
+    f.write(mqtt_packet(MQTT_DISCONNECT, 0, b""))
+    f.flush()
+    sock.close()
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(p * (len(values) - 1)))] if values else 0.0
+
+
+def cmd_bench(args, cert, key):
+    server, counters = start_server(args.port, cert, key)
+    mqtt = start_mqtt_server(args.mqtt_port, cert, key, counters)
+    b = args.batch
+    strategies = [
+        ("http: new connection per message", lambda s: run_strategy(args.port, args.messages, False, 1, s)),
+        ("http: keep-alive, one message per POST", lambda s: run_strategy(args.port, args.messages, True, 1, s)),
+        ("http: keep-alive + batch of %d" % b, lambda s: run_strategy(args.port, args.messages, True, b, s)),
+        ("mqtt: one message per publish", lambda s: run_mqtt(args.mqtt_port, args.messages, 1, 0, 1, s)),
+        ("mqtt: %d messages per publish" % 16, lambda s: run_mqtt(args.mqtt_port, args.messages, 16, 0, 1, s)),
+        ("sdk: QoS 1, one in flight", lambda s: run_mqtt(args.mqtt_port, args.messages, 1, 1, 1, s)),
+        ("sdk: QoS 1, window of 8", lambda s: run_mqtt(args.mqtt_port, args.messages, 1, 1, 8, s)),
+    ]
+    print("[BENCH] %d messages per transport, https://127.0.0.1:%d and mqtts://127.0.0.1:%d"
+          % (args.messages, args.port, args.mqtt_port))
+    print("[BENCH] latency = handed to the transport -> received by the stand-in; "
+          "body = largest request/publish (the device buffer it needs)")
+    for name, run in strategies:
+        counters.reset()
+        sent = []
+        run(sent)
+        with counters.lock:
+            lat = sorted((a - t) * 1000.0 for t, a in zip(sent, counters.arrivals))
+            largest = counters.largest
+        print("[BENCH] %-40s %s  p50 %6.2f ms  p95 %6.2f ms  body %5d B" % (
+            name, report(counters), percentile(lat, 0.50), percentile(lat, 0.95), largest))
+    server.shutdown()
+    mqtt.shutdown()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--cert", help="PEM certificate (default: generate a self-signed one)")
+    p.add_argument("--key", help="PEM private key for --cert")
+    sub = p.add_subparsers(dest="cmd", required=True)
+    s = sub.add_parser("serve", help="run the HTTPS stand-in for a real gateway")
+    s.add_argument("--port", type=int, default=8443)
+    s.add_argument("--mqtt-port", type=int, default=8883)
+    s.add_argument("--report", type=float, default=10.0, help="seconds between reports")
+    s.add_argument("--verbose", action="store_true")
+    b = sub.add_parser("bench", help="compare uplink transports on localhost")
+    b.add_argument("--port", type=int, default=8443)
+    b.add_argument("--mqtt-port", type=int, default=8883)
+    b.add_argument("--messages", type=int, default=1000)
+    b.add_argument("--batch", type=int, default=32)
+    args = p.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        cert, key = (args.cert, args.key) if args.cert else make_cert(tmp)
+        if args.cmd == "serve":
+            cmd_serve(args, cert, key)
+        else:
+            cmd_bench(args, cert, key)
+
+
+if __name__ == "__main__":
+    main()